@@ -0,0 +1,401 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "lwgeom_partition.h"
+#include "liblwgeom_internel.h"
+#include "geohash.h"
+#include "lwpool.h"
+#include "lwsort.h"
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// features per block, and blocks per group, of the envelope index over the
+/// geohash order
+#define LWPARTITION_BLOCK 64
+
+struct lwpartition__build {
+	LWGEOM **geoms;
+	uint32_t ngeoms;
+	double halo;
+	LWPARTITIONSET *set;
+	const uint32_t *owner; ///< partition of every input geometry
+	const uint64_t *order; ///< input indices in geohash order
+	const LWBOX *blocks;   ///< extent of every LWPARTITION_BLOCK features of order
+	const LWBOX *groups;   ///< extent of every LWPARTITION_BLOCK blocks
+	uint32_t nblocks;
+	uint32_t ngroups;
+	int oom;
+};
+
+/// number of vertices, used as the processing load of a geometry
+static uint64_t
+lwpartition__weight(const LWGEOM *g)
+{
+	uint64_t w = g->npoints;
+	for (uint32_t i = 0; i < g->ngeoms; i++)
+		w += lwpartition__weight(g->geoms[i]);
+	return w;
+}
+
+static POINT2D
+lwpartition__center(const LWGEOM *g)
+{
+	POINT2D c = {.x = (g->env.xmin + g->env.xmax) / 2, .y = (g->env.ymin + g->env.ymax) / 2};
+	return c;
+}
+
+static uint64_t
+lwpartition__hash(const LWGEOM *g)
+{
+	POINT2D c = lwpartition__center(g);
+	double lon = fmin(fmax(c.x, GEO_LONG_MIN), nextafter(GEO_LONG_MAX, 0));
+	double lat = fmin(fmax(c.y, GEO_LAT_MIN), nextafter(GEO_LAT_MAX, 0));
+	GeoHashBits hash;
+	if (!geohashEncodeWGS84(lon, lat, GEO_STEP_MAX, &hash))
+		return 0;
+	return hash.bits;
+}
+
+/// Rank of the boundary between two sorted keys, the highest differing bit.
+/// Cutting where it is largest splits on the shortest common geohash prefix.
+static int
+lwpartition__cut_rank(uint64_t a, uint64_t b)
+{
+	return a == b ? -1 : 63 - __builtin_clzll(a ^ b);
+}
+
+/// Split the sorted keys into nparts ranges of about equal load, each cut
+/// moved to the coarsest geohash prefix boundary near the ideal position.
+static void
+lwpartition__cuts(LWGEOM **geoms,
+		  const uint64_t *hashes,
+		  const uint64_t *order,
+		  uint32_t n,
+		  uint32_t nparts,
+		  uint32_t *cuts)
+{
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		uint64_t w = lwpartition__weight(geoms[order[i]]);
+		total += LWMAX(w, 1);
+	}
+
+	uint32_t window = LWMAX(n / nparts / 8, 1);
+	uint64_t sum = 0;
+	uint32_t i = 0;
+	cuts[0] = 0;
+	for (uint32_t p = 1; p < nparts; p++)
+	{
+		uint64_t target = total / nparts * p;
+		while (i < n && sum < target)
+		{
+			uint64_t w = lwpartition__weight(geoms[order[i++]]);
+			sum += LWMAX(w, 1);
+		}
+
+		/* leave at least one feature to every partition */
+		uint32_t lo = cuts[p - 1] + 1;
+		uint32_t hi = n - (nparts - p);
+		uint32_t ideal = LWMIN(LWMAX(i, lo), hi);
+		uint32_t first = ideal > lo + window ? ideal - window : lo;
+		uint32_t last = LWMIN(ideal + window, hi);
+
+		uint32_t best = ideal;
+		int rank = lwpartition__cut_rank(hashes[ideal - 1], hashes[ideal]);
+		for (uint32_t j = first; j <= last; j++)
+		{
+			int r = lwpartition__cut_rank(hashes[j - 1], hashes[j]);
+			if (r > rank || (r == rank && abs((int)j - (int)ideal) < abs((int)best - (int)ideal)))
+			{
+				rank = r;
+				best = j;
+			}
+		}
+		cuts[p] = best;
+	}
+	cuts[nparts] = n;
+}
+
+static void
+lwpartition__expand(LWBOX *box, const LWBOX *env)
+{
+	box->xmin = LWMIN(box->xmin, env->xmin);
+	box->ymin = LWMIN(box->ymin, env->ymin);
+	box->xmax = LWMAX(box->xmax, env->xmax);
+	box->ymax = LWMAX(box->ymax, env->ymax);
+}
+
+/// LW_TRUE when \a env grown by \a halo reaches \a box, an empty box with
+/// xmin > xmax reaches nothing
+static int
+lwpartition__near(const LWBOX *env, const LWBOX *box, double halo)
+{
+	return env->xmin - halo <= box->xmax && env->xmax + halo >= box->xmin && env->ymin - halo <= box->ymax &&
+	       env->ymax + halo >= box->ymin;
+}
+
+static int
+lwpartition__append(uint32_t **items, uint32_t *count, uint32_t *capacity, uint32_t value)
+{
+	if (*count == *capacity)
+	{
+		uint32_t cap = *capacity ? *capacity * 2 : 16;
+		uint32_t *tmp = (uint32_t *)lwrealloc(*items, sizeof(uint32_t) * cap);
+		if (!tmp)
+			return LW_FAILURE;
+		*items = tmp;
+		*capacity = cap;
+	}
+	(*items)[(*count)++] = value;
+	return LW_SUCCESS;
+}
+
+/// Collect the owned features and the halo of one partition: features of
+/// other partitions whose envelope, grown by the halo distance, reaches the
+/// extent of the owned features. Candidates come from the block and group
+/// extents over the geohash order, so only blocks near the partition are
+/// looked at feature by feature.
+static void
+lwpartition__fill(size_t index, void *udata)
+{
+	struct lwpartition__build *b = (struct lwpartition__build *)udata;
+	LWPARTITION *part = &b->set->parts[index];
+	const uint32_t *owned = part->items;
+
+	uint32_t count = 0;
+	uint32_t capacity = 0;
+	uint32_t *items = NULL;
+	LWBOX extent = {.xmin = DBL_MAX, .ymin = DBL_MAX, .xmax = -DBL_MAX, .ymax = -DBL_MAX};
+	for (uint32_t i = 0; i < part->nitems; i++)
+	{
+		if (!lwpartition__append(&items, &count, &capacity, owned[i]))
+			goto oom;
+		if (!lwgeom__is_empty(b->geoms[owned[i]]))
+			lwpartition__expand(&extent, &b->geoms[owned[i]]->env);
+	}
+	if (extent.xmin <= extent.xmax)
+		part->env = extent;
+
+	for (uint32_t g = 0; g < b->ngroups; g++)
+	{
+		if (!lwpartition__near(&b->groups[g], &extent, b->halo))
+			continue;
+		uint32_t last_block = LWMIN((g + 1) * LWPARTITION_BLOCK, b->nblocks);
+		for (uint32_t k = g * LWPARTITION_BLOCK; k < last_block; k++)
+		{
+			if (!lwpartition__near(&b->blocks[k], &extent, b->halo))
+				continue;
+			uint32_t last = LWMIN((k + 1) * LWPARTITION_BLOCK, b->ngeoms);
+			for (uint32_t i = k * LWPARTITION_BLOCK; i < last; i++)
+			{
+				uint32_t id = (uint32_t)b->order[i];
+				const LWGEOM *geom = b->geoms[id];
+				if (b->owner[id] == index || lwgeom__is_empty(geom) ||
+				    !lwpartition__near(&geom->env, &extent, b->halo))
+					continue;
+				if (!lwpartition__append(&items, &count, &capacity, id))
+					goto oom;
+			}
+		}
+	}
+
+	part->items = items;
+	part->nhalo = count - part->nitems;
+	return;
+oom:
+	lwfree(items);
+	part->items = NULL;
+	b->oom = LW_TRUE;
+}
+
+/// @brief Shard geometries into spatially coherent partitions.
+///
+/// The geometries are ordered by the 52-bit geohash of their envelope centre
+/// (LWGEOM.env must be set) and the order is cut into \a nparts ranges of
+/// about equal vertex count, each cut snapped to a nearby geohash prefix
+/// boundary. Every partition also lists, as halo, the features of other
+/// partitions whose envelope comes within \a halo of the extent of its own
+/// features. Empty geometries are owned but take no part in extents or halos.
+/// @param geoms input geometries
+/// @param ngeoms number of input geometries
+/// @param nparts wanted number of partitions, reduced to \a ngeoms if larger
+/// @param halo halo distance, in coordinate units
+/// @param nthreads threads used to collect the halos, 0 for one per processor
+/// @return the partitions, NULL on error
+LWPARTITIONSET *
+lwgeom_partition(LWGEOM **geoms, uint32_t ngeoms, uint32_t nparts, double halo, int nthreads)
+{
+	if (!geoms || ngeoms == 0 || nparts == 0)
+		return NULL;
+	nparts = LWMIN(nparts, ngeoms);
+
+	LWPARTITIONSET *set = (LWPARTITIONSET *)lwmalloc0(sizeof(LWPARTITIONSET));
+	uint64_t *hashes = (uint64_t *)lwmalloc(sizeof(uint64_t) * ngeoms);
+	uint64_t *order = (uint64_t *)lwmalloc(sizeof(uint64_t) * ngeoms);
+	uint32_t *cuts = (uint32_t *)lwmalloc(sizeof(uint32_t) * (nparts + 1));
+	uint32_t *owner = (uint32_t *)lwmalloc(sizeof(uint32_t) * ngeoms);
+	uint32_t nblocks = (ngeoms + LWPARTITION_BLOCK - 1) / LWPARTITION_BLOCK;
+	uint32_t ngroups = (nblocks + LWPARTITION_BLOCK - 1) / LWPARTITION_BLOCK;
+	LWBOX *blocks = (LWBOX *)lwmalloc(sizeof(LWBOX) * (nblocks + ngroups));
+	if (!set || !hashes || !order || !cuts || !owner || !blocks)
+		goto fail;
+	set->nparts = nparts;
+	set->parts = (LWPARTITION *)lwmalloc0(sizeof(LWPARTITION) * nparts);
+	set->items = (uint32_t *)lwmalloc(sizeof(uint32_t) * ngeoms);
+	if (!set->parts || !set->items)
+		goto fail;
+
+	for (uint32_t i = 0; i < ngeoms; i++)
+	{
+		hashes[i] = lwpartition__hash(geoms[i]);
+		order[i] = i;
+	}
+	if (!lwsort_radix64(hashes, order, ngeoms, nthreads))
+		goto fail;
+	lwpartition__cuts(geoms, hashes, order, ngeoms, nparts, cuts);
+
+	for (uint32_t p = 0; p < nparts; p++)
+	{
+		LWPARTITION *part = &set->parts[p];
+		part->id = p;
+		part->nitems = cuts[p + 1] - cuts[p];
+		part->items = set->items + cuts[p];
+		part->hash_min = hashes[cuts[p]];
+		part->hash_max = hashes[cuts[p + 1] - 1];
+
+		for (uint32_t i = cuts[p]; i < cuts[p + 1]; i++)
+		{
+			set->items[i] = (uint32_t)order[i];
+			owner[order[i]] = p;
+		}
+	}
+
+	/* envelope index over the geohash order, neighbours in the order are
+	 * close in space so the extent of a block stays small */
+	LWBOX *groups = blocks + nblocks;
+	for (uint32_t k = 0; k < nblocks + ngroups; k++)
+		blocks[k] = (LWBOX){.xmin = DBL_MAX, .ymin = DBL_MAX, .xmax = -DBL_MAX, .ymax = -DBL_MAX};
+	for (uint32_t i = 0; i < ngeoms; i++)
+	{
+		const LWGEOM *g = geoms[order[i]];
+		if (!lwgeom__is_empty(g))
+			lwpartition__expand(&blocks[i / LWPARTITION_BLOCK], &g->env);
+	}
+	for (uint32_t k = 0; k < nblocks; k++)
+		lwpartition__expand(&groups[k / LWPARTITION_BLOCK], &blocks[k]);
+
+	struct lwpartition__build build = {.geoms = geoms,
+					   .ngeoms = ngeoms,
+					   .halo = halo,
+					   .set = set,
+					   .owner = owner,
+					   .order = order,
+					   .blocks = blocks,
+					   .groups = groups,
+					   .nblocks = nblocks,
+					   .ngroups = ngroups,
+					   .oom = 0};
+	lwpool_run(nparts, nthreads, lwpartition__fill, &build);
+
+	lwfree(hashes);
+	lwfree(order);
+	lwfree(cuts);
+	lwfree(owner);
+	lwfree(blocks);
+	if (build.oom)
+	{
+		lwpartitionset_free(set);
+		return NULL;
+	}
+	return set;
+fail:
+	lwfree(hashes);
+	lwfree(order);
+	lwfree(cuts);
+	lwfree(owner);
+	lwfree(blocks);
+	if (set)
+	{
+		lwfree(set->parts);
+		lwfree(set->items);
+		lwfree(set);
+	}
+	return NULL;
+}
+
+/// @brief free partitions created by lwgeom_partition
+void
+lwpartitionset_free(LWPARTITIONSET *set)
+{
+	if (!set)
+		return;
+	for (uint32_t p = 0; p < set->nparts; p++)
+		lwfree(set->parts[p].items);
+	lwfree(set->parts);
+	lwfree(set->items);
+	lwfree(set);
+}
+
+struct lwpartition__run {
+	const LWPARTITIONSET *set;
+	LWGEOM **geoms;
+	lwpartition_func func;
+	void *udata;
+};
+
+static void
+lwpartition__run_one(size_t index, void *udata)
+{
+	struct lwpartition__run *r = (struct lwpartition__run *)udata;
+	r->func(&r->set->parts[index], r->geoms, r->udata);
+}
+
+/// @brief Partition geometries and run \a func once per partition on a
+/// thread pool.
+///
+/// See lwgeom_partition for how the partitions are built. Callbacks run
+/// concurrently and must only write to state owned by their partition.
+/// @return LW_SUCCESS, or LW_FAILURE if the partitions could not be built
+int
+lwgeom_partition_run(LWGEOM **geoms,
+		     uint32_t ngeoms,
+		     uint32_t nparts,
+		     double halo,
+		     int nthreads,
+		     lwpartition_func func,
+		     void *udata)
+{
+	assert(func);
+	LWPARTITIONSET *set = lwgeom_partition(geoms, ngeoms, nparts, halo, nthreads);
+	if (!set)
+		return LW_FAILURE;
+
+	struct lwpartition__run r = {.set = set, .geoms = geoms, .func = func, .udata = udata};
+	lwpool_run(set->nparts, nthreads, lwpartition__run_one, &r);
+	lwpartitionset_free(set);
+	return LW_SUCCESS;
+}
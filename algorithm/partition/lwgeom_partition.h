@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef LWGEOM_PARTITION_H
+#define LWGEOM_PARTITION_H
+
+#include "liblwgeom.h"
+
+/// @brief one spatially coherent partition of the input geometries
+typedef struct {
+	uint32_t id;       ///< partition number
+	uint32_t nitems;   ///< number of features owned by the partition
+	uint32_t nhalo;    ///< number of halo features owned by other partitions
+	uint32_t *items;   ///< input indices, the owned features first then the halo
+	LWBOX env;         ///< extent of the owned features
+	uint64_t hash_min; ///< smallest geohash of the owned features
+	uint64_t hash_max; ///< largest geohash of the owned features
+} LWPARTITION;
+
+/// @brief partitions of a geometry array
+typedef struct {
+	uint32_t nparts;     ///< number of partitions
+	LWPARTITION *parts;  ///< partitions
+	uint32_t *items;     ///< owned indices of all partitions, in geohash order
+} LWPARTITIONSET;
+
+/// Partition callback, \a geoms is the array the set was built from.
+typedef void (*lwpartition_func)(const LWPARTITION *part, LWGEOM **geoms, void *udata);
+
+LWPARTITIONSET *lwgeom_partition(LWGEOM **geoms, uint32_t ngeoms, uint32_t nparts, double halo, int nthreads);
+void lwpartitionset_free(LWPARTITIONSET *set);
+int lwgeom_partition_run(LWGEOM **geoms,
+			 uint32_t ngeoms,
+			 uint32_t nparts,
+			 double halo,
+			 int nthreads,
+			 lwpartition_func func,
+			 void *udata);
+
+#endif /* LWGEOM_PARTITION_H */
@@ -24,6 +24,7 @@
 #include <float.h>
 #include <math.h>
 #include <assert.h>
+#include <string.h>
 
 /// check box is null?
 #define MV_BOX_NULL(B) \
@@ -41,7 +42,7 @@
 /// @param env2 the second Envelope
 /// @return LW_TRUE if the two Envelopes intersect
 int
-nv_box_intersects(const LWBOX env1, const LWBOX env2)
+lwbox_intersects(const LWBOX env1, const LWBOX env2)
 {
 	const double x1 = LWMAX(env1.xmin, env2.xmin);
 	const double x2 = LWMIN(env1.xmax, env2.xmax);
@@ -57,7 +58,7 @@ nv_box_intersects(const LWBOX env1, const LWBOX env2)
 /// @param env2 the second Envelope
 /// @return the intersection of the two Envelopes
 LWBOX
-nv_box_intersection(const LWBOX env1, const LWBOX env2)
+lwbox_intersection(const LWBOX env1, const LWBOX env2)
 {
 	MV_BOX_INIT(b)
 	if (MV_BOX_NULL(env1) || MV_BOX_NULL(env2))
@@ -65,7 +66,7 @@ nv_box_intersection(const LWBOX env1, const LWBOX env2)
 		return b;
 	}
 
-	if (nv_box_intersects(env1, env2))
+	if (lwbox_intersects(env1, env2))
 	{
 		b.xmin = env1.xmin > env2.xmin ? env1.xmin : env2.xmin;
 		b.ymin = env1.ymin > env2.ymin ? env1.ymin : env2.ymin;
@@ -80,7 +81,7 @@ nv_box_intersection(const LWBOX env1, const LWBOX env2)
 /// @param env2 the Envelope to be contained
 /// @return the enlarged Envelope
 LWBOX
-nv_box_union(const LWBOX env1, const LWBOX env2)
+lwbox_union(const LWBOX env1, const LWBOX env2)
 {
 	MV_BOX_INIT(b)
 	if (MV_BOX_NULL(env1) || MV_BOX_NULL(env2))
@@ -89,8 +90,8 @@ nv_box_union(const LWBOX env1, const LWBOX env2)
 	}
 	b.xmin = LWMIN(env1.xmin, env2.xmin);
 	b.ymin = LWMIN(env1.ymin, env2.ymin);
-	b.xmax = LWMIN(env1.xmax, env2.xmax);
-	b.ymax = LWMIN(env1.ymax, env2.ymax);
+	b.xmax = LWMAX(env1.xmax, env2.xmax);
+	b.ymax = LWMAX(env1.ymax, env2.ymax);
 	return b;
 }
 
@@ -99,7 +100,7 @@ nv_box_union(const LWBOX env1, const LWBOX env2)
 /// @param gdim the geometry dimension
 /// @return the LWGEOM object
 LWGEOM *
-nv_box_stroke(LWBOX e, int gdim)
+lwbox_stroke(LWBOX e, int gdim)
 {
 	return NULL; // TODO
 }
@@ -138,6 +139,7 @@ nv__arc_center(POINT2D c0, POINT2D c1, POINT2D c2, POINT2D *center)
 	return 1;
 }
 
+/// @brief deep copy of \a obj, the copy always owns its coordinates
 LWGEOM *
 lwgeom_clone(const LWGEOM *obj)
 {
@@ -149,7 +151,39 @@ lwgeom_clone(const LWGEOM *obj)
 		return NULL;
 	}
 
-	clone->ngeoms = obj->ngeoms;
-	if (obj->ngeoms == 1) {}
-	return NULL;
+	*clone = *obj;
+	clone->flags &= ~LW_FLAG_READONLY;
+	clone->pp = NULL;
+	clone->geoms = NULL;
+	clone->ngeoms = 0;
+	if (obj->npoints > 0)
+	{
+		size_t msize = (size_t)obj->npoints * lwgeom_dim_coordinate(obj) * sizeof(double);
+		clone->pp = (double *)lwmalloc(msize);
+		if (clone->pp == NULL)
+		{
+			lwfree(clone);
+			return NULL;
+		}
+		memcpy(clone->pp, obj->pp, msize);
+	}
+	if (obj->ngeoms > 0)
+	{
+		clone->geoms = (LWGEOM **)lwmalloc(lw_nearest_pow(obj->ngeoms) * sizeof(LWGEOM *));
+		if (clone->geoms == NULL)
+		{
+			lwgeom_free(clone);
+			return NULL;
+		}
+		for (; clone->ngeoms < obj->ngeoms; clone->ngeoms++)
+		{
+			clone->geoms[clone->ngeoms] = lwgeom_clone(obj->geoms[clone->ngeoms]);
+			if (clone->geoms[clone->ngeoms] == NULL)
+			{
+				lwgeom_free(clone);
+				return NULL;
+			}
+		}
+	}
+	return clone;
 }
\ No newline at end of file
@@ -0,0 +1,197 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "lwgeom_spatial_sort.h"
+#include "liblwgeom_internel.h"
+#include "geohash.h"
+#include "lwpool.h"
+#include "lwsort.h"
+#include <assert.h>
+#include <float.h>
+
+/// number of geometries handled by one key task
+#define LWSORT_KEY_BLOCK 65536
+
+struct lwsort__keys {
+	LWGEOM **geoms;
+	size_t ngeoms;
+	LWSORT_CURVE curve;
+	LWBOX extent;
+	uint64_t *keys;
+};
+
+/// @brief Hilbert curve distance of a point on a 2^32 x 2^32 grid.
+uint64_t
+lwsort_hilbert64(uint32_t x, uint32_t y)
+{
+	uint64_t d = 0;
+	for (uint32_t s = 1U << 31; s > 0; s >>= 1)
+	{
+		uint32_t rx = (x & s) > 0;
+		uint32_t ry = (y & s) > 0;
+		d += (uint64_t)s * s * ((3 * rx) ^ ry);
+		/* rotate the quadrant */
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = ~x;
+				y = ~y;
+			}
+			uint32_t t = x;
+			x = y;
+			y = t;
+		}
+	}
+	return d;
+}
+
+/// scale a coordinate to [0, 2^32)
+static inline uint32_t
+lwsort__grid(double v, double min, double scale)
+{
+	double g = (v - min) * scale;
+	if (!(g > 0))
+		return 0;
+	if (g >= 4294967295.0)
+		return UINT32_MAX;
+	return (uint32_t)g;
+}
+
+static void
+lwsort__keys_block(size_t block, void *udata)
+{
+	struct lwsort__keys *k = (struct lwsort__keys *)udata;
+	size_t first = block * LWSORT_KEY_BLOCK;
+	size_t last = LWMIN(first + LWSORT_KEY_BLOCK, k->ngeoms);
+
+	double w = k->extent.xmax - k->extent.xmin;
+	double h = k->extent.ymax - k->extent.ymin;
+	double sx = w > 0 ? 4294967295.0 / w : 0;
+	double sy = h > 0 ? 4294967295.0 / h : 0;
+
+	for (size_t i = first; i < last; i++)
+	{
+		const LWBOX *env = &k->geoms[i]->env;
+		uint32_t x = lwsort__grid((env->xmin + env->xmax) / 2, k->extent.xmin, sx);
+		uint32_t y = lwsort__grid((env->ymin + env->ymax) / 2, k->extent.ymin, sy);
+		k->keys[i] = k->curve == LWSORT_HILBERT ? lwsort_hilbert64(x, y) : interleave64(x, y);
+	}
+}
+
+/// @brief Compute the space filling curve key of every geometry's
+/// envelope centre.
+/// @param geoms geometries, LWGEOM.env must be set
+/// @param ngeoms number of geometries
+/// @param curve LWSORT_MORTON or LWSORT_HILBERT
+/// @param extent the area mapped onto the curve, NULL for the extent of the
+/// envelope centres
+/// @param keys output keys, \a ngeoms entries
+/// @param nthreads number of threads, see lwpool_nthreads
+/// @return LW_SUCCESS
+int
+lwgeom_sort_keys(LWGEOM **geoms,
+		 size_t ngeoms,
+		 LWSORT_CURVE curve,
+		 const LWBOX *extent,
+		 uint64_t *keys,
+		 int nthreads)
+{
+	assert(geoms && keys);
+	struct lwsort__keys k = {.geoms = geoms, .ngeoms = ngeoms, .curve = curve, .keys = keys};
+	if (extent)
+	{
+		k.extent = *extent;
+	}
+	else
+	{
+		k.extent.xmin = k.extent.ymin = DBL_MAX;
+		k.extent.xmax = k.extent.ymax = -DBL_MAX;
+		for (size_t i = 0; i < ngeoms; i++)
+		{
+			const LWBOX *env = &geoms[i]->env;
+			double cx = (env->xmin + env->xmax) / 2;
+			double cy = (env->ymin + env->ymax) / 2;
+			k.extent.xmin = LWMIN(k.extent.xmin, cx);
+			k.extent.ymin = LWMIN(k.extent.ymin, cy);
+			k.extent.xmax = LWMAX(k.extent.xmax, cx);
+			k.extent.ymax = LWMAX(k.extent.ymax, cy);
+		}
+	}
+
+	size_t nblocks = (ngeoms + LWSORT_KEY_BLOCK - 1) / LWSORT_KEY_BLOCK;
+	lwpool_run(nblocks, nthreads, lwsort__keys_block, &k);
+	return LW_SUCCESS;
+}
+
+/// @brief Compute the spatial order of geometries without moving them.
+/// @param ids output, the input indices in curve order, \a ngeoms entries
+/// @return LW_SUCCESS, or LW_FAILURE if the system is out of memory
+int
+lwgeom_spatial_order(LWGEOM **geoms, size_t ngeoms, LWSORT_CURVE curve, uint64_t *ids, int nthreads)
+{
+	uint64_t *keys = (uint64_t *)lwmalloc(sizeof(uint64_t) * LWMAX(ngeoms, 1));
+	if (!keys)
+		return LW_FAILURE;
+	lwgeom_sort_keys(geoms, ngeoms, curve, NULL, keys, nthreads);
+	for (size_t i = 0; i < ngeoms; i++)
+		ids[i] = i;
+	int ret = lwsort_radix64(keys, ids, ngeoms, nthreads);
+	lwfree(keys);
+	return ret;
+}
+
+/// @brief Sort geometry pointers along a space filling curve through their
+/// envelope centres.
+///
+/// Keys are computed in parallel and sorted with lwsort_radix64, the
+/// pointers ride along as values, so \a geoms ends up reordered in place.
+/// @return LW_SUCCESS, or LW_FAILURE if the system is out of memory
+int
+lwgeom_spatial_sort(LWGEOM **geoms, size_t ngeoms, LWSORT_CURVE curve, int nthreads)
+{
+	uint64_t *keys = (uint64_t *)lwmalloc(sizeof(uint64_t) * LWMAX(ngeoms, 1));
+	if (!keys)
+		return LW_FAILURE;
+	lwgeom_sort_keys(geoms, ngeoms, curve, NULL, keys, nthreads);
+
+	assert(sizeof(LWGEOM *) <= sizeof(uint64_t));
+	uint64_t *vals = (uint64_t *)lwmalloc(sizeof(uint64_t) * LWMAX(ngeoms, 1));
+	if (!vals)
+	{
+		lwfree(keys);
+		return LW_FAILURE;
+	}
+	for (size_t i = 0; i < ngeoms; i++)
+		vals[i] = (uint64_t)(uintptr_t)geoms[i];
+
+	int ret = lwsort_radix64(keys, vals, ngeoms, nthreads);
+	if (ret == LW_SUCCESS)
+	{
+		for (size_t i = 0; i < ngeoms; i++)
+			geoms[i] = (LWGEOM *)(uintptr_t)vals[i];
+	}
+	lwfree(keys);
+	lwfree(vals);
+	return ret;
+}
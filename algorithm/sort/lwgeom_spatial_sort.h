@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef LWGEOM_SPATIAL_SORT_H
+#define LWGEOM_SPATIAL_SORT_H
+
+#include "liblwgeom.h"
+
+/// @brief space filling curve used to order geometries
+typedef enum
+{
+	LWSORT_MORTON, ///< Z-order, the geohash bit interleaving
+	LWSORT_HILBERT ///< Hilbert curve, better locality, slightly slower keys
+} LWSORT_CURVE;
+
+int lwgeom_sort_keys(LWGEOM **geoms,
+		     size_t ngeoms,
+		     LWSORT_CURVE curve,
+		     const LWBOX *extent,
+		     uint64_t *keys,
+		     int nthreads);
+int lwgeom_spatial_order(LWGEOM **geoms, size_t ngeoms, LWSORT_CURVE curve, uint64_t *ids, int nthreads);
+int lwgeom_spatial_sort(LWGEOM **geoms, size_t ngeoms, LWSORT_CURVE curve, int nthreads);
+uint64_t lwsort_hilbert64(uint32_t x, uint32_t y);
+
+#endif /* LWGEOM_SPATIAL_SORT_H */
@@ -20,7 +20,7 @@
  * IN THE SOFTWARE.
  */
 
-#include "liblwgeom.h"
+#include "liblwgeom_internel.h"
 #include <string.h>
 #include <assert.h>
 #include <math.h>
@@ -46,7 +46,7 @@ lwgeom__query_envolpe(const double *pp, int npoints, int cdim)
 		xmin = pp[i * cdim] > xmin ? xmin : pp[i * cdim];
 		xmax = pp[i * cdim] < xmax ? xmax : pp[i * cdim];
 		ymin = pp[i * cdim + 1] > ymin ? ymin : pp[i * cdim + 1];
-		xmax = pp[i * cdim + 1] < xmax ? xmax : pp[i * cdim + 1];
+		ymax = pp[i * cdim + 1] < ymax ? ymax : pp[i * cdim + 1];
 	}
 
 	LWBOX box = {.xmin = xmin, .ymin = ymin, .xmax = xmax, .ymax = ymax, .zmin = 0.0, .zmax = 0.0};
@@ -63,8 +63,8 @@ nv__check_single_ring(const double *pp, int npoints, int cdim)
 
 	double x0 = pp[0];
 	double y0 = pp[1];
-	double xn = pp[(ptrdiff_t)(npoints * cdim)];
-	double yn = pp[(ptrdiff_t)(npoints * cdim + 1)];
+	double xn = pp[(ptrdiff_t)((npoints - 1) * cdim)];
+	double yn = pp[(ptrdiff_t)((npoints - 1) * cdim + 1)];
 
 	return LW_DOUBLE_NEARES2(x0, xn) && LW_DOUBLE_NEARES2(y0, yn);
 }
@@ -72,180 +72,344 @@ nv__check_single_ring(const double *pp, int npoints, int cdim)
 double
 lwgeom_get_x(const LWGEOM *obj, uint32_t i)
 {
-	return 0.0;
+	assert(obj && i < obj->npoints);
+	return obj->pp[(size_t)i * lwgeom_dim_coordinate(obj)];
 }
 
 double
 lwgeom_get_y(const LWGEOM *obj, uint32_t i)
 {
-	return 0.0;
+	assert(obj && i < obj->npoints);
+	return obj->pp[(size_t)i * lwgeom_dim_coordinate(obj) + 1];
 }
 
 double
 lwgeom_get_z(const LWGEOM *obj, uint32_t i)
 {
-	return 0.0;
+	assert(obj && i < obj->npoints);
+	if (!LWFLAGS_GET_Z(obj->flags))
+		return NO_Z_VALUE;
+	return obj->pp[(size_t)i * lwgeom_dim_coordinate(obj) + 2];
 }
 
 double
 lwgeom_get_m(const LWGEOM *obj, uint32_t i)
 {
-	return 0.0;
+	assert(obj && i < obj->npoints);
+	if (!LWFLAGS_GET_M(obj->flags))
+		return NO_M_VALUE;
+	int cdim = lwgeom_dim_coordinate(obj);
+	return obj->pp[(size_t)i * cdim + cdim - 1];
 }
 
 /* ---------------------------- geometry factory ---------------------------- */
 
+size_t
+lw_nearest_pow(size_t v)
+{
+	size_t p = 1;
+	while (p < v && p << 1)
+		p <<= 1;
+	return p;
+}
+
+/// @brief create an empty geometry of any type
 LWGEOM *
-lwgeom_point(const double *pp, int hasz, int hasm)
+lwgeom__new(uint8_t type, LWBOOLEAN hasz, LWBOOLEAN hasm)
 {
-	assert(pp);
 	LWGEOM *obj = (LWGEOM *)lwmalloc(sizeof(LWGEOM));
 	if (!obj)
 		return NULL;
 	memset(obj, 0, sizeof(LWGEOM));
-	obj->type = POINTTYPE;
-	obj->npoints = 1;
-	size_t msize = LW_POINTBYTESIZE(hasz, hasm) * sizeof(double);
-	obj->pp = (double *)lwmalloc(msize);
-	if (!obj->pp)
-	{
-		lwgeom_free(obj);
-		return NULL;
-	}
-	memcpy(obj->pp, pp, msize);
+	obj->type = type;
 	LWFLAGS_SET_Z(obj->flags, hasz);
 	LWFLAGS_SET_M(obj->flags, hasm);
+	LWFLAGS_SET_Z(obj->env.flags, hasz);
+	LWFLAGS_SET_M(obj->env.flags, hasm);
+	return obj;
+}
+
+/// @brief create a geometry which takes ownership of \a pp, or only borrows
+/// it when \a readonly is set.
+LWGEOM *
+lwgeom__new_points(uint8_t type, uint32_t npoints, double *pp, lwflags_t flags, LWBOOLEAN readonly)
+{
+	LWGEOM *obj = lwgeom__new(type, LWFLAGS_GET_Z(flags), LWFLAGS_GET_M(flags));
+	if (!obj)
+		return NULL;
+	obj->flags |= flags & (LW_FLAG_SHELL_RING | LW_FLAG_HOLE_RING);
+	if (readonly)
+		obj->flags |= LW_FLAG_READONLY;
+	obj->npoints = npoints;
+	obj->pp = pp;
+	if (npoints > 0)
+		obj->env = lwgeom__query_envolpe(pp, npoints, LW_POINTBYTESIZE(LWFLAGS_GET_Z(flags), LWFLAGS_GET_M(flags)));
+	obj->env.flags = obj->flags & (LW_FLAG_Z | LW_FLAG_M);
+	return obj;
+}
+
+static LWGEOM *
+lwgeom__copy_points(uint8_t type, uint32_t npoints, const double *points, LWBOOLEAN hasz, LWBOOLEAN hasm)
+{
+	double *pp = NULL;
+	if (npoints > 0)
+	{
+		size_t msize = (size_t)npoints * LW_POINTBYTESIZE(hasz, hasm) * sizeof(double);
+		pp = (double *)lwmalloc(msize);
+		if (!pp)
+			return NULL;
+		memcpy(pp, points, msize);
+	}
 
-	obj->geoms = NULL;
+	lwflags_t flags = 0;
+	LWFLAGS_SET_Z(flags, hasz);
+	LWFLAGS_SET_M(flags, hasm);
+	LWGEOM *obj = lwgeom__new_points(type, npoints, pp, flags, LW_FALSE);
+	if (!obj)
+		lwfree(pp);
 	return obj;
 }
 
+/// @brief append \a obj to the children of \a mobj, \a mobj takes ownership
+/// @return \a mobj, or NULL if the system is out of memory
+LWGEOM *
+lwgeom__add(LWGEOM *mobj, LWGEOM *obj)
+{
+	assert(mobj && obj);
+	/* the envelope is taken over from the first child with coordinates */
+	int first = lwgeom__is_empty(mobj);
+	/* the children array grows in powers of two */
+	if (mobj->ngeoms == 0 || mobj->ngeoms == lw_nearest_pow(mobj->ngeoms))
+	{
+		size_t capacity = mobj->ngeoms == 0 ? 1 : (size_t)mobj->ngeoms * 2;
+		LWGEOM **geoms = (LWGEOM **)lwrealloc(mobj->geoms, capacity * sizeof(LWGEOM *));
+		if (!geoms)
+			return NULL;
+		mobj->geoms = geoms;
+	}
+	mobj->geoms[mobj->ngeoms++] = obj;
+
+	if (lwgeom__is_empty(obj))
+		return mobj;
+	if (first)
+	{
+		mobj->env = obj->env;
+	}
+	else
+	{
+		mobj->env.xmin = LWMIN(mobj->env.xmin, obj->env.xmin);
+		mobj->env.ymin = LWMIN(mobj->env.ymin, obj->env.ymin);
+		mobj->env.xmax = LWMAX(mobj->env.xmax, obj->env.xmax);
+		mobj->env.ymax = LWMAX(mobj->env.ymax, obj->env.ymax);
+	}
+	mobj->env.flags = mobj->flags & (LW_FLAG_Z | LW_FLAG_M);
+	return mobj;
+}
+
+/// @brief LW_TRUE if the geometry has no coordinates at all
+int
+lwgeom__is_empty(const LWGEOM *obj)
+{
+	if (obj->npoints > 0)
+		return LW_FALSE;
+	for (uint32_t i = 0; i < obj->ngeoms; i++)
+	{
+		if (!lwgeom__is_empty(obj->geoms[i]))
+			return LW_FALSE;
+	}
+	return LW_TRUE;
+}
+
+LWGEOM *
+lwgeom_point(const double *pp, int hasz, int hasm)
+{
+	assert(pp);
+	return lwgeom__copy_points(POINTTYPE, 1, pp, hasz, hasm);
+}
+
 LWGEOM *
 lwgeom_line(uint32_t npoints, const double *points, LWBOOLEAN hasz, LWBOOLEAN hasm)
 {
-	return NULL;
+	assert(points || npoints == 0);
+	return lwgeom__copy_points(LINETYPE, npoints, points, hasz, hasm);
 }
+
+/// @brief create a polygon from copies of the shell and the holes
 LWGEOM *
 lwgeom_poly(const LWGEOM *shell, uint32_t nholes, const LWGEOM **holes)
 {
-	return NULL;
+	assert(shell);
+	LWGEOM *poly = lwgeom__new(POLYTYPE, lwgeom_has_z(shell), lwgeom_has_m(shell));
+	if (!poly)
+		return NULL;
+	for (uint32_t i = 0; i <= nholes; i++)
+	{
+		const LWGEOM *src = i == 0 ? shell : holes[i - 1];
+		LWGEOM *ring = lwgeom_line(src->npoints, src->pp, lwgeom_has_z(src), lwgeom_has_m(src));
+		if (!ring || !lwgeom__add(poly, ring))
+		{
+			if (ring)
+				lwgeom_free(ring);
+			lwgeom_free(poly);
+			return NULL;
+		}
+		ring->flags |= i == 0 ? LW_FLAG_SHELL_RING : LW_FLAG_HOLE_RING;
+	}
+	return poly;
 }
 
 LWGEOM *
 lwgeom_create_empty_mpoint(LWBOOLEAN hasz, LWBOOLEAN hasm)
 {
-	return NULL;
+	return lwgeom__new(MPOINTTYPE, hasz, hasm);
 }
 
 LWGEOM *
 lwgeom_create_empty_mline(LWBOOLEAN hasz, LWBOOLEAN hasm)
 {
-	return NULL;
+	return lwgeom__new(MLINETYPE, hasz, hasm);
 }
 
 LWGEOM *
 lwgeom_create_empty_mpoly(LWBOOLEAN hasz, LWBOOLEAN hasm)
 {
-	return NULL;
+	return lwgeom__new(MPOLYTYPE, hasz, hasm);
 }
 
 LWGEOM *
 lwgeom_create_empty_collection(uint8_t type, LWBOOLEAN hasz, LWBOOLEAN hasm)
 {
-	return NULL;
+	if (type < MPOINTTYPE || type > COLLECTIONTYPE)
+		return NULL;
+	return lwgeom__new(type, hasz, hasm);
 }
 
+/// @brief create a collection from copies of the \a ngeoms geometries of \a geoms
 LWGEOM *
 lwgeom_create_empty_collection2(uint8_t type, uint32_t ngeoms, LWGEOM *geoms)
 {
-	return NULL;
+	LWGEOM *mobj = lwgeom_create_empty_collection(type, ngeoms ? lwgeom_has_z(&geoms[0]) : LW_FALSE,
+						      ngeoms ? lwgeom_has_m(&geoms[0]) : LW_FALSE);
+	for (uint32_t i = 0; mobj && i < ngeoms; i++)
+	{
+		LWGEOM *obj = lwgeom_clone(&geoms[i]);
+		if (!obj || !lwgeom__add(mobj, obj))
+		{
+			lwgeom_free(obj);
+			lwgeom_free(mobj);
+			return NULL;
+		}
+	}
+	return mobj;
 }
 
 LWGEOM *
 lwgeom_mpoint_add_point(LWGEOM *mobj, LWGEOM *obj)
 {
-	return NULL;
+	if (!mobj || !obj || mobj->type != MPOINTTYPE || obj->type != POINTTYPE)
+		return NULL;
+	return lwgeom__add(mobj, obj);
 }
 
 LWGEOM *
 lwgeom_mline_add_line(LWGEOM *mobj, LWGEOM *obj)
 {
-	return NULL;
+	if (!mobj || !obj || mobj->type != MLINETYPE || obj->type != LINETYPE)
+		return NULL;
+	return lwgeom__add(mobj, obj);
 }
 
 LWGEOM *
 lwgeom_mpoly_add_poly(LWGEOM *mobj, LWGEOM *obj)
 {
-	return NULL;
+	if (!mobj || !obj || mobj->type != MPOLYTYPE || obj->type != POLYTYPE)
+		return NULL;
+	return lwgeom__add(mobj, obj);
 }
+
 LWGEOM *
 lwgeom_collection_add_geom(LWGEOM *mobj, LWGEOM *obj)
 {
-	return NULL;
+	if (!mobj || !obj || mobj->type != COLLECTIONTYPE)
+		return NULL;
+	return lwgeom__add(mobj, obj);
 }
 
 int
 lwgeom_has_z(const LWGEOM *obj)
 {
-	return 0;
+	return LWFLAGS_GET_Z(obj->flags) ? LW_TRUE : LW_FALSE;
 }
 
 int
 lwgeom_has_m(const LWGEOM *obj)
 {
-	return 0;
+	return LWFLAGS_GET_M(obj->flags) ? LW_TRUE : LW_FALSE;
 }
 
 int
 lwgeom_dim_coordinate(const LWGEOM *obj)
 {
-	return 0;
+	return LW_POINTBYTESIZE(LWFLAGS_GET_Z(obj->flags), LWFLAGS_GET_M(obj->flags));
 }
 
 int
 lwgeom_dim_geometry(const LWGEOM *obj)
 {
-	return 0;
+	switch (obj->type)
+	{
+	case POINTTYPE:
+	case MPOINTTYPE:
+		return 0;
+	case LINETYPE:
+	case MLINETYPE:
+		return 1;
+	case POLYTYPE:
+	case MPOLYTYPE:
+		return 2;
+	default: {
+		int dim = 0;
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			dim = LWMAX(dim, lwgeom_dim_geometry(obj->geoms[i]));
+		return dim;
+	}
+	}
 }
 
 int
 lwgeom_children_count(const LWGEOM *obj)
 {
-	return 0;
+	return (int)obj->ngeoms;
 }
+
 LWGEOM *
 lwgeom_child_at(const LWGEOM *obj, int i)
 {
-	return NULL;
+	if (i < 0 || (uint32_t)i >= obj->ngeoms)
+		return NULL;
+	return obj->geoms[i];
 }
 
 int
 lwgeom_points_count(const LWGEOM *obj)
 {
-	return 0;
+	return (int)obj->npoints;
 }
 
 int
 lwgeom_point_at(const LWGEOM *obj, int n, double *point)
 {
-	return 0;
+	if (n < 0 || (uint32_t)n >= obj->npoints)
+		return LW_FAILURE;
+	int cdim = lwgeom_dim_coordinate(obj);
+	memcpy(point, obj->pp + (size_t)n * cdim, cdim * sizeof(double));
+	return LW_SUCCESS;
 }
 
 double *
 lwgeom_points(const LWGEOM *obj)
 {
-	return NULL;
-}
-
-void
-lwgeom__free(LWGEOM *g)
-{
-	assert(g);
-	if (g->flags != 0)
-	{
-		lwfree(g->pp);
-	}
-	lwfree(g);
+	return obj->pp;
 }
 
 /// @brief free geometry object
@@ -254,22 +418,19 @@ lwgeom__free(LWGEOM *g)
 void
 lwgeom_free(LWGEOM *obj)
 {
-	assert(obj);
-	if (obj->ngeoms == 1)
+	if (!obj)
+		return;
+	for (uint32_t i = 0; i < obj->ngeoms; ++i)
 	{
-		lwgeom__free(obj);
-	}
-	else
-	{
-		for (int i = 0; i < obj->ngeoms; ++i)
-		{
-			LWGEOM *sub = obj->geoms[i];
-			if (sub == NULL)
-				continue;
-			lwgeom__free(sub);
-		}
+		if (obj->geoms[i])
+			lwgeom_free(obj->geoms[i]);
 	}
+	lwfree(obj->geoms);
+	if (!(obj->flags & LW_FLAG_READONLY))
+		lwfree(obj->pp);
+	lwfree(obj);
 }
+
 /* -------------------------------- tolerance ------------------------------- */
 
 static double g_tolerance = 0.0001;
@@ -310,28 +471,38 @@ nv_ccw(const double *pp, int npoints, int cdim)
 
 	// Flat Ring
 	// The Y coordinate of at least one of the adjacent points of the lowest
-	// point on the ring is the same as that of the lowest point.
+	// point on the ring is the same as that of the lowest point. Among the
+	// lowest points the rightmost one is taken, it is still a strict corner of
+	// the hull.
 
 	// of points without closing endpoint
-	// Search for the highest point
-	double lowY = pp[1];
+	int n = npoints - 1;
 	int lowIndex = 0;
-	for (int i = 0; i < npoints; ++i)
+	for (int i = 1; i < n; ++i)
 	{
 		double ty = pp[(ptrdiff_t)(i * cdim + 1)];
-		if (ty < lowY)
-		{
+		double ly = pp[(ptrdiff_t)(lowIndex * cdim + 1)];
+		if (ty < ly || (ty == ly && pp[(ptrdiff_t)(i * cdim)] > pp[(ptrdiff_t)(lowIndex * cdim)]))
 			lowIndex = i;
-			lowY = ty;
-		}
 	}
 
-	double x1 = pp[(ptrdiff_t)((lowIndex - 1) * cdim)];
-	double y1 = pp[(ptrdiff_t)((lowIndex - 1) * cdim + 1)];
 	double x2 = pp[(ptrdiff_t)(lowIndex * cdim)];
 	double y2 = pp[(ptrdiff_t)(lowIndex * cdim + 1)];
-	double x3 = pp[(ptrdiff_t)(((lowIndex + 1) % npoints) * cdim)];
-	double y3 = pp[(ptrdiff_t)(((lowIndex + 1) % npoints) * cdim + 1)];
+
+	// neighbours that repeat the lowest point don't give a direction
+	int prev = lowIndex;
+	do
+		prev = (prev - 1 + n) % n;
+	while (prev != lowIndex && pp[(ptrdiff_t)(prev * cdim)] == x2 && pp[(ptrdiff_t)(prev * cdim + 1)] == y2);
+	int next = lowIndex;
+	do
+		next = (next + 1) % n;
+	while (next != lowIndex && pp[(ptrdiff_t)(next * cdim)] == x2 && pp[(ptrdiff_t)(next * cdim + 1)] == y2);
+
+	double x1 = pp[(ptrdiff_t)(prev * cdim)];
+	double y1 = pp[(ptrdiff_t)(prev * cdim + 1)];
+	double x3 = pp[(ptrdiff_t)(next * cdim)];
+	double y3 = pp[(ptrdiff_t)(next * cdim + 1)];
 
 	double r = (x2 - x1) * (y3 - y2) - (y2 - y1) * (x3 - x2);
 	return (r > 0) ? LW_TRUE : LW_FALSE;
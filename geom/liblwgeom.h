@@ -26,6 +26,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdarg.h>
+#include <stdio.h>
 #include <syslog.h>
 
 /**
@@ -158,6 +159,18 @@ typedef struct {
 	double *sdo_ordinates;
 } LWGEOM_SDO;
 
+/******************************************************************
+ * LWMVT_TILE structure.
+ * Placement of a Mapbox Vector Tile, the bounds map onto a grid of
+ * extent x extent units and geometry is kept up to buffer units past
+ * its edges.
+ */
+typedef struct {
+	LWBOX bounds;
+	uint32_t extent;
+	uint32_t buffer;
+} LWMVT_TILE;
+
 typedef struct {
 	LWGEOM *geom;
 	size_t prop_size;
@@ -214,6 +227,7 @@ typedef enum
 #define LW_FLAG_M          0x02
 #define LW_FLAG_SHELL_RING 0x04
 #define LW_FLAG_HOLE_RING  0x08
+#define LW_FLAG_READONLY   0x10 ///< pp is borrowed and not freed with the geometry
 
 #define LWFLAGS_GET_Z(flags)          ((flags) & LW_FLAG_Z)
 #define LWFLAGS_GET_M(flags)          ((flags) & LW_FLAG_M)
@@ -263,22 +277,421 @@ extern LWGEOM *lwgeom_read_wkt(const char *wkt, size_t len);
 extern LWGEOM *lwgeom_read_wkb(const char *wkb, size_t len, int hex);
 extern LWGEOM *lwgeom_read_ewkt(const char *ewkt, size_t len);
 extern LWGEOM *lwgeom_read_ewkb(const char *ewkb, size_t len);
+extern LWGEOM *lwgeom_read_wkb_view(const char *wkb, size_t len);
 extern LWGEOM *lwgeom_read_geojson(const char *json, size_t len);
 extern LWGEOM *lwgeom_read_kml(const char *kml, size_t len);
 extern LWGEOM *lwgeom_read_gml2(const char *gml, size_t len);
 extern LWGEOM *lwgeom_read_gml3(const char *gml, size_t len);
 
+/******************************************************************
+ * Reading untrusted input. The readers above report a failure through
+ * lwnotice and return NULL, lwgeom_parse reports it in a LWPARSE_RESULT
+ * instead and enforces LWPARSE_LIMITS while it reads, so hostile input fails
+ * at the first vertex or level over a limit and not after a large allocation.
+ */
+#define LW_PARSE_OK       0
+#define LW_PARSE_FORMAT   1 /* format not recognized */
+#define LW_PARSE_SYNTAX   2 /* malformed input */
+#define LW_PARSE_BYTES    3 /* input longer than max_bytes */
+#define LW_PARSE_VERTICES 4 /* more vertices than max_vertices */
+#define LW_PARSE_DEPTH    5 /* collections nested deeper than max_depth */
+#define LW_PARSE_MEMORY   6 /* an allocation failed */
+
+/* a zeroed struct is the default, no limit on bytes or vertices and nesting
+ * up to 64 levels, which is also the most any reader accepts */
+typedef struct {
+	size_t max_bytes;    /* bytes of the input, of one feature when streaming */
+	size_t max_vertices; /* vertices of all parts together */
+	int max_depth;       /* collection levels below the outermost geometry */
+} LWPARSE_LIMITS;
+
+typedef struct {
+	int code;            /* LW_PARSE_OK or the reason no geometry was read */
+	size_t offset;       /* byte offset of the failure in the input */
+	const char *message; /* static text, NULL when code is LW_PARSE_OK */
+} LWPARSE_RESULT;
+
+/******************************************************************
+ * Streaming reader for GeoJSON FeatureCollections of any size, it yields one
+ * feature at a time and only holds the feature being parsed in memory.
+ */
+typedef struct LWGEOJSONREADER LWGEOJSONREADER;
+
+/* fills buf with up to len bytes, returns the count, 0 at the end, -1 on error */
+typedef long (*lwgeojson_read_func)(void *udata, char *buf, size_t len);
+
+extern LWGEOJSONREADER *lwgeojson_reader_callback(lwgeojson_read_func read, void *udata);
+extern LWGEOJSONREADER *lwgeojson_reader_fd(int fd);
+extern LWGEOJSONREADER *lwgeojson_reader_mmap(const char *path);
+extern LWGEOJSONREADER *lwgeojson_reader_memory(const char *data, size_t len);
+extern void lwgeojson_reader_set_limits(LWGEOJSONREADER *reader, const LWPARSE_LIMITS *limits);
+extern int lwgeojson_reader_next(LWGEOJSONREADER *reader, LWGEOM **geom, const char **props, size_t *props_len);
+extern const LWPARSE_RESULT *lwgeojson_reader_result(const LWGEOJSONREADER *reader);
+extern void lwgeojson_reader_free(LWGEOJSONREADER *reader);
+
+/******************************************************************
+ * Streaming reader for GML 2, GML 3 and KML documents of any size, it yields
+ * the outermost geometries one at a time and never builds a document tree.
+ */
+typedef struct LWXMLREADER LWXMLREADER;
+
+/* fills buf with up to len bytes, returns the count, 0 at the end, -1 on error */
+typedef long (*lwxml_read_func)(void *udata, char *buf, size_t len);
+
+extern LWXMLREADER *lwxml_reader_callback(int format, lwxml_read_func read, void *udata);
+extern LWXMLREADER *lwxml_reader_fd(int format, int fd);
+extern LWXMLREADER *lwxml_reader_mmap(int format, const char *path);
+extern LWXMLREADER *lwxml_reader_memory(int format, const char *data, size_t len);
+extern void lwxml_reader_set_limits(LWXMLREADER *reader, const LWPARSE_LIMITS *limits);
+extern int lwxml_reader_next(LWXMLREADER *reader, LWGEOM **geom);
+extern const LWPARSE_RESULT *lwxml_reader_result(const LWXMLREADER *reader);
+extern void lwxml_reader_free(LWXMLREADER *reader);
+
+/******************************************************************
+ * Output sinks for the text writers, one sink takes any number of geometries
+ * so that writing many of them costs no allocation per geometry.
+ */
+typedef struct LWSINK LWSINK;
+
+/* receives successive chunks of text output, returns 0 to abort the write */
+typedef int (*lwgeom_text_sink)(const char *data, size_t len, void *udata);
+
+#define LW_SINK_OK       0
+#define LW_SINK_OVERFLOW 1
+#define LW_SINK_ERROR    2
+
+extern LWSINK *lwsink_buffer(size_t capacity);
+extern LWSINK *lwsink_fixed(char *buf, size_t size);
+extern LWSINK *lwsink_fd(int fd);
+extern LWSINK *lwsink_file(FILE *file);
+extern LWSINK *lwsink_callback(lwgeom_text_sink func, void *udata);
+extern int lwsink_write(LWSINK *sink, const char *data, size_t len);
+extern int lwsink_flush(LWSINK *sink);
+extern int lwsink_status(const LWSINK *sink);
+extern size_t lwsink_size(const LWSINK *sink);
+extern const char *lwsink_data(LWSINK *sink, size_t *len);
+extern void lwsink_reset(LWSINK *sink);
+extern void lwsink_free(LWSINK *sink);
+
+/******************************************************************
+ * Bulk input and output of text holding one geometry per line, the work is
+ * spread over the thread pool.
+ */
+#define LW_FORMAT_WKT     1
+#define LW_FORMAT_GEOJSON 2
+
+/* dialects of LWXMLREADER, those documents are not read line by line */
+#define LW_FORMAT_GML2 3
+#define LW_FORMAT_GML3 4
+#define LW_FORMAT_KML  5
+
+/* the remaining formats of lwgeom_read_format, LW_FORMAT_EWKB is binary or
+ * hex EWKB */
+#define LW_FORMAT_AUTO   0
+#define LW_FORMAT_WKB    6
+#define LW_FORMAT_HEXWKB 7
+#define LW_FORMAT_EWKT   8
+#define LW_FORMAT_EWKB   9
+
+/* formats lwgeom_detect_format does not recognize, POLYLINE is written with
+ * five decimal places and POLYLINE6 with six */
+#define LW_FORMAT_TWKB       10
+#define LW_FORMAT_SERIALIZED 11
+#define LW_FORMAT_POLYLINE   12
+#define LW_FORMAT_POLYLINE6  13
+
+/* per input results of lwgeom_read_many */
+#define LW_READ_OK      0
+#define LW_READ_FORMAT  1
+#define LW_READ_INVALID 2
+
+/* receives a geometry it then owns, NULL for a line that failed to parse,
+ * line numbers start at 1. Returns 0 to stop reading */
+typedef int (*lwgeom_line_func)(LWGEOM *geom, size_t line, void *udata);
+
+extern int lwgeom_read_lines(const char *data,
+			     size_t len,
+			     int format,
+			     int nthreads,
+			     int ordered,
+			     lwgeom_line_func func,
+			     void *udata);
+extern int
+lwgeom_read_lines_file(const char *path, int format, int nthreads, int ordered, lwgeom_line_func func, void *udata);
+
+extern int lwgeom_detect_format(const char *data, size_t len);
+extern LWGEOM *lwgeom_read_format(int format, const char *data, size_t len);
+extern LWGEOM *lwgeom_read_any(const char *data, size_t len);
+extern size_t lwgeom_read_many(const char *const *inputs,
+			       const size_t *lens,
+			       size_t count,
+			       int format,
+			       int nthreads,
+			       LWGEOM **geoms,
+			       int *errors);
+extern LWGEOM *
+lwgeom_parse(int format, const char *data, size_t len, const LWPARSE_LIMITS *limits, LWPARSE_RESULT *result);
+extern size_t lwgeom_parse_many(const char *const *inputs,
+				const size_t *lens,
+				size_t count,
+				int format,
+				const LWPARSE_LIMITS *limits,
+				int nthreads,
+				LWGEOM **geoms,
+				LWPARSE_RESULT *results);
+
+extern int lwgeom_write_lines(LWGEOM *const *geoms, size_t ngeoms, int format, int nthreads, char **data, size_t *len);
+extern int lwgeom_write_lines_fd(LWGEOM *const *geoms, size_t ngeoms, int format, int nthreads, int fd);
+
 extern int lwgeom_write_wkt(const LWGEOM *obj, char **wkt, size_t *len);
 extern int lwgeom_write_wkb(const LWGEOM *obj, int hex, char **wkb, size_t *len);
 extern int lwgeom_write_ewkt(const LWGEOM *obj, char **ewkt, size_t *len);
 extern int lwgeom_write_ewkb(const LWGEOM *obj, char **ewkb, size_t *len);
+extern int lwgeom_write_wkt_to(const LWGEOM *obj, int precision, LWSINK *sink);
+extern int lwgeom_write_ewkt_to(const LWGEOM *obj, int precision, LWSINK *sink);
+
+/**
+ * WKB output variants, ISO and EXTENDED select the type code convention, NDR
+ * and XDR the byte order (NDR when neither is given), HEX writes two hex
+ * characters per byte.
+ */
+#define LW_WKB_ISO      0x01
+#define LW_WKB_EXTENDED 0x04
+#define LW_WKB_NDR      0x08
+#define LW_WKB_XDR      0x10
+#define LW_WKB_HEX      0x20
+
+extern size_t lwgeom_wkb_size(const LWGEOM *obj, uint8_t variant);
+extern size_t lwgeom_write_wkb_buffer(const LWGEOM *obj, uint8_t variant, uint8_t *buf, size_t size);
+extern int lwgeom_write_wkb_to(const LWGEOM *obj, uint8_t variant, LWSINK *sink);
+
+/**
+ * TWKB output variants, BBOX adds the bounding box header and SIZE the byte
+ * count of every geometry so readers can skip it.
+ */
+#define LW_TWKB_BBOX 0x01
+#define LW_TWKB_SIZE 0x02
+
+extern LWGEOM *lwgeom_read_twkb(const char *twkb, size_t len);
+extern size_t lwgeom_read_twkb_batch(const char *twkb, size_t len, LWGEOM ***geoms);
+extern int lwgeom_write_twkb(const LWGEOM *obj,
+			     int precision_xy,
+			     int precision_z,
+			     int precision_m,
+			     uint8_t variant,
+			     char **twkb,
+			     size_t *len);
+extern int lwgeom_write_twkb_batch(LWGEOM *const *geoms,
+				   size_t count,
+				   int precision_xy,
+				   int precision_z,
+				   int precision_m,
+				   uint8_t variant,
+				   char **twkb,
+				   size_t *len,
+				   size_t *offsets);
+
+extern int lwgeom_write_mvt(const LWGEOM *obj, const LWMVT_TILE *tile, uint32_t **geometry, size_t *len, uint8_t *type);
+extern int lwgeom_write_mvt_layer(LWGEOM *const *geoms,
+				  const uint64_t *ids,
+				  size_t count,
+				  const char *name,
+				  const LWMVT_TILE *tile,
+				  char **data,
+				  size_t *len);
+
 extern int lwgeom_write_geojson(const LWGEOM *obj, char **json, size_t *len);
+
+/**
+ * GeoJSON output options, BBOX adds a "bbox" member taken from the envelope.
+ */
+#define LW_GEOJSON_BBOX 0x01
+
+extern int lwgeom_write_geojson_to(const LWGEOM *obj, int precision, int options, LWSINK *sink);
+
 extern int lwgeom_write_kml(const LWGEOM *obj, char **kml, size_t *len);
 extern int lwgeom_write_gml2(const LWGEOM *obj, char **gml, size_t *len);
 extern int lwgeom_write_gml3(const LWGEOM *obj, char **gml, size_t *len);
+extern int lwgeom_write_kml_to(const LWGEOM *obj, int precision, LWSINK *sink);
+extern int lwgeom_write_gml2_to(const LWGEOM *obj, int precision, LWSINK *sink);
+extern int lwgeom_write_gml3_to(const LWGEOM *obj, int precision, LWSINK *sink);
+
+/**
+ * Encoded Polyline, the text format of routing services. precision is the
+ * number of decimal places, 5 for the classic format and 6 for 1e6 services.
+ * The batch reader places all coordinates in one arena that the read-only
+ * linestrings point into, the arena is freed with lwfree after them.
+ */
+extern int lwgeom_write_polyline(const LWGEOM *obj, int precision, char **polyline, size_t *len);
+extern int lwgeom_write_polyline_to(const LWGEOM *obj, int precision, LWSINK *sink);
+extern LWGEOM *lwgeom_read_polyline(const char *polyline, size_t len, int precision);
+extern size_t lwgeom_read_polyline_batch(const char *const *polylines,
+					 const size_t *lens,
+					 size_t count,
+					 int precision,
+					 int nthreads,
+					 double **coords,
+					 LWGEOM **geoms);
 
 extern LWGEOM *lwgeom_read_ora(const LWGEOM_SDO sdo, int flag);
 extern int lwgeom_write_ora(const LWGEOM *obj, LWGEOM_SDO *sdo);
+extern size_t lwgeom_read_ora_batch(const LWGEOM_SDO *sdos, size_t count, int flag, int nthreads, LWGEOM **geoms);
+extern int lwgeom_write_ora_batch(LWGEOM *const *geoms,
+				  size_t count,
+				  int nthreads,
+				  LWGEOM_SDO *sdos,
+				  int **elem_info,
+				  double **ordinates);
+
+/**
+ * Flat layer files, a FlatGeobuf style container of a header, a packed
+ * Hilbert R-tree and length prefixed WKB records that is read by mmap or by
+ * range reads.
+ */
+typedef struct LWFLATREADER LWFLATREADER;
+
+/* reads len bytes at offset of the file into buf, returns 0 on failure */
+typedef int (*lwflat_read_func)(void *buf, size_t len, uint64_t offset, void *udata);
+/* receives a geometry it then owns and its position in the file, returns 0
+ * to stop the query */
+typedef int (*lwflat_query_func)(LWGEOM *geom, size_t index, void *udata);
+
+extern int lwgeom_write_flat(LWGEOM *const *geoms,
+			     size_t count,
+			     uint16_t node_size,
+			     int nthreads,
+			     char **data,
+			     size_t *len,
+			     uint64_t *order);
+extern int lwgeom_write_flat_file(LWGEOM *const *geoms,
+				  size_t count,
+				  uint16_t node_size,
+				  int nthreads,
+				  const char *path,
+				  uint64_t *order);
+extern LWFLATREADER *lwflat_open(const char *path);
+extern LWFLATREADER *lwflat_open_memory(const void *data, size_t len);
+extern LWFLATREADER *lwflat_open_reader(lwflat_read_func read, void *udata);
+extern void lwflat_close(LWFLATREADER *reader);
+extern size_t lwflat_count(const LWFLATREADER *reader);
+extern int lwflat_extent(const LWFLATREADER *reader, LWBOX *extent);
+extern LWGEOM *lwflat_get(LWFLATREADER *reader, size_t index);
+extern size_t lwflat_query(LWFLATREADER *reader, const LWBOX *box, lwflat_query_func func, void *udata);
+
+/**
+ * ESRI shapefiles, the .shp is mapped and its records are found through the
+ * .shx index next to it, or by walking the record headers when there is none.
+ * lwshp_read decodes every record into geoms[index], leaving NULL for null
+ * shapes, bad records and records whose box misses the box given.
+ */
+typedef struct LWSHPREADER LWSHPREADER;
+
+extern LWSHPREADER *lwshp_open(const char *path);
+extern LWSHPREADER *lwshp_open_memory(const void *shp, size_t shp_len, const void *shx, size_t shx_len);
+extern void lwshp_close(LWSHPREADER *reader);
+extern size_t lwshp_count(const LWSHPREADER *reader);
+extern int lwshp_extent(const LWSHPREADER *reader, LWBOX *extent);
+extern LWGEOM *lwshp_get(const LWSHPREADER *reader, size_t index);
+extern size_t lwshp_read(const LWSHPREADER *reader, const LWBOX *box, int nthreads, LWGEOM **geoms);
+
+/**
+ * Serialized form for caches, a fixed header with the type, the flags and a
+ * float envelope ahead of the coordinates. Box tests read the header alone,
+ * the view reader references the coordinates of an aligned buffer in place.
+ * The bytes are in the byte order of the machine that wrote them.
+ */
+extern size_t lwgeom_serialized_size(const LWGEOM *obj);
+extern size_t lwgeom_write_serialized_buffer(const LWGEOM *obj, char *buf, size_t size);
+extern int lwgeom_write_serialized(const LWGEOM *obj, char **data, size_t *len);
+extern LWGEOM *lwgeom_read_serialized(const char *data, size_t len);
+extern LWGEOM *lwgeom_read_serialized_view(const char *data, size_t len);
+extern uint8_t lwserialized_type(const char *data, size_t len);
+extern int lwserialized_box(const char *data, size_t len, LWBOX *box);
+extern int lwserialized_intersects(const char *data, size_t len, const LWBOX *box);
+
+/**
+ * Compressed in-memory geometry store. Coordinates are rounded to a grid of
+ * the given decimal places and kept as varint deltas, the first vertex of a
+ * geometry relative to the origin of its block of geometries. A geometry is
+ * found by its id in constant time and decoded into a scratch that is reused
+ * from one call to the next, one scratch per thread.
+ */
+typedef struct LWSTORE LWSTORE;
+typedef struct LWSCRATCH LWSCRATCH;
+
+#define LWSTORE_NONE SIZE_MAX
+
+extern LWSTORE *lwstore_new(int precision_xy, int precision_z, int precision_m);
+extern void lwstore_free(LWSTORE *store);
+extern size_t lwstore_add(LWSTORE *store, const LWGEOM *obj);
+extern void lwstore_trim(LWSTORE *store);
+extern size_t lwstore_count(const LWSTORE *store);
+extern size_t lwstore_memory(const LWSTORE *store);
+extern LWSCRATCH *lwscratch_new(void);
+extern void lwscratch_free(LWSCRATCH *scratch);
+extern const LWGEOM *lwstore_decode(const LWSTORE *store, size_t id, LWSCRATCH *scratch);
+extern LWGEOM *lwstore_get(const LWSTORE *store, size_t id);
+
+/**
+ * Arrow C data interface, declared here as the specification allows so that
+ * no Arrow headers are needed.
+ */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE           2
+#define ARROW_FLAG_MAP_KEYS_SORTED    4
+
+struct ArrowSchema {
+	const char *format;
+	const char *name;
+	const char *metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema **children;
+	struct ArrowSchema *dictionary;
+	void (*release)(struct ArrowSchema *);
+	void *private_data;
+};
+
+struct ArrowArray {
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void **buffers;
+	struct ArrowArray **children;
+	struct ArrowArray *dictionary;
+	void (*release)(struct ArrowArray *);
+	void *private_data;
+};
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+/**
+ * GeoArrow options. SEPARATED writes one buffer per ordinate instead of
+ * interleaved coordinates, WKB writes geoarrow.wkb whatever the geometries
+ * are, BORROW lets coordinates be shared instead of copied: on output the
+ * geometries must outlive the array, on input the array must outlive the
+ * geometries.
+ */
+#define LW_GEOARROW_SEPARATED 0x01
+#define LW_GEOARROW_WKB       0x02
+#define LW_GEOARROW_BORROW    0x04
+
+extern int lwgeom_write_geoarrow(LWGEOM *const *geoms,
+				 size_t count,
+				 int options,
+				 int nthreads,
+				 struct ArrowSchema *schema,
+				 struct ArrowArray *array);
+extern size_t lwgeom_read_geoarrow(const struct ArrowSchema *schema,
+				   const struct ArrowArray *array,
+				   int options,
+				   int nthreads,
+				   LWGEOM **geoms);
 
 extern double lwgeom_prop_width(const LWGEOM *obj);
 extern double lwgeom_prop_height(const LWGEOM *obj);
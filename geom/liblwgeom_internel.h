@@ -71,6 +71,23 @@ size_t lw_str_hash(const void *str);
 
 size_t lw_nearest_pow(size_t v);
 
+// geometry construction helpers for the readers
+LWBOX lwgeom__query_envolpe(const double *pp, int npoints, int cdim);
+LWGEOM *lwgeom__new(uint8_t type, LWBOOLEAN hasz, LWBOOLEAN hasm);
+LWGEOM *lwgeom__new_points(uint8_t type, uint32_t npoints, double *pp, lwflags_t flags, LWBOOLEAN readonly);
+LWGEOM *lwgeom__add(LWGEOM *mobj, LWGEOM *obj);
+int lwgeom__is_empty(const LWGEOM *obj);
+
+// ring orientation, pp is a closed ring
+int nv_ccw(const double *pp, int npoints, int cdim);
+
+// shared by the WKB and EWKB readers and writers
+uint8_t *lwgeom__hex_decode(const char *hex, size_t len, size_t *size);
+int lwgeom__write_wkb(const LWGEOM *obj, uint8_t variant, char **data, size_t *len);
+int lwgeom__write_wkt(const LWGEOM *obj, int precision, int extended, LWSINK *sink);
+// run a sink writer into a string allocated with lwmalloc
+int lwgeom__write_text(int (*write)(const LWGEOM *, int, LWSINK *), const LWGEOM *obj, char **data, size_t *len);
+
 int lwbox_intersects(const LWBOX env1, const LWBOX env2);
 LWBOX lwbox_intersection(const LWBOX env1, const LWBOX env2);
 LWBOX lwbox_union(const LWBOX env1, const LWBOX env2);
@@ -66,80 +66,6 @@
  *  -----------------
  */
 
-/* Interleave lower bits of x and y, so the bits of x
- * are in the even positions and bits from y in the odd;
- * x and y must initially be less than 2**32 (4294967296).
- * From:  https://graphics.stanford.edu/~seander/bithacks.html#InterleaveBMN
- */
-static inline uint64_t
-interleave64(uint32_t xlo, uint32_t ylo)
-{
-	static const uint64_t B[] = {0x5555555555555555ULL,
-				     0x3333333333333333ULL,
-				     0x0F0F0F0F0F0F0F0FULL,
-				     0x00FF00FF00FF00FFULL,
-				     0x0000FFFF0000FFFFULL};
-	static const unsigned int S[] = {1, 2, 4, 8, 16};
-
-	uint64_t x = xlo;
-	uint64_t y = ylo;
-
-	x = (x | (x << S[4])) & B[4];
-	y = (y | (y << S[4])) & B[4];
-
-	x = (x | (x << S[3])) & B[3];
-	y = (y | (y << S[3])) & B[3];
-
-	x = (x | (x << S[2])) & B[2];
-	y = (y | (y << S[2])) & B[2];
-
-	x = (x | (x << S[1])) & B[1];
-	y = (y | (y << S[1])) & B[1];
-
-	x = (x | (x << S[0])) & B[0];
-	y = (y | (y << S[0])) & B[0];
-
-	return x | (y << 1);
-}
-
-/* reverse the interleave process
- * derived from http://stackoverflow.com/questions/4909263
- */
-static inline uint64_t
-deinterleave64(uint64_t interleaved)
-{
-	static const uint64_t B[] = {0x5555555555555555ULL,
-				     0x3333333333333333ULL,
-				     0x0F0F0F0F0F0F0F0FULL,
-				     0x00FF00FF00FF00FFULL,
-				     0x0000FFFF0000FFFFULL,
-				     0x00000000FFFFFFFFULL};
-	static const unsigned int S[] = {0, 1, 2, 4, 8, 16};
-
-	uint64_t x = interleaved;
-	uint64_t y = interleaved >> 1;
-
-	x = (x | (x >> S[0])) & B[0];
-	y = (y | (y >> S[0])) & B[0];
-
-	x = (x | (x >> S[1])) & B[1];
-	y = (y | (y >> S[1])) & B[1];
-
-	x = (x | (x >> S[2])) & B[2];
-	y = (y | (y >> S[2])) & B[2];
-
-	x = (x | (x >> S[3])) & B[3];
-	y = (y | (y >> S[3])) & B[3];
-
-	x = (x | (x >> S[4])) & B[4];
-	y = (y | (y >> S[4])) & B[4];
-
-	x = (x | (x >> S[5])) & B[5];
-	y = (y | (y >> S[5])) & B[5];
-
-	return x | (y << 32);
-}
-
 void
 geohashGetCoordRange(GeoHashRange *long_range, GeoHashRange *lat_range)
 {
@@ -183,6 +109,13 @@ geohashEncode(const GeoHashRange *long_range,
 	/* convert to fixed point based on the step size */
 	lat_offset *= (1ULL << step);
 	long_offset *= (1ULL << step);
+
+	/* The upper limits (and values rounding up to them) belong to the last
+	 * cell, not to a cell outside the 2 * step bits. */
+	if (lat_offset >= (1ULL << step))
+		lat_offset = (1ULL << step) - 1;
+	if (long_offset >= (1ULL << step))
+		long_offset = (1ULL << step) - 1;
 	hash->bits = interleave64(lat_offset, long_offset);
 	return 1;
 }
@@ -360,4 +293,268 @@ geohashNeighbors(const GeoHashBits *hash, GeoHashNeighbors *neighbors)
 
 	geohash_move_x(&neighbors->south_west, -1);
 	geohash_move_y(&neighbors->south_west, -1);
-}
\ No newline at end of file
+}
+
+/* --------------------------------- k-ring --------------------------------- */
+
+size_t
+geohashKRingSize(int k)
+{
+	if (k < 0)
+		return 0;
+	return (size_t)(2 * k + 1) * (size_t)(2 * k + 1);
+}
+
+static inline int64_t
+geohash_min64(int64_t a, int64_t b)
+{
+	return a < b ? a : b;
+}
+
+static inline int64_t
+geohash_max64(int64_t a, int64_t b)
+{
+	return a > b ? a : b;
+}
+
+/* Adds a signed offset to the longitude (odd) or latitude (even) bits of an
+ * interleaved hash. Filling the other lane with ones lets the carry ripple
+ * through it, the result wraps around modulo 2**step. */
+static inline uint64_t
+geohash_dilated_add(uint64_t bits, uint64_t mask, int64_t d, int lon)
+{
+	uint64_t v = (uint64_t)(d < 0 ? -d : d);
+	uint64_t dilated = lon ? interleave64(0, (uint32_t)v) : interleave64((uint32_t)v, 0);
+	if (d >= 0)
+		return ((bits | ~mask) + dilated) & mask;
+	return ((bits & mask) - dilated) & mask;
+}
+
+size_t
+geohashKRing(const GeoHashBits *hash, int k, GeoHashBits *cells, size_t *rings)
+{
+	if (hash == NULL || cells == NULL || k < 0 || hash->step == 0 || hash->step > 32)
+		return 0;
+
+	const uint8_t step = hash->step;
+	const uint64_t xmask = 0xaaaaaaaaaaaaaaaaULL >> (64 - step * 2);
+	const uint64_t ymask = 0x5555555555555555ULL >> (64 - step * 2);
+	const uint64_t x = hash->bits & xmask;
+	const uint64_t y = hash->bits & ymask;
+
+	/* Latitude does not wrap: rows past GEO_LAT_MIN/MAX are clamped away. */
+	const int64_t width = (int64_t)1 << step;
+	const int64_t ylat = (int64_t)(uint32_t)deinterleave64(hash->bits);
+	const int64_t dymin = -geohash_min64((int64_t)k, ylat);
+	const int64_t dymax = geohash_min64((int64_t)k, width - 1 - ylat);
+
+	/* Longitude wraps at the antimeridian: when the rings are wider than
+	 * the world, keep each column once. */
+	const int64_t half = geohash_min64((int64_t)k, (width - 1) / 2);
+	const int64_t dxmin = -half;
+	const int64_t dxmax = geohash_min64((int64_t)k, width - 1 - half);
+
+	size_t n = 0;
+	for (int64_t r = 0; r <= k; r++)
+	{
+		if (rings)
+			rings[r] = n;
+		for (int64_t dy = geohash_max64(-r, dymin); dy <= geohash_min64(r, dymax); dy++)
+		{
+			uint64_t row = geohash_dilated_add(y, ymask, dy, 0);
+			if (dy == -r || dy == r)
+			{
+				/* top and bottom edges, every column */
+				int64_t first = geohash_max64(-r, dxmin);
+				int64_t last = geohash_min64(r, dxmax);
+				uint64_t col = geohash_dilated_add(x, xmask, first, 1);
+				for (int64_t dx = first; dx <= last; dx++)
+				{
+					cells[n].bits = col | row;
+					cells[n].step = step;
+					n++;
+					col = ((col | ~xmask) + 2) & xmask;
+				}
+			}
+			else
+			{
+				/* left and right edges */
+				if (-r >= dxmin)
+				{
+					cells[n].bits = geohash_dilated_add(x, xmask, -r, 1) | row;
+					cells[n].step = step;
+					n++;
+				}
+				if (r <= dxmax && r != 0)
+				{
+					cells[n].bits = geohash_dilated_add(x, xmask, r, 1) | row;
+					cells[n].step = step;
+					n++;
+				}
+			}
+		}
+	}
+	if (rings)
+		rings[k + 1] = n;
+	return n;
+}
+
+/* ------------------------------ base32 string ----------------------------- */
+
+static const char geohash_base32[] = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+/* Reverse lookup of geohash_base32, upper case letters are accepted too.
+ * Invalid characters map to 0x20, which is outside the 5-bit value range. */
+static const uint8_t geohash_base32_rev[256] = {
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x20, 0x11, 0x12, 0x20, 0x13, 0x14, 0x20,
+	0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x20, 0x11, 0x12, 0x20, 0x13, 0x14, 0x20,
+	0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+};
+
+uint8_t
+geohashStepFromLength(size_t len)
+{
+	if (len > GEOHASH_STRING_MAX)
+		len = GEOHASH_STRING_MAX;
+	return (uint8_t)(len * 5 / 2);
+}
+
+size_t
+geohashLengthFromStep(uint8_t step)
+{
+	return ((size_t)step * 2 + 4) / 5;
+}
+
+void
+geohashGetStandardCoordRange(GeoHashRange *long_range, GeoHashRange *lat_range)
+{
+	long_range->max = GEO_LONG_MAX;
+	long_range->min = GEO_LONG_MIN;
+	lat_range->max = GEO_STANDARD_LAT_MAX;
+	lat_range->min = GEO_STANDARD_LAT_MIN;
+}
+
+int
+geohashEncodeStandard(double longitude, double latitude, uint8_t step, GeoHashBits *hash)
+{
+	if (hash == NULL || step > 32 || step == 0)
+		return 0;
+	if (longitude > GEO_LONG_MAX || longitude < GEO_LONG_MIN || latitude > GEO_STANDARD_LAT_MAX ||
+	    latitude < GEO_STANDARD_LAT_MIN)
+		return 0;
+
+	double cells = (double)(1ULL << step);
+	double lat_offset = (latitude - GEO_STANDARD_LAT_MIN) / (GEO_STANDARD_LAT_MAX - GEO_STANDARD_LAT_MIN) * cells;
+	double long_offset = (longitude - GEO_LONG_MIN) / (GEO_LONG_MAX - GEO_LONG_MIN) * cells;
+
+	/* The upper limits belong to the last cell. */
+	if (lat_offset >= cells)
+		lat_offset = cells - 1;
+	if (long_offset >= cells)
+		long_offset = cells - 1;
+
+	hash->step = step;
+	hash->bits = interleave64(lat_offset, long_offset);
+	return 1;
+}
+
+int
+geohashDecodeStandard(const GeoHashBits hash, GeoHashArea *area)
+{
+	GeoHashRange r[2] = {{0}};
+	geohashGetStandardCoordRange(&r[0], &r[1]);
+	return geohashDecode(r[0], r[1], hash, area);
+}
+
+/* Writes len characters of a value whose 5 * len bits are left-aligned. */
+static inline void
+geohash_base32_put(uint64_t value, size_t len, char *str)
+{
+	for (size_t i = 0; i < len; i++)
+		str[i] = geohash_base32[(value >> (5 * (len - 1 - i))) & 0x1f];
+	str[len] = '\0';
+}
+
+size_t
+geohashToBase32(const GeoHashBits hash, char *str)
+{
+	if (str == NULL || hash.step == 0 || hash.step > GEOHASH_STRING_STEP_MAX)
+		return 0;
+
+	size_t len = geohashLengthFromStep(hash.step);
+	/* pad the 2 * step bits with zeros up to a whole number of characters */
+	uint64_t value = hash.bits << (len * 5 - hash.step * 2);
+	geohash_base32_put(value, len, str);
+	return len;
+}
+
+int
+geohashFromBase32(const char *str, size_t len, GeoHashBits *hash)
+{
+	if (str == NULL || hash == NULL || len == 0 || len > GEOHASH_STRING_MAX)
+		return 0;
+
+	uint64_t value = 0;
+	uint8_t invalid = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		uint8_t v = geohash_base32_rev[(uint8_t)str[i]];
+		invalid |= v;
+		value = (value << 5) | (v & 0x1f);
+	}
+	if (invalid & 0x20)
+		return 0;
+
+	/* an odd number of bits can't be split evenly, the last one is dropped */
+	hash->step = geohashStepFromLength(len);
+	hash->bits = value >> (len * 5 - hash->step * 2);
+	return 1;
+}
+
+size_t
+geohashToBase32Batch(const GeoHashBits *hashes, size_t count, char *out, size_t stride)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		char *str = out + i * stride;
+		if (geohashLengthFromStep(hashes[i].step) >= stride || !geohashToBase32(hashes[i], str))
+		{
+			if (stride > 0)
+				str[0] = '\0';
+			continue;
+		}
+		n++;
+	}
+	return n;
+}
+
+size_t
+geohashFromBase32Batch(const char *in, size_t stride, size_t len, size_t count, GeoHashBits *hashes)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!geohashFromBase32(in + i * stride, len, &hashes[i]))
+		{
+			hashes[i].bits = 0;
+			hashes[i].step = 0;
+			continue;
+		}
+		n++;
+	}
+	return n;
+}
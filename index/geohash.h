@@ -73,6 +73,14 @@ extern "C" {
 #define GEO_LONG_MIN -180
 #define GEO_LONG_MAX 180
 
+/* Latitude limits of the standard (base32 string) geohash. */
+#define GEO_STANDARD_LAT_MIN -90
+#define GEO_STANDARD_LAT_MAX 90
+
+/* Longest base32 string handled, 12 characters = 60 bits = step 30. */
+#define GEOHASH_STRING_MAX 12
+#define GEOHASH_STRING_STEP_MAX 30
+
 typedef enum
 {
 	GEOHASH_NORTH = 0,
@@ -131,6 +139,80 @@ typedef struct {
 	} t;
 } GeoShape;
 
+/* Interleave lower bits of x and y, so the bits of x
+ * are in the even positions and bits from y in the odd;
+ * x and y must initially be less than 2**32 (4294967296).
+ * From:  https://graphics.stanford.edu/~seander/bithacks.html#InterleaveBMN
+ */
+static inline uint64_t
+interleave64(uint32_t xlo, uint32_t ylo)
+{
+	static const uint64_t B[] = {0x5555555555555555ULL,
+				     0x3333333333333333ULL,
+				     0x0F0F0F0F0F0F0F0FULL,
+				     0x00FF00FF00FF00FFULL,
+				     0x0000FFFF0000FFFFULL};
+	static const unsigned int S[] = {1, 2, 4, 8, 16};
+
+	uint64_t x = xlo;
+	uint64_t y = ylo;
+
+	x = (x | (x << S[4])) & B[4];
+	y = (y | (y << S[4])) & B[4];
+
+	x = (x | (x << S[3])) & B[3];
+	y = (y | (y << S[3])) & B[3];
+
+	x = (x | (x << S[2])) & B[2];
+	y = (y | (y << S[2])) & B[2];
+
+	x = (x | (x << S[1])) & B[1];
+	y = (y | (y << S[1])) & B[1];
+
+	x = (x | (x << S[0])) & B[0];
+	y = (y | (y << S[0])) & B[0];
+
+	return x | (y << 1);
+}
+
+/* reverse the interleave process
+ * derived from http://stackoverflow.com/questions/4909263
+ */
+static inline uint64_t
+deinterleave64(uint64_t interleaved)
+{
+	static const uint64_t B[] = {0x5555555555555555ULL,
+				     0x3333333333333333ULL,
+				     0x0F0F0F0F0F0F0F0FULL,
+				     0x00FF00FF00FF00FFULL,
+				     0x0000FFFF0000FFFFULL,
+				     0x00000000FFFFFFFFULL};
+	static const unsigned int S[] = {0, 1, 2, 4, 8, 16};
+
+	uint64_t x = interleaved;
+	uint64_t y = interleaved >> 1;
+
+	x = (x | (x >> S[0])) & B[0];
+	y = (y | (y >> S[0])) & B[0];
+
+	x = (x | (x >> S[1])) & B[1];
+	y = (y | (y >> S[1])) & B[1];
+
+	x = (x | (x >> S[2])) & B[2];
+	y = (y | (y >> S[2])) & B[2];
+
+	x = (x | (x >> S[3])) & B[3];
+	y = (y | (y >> S[3])) & B[3];
+
+	x = (x | (x >> S[4])) & B[4];
+	y = (y | (y >> S[4])) & B[4];
+
+	x = (x | (x >> S[5])) & B[5];
+	y = (y | (y >> S[5])) & B[5];
+
+	return x | (y << 32);
+}
+
 /*
  * 0:success
  * -1:failed
@@ -153,8 +235,42 @@ int geohashDecodeToLongLatType(const GeoHashBits hash, double *xy);
 int geohashDecodeToLongLatWGS84(const GeoHashBits hash, double *xy);
 void geohashNeighbors(const GeoHashBits *hash, GeoHashNeighbors *neighbors);
 
+/*
+ * All cells within k rings (Chebyshev distance) of hash, generated directly
+ * in the interleaved bit domain. Cells are written ring by ring, ring 0 being
+ * hash itself; when rings is not NULL it receives k + 2 offsets, ring r
+ * occupying cells[rings[r]] .. cells[rings[r + 1] - 1]. Longitude wraps at
+ * the antimeridian, rows beyond GEO_LAT_MIN/MAX are dropped, and no cell is
+ * written twice. cells must hold geohashKRingSize(k) entries. Returns the
+ * number of cells written.
+ */
+size_t geohashKRingSize(int k);
+size_t geohashKRing(const GeoHashBits *hash, int k, GeoHashBits *cells, size_t *rings);
+
+/*
+ * Standard base32 geohash strings.
+ *
+ * Strings carry the same interleaved bits as GeoHashBits, longitude first, 5
+ * bits per character. A step maps to ceil(2 * step / 5) characters, the
+ * padding bits are zero; a string maps to floor(5 * len / 2) steps.
+ * Interoperable strings should be produced from the standard coordinate
+ * range (latitude -90..90), see geohashEncodeStandard().
+ *
+ * The single value functions return the string length / 1 on success and 0
+ * on failure, the batch functions the number of successful entries.
+ */
+uint8_t geohashStepFromLength(size_t len);
+size_t geohashLengthFromStep(uint8_t step);
+void geohashGetStandardCoordRange(GeoHashRange *long_range, GeoHashRange *lat_range);
+int geohashEncodeStandard(double longitude, double latitude, uint8_t step, GeoHashBits *hash);
+int geohashDecodeStandard(const GeoHashBits hash, GeoHashArea *area);
+size_t geohashToBase32(const GeoHashBits hash, char *str);
+int geohashFromBase32(const char *str, size_t len, GeoHashBits *hash);
+size_t geohashToBase32Batch(const GeoHashBits *hashes, size_t count, char *out, size_t stride);
+size_t geohashFromBase32Batch(const char *in, size_t stride, size_t len, size_t count, GeoHashBits *hashes);
+
 #if defined(__cplusplus)
 }
 #endif
 
-#endif /* GEOHASH_H_ */
\ No newline at end of file
+#endif /* GEOHASH_H_ */
\ No newline at end of file
@@ -0,0 +1,428 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "ghindex.h"
+#include "geohash.h"
+#include "liblwgeom_internel.h"
+#include "lwsort.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GHINDEX_MAGIC 0x31584449484756ULL /* "VGHIDX1" */
+
+/* Earth radius in meters, the same value used by the redis geo commands. */
+#define GHINDEX_EARTH_RADIUS 6372797.560856
+
+#define GHINDEX_DEG_RAD(d) ((d) * M_PI / 180.0)
+#define GHINDEX_RAD_DEG(r) ((r) * 180.0 / M_PI)
+
+/* Serialized layout, every section is 8-byte aligned:
+ *
+ *   struct ghindex_header
+ *   uint64_t hashes[count]    geohash of each point, ascending
+ *   uint64_t fences[nfences]  hashes[i * NV_GHINDEX_FENCE]
+ *   double   xy[count * 2]    lon/lat of each point
+ *   uint64_t ids[count]       user id of each point
+ */
+struct ghindex_header {
+	uint64_t magic;
+	uint64_t count;
+	uint64_t nfences;
+	uint64_t reserved;
+};
+
+struct nv_ghindex {
+	const struct ghindex_header *head;
+	const uint64_t *hashes;
+	const uint64_t *fences;
+	const double *xy;
+	const uint64_t *ids;
+	size_t size;
+	int owned; // LW_TRUE if the block was allocated by nv_ghindex_new
+};
+
+struct ghindex_range {
+	uint64_t min; // inclusive
+	uint64_t max; // exclusive
+};
+
+static size_t
+ghindex_size(size_t count, size_t nfences)
+{
+	return sizeof(struct ghindex_header) + (count * 4 + nfences) * sizeof(uint64_t);
+}
+
+static void
+ghindex_attach(struct nv_ghindex *ix, const void *buf)
+{
+	const struct ghindex_header *head = (const struct ghindex_header *)buf;
+	ix->head = head;
+	ix->hashes = (const uint64_t *)(head + 1);
+	ix->fences = ix->hashes + head->count;
+	ix->xy = (const double *)(ix->fences + head->nfences);
+	ix->ids = (const uint64_t *)(ix->xy + head->count * 2);
+	ix->size = ghindex_size(head->count, head->nfences);
+}
+
+/* Points outside the mercator limits are clamped, the key is only used to
+ * keep nearby points close together; filtering always uses the real
+ * coordinates. */
+static uint64_t
+ghindex_hash(double lon, double lat)
+{
+	GeoHashBits hash;
+	lon = fmin(fmax(lon, GEO_LONG_MIN), nextafter(GEO_LONG_MAX, 0));
+	lat = fmin(fmax(lat, GEO_LAT_MIN), nextafter(GEO_LAT_MAX, 0));
+	if (!geohashEncodeWGS84(lon, lat, GEO_STEP_MAX, &hash))
+		return 0;
+	return hash.bits;
+}
+
+static int
+ghindex_range_cmp(const void *a, const void *b)
+{
+	const struct ghindex_range *ra = (const struct ghindex_range *)a;
+	const struct ghindex_range *rb = (const struct ghindex_range *)b;
+	if (ra->min != rb->min)
+		return ra->min < rb->min ? -1 : 1;
+	return 0;
+}
+
+// nv_ghindex_new builds a new index over count points.
+//
+// The xy array holds count lon/lat pairs, ids holds the user id of each point
+// and may be NULL, in which case the position in xy is used as the id.
+//
+// Returns NULL if the system is out of memory.
+struct nv_ghindex *
+nv_ghindex_new(const double *xy, const uint64_t *ids, size_t count)
+{
+	struct nv_ghindex *ix = (struct nv_ghindex *)lwmalloc(sizeof(struct nv_ghindex));
+	if (!ix)
+		return NULL;
+	memset(ix, 0, sizeof(struct nv_ghindex));
+
+	size_t nfences = (count + NV_GHINDEX_FENCE - 1) / NV_GHINDEX_FENCE;
+	size_t size = ghindex_size(count, nfences);
+	uint64_t *order = NULL;
+	uint64_t *block = (uint64_t *)lwmalloc(size);
+	if (!block)
+		goto oom;
+	if (count > 0)
+	{
+		order = (uint64_t *)lwmalloc(count * sizeof(uint64_t));
+		if (!order)
+			goto oom;
+	}
+
+	struct ghindex_header *head = (struct ghindex_header *)block;
+	head->magic = GHINDEX_MAGIC;
+	head->count = count;
+	head->nfences = nfences;
+	head->reserved = 0;
+	ghindex_attach(ix, block);
+	ix->owned = LW_TRUE;
+
+	/* the hashes are sorted in place, carrying the original position */
+	uint64_t *hashes = (uint64_t *)ix->hashes;
+	uint64_t *fences = (uint64_t *)ix->fences;
+	double *pxy = (double *)ix->xy;
+	uint64_t *pids = (uint64_t *)ix->ids;
+	for (size_t i = 0; i < count; i++)
+	{
+		hashes[i] = ghindex_hash(xy[i * 2], xy[i * 2 + 1]);
+		order[i] = i;
+	}
+	if (!lwsort_radix64(hashes, order, count, 1))
+		goto oom;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t src = order[i];
+		pxy[i * 2] = xy[src * 2];
+		pxy[i * 2 + 1] = xy[src * 2 + 1];
+		pids[i] = ids ? ids[src] : src;
+	}
+	for (size_t i = 0; i < nfences; i++)
+		fences[i] = hashes[i * NV_GHINDEX_FENCE];
+
+	lwfree(order);
+	return ix;
+oom:
+	lwfree(order);
+	lwfree(block);
+	lwfree(ix);
+	return NULL;
+}
+
+// nv_ghindex_open returns an index that reads directly from buf, which must
+// be a block produced by nv_ghindex_bytes() (for example a mapped file).
+//
+// The buffer is not copied and must outlive the index. Returns NULL if buf is
+// not 8-byte aligned or does not hold a valid index.
+struct nv_ghindex *
+nv_ghindex_open(const void *buf, size_t len)
+{
+	if (!buf || ((uintptr_t)buf & 7) || len < sizeof(struct ghindex_header))
+		return NULL;
+	const struct ghindex_header *head = (const struct ghindex_header *)buf;
+	if (head->magic != GHINDEX_MAGIC || head->nfences != (head->count + NV_GHINDEX_FENCE - 1) / NV_GHINDEX_FENCE)
+		return NULL;
+	if (head->count > (len - sizeof(struct ghindex_header)) / (4 * sizeof(uint64_t)) ||
+	    len < ghindex_size(head->count, head->nfences))
+		return NULL;
+
+	struct nv_ghindex *ix = (struct nv_ghindex *)lwmalloc(sizeof(struct nv_ghindex));
+	if (!ix)
+		return NULL;
+	memset(ix, 0, sizeof(struct nv_ghindex));
+	ghindex_attach(ix, buf);
+	return ix;
+}
+
+// nv_ghindex_bytes returns the contiguous block backing the index.
+const void *
+nv_ghindex_bytes(const struct nv_ghindex *ix, size_t *len)
+{
+	if (len)
+		*len = ix->size;
+	return ix->head;
+}
+
+// nv_ghindex_count returns the number of points in the index.
+size_t
+nv_ghindex_count(const struct nv_ghindex *ix)
+{
+	return ix->head->count;
+}
+
+// nv_ghindex_free frees the index. A buffer passed to nv_ghindex_open is left
+// untouched.
+void
+nv_ghindex_free(struct nv_ghindex *ix)
+{
+	if (!ix)
+		return;
+	if (ix->owned)
+		lwfree((void *)ix->head);
+	lwfree(ix);
+}
+
+/* Returns the position of the first point whose hash is >= hash. The fence
+ * directory narrows the search down to a single block. */
+static size_t
+ghindex_lower_bound(const struct nv_ghindex *ix, uint64_t hash)
+{
+	size_t lo = 0;
+	size_t hi = ix->head->nfences;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (ix->fences[mid] < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	size_t first = lo > 0 ? (lo - 1) * NV_GHINDEX_FENCE : 0;
+	size_t last = lo < ix->head->nfences ? lo * NV_GHINDEX_FENCE : ix->head->count;
+	while (first < last)
+	{
+		size_t mid = first + (last - first) / 2;
+		if (ix->hashes[mid] < hash)
+			first = mid + 1;
+		else
+			last = mid;
+	}
+	return first;
+}
+
+/* Largest step whose cells are at least as wide and high as the extent, so
+ * that the query area is covered by a cell and its 8 neighbours. Returns 0
+ * when the extent is too large for any step. */
+static uint8_t
+ghindex_estimate_step(double width, double height)
+{
+	int step = GEO_STEP_MAX;
+	if (width > 0)
+		step = LWMIN(step, (int)floor(log2((GEO_LONG_MAX - GEO_LONG_MIN) / width)));
+	if (height > 0)
+		step = LWMIN(step, (int)floor(log2((GEO_LAT_MAX - GEO_LAT_MIN) / height)));
+	return step < 1 ? 0 : (uint8_t)step;
+}
+
+/* Collects the hash ranges covering the centre cell and its neighbours,
+ * sorted and with duplicates and adjacent ranges merged. When box is not
+ * NULL, neighbour cells which do not intersect it are dropped. */
+static int
+ghindex_cover(double lon, double lat, uint8_t step, const double *box, struct ghindex_range *ranges)
+{
+	GeoHashBits center;
+	lon = fmin(fmax(lon, GEO_LONG_MIN), nextafter(GEO_LONG_MAX, 0));
+	lat = fmin(fmax(lat, GEO_LAT_MIN), nextafter(GEO_LAT_MAX, 0));
+	if (!geohashEncodeWGS84(lon, lat, step, &center))
+		return 0;
+
+	GeoHashNeighbors neighbors;
+	geohashNeighbors(&center, &neighbors);
+	const GeoHashBits cells[9] = {center,
+				      neighbors.north,
+				      neighbors.east,
+				      neighbors.west,
+				      neighbors.south,
+				      neighbors.north_east,
+				      neighbors.south_east,
+				      neighbors.north_west,
+				      neighbors.south_west};
+
+	int shift = (GEO_STEP_MAX - step) * 2;
+	int n = 0;
+	for (int i = 0; i < 9; i++)
+	{
+		if (box && i > 0)
+		{
+			GeoHashArea area;
+			if (!geohashDecodeWGS84(cells[i], &area))
+				continue;
+			if (area.longitude.min > box[2] || area.longitude.max < box[0] || area.latitude.min > box[3] ||
+			    area.latitude.max < box[1])
+				continue;
+		}
+		ranges[n].min = cells[i].bits << shift;
+		ranges[n].max = (cells[i].bits + 1) << shift;
+		n++;
+	}
+
+	qsort(ranges, n, sizeof(struct ghindex_range), ghindex_range_cmp);
+	int m = 0;
+	for (int i = 0; i < n; i++)
+	{
+		if (m > 0 && ranges[i].min <= ranges[m - 1].max)
+		{
+			ranges[m - 1].max = LWMAX(ranges[m - 1].max, ranges[i].max);
+			continue;
+		}
+		ranges[m++] = ranges[i];
+	}
+	return m;
+}
+
+static double
+ghindex_distance(double lon1d, double lat1d, double lon2d, double lat2d)
+{
+	double lat1r = GHINDEX_DEG_RAD(lat1d);
+	double lat2r = GHINDEX_DEG_RAD(lat2d);
+	double u = sin((lat2r - lat1r) / 2);
+	double v = sin(GHINDEX_DEG_RAD(lon2d - lon1d) / 2);
+	double a = u * u + cos(lat1r) * cos(lat2r) * v * v;
+	return 2.0 * GHINDEX_EARTH_RADIUS * asin(sqrt(a));
+}
+
+struct ghindex_query {
+	const double *box; // min lon, min lat, max lon, max lat
+	const double *center;
+	double radius;
+	nv_ghindex_iter iter;
+	void *udata;
+};
+
+static int
+ghindex_match(const struct ghindex_query *q, const double *xy)
+{
+	if (q->box)
+		return xy[0] >= q->box[0] && xy[0] <= q->box[2] && xy[1] >= q->box[1] && xy[1] <= q->box[3];
+	return ghindex_distance(q->center[0], q->center[1], xy[0], xy[1]) <= q->radius;
+}
+
+static int
+ghindex_scan(const struct nv_ghindex *ix, size_t first, size_t last, const struct ghindex_query *q)
+{
+	for (size_t i = first; i < last; i++)
+	{
+		if (ghindex_match(q, &ix->xy[i * 2]) && !q->iter(&ix->xy[i * 2], ix->ids[i], q->udata))
+			return LW_FALSE;
+	}
+	return LW_TRUE;
+}
+
+static void
+ghindex_search(const struct nv_ghindex *ix,
+	       double lon,
+	       double lat,
+	       double width,
+	       double height,
+	       const struct ghindex_query *q)
+{
+	uint8_t step = ghindex_estimate_step(width, height);
+	struct ghindex_range ranges[9];
+	int n = step ? ghindex_cover(lon, lat, step, q->box, ranges) : 0;
+	if (n == 0)
+	{
+		ghindex_scan(ix, 0, ix->head->count, q);
+		return;
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		size_t first = ghindex_lower_bound(ix, ranges[i].min);
+		size_t last = ghindex_lower_bound(ix, ranges[i].max);
+		if (!ghindex_scan(ix, first, last, q))
+			return;
+	}
+}
+
+// nv_ghindex_search_box iterates over every point inside the lon/lat box
+// [min, max].
+//
+// Returning LW_FALSE from the iter will stop the search.
+void
+nv_ghindex_search_box(const struct nv_ghindex *ix,
+		      const double min[],
+		      const double max[],
+		      nv_ghindex_iter iter,
+		      void *udata)
+{
+	const double box[4] = {min[0], min[1], max[0], max[1]};
+	struct ghindex_query q = {.box = box, .center = NULL, .radius = 0, .iter = iter, .udata = udata};
+	ghindex_search(ix, (min[0] + max[0]) / 2, (min[1] + max[1]) / 2, max[0] - min[0], max[1] - min[1], &q);
+}
+
+// nv_ghindex_search_radius iterates over every point within radius meters of
+// the lon/lat point xy, using the haversine distance.
+//
+// Returning LW_FALSE from the iter will stop the search.
+void
+nv_ghindex_search_radius(const struct nv_ghindex *ix,
+			 const double xy[],
+			 double radius,
+			 nv_ghindex_iter iter,
+			 void *udata)
+{
+	struct ghindex_query q = {.box = NULL, .center = xy, .radius = radius, .iter = iter, .udata = udata};
+
+	double height = GHINDEX_RAD_DEG(radius / GHINDEX_EARTH_RADIUS);
+	double coslat = cos(GHINDEX_DEG_RAD(xy[1]));
+	double width = coslat > 0 ? height / coslat : GEO_LONG_MAX - GEO_LONG_MIN;
+	ghindex_search(ix, xy[0], xy[1], width * 2, height * 2, &q);
+}
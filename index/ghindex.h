@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef GHINDEX_H
+#define GHINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/// Static point index keyed by 52-bit geohash (GEO_STEP_MAX).
+///
+/// Points are kept in flat arrays sorted by their geohash, with a sparse
+/// fence directory (one key every NV_GHINDEX_FENCE points) on top. The whole
+/// index lives in one contiguous, pointer-free block, so the buffer returned
+/// by nv_ghindex_bytes() can be written to disk and mapped back with
+/// nv_ghindex_open().
+struct nv_ghindex;
+
+#define NV_GHINDEX_FENCE 64
+
+/// The iterator callback, returning LW_FALSE stops the search.
+typedef int (*nv_ghindex_iter)(const double *xy, uint64_t id, void *udata);
+
+struct nv_ghindex *nv_ghindex_new(const double *xy, const uint64_t *ids, size_t count);
+struct nv_ghindex *nv_ghindex_open(const void *buf, size_t len);
+const void *nv_ghindex_bytes(const struct nv_ghindex *ix, size_t *len);
+size_t nv_ghindex_count(const struct nv_ghindex *ix);
+void nv_ghindex_free(struct nv_ghindex *ix);
+
+void nv_ghindex_search_box(const struct nv_ghindex *ix,
+			   const double min[],
+			   const double max[],
+			   nv_ghindex_iter iter,
+			   void *udata);
+void nv_ghindex_search_radius(const struct nv_ghindex *ix,
+			      const double xy[],
+			      double radius,
+			      nv_ghindex_iter iter,
+			      void *udata);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* GHINDEX_H */
@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LWGEOM_FLAT_H
+#define LWGEOM_FLAT_H
+
+#include <stdint.h>
+#include <string.h>
+
+/// Layout of flat layer files, shared by the reader and the writer. Every
+/// field is little endian.
+///
+///   header   FLAT_HEADER_SIZE bytes, see the FLAT_HEADER_ offsets
+///   index    packed Hilbert R-tree of FLAT_NODE_BYTES nodes, the root level
+///            first and the leaves last, one leaf per record in file order
+///   records  uint32 length and ISO WKB of one geometry, preceded by up to 7
+///            zero bytes so its first coordinate array is 8 byte aligned
+///
+/// A node is xmin, ymin, xmax, ymax and an offset. A branch stores the index
+/// of its first child, the children are the next node_size nodes of the level
+/// below. A leaf stores the position of its record relative to the first
+/// record, a record ends where the next one starts.
+
+#define FLAT_MAGIC             "LWFLAT\0\1"
+#define FLAT_MAGIC_SIZE        8
+#define FLAT_HEADER_SIZE       64
+#define FLAT_HEADER_COUNT      8  ///< uint64 number of records
+#define FLAT_HEADER_NODE_SIZE  16 ///< uint16 children per branch
+#define FLAT_HEADER_EXTENT     24 ///< 4 doubles, xmin ymin xmax ymax
+#define FLAT_HEADER_DATA_SIZE  56 ///< uint64 bytes of the record section
+#define FLAT_NODE_BYTES        40
+#define FLAT_NODE_SIZE_DEFAULT 16
+#define FLAT_LEVELS_MAX        66
+
+static inline uint64_t
+flat_load_u64(const uint8_t *p)
+{
+	uint64_t v = 0;
+	for (int i = 7; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static inline void
+flat_store_u64(uint8_t *p, uint64_t v)
+{
+	for (int i = 0; i < 8; i++, v >>= 8)
+		p[i] = (uint8_t)v;
+}
+
+static inline uint32_t
+flat_load_u32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void
+flat_store_u32(uint8_t *p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++, v >>= 8)
+		p[i] = (uint8_t)v;
+}
+
+static inline double
+flat_load_double(const uint8_t *p)
+{
+	uint64_t u = flat_load_u64(p);
+	double v;
+	memcpy(&v, &u, sizeof(double));
+	return v;
+}
+
+static inline void
+flat_store_double(uint8_t *p, double v)
+{
+	uint64_t u;
+	memcpy(&u, &v, sizeof(double));
+	flat_store_u64(p, u);
+}
+
+/// @brief node ranges of every level of the tree, level k spans nodes
+/// [bounds[2k], bounds[2k + 1]), level 0 are the leaves
+/// @return number of levels, 0 for an empty tree
+static inline int
+flat_levels(uint64_t count, uint16_t node_size, uint64_t *bounds)
+{
+	uint64_t sizes[FLAT_LEVELS_MAX];
+	int n = 0;
+	if (count == 0 || node_size < 2)
+		return 0;
+	sizes[n++] = count;
+	while (sizes[n - 1] > 1 && n < FLAT_LEVELS_MAX)
+	{
+		sizes[n] = (sizes[n - 1] + node_size - 1) / node_size;
+		n++;
+	}
+	uint64_t start = 0;
+	for (int k = n - 1; k >= 0; k--)
+	{
+		bounds[2 * k] = start;
+		start += sizes[k];
+		bounds[2 * k + 1] = start;
+	}
+	return n;
+}
+
+#endif /* LWGEOM_FLAT_H */
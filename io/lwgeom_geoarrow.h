@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LWGEOM_GEOARROW_H
+#define LWGEOM_GEOARROW_H
+
+#include "liblwgeom_internel.h"
+
+/// GeoArrow layouts, shared by the reader and the writer. A layout is named
+/// by the LWGEOM type it holds, COLLECTIONTYPE stands for geoarrow.wkb. It is
+/// up to GA_DEPTH_MAX nested lists with int32 offsets over one coordinate
+/// array:
+///
+///   point            coordinates, an empty point is all NaN
+///   linestring       vertices
+///   polygon          rings, vertices
+///   multipoint       points
+///   multilinestring  linestrings, vertices
+///   multipolygon     polygons, rings, vertices
+///
+/// Coordinates are a fixed size list of doubles named xy, xyz, xym or xyzm
+/// when interleaved, a struct of the double arrays x, y, z and m when
+/// separated. Interleaved coordinates have the layout of LWGEOM pp.
+
+#define GA_DEPTH_MAX 3
+/// rows converted per task
+#define GA_BLOCK 256
+
+#define GA_KEY_NAME     "ARROW:extension:name"
+#define GA_KEY_METADATA "ARROW:extension:metadata"
+
+static inline const char *
+ga_extension_name(uint8_t type)
+{
+	switch (type)
+	{
+	case POINTTYPE:
+		return "geoarrow.point";
+	case LINETYPE:
+		return "geoarrow.linestring";
+	case POLYTYPE:
+		return "geoarrow.polygon";
+	case MPOINTTYPE:
+		return "geoarrow.multipoint";
+	case MLINETYPE:
+		return "geoarrow.multilinestring";
+	case MPOLYTYPE:
+		return "geoarrow.multipolygon";
+	case COLLECTIONTYPE:
+		return "geoarrow.wkb";
+	default:
+		return NULL;
+	}
+}
+
+/// @brief number of nested lists above the coordinates
+static inline int
+ga_depth(uint8_t type)
+{
+	switch (type)
+	{
+	case LINETYPE:
+	case MPOINTTYPE:
+		return 1;
+	case POLYTYPE:
+	case MLINETYPE:
+		return 2;
+	case MPOLYTYPE:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+#endif /* LWGEOM_GEOARROW_H */
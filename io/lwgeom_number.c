@@ -0,0 +1,872 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "lwgeom_number.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/* ------------------------------ number parser ----------------------------- */
+
+static const double lwnumber__pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+					 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+#define LWDECIMAL_DIGITS 800
+#define LWDECIMAL_SHIFT	 60
+
+/// Arbitrary precision decimal used when the fast path cannot round exactly.
+/// The number is 0.d[0]d[1]...d[nd-1] * 10^dp, binary shifts are done on the
+/// digits directly (the simple decimal conversion algorithm).
+typedef struct {
+	uint8_t d[LWDECIMAL_DIGITS];
+	int nd;
+	int dp;
+	int trunc; ///< nonzero digits were dropped
+} lwdecimal;
+
+static void
+lwdecimal__trim(lwdecimal *a)
+{
+	while (a->nd > 0 && a->d[a->nd - 1] == 0)
+		a->nd--;
+	if (a->nd == 0)
+		a->dp = 0;
+}
+
+static void
+lwdecimal__left_shift(lwdecimal *a, unsigned k)
+{
+	uint8_t tmp[LWDECIMAL_DIGITS + 24];
+	int w = (int)sizeof(tmp);
+	uint64_t carry = 0;
+	for (int r = a->nd - 1; r >= 0; r--)
+	{
+		uint64_t n = ((uint64_t)a->d[r] << k) + carry;
+		tmp[--w] = (uint8_t)(n % 10);
+		carry = n / 10;
+	}
+	while (carry)
+	{
+		tmp[--w] = (uint8_t)(carry % 10);
+		carry /= 10;
+	}
+	int nd = (int)sizeof(tmp) - w;
+	a->dp += nd - a->nd;
+	if (nd > LWDECIMAL_DIGITS)
+	{
+		for (int i = LWDECIMAL_DIGITS; i < nd; i++)
+			a->trunc |= tmp[w + i] != 0;
+		nd = LWDECIMAL_DIGITS;
+	}
+	memcpy(a->d, tmp + w, (size_t)nd);
+	a->nd = nd;
+	lwdecimal__trim(a);
+}
+
+static void
+lwdecimal__right_shift(lwdecimal *a, unsigned k)
+{
+	int r = 0;
+	int w = 0;
+	uint64_t n = 0;
+	while ((n >> k) == 0)
+	{
+		if (r >= a->nd)
+		{
+			if (n == 0)
+			{
+				a->nd = 0;
+				return;
+			}
+			while ((n >> k) == 0)
+			{
+				n *= 10;
+				r++;
+			}
+			break;
+		}
+		n = n * 10 + a->d[r++];
+	}
+	a->dp -= r - 1;
+
+	uint64_t mask = ((uint64_t)1 << k) - 1;
+	for (; r < a->nd; r++)
+	{
+		uint8_t c = a->d[r];
+		a->d[w++] = (uint8_t)(n >> k);
+		n = (n & mask) * 10 + c;
+	}
+	while (n > 0)
+	{
+		uint8_t dig = (uint8_t)(n >> k);
+		n &= mask;
+		if (w < LWDECIMAL_DIGITS)
+			a->d[w++] = dig;
+		else if (dig > 0)
+			a->trunc = 1;
+		n *= 10;
+	}
+	a->nd = w;
+	lwdecimal__trim(a);
+}
+
+/// @brief multiply by 2^k, or divide by 2^-k
+static void
+lwdecimal__shift(lwdecimal *a, int k)
+{
+	if (a->nd == 0)
+		return;
+	for (; k > LWDECIMAL_SHIFT; k -= LWDECIMAL_SHIFT)
+		lwdecimal__left_shift(a, LWDECIMAL_SHIFT);
+	for (; k < -LWDECIMAL_SHIFT; k += LWDECIMAL_SHIFT)
+		lwdecimal__right_shift(a, LWDECIMAL_SHIFT);
+	if (k > 0)
+		lwdecimal__left_shift(a, (unsigned)k);
+	else if (k < 0)
+		lwdecimal__right_shift(a, (unsigned)-k);
+}
+
+static int
+lwdecimal__round_up(const lwdecimal *a, int nd)
+{
+	if (nd < 0 || nd >= a->nd)
+		return 0;
+	if (a->d[nd] == 5 && nd + 1 == a->nd)
+		return a->trunc || (nd > 0 && (a->d[nd - 1] & 1));
+	return a->d[nd] >= 5;
+}
+
+static uint64_t
+lwdecimal__rounded_integer(const lwdecimal *a)
+{
+	if (a->dp > 20)
+		return UINT64_MAX;
+	uint64_t n = 0;
+	int i = 0;
+	for (; i < a->dp && i < a->nd; i++)
+		n = n * 10 + a->d[i];
+	for (; i < a->dp; i++)
+		n *= 10;
+	if (lwdecimal__round_up(a, a->dp))
+		n++;
+	return n;
+}
+
+/// @brief correctly rounded conversion of the decimal to a binary64
+static double
+lwdecimal__to_double(lwdecimal *a, int negative)
+{
+	static const int powtab[] = {1, 3, 6, 9, 13, 16, 19, 23, 26};
+	const int bias = -1023;
+	int exp = 0;
+	uint64_t mant = 0;
+
+	if (a->nd == 0 || a->dp < -330)
+	{
+		exp = bias;
+	}
+	else if (a->dp > 310)
+	{
+		goto overflow;
+	}
+	else
+	{
+		while (a->dp > 0)
+		{
+			int n = a->dp >= 9 ? 27 : powtab[a->dp];
+			lwdecimal__shift(a, -n);
+			exp += n;
+		}
+		while (a->dp < 0 || (a->dp == 0 && a->d[0] < 5))
+		{
+			int n = -a->dp >= 9 ? 27 : powtab[-a->dp];
+			lwdecimal__shift(a, n);
+			exp -= n;
+		}
+		// the decimal is now in [0.5, 1), make it [1, 2)
+		exp--;
+		if (exp < bias + 1)
+		{
+			int n = bias + 1 - exp;
+			lwdecimal__shift(a, -n);
+			exp += n;
+		}
+		if (exp - bias >= 0x7ff)
+			goto overflow;
+		lwdecimal__shift(a, 53);
+		mant = lwdecimal__rounded_integer(a);
+		if (mant == (UINT64_C(2) << 52))
+		{
+			mant >>= 1;
+			exp++;
+			if (exp - bias >= 0x7ff)
+				goto overflow;
+		}
+		if (!(mant & (UINT64_C(1) << 52)))
+			exp = bias;
+	}
+	goto out;
+
+overflow:
+	mant = 0;
+	exp = 0x7ff + bias;
+
+out:;
+	uint64_t bits = mant & ((UINT64_C(1) << 52) - 1);
+	bits |= (uint64_t)((exp - bias) & 0x7ff) << 52;
+	if (negative)
+		bits |= UINT64_C(1) << 63;
+	double v;
+	memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+/// @brief read the digits of [p, end) into a decimal, the syntax has already
+/// been checked by the caller
+static void
+lwdecimal__read(lwdecimal *a, const char *p, const char *end)
+{
+	int count = 0; // significant digits, stored or dropped
+	int sawdot = 0;
+	a->nd = 0;
+	a->dp = 0;
+	a->trunc = 0;
+	for (; p < end; p++)
+	{
+		char c = *p;
+		if (c == '.')
+		{
+			sawdot = 1;
+			a->dp = count;
+			continue;
+		}
+		if (c == '0' && a->nd == 0)
+		{
+			if (sawdot)
+				a->dp--;
+			continue;
+		}
+		count++;
+		if (a->nd < LWDECIMAL_DIGITS)
+			a->d[a->nd++] = (uint8_t)(c - '0');
+		else if (c != '0')
+			a->trunc = 1;
+	}
+	if (!sawdot)
+		a->dp = count;
+	lwdecimal__trim(a);
+}
+
+static int
+lwnumber__match(const char *p, const char *end, const char *word)
+{
+	size_t n = strlen(word);
+	if ((size_t)(end - p) < n)
+		return 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if ((p[i] | 0x20) != word[i])
+			return 0;
+	}
+	return 1;
+}
+
+const char *
+lwnumber_parse(const char *str, const char *end, double *value)
+{
+	const char *p = str;
+	int negative = 0;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	if (p < end && (*p | 0x20) >= 'a' && (*p | 0x20) <= 'z')
+	{
+		if (lwnumber__match(p, end, "nan"))
+		{
+			*value = negative ? -NAN : NAN;
+			return p + 3;
+		}
+		if (lwnumber__match(p, end, "inf"))
+		{
+			*value = negative ? -INFINITY : INFINITY;
+			return p + (lwnumber__match(p, end, "infinity") ? 8 : 3);
+		}
+		return NULL;
+	}
+
+	const char *digits = p;
+	uint64_t mantissa = 0;
+	int ndigits = 0; // significant digits kept in mantissa
+	int nseen = 0;	 // all digits seen
+	int exp10 = 0;
+	int truncated = 0;
+
+	while (p < end && *p == '0')
+	{
+		p++;
+		nseen++;
+	}
+	while (p < end && (unsigned)(*p - '0') < 10)
+	{
+		if (ndigits < 19)
+		{
+			mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+			ndigits++;
+		}
+		else
+		{
+			exp10++;
+			truncated |= *p != '0';
+		}
+		p++;
+		nseen++;
+	}
+	if (p < end && *p == '.')
+	{
+		p++;
+		if (ndigits == 0)
+		{
+			while (p < end && *p == '0')
+			{
+				p++;
+				nseen++;
+				exp10--;
+			}
+		}
+		while (p < end && (unsigned)(*p - '0') < 10)
+		{
+			if (ndigits < 19)
+			{
+				mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+				ndigits++;
+				exp10--;
+			}
+			else
+			{
+				truncated |= *p != '0';
+			}
+			p++;
+			nseen++;
+		}
+	}
+	if (nseen == 0)
+		return NULL;
+	const char *digits_end = p;
+
+	int exp_given = 0;
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char *q = p + 1;
+		int eneg = 0;
+		if (q < end && (*q == '-' || *q == '+'))
+		{
+			eneg = *q == '-';
+			q++;
+		}
+		if (q < end && (unsigned)(*q - '0') < 10)
+		{
+			while (q < end && (unsigned)(*q - '0') < 10)
+			{
+				if (exp_given < 100000)
+					exp_given = exp_given * 10 + (*q - '0');
+				q++;
+			}
+			if (eneg)
+				exp_given = -exp_given;
+			p = q;
+		}
+	}
+	exp10 += exp_given;
+
+	// Clinger's fast path, exact mantissa times an exact power of ten gives a
+	// correctly rounded result with a single rounding
+	if (!truncated && mantissa <= (UINT64_C(1) << 53))
+	{
+		double v = (double)mantissa;
+		int fast = 1;
+		if (mantissa == 0)
+			exp10 = 0;
+		if (exp10 > 22 && exp10 <= 22 + 15)
+		{
+			// move the excess of the exponent into the mantissa while exact
+			uint64_t m = mantissa;
+			for (; exp10 > 22 && m <= (UINT64_C(1) << 53) / 10; exp10--)
+				m *= 10;
+			v = (double)m;
+			fast = exp10 <= 22;
+		}
+		if (fast && exp10 >= -22 && exp10 <= 22)
+		{
+			v = exp10 < 0 ? v / lwnumber__pow10[-exp10] : v * lwnumber__pow10[exp10];
+			*value = negative ? -v : v;
+			return p;
+		}
+	}
+
+	lwdecimal a;
+	lwdecimal__read(&a, digits, digits_end);
+	if (a.nd > 0)
+	{
+		// keep dp within a range that cannot overflow, the conversion
+		// saturates far before these bounds
+		long dp = (long)a.dp + exp_given;
+		a.dp = dp > 100000 ? 100000 : (dp < -100000 ? -100000 : (int)dp);
+	}
+	*value = lwdecimal__to_double(&a, negative);
+	return p;
+}
+
+/* ---------------------------- number formatting --------------------------- */
+
+/// Shortest round trip formatting with Grisu2 (Loitsch, "Printing
+/// Floating-Point Numbers Quickly and Accurately with Integers", 2010). The
+/// digits always read back to the same double, and are the shortest such
+/// digits for all but a tiny fraction of inputs.
+
+typedef struct {
+	uint64_t f;
+	int e;
+} lwdiyfp;
+
+/// normalized 10^k for k = -348, -340, ..., 340
+static const uint64_t lwnumber__cached_f[] = {
+	UINT64_C(0xfa8fd5a0081c0288), UINT64_C(0xbaaee17fa23ebf76), UINT64_C(0x8b16fb203055ac76),
+	UINT64_C(0xcf42894a5dce35ea), UINT64_C(0x9a6bb0aa55653b2d), UINT64_C(0xe61acf033d1a45df),
+	UINT64_C(0xab70fe17c79ac6ca), UINT64_C(0xff77b1fcbebcdc4f), UINT64_C(0xbe5691ef416bd60c),
+	UINT64_C(0x8dd01fad907ffc3c), UINT64_C(0xd3515c2831559a83), UINT64_C(0x9d71ac8fada6c9b5),
+	UINT64_C(0xea9c227723ee8bcb), UINT64_C(0xaecc49914078536d), UINT64_C(0x823c12795db6ce57),
+	UINT64_C(0xc21094364dfb5637), UINT64_C(0x9096ea6f3848984f), UINT64_C(0xd77485cb25823ac7),
+	UINT64_C(0xa086cfcd97bf97f4), UINT64_C(0xef340a98172aace5), UINT64_C(0xb23867fb2a35b28e),
+	UINT64_C(0x84c8d4dfd2c63f3b), UINT64_C(0xc5dd44271ad3cdba), UINT64_C(0x936b9fcebb25c996),
+	UINT64_C(0xdbac6c247d62a584), UINT64_C(0xa3ab66580d5fdaf6), UINT64_C(0xf3e2f893dec3f126),
+	UINT64_C(0xb5b5ada8aaff80b8), UINT64_C(0x87625f056c7c4a8b), UINT64_C(0xc9bcff6034c13053),
+	UINT64_C(0x964e858c91ba2655), UINT64_C(0xdff9772470297ebd), UINT64_C(0xa6dfbd9fb8e5b88f),
+	UINT64_C(0xf8a95fcf88747d94), UINT64_C(0xb94470938fa89bcf), UINT64_C(0x8a08f0f8bf0f156b),
+	UINT64_C(0xcdb02555653131b6), UINT64_C(0x993fe2c6d07b7fac), UINT64_C(0xe45c10c42a2b3b06),
+	UINT64_C(0xaa242499697392d3), UINT64_C(0xfd87b5f28300ca0e), UINT64_C(0xbce5086492111aeb),
+	UINT64_C(0x8cbccc096f5088cc), UINT64_C(0xd1b71758e219652c), UINT64_C(0x9c40000000000000),
+	UINT64_C(0xe8d4a51000000000), UINT64_C(0xad78ebc5ac620000), UINT64_C(0x813f3978f8940984),
+	UINT64_C(0xc097ce7bc90715b3), UINT64_C(0x8f7e32ce7bea5c70), UINT64_C(0xd5d238a4abe98068),
+	UINT64_C(0x9f4f2726179a2245), UINT64_C(0xed63a231d4c4fb27), UINT64_C(0xb0de65388cc8ada8),
+	UINT64_C(0x83c7088e1aab65db), UINT64_C(0xc45d1df942711d9a), UINT64_C(0x924d692ca61be758),
+	UINT64_C(0xda01ee641a708dea), UINT64_C(0xa26da3999aef774a), UINT64_C(0xf209787bb47d6b85),
+	UINT64_C(0xb454e4a179dd1877), UINT64_C(0x865b86925b9bc5c2), UINT64_C(0xc83553c5c8965d3d),
+	UINT64_C(0x952ab45cfa97a0b3), UINT64_C(0xde469fbd99a05fe3), UINT64_C(0xa59bc234db398c25),
+	UINT64_C(0xf6c69a72a3989f5c), UINT64_C(0xb7dcbf5354e9bece), UINT64_C(0x88fcf317f22241e2),
+	UINT64_C(0xcc20ce9bd35c78a5), UINT64_C(0x98165af37b2153df), UINT64_C(0xe2a0b5dc971f303a),
+	UINT64_C(0xa8d9d1535ce3b396), UINT64_C(0xfb9b7cd9a4a7443c), UINT64_C(0xbb764c4ca7a44410),
+	UINT64_C(0x8bab8eefb6409c1a), UINT64_C(0xd01fef10a657842c), UINT64_C(0x9b10a4e5e9913129),
+	UINT64_C(0xe7109bfba19c0c9d), UINT64_C(0xac2820d9623bf429), UINT64_C(0x80444b5e7aa7cf85),
+	UINT64_C(0xbf21e44003acdd2d), UINT64_C(0x8e679c2f5e44ff8f), UINT64_C(0xd433179d9c8cb841),
+	UINT64_C(0x9e19db92b4e31ba9), UINT64_C(0xeb96bf6ebadf77d9), UINT64_C(0xaf87023b9bf0ee6b),
+};
+
+static const int16_t lwnumber__cached_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+	-954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+	-688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+	-422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+	-157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+	109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+	641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+	907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static lwdiyfp
+lwdiyfp__from_double(double d)
+{
+	uint64_t u;
+	memcpy(&u, &d, sizeof(u));
+	int biased_e = (int)((u >> 52) & 0x7ff);
+	uint64_t significand = u & ((UINT64_C(1) << 52) - 1);
+	lwdiyfp r;
+	if (biased_e != 0)
+	{
+		r.f = significand | (UINT64_C(1) << 52);
+		r.e = biased_e - 1075;
+	}
+	else
+	{
+		r.f = significand;
+		r.e = -1074;
+	}
+	return r;
+}
+
+static lwdiyfp
+lwdiyfp__mul(lwdiyfp x, lwdiyfp y)
+{
+	const uint64_t m32 = 0xffffffff;
+	uint64_t a = x.f >> 32, b = x.f & m32;
+	uint64_t c = y.f >> 32, d = y.f & m32;
+	uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+	tmp += UINT64_C(1) << 31; // round
+	lwdiyfp r = {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+	return r;
+}
+
+static lwdiyfp
+lwdiyfp__normalize(lwdiyfp x)
+{
+	while (!(x.f & (UINT64_C(1) << 63)))
+	{
+		x.f <<= 1;
+		x.e--;
+	}
+	return x;
+}
+
+/// @brief boundaries m- and m+ of the rounding interval of \a v
+static void
+lwdiyfp__boundaries(lwdiyfp v, lwdiyfp *minus, lwdiyfp *plus)
+{
+	lwdiyfp pl = {(v.f << 1) + 1, v.e - 1};
+	while (!(pl.f & (UINT64_C(1) << 53)))
+	{
+		pl.f <<= 1;
+		pl.e--;
+	}
+	pl.f <<= 10;
+	pl.e -= 10;
+
+	lwdiyfp mi;
+	if (v.f == (UINT64_C(1) << 52))
+	{
+		mi.f = (v.f << 2) - 1;
+		mi.e = v.e - 2;
+	}
+	else
+	{
+		mi.f = (v.f << 1) - 1;
+		mi.e = v.e - 1;
+	}
+	mi.f <<= mi.e - pl.e;
+	mi.e = pl.e;
+	*plus = pl;
+	*minus = mi;
+}
+
+static lwdiyfp
+lwdiyfp__cached_power(int e, int *K)
+{
+	// 1/log2(10) = 0.30102999566398114
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int k = (int)dk;
+	if (dk - k > 0.0)
+		k++;
+	unsigned index = (unsigned)((k >> 3) + 1);
+	*K = -(-348 + (int)(index * 8));
+	lwdiyfp r = {lwnumber__cached_f[index], lwnumber__cached_e[index]};
+	return r;
+}
+
+static const uint64_t lwnumber__pow10_u64[] = {1,
+					      10,
+					      100,
+					      1000,
+					      10000,
+					      100000,
+					      1000000,
+					      10000000,
+					      100000000,
+					      1000000000,
+					      10000000000,
+					      100000000000,
+					      1000000000000,
+					      10000000000000,
+					      100000000000000,
+					      1000000000000000,
+					      10000000000000000,
+					      100000000000000000,
+					      1000000000000000000,
+					      10000000000000000000u};
+
+static void
+lwnumber__grisu_round(char *buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+	while (rest < wp_w && delta - rest >= ten_kappa &&
+	       (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+	{
+		buf[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+static int
+lwnumber__count_digits(uint32_t n)
+{
+	int d = 1;
+	while (d < 10 && n >= lwnumber__pow10_u64[d])
+		d++;
+	return d;
+}
+
+static void
+lwnumber__digit_gen(lwdiyfp W, lwdiyfp Mp, uint64_t delta, char *buf, int *len, int *K)
+{
+	lwdiyfp one = {UINT64_C(1) << -Mp.e, Mp.e};
+	uint64_t wp_w = Mp.f - W.f;
+	uint32_t p1 = (uint32_t)(Mp.f >> -one.e);
+	uint64_t p2 = Mp.f & (one.f - 1);
+	int kappa = lwnumber__count_digits(p1);
+	*len = 0;
+
+	while (kappa > 0)
+	{
+		uint32_t div = (uint32_t)lwnumber__pow10_u64[kappa - 1];
+		uint32_t d = p1 / div;
+		p1 %= div;
+		if (d || *len)
+			buf[(*len)++] = (char)('0' + d);
+		kappa--;
+		uint64_t tmp = ((uint64_t)p1 << -one.e) + p2;
+		if (tmp <= delta)
+		{
+			*K += kappa;
+			lwnumber__grisu_round(buf, *len, delta, tmp, lwnumber__pow10_u64[kappa] << -one.e, wp_w);
+			return;
+		}
+	}
+
+	for (;;)
+	{
+		p2 *= 10;
+		delta *= 10;
+		char d = (char)(p2 >> -one.e);
+		if (d || *len)
+			buf[(*len)++] = (char)('0' + d);
+		p2 &= one.f - 1;
+		kappa--;
+		if (p2 < delta)
+		{
+			*K += kappa;
+			int index = -kappa;
+			lwnumber__grisu_round(buf, *len, delta, p2, one.f, wp_w * (index < 20 ? lwnumber__pow10_u64[index] : 0));
+			return;
+		}
+	}
+}
+
+/// @brief digits and decimal exponent of a positive finite double
+static void
+lwnumber__grisu2(double value, char *buf, int *len, int *K)
+{
+	lwdiyfp v = lwdiyfp__from_double(value);
+	lwdiyfp w_m, w_p;
+	lwdiyfp__boundaries(v, &w_m, &w_p);
+
+	lwdiyfp c_mk = lwdiyfp__cached_power(w_p.e, K);
+	lwdiyfp W = lwdiyfp__mul(lwdiyfp__normalize(v), c_mk);
+	lwdiyfp Wp = lwdiyfp__mul(w_p, c_mk);
+	lwdiyfp Wm = lwdiyfp__mul(w_m, c_mk);
+	Wm.f++;
+	Wp.f--;
+	lwnumber__digit_gen(W, Wp, Wp.f - Wm.f, buf, len, K);
+}
+
+/// @brief lay out the digits d1..dn * 10^k as plain or exponent notation
+static int
+lwnumber__prettify(const char *digits, int len, int k, char *out)
+{
+	int kk = len + k; // 10^(kk-1) <= v < 10^kk
+	char *p = out;
+
+	if (k >= 0 && kk <= 21)
+	{
+		// 1234e7 -> 12340000000
+		memcpy(p, digits, (size_t)len);
+		p += len;
+		memset(p, '0', (size_t)k);
+		p += k;
+	}
+	else if (kk > 0 && kk <= 21)
+	{
+		// 1234e-2 -> 12.34
+		memcpy(p, digits, (size_t)kk);
+		p += kk;
+		*p++ = '.';
+		memcpy(p, digits + kk, (size_t)(len - kk));
+		p += len - kk;
+	}
+	else if (kk > -6 && kk <= 0)
+	{
+		// 1234e-6 -> 0.001234
+		*p++ = '0';
+		*p++ = '.';
+		memset(p, '0', (size_t)-kk);
+		p += -kk;
+		memcpy(p, digits, (size_t)len);
+		p += len;
+	}
+	else
+	{
+		// 1234e30 -> 1.234e33
+		*p++ = digits[0];
+		if (len > 1)
+		{
+			*p++ = '.';
+			memcpy(p, digits + 1, (size_t)(len - 1));
+			p += len - 1;
+		}
+		*p++ = 'e';
+		int e = kk - 1;
+		if (e < 0)
+		{
+			*p++ = '-';
+			e = -e;
+		}
+		if (e >= 100)
+		{
+			*p++ = (char)('0' + e / 100);
+			e %= 100;
+			*p++ = (char)('0' + e / 10);
+		}
+		else if (e >= 10)
+		{
+			*p++ = (char)('0' + e / 10);
+		}
+		*p++ = (char)('0' + e % 10);
+	}
+	*p = '\0';
+	return (int)(p - out);
+}
+
+/// @brief NaN, infinities and zero
+static int
+lwnumber__special(double v, char *buf)
+{
+	const char *s;
+	if (isnan(v))
+		s = "NaN";
+	else if (isinf(v))
+		s = v < 0 ? "-Inf" : "Inf";
+	else
+		s = signbit(v) ? "-0" : "0";
+	size_t n = strlen(s);
+	memcpy(buf, s, n + 1);
+	return (int)n;
+}
+
+int
+lwnumber_format(double v, char *buf)
+{
+	if (!isfinite(v) || v == 0.0)
+		return lwnumber__special(v, buf);
+
+	char *p = buf;
+	if (v < 0)
+	{
+		*p++ = '-';
+		v = -v;
+	}
+	char digits[20];
+	int len, K;
+	lwnumber__grisu2(v, digits, &len, &K);
+	return (int)(p - buf) + lwnumber__prettify(digits, len, K, p);
+}
+
+/// @brief \a a * 10^precision rounded half to even from the exact binary
+/// value of \a a, for products too close to a tie to trust the double
+static uint64_t
+lwnumber__round_exact(double a, int precision)
+{
+	int e;
+	uint64_t mant = (uint64_t)ldexp(frexp(a, &e), 53);
+	e -= 53;
+
+	lwdecimal d;
+	uint8_t rev[20];
+	int nd = 0;
+	for (; mant > 0; mant /= 10)
+		rev[nd++] = (uint8_t)(mant % 10);
+	for (int i = 0; i < nd; i++)
+		d.d[i] = rev[nd - 1 - i];
+	d.nd = nd;
+	d.dp = nd;
+	d.trunc = 0;
+	lwdecimal__trim(&d);
+	lwdecimal__shift(&d, e);
+	d.dp += precision;
+	return lwdecimal__rounded_integer(&d);
+}
+
+int
+lwnumber_format_precision(double v, int precision, char *buf)
+{
+	if (precision < 0 || !isfinite(v))
+		return lwnumber_format(v, buf);
+	if (precision > 19)
+		precision = 19;
+
+	// round once in integer space, then print the integer with the decimal
+	// point inserted, values too large for that have no fraction to round.
+	// The product is off by at most half an ulp, so only a fraction that
+	// close to .5 needs the exact value
+	double scaled = fabs(v) * lwnumber__pow10[precision];
+	if (!(scaled < 9.0e18))
+		return lwnumber_format(v, buf);
+	double whole = floor(scaled);
+	double rest = scaled - whole;
+	uint64_t n;
+	if (fabs(rest - 0.5) > scaled * 0x1p-52)
+		n = (uint64_t)whole + (rest > 0.5);
+	else
+		n = lwnumber__round_exact(fabs(v), precision);
+	if (n == 0)
+		return lwnumber__special(0.0, buf);
+
+	char digits[24];
+	int len = 0;
+	for (; n > 0; n /= 10)
+		digits[len++] = (char)('0' + n % 10);
+	int frac = precision;
+	int skip = 0; // trailing zeros of the fraction
+	while (skip < frac && digits[skip] == '0')
+		skip++;
+
+	char *p = buf;
+	if (v < 0)
+		*p++ = '-';
+	if (len <= frac)
+	{
+		*p++ = '0';
+	}
+	else
+	{
+		for (int i = len - 1; i >= frac; i--)
+			*p++ = digits[i];
+	}
+	if (skip < frac)
+	{
+		*p++ = '.';
+		for (int i = frac - 1; i >= skip; i--)
+			*p++ = i < len ? digits[i] : '0';
+	}
+	*p = '\0';
+	return (int)(p - buf);
+}
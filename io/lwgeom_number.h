@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LWGEOM_NUMBER_H
+#define LWGEOM_NUMBER_H
+
+#include <stddef.h>
+
+/// Number conversion shared by the text readers and writers. Nothing here
+/// depends on LC_NUMERIC, the decimal separator is always '.', and every
+/// function is reentrant.
+
+/// Buffer size large enough for any number written by lwnumber_format
+#define LWNUMBER_BUFSIZE 32
+
+/// @brief parse a decimal number from [str, end)
+/// @param str first character of the number, leading blanks are not skipped
+/// @param end end of the input
+/// @param value correctly rounded result
+/// @return pointer past the number, NULL if no number starts at \a str
+const char *lwnumber_parse(const char *str, const char *end, double *value);
+
+/// @brief write the shortest text that reads back to exactly \a v
+/// @param buf at least LWNUMBER_BUFSIZE bytes, the result is NUL terminated
+/// @return number of characters written
+int lwnumber_format(double v, char *buf);
+
+/// @brief write \a v rounded to at most \a precision decimal places, trailing
+/// zeros are not written. Ties are rounded to even on the exact binary value,
+/// as printf does. A negative precision is the same as lwnumber_format
+int lwnumber_format_precision(double v, int precision, char *buf);
+
+#endif /* LWGEOM_NUMBER_H */
@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "lwgeom_parse.h"
+
+#include <string.h>
+
+/* ------------------------------- inner parse ------------------------------ */
+
+void
+lwparse__init(lwparse *ctx, const LWPARSE_LIMITS *limits, int notice)
+{
+	memset(ctx, 0, sizeof(lwparse));
+	ctx->max_bytes = SIZE_MAX;
+	ctx->max_vertices = SIZE_MAX;
+	ctx->max_depth = LWPARSE_DEPTH_MAX;
+	ctx->notice = notice;
+	if (limits)
+	{
+		if (limits->max_bytes)
+			ctx->max_bytes = limits->max_bytes;
+		if (limits->max_vertices)
+			ctx->max_vertices = limits->max_vertices;
+		if (limits->max_depth > 0 && limits->max_depth < LWPARSE_DEPTH_MAX)
+			ctx->max_depth = limits->max_depth;
+	}
+}
+
+void
+lwparse__reset(lwparse *ctx)
+{
+	ctx->code = LW_PARSE_OK;
+	ctx->vertices = 0;
+	ctx->base = 0;
+	memset(&ctx->result, 0, sizeof(LWPARSE_RESULT));
+}
+
+void
+lwparse__fail(lwparse *ctx, const char *name, size_t offset, const char *message)
+{
+	if (ctx->result.code != LW_PARSE_OK)
+		return;
+	ctx->result.code = ctx->code ? ctx->code : LW_PARSE_SYNTAX;
+	ctx->result.offset = ctx->base + (ctx->hex ? 2 * offset : offset);
+	ctx->result.message = message;
+	if (ctx->notice)
+		lwnotice("%s parse error at offset %zu: %s", name, ctx->result.offset, message);
+}
+
+int
+lwparse__bytes(lwparse *ctx, const char *name, size_t len)
+{
+	if (len <= ctx->max_bytes)
+		return LW_TRUE;
+	ctx->code = LW_PARSE_BYTES;
+	lwparse__fail(ctx, name, ctx->max_bytes, "input longer than max_bytes");
+	return LW_FALSE;
+}
+
+int
+lwparse__text(lwparse *ctx, const char *name, const char *data, size_t *len)
+{
+	if (*len == 0)
+		*len = strnlen(data, ctx->max_bytes == SIZE_MAX ? SIZE_MAX : ctx->max_bytes + 1);
+	return lwparse__bytes(ctx, name, *len);
+}
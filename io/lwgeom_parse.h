@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef LWGEOM_PARSE_H
+#define LWGEOM_PARSE_H
+
+#include "liblwgeom_internel.h"
+
+/// Limits and outcome of one parse, shared by the readers. A reader counts
+/// vertices before it makes room for them and checks the level before it
+/// descends into a member, so a limit fails the parse where it is crossed.
+/// The public readers run with the default limits and report through
+/// lwnotice, lwgeom_parse runs them with the limits of its caller and returns
+/// the outcome in a LWPARSE_RESULT.
+
+/// deepest nesting any reader accepts, the readers recurse or keep a frame
+/// per level
+#define LWPARSE_DEPTH_MAX 64
+
+typedef struct {
+	size_t max_bytes;    ///< SIZE_MAX when not limited
+	size_t max_vertices; ///< SIZE_MAX when not limited
+	int max_depth;
+	int notice;          ///< report failures through lwnotice
+	int hex;             ///< offsets count bytes decoded from hex text
+	int code;            ///< LW_PARSE_* of a failure that is not a syntax error
+	size_t vertices;     ///< vertices counted so far
+	size_t base;         ///< input offset of the text the reader was given
+	LWPARSE_RESULT result;
+} lwparse;
+
+/// @brief set up a parse, NULL \a limits are the defaults
+void lwparse__init(lwparse *ctx, const LWPARSE_LIMITS *limits, int notice);
+
+/// @brief forget the outcome and the count of the previous geometry, the
+/// limits stay
+void lwparse__reset(lwparse *ctx);
+
+/// @brief record a failure at \a offset of the text the reader was given, the
+/// first one is kept
+/// @param name format named in the notice
+void lwparse__fail(lwparse *ctx, const char *name, size_t offset, const char *message);
+
+/// @brief check the length of binary input before anything is read
+/// @return LW_FALSE when it fails the parse
+int lwparse__bytes(lwparse *ctx, const char *name, size_t len);
+
+/// @brief as lwparse__bytes for text, where a \a len of 0 stands for a NUL
+/// terminated string. The terminator is not searched past max_bytes
+int lwparse__text(lwparse *ctx, const char *name, const char *data, size_t *len);
+
+/// @brief count \a n more vertices, called before room is made for them
+/// @return NULL, or the message to fail with
+static inline const char *
+lwparse__vertices(lwparse *ctx, size_t n)
+{
+	if (n <= ctx->max_vertices - ctx->vertices)
+	{
+		ctx->vertices += n;
+		return NULL;
+	}
+	ctx->code = LW_PARSE_VERTICES;
+	return "too many vertices";
+}
+
+/// @brief check the level of a geometry about to be read, 0 for the
+/// outermost one
+/// @return NULL, or the message to fail with
+static inline const char *
+lwparse__depth(lwparse *ctx, int depth)
+{
+	if (depth <= ctx->max_depth)
+		return NULL;
+	ctx->code = LW_PARSE_DEPTH;
+	return "geometry nested too deeply";
+}
+
+/// @return the message to fail with after an allocation failed
+static inline const char *
+lwparse__nomem(lwparse *ctx)
+{
+	ctx->code = LW_PARSE_MEMORY;
+	return "out of memory";
+}
+
+// the readers with their limits and outcome in ctx
+LWGEOM *lwgeom__read_wkt(const char *data, size_t len, lwparse *ctx);
+LWGEOM *lwgeom__read_ewkt(const char *data, size_t len, lwparse *ctx);
+LWGEOM *lwgeom__read_wkb(const uint8_t *data, size_t len, int borrow, lwparse *ctx);
+LWGEOM *lwgeom__read_hexwkb(const char *data, size_t len, lwparse *ctx);
+LWGEOM *lwgeom__read_ewkb(const char *data, size_t len, lwparse *ctx);
+LWGEOM *lwgeom__read_geojson(const char *data, size_t len, lwparse *ctx);
+LWGEOM *lwgeom__read_twkb(const char *data, size_t len, lwparse *ctx);
+LWGEOM *lwgeom__read_polyline(const char *data, size_t len, int precision, lwparse *ctx);
+LWGEOM *lwgeom__read_serialized(const char *data, size_t len, int borrow, lwparse *ctx);
+
+#endif /* LWGEOM_PARSE_H */
@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LWGEOM_SERIALIZED_H
+#define LWGEOM_SERIALIZED_H
+
+#include <stdint.h>
+#include <string.h>
+
+/// Layout of the serialized form, shared by the reader and the writer. Every
+/// field is in the byte order of the machine, the form is meant for caches and
+/// not for exchange.
+///
+///   header   uint32 size of the whole serialization, uint8 type, uint8
+///            flags and two zero bytes
+///   box      float xmin, ymin, xmax, ymax rounded outwards, present unless
+///            the geometry is a point or empty
+///   body     uint32 type and uint32 count, the vertices of a point or a
+///            linestring, for a polygon the vertex count of every ring padded
+///            to 8 bytes and then the rings, for a collection its members
+///
+/// Every part is a multiple of 8 bytes so that coordinates in a buffer that is
+/// 8 byte aligned can be referenced in place.
+
+#define SER_HEADER_SIZE 8
+#define SER_BOX_SIZE    16
+#define SER_FLAG_Z      0x01
+#define SER_FLAG_M      0x02
+#define SER_FLAG_BOX    0x04
+
+static inline uint32_t
+ser_load_u32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void
+ser_store_u32(uint8_t *p, uint32_t v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+#endif /* LWGEOM_SERIALIZED_H */
@@ -0,0 +1,406 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "lwgeom_sink.h"
+
+#include "lwgeom_number.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/* ------------------------------- inner sink ------------------------------- */
+
+void
+lwsink__init(LWSINK *sink, int kind, char *data, size_t len, size_t capacity)
+{
+	memset(sink, 0, offsetof(LWSINK, spill));
+	sink->kind = kind;
+	sink->status = LW_SINK_OK;
+	sink->data = data;
+	sink->len = len;
+	sink->capacity = capacity;
+	sink->base = data;
+	sink->size = capacity;
+	sink->fd = -1;
+}
+
+/// @brief hand the staged chunk on, the chunk is emptied even on failure
+static void
+sink_flush_chunk(LWSINK *sink)
+{
+	const char *p = sink->data;
+	size_t n = sink->len;
+	sink->passed += n;
+	sink->len = 0;
+	if (n == 0 || sink->status != LW_SINK_OK)
+		return;
+
+	switch (sink->kind)
+	{
+	case LWSINK_FD:
+		while (n > 0)
+		{
+			ssize_t w = write(sink->fd, p, n);
+			if (w < 0 && errno == EINTR)
+				continue;
+			if (w <= 0)
+			{
+				sink->status = LW_SINK_ERROR;
+				return;
+			}
+			p += w;
+			n -= (size_t)w;
+		}
+		break;
+	case LWSINK_FILE:
+		if (fwrite(p, 1, n, sink->file) != n)
+			sink->status = LW_SINK_ERROR;
+		break;
+	case LWSINK_CALLBACK:
+		if (!sink->func(p, n, sink->udata))
+			sink->status = LW_SINK_ERROR;
+		break;
+	default:
+		break;
+	}
+}
+
+char *
+lwsink__make_room(LWSINK *sink, size_t n)
+{
+	if (sink->status == LW_SINK_ERROR)
+		return NULL;
+
+	switch (sink->kind)
+	{
+	case LWSINK_BUFFER: {
+		size_t capacity = sink->capacity ? sink->capacity : 256;
+		while (sink->len + n >= capacity)
+			capacity *= 2;
+		char *data = (char *)lwrealloc(sink->data, capacity);
+		if (data == NULL)
+		{
+			sink->status = LW_SINK_ERROR;
+			return NULL;
+		}
+		sink->data = data;
+		sink->capacity = capacity;
+		break;
+	}
+	case LWSINK_FIXED:
+		if (sink->status == LW_SINK_OK)
+		{
+			// keep what fits and count the rest in the spill area
+			sink->kept = sink->len;
+			sink->base[sink->kept] = '\0';
+			sink->passed = sink->len;
+			sink->data = sink->spill;
+			sink->capacity = sizeof(sink->spill);
+			sink->status = LW_SINK_OVERFLOW;
+		}
+		else
+			sink->passed += sink->len;
+		sink->len = 0;
+		break;
+	default:
+		sink_flush_chunk(sink);
+		if (sink->status != LW_SINK_OK)
+			return NULL;
+		break;
+	}
+	return sink->data + sink->len;
+}
+
+void
+lwsink__append(LWSINK *sink, const char *str, size_t n)
+{
+	while (n > 0)
+	{
+		size_t take = sink->kind == LWSINK_BUFFER ? n : LWMIN(n, (size_t)LWSINK_RESERVE_MAX);
+		char *p = lwsink__reserve(sink, take);
+		if (p == NULL)
+			return;
+		memcpy(p, str, take);
+		lwsink__commit(sink, take);
+		str += take;
+		n -= take;
+	}
+}
+
+void
+lwsink__append_str(LWSINK *sink, const char *str)
+{
+	lwsink__append(sink, str, strlen(str));
+}
+
+int
+lwsink__end(LWSINK *sink, size_t mark)
+{
+	if (sink->status == LW_SINK_OK)
+		return LW_SUCCESS;
+	if (sink->kind == LWSINK_BUFFER || (sink->kind == LWSINK_FIXED && sink->status == LW_SINK_ERROR))
+	{
+		sink->len = mark;
+		sink->status = LW_SINK_OK;
+	}
+	return LW_FAILURE;
+}
+
+void
+lwsink__write_points(LWSINK *sink, const LWGEOM *obj, int ndim, int precision, char cs, char ts)
+{
+	int cdim = lwgeom_dim_coordinate(obj);
+	const double *pp = obj->pp;
+	for (uint32_t i = 0; i < obj->npoints; i++, pp += cdim)
+	{
+		// one reservation per point, every number fits LWNUMBER_BUFSIZE
+		char *p = lwsink__reserve(sink, (size_t)ndim * (LWNUMBER_BUFSIZE + 1) + 1);
+		if (p == NULL)
+			return;
+		char *start = p;
+		if (i > 0)
+			*p++ = ts;
+		for (int k = 0; k < ndim; k++)
+		{
+			if (k > 0)
+				*p++ = cs;
+			p += lwnumber_format_precision(pp[k], precision, p);
+		}
+		lwsink__commit(sink, (size_t)(p - start));
+	}
+}
+
+/// @brief run the sink writer \a write into a string of its own, allocated
+/// with lwmalloc
+int
+lwgeom__write_text(int (*write)(const LWGEOM *, int, LWSINK *), const LWGEOM *obj, char **data, size_t *len)
+{
+	if (obj == NULL || data == NULL)
+		return LW_FAILURE;
+
+	LWSINK sink;
+	lwsink__init(&sink, LWSINK_BUFFER, NULL, 0, 0);
+	if (!write(obj, -1, &sink) || lwsink_data(&sink, NULL) == NULL)
+	{
+		lwfree(sink.data);
+		return LW_FAILURE;
+	}
+	*data = sink.data;
+	if (len)
+		*len = sink.len;
+	return LW_SUCCESS;
+}
+
+/* ------------------------------- output sink ------------------------------ */
+
+static LWSINK *
+sink_new(int kind)
+{
+	LWSINK *sink = (LWSINK *)lwmalloc(sizeof(LWSINK) + LWSINK_CHUNK_SIZE);
+	if (sink == NULL)
+		return NULL;
+	lwsink__init(sink, kind, (char *)(sink + 1), 0, LWSINK_CHUNK_SIZE);
+	return sink;
+}
+
+/// @brief a sink that collects the text in a buffer, the buffer is kept by
+/// lwsink_reset so that it grows once to fit the largest output
+/// @param capacity initial size, 0 to allocate on the first write
+LWSINK *
+lwsink_buffer(size_t capacity)
+{
+	LWSINK *sink = (LWSINK *)lwmalloc(sizeof(LWSINK));
+	if (sink == NULL)
+		return NULL;
+	char *data = NULL;
+	if (capacity > 0 && (data = (char *)lwmalloc(capacity)) == NULL)
+	{
+		lwfree(sink);
+		return NULL;
+	}
+	lwsink__init(sink, LWSINK_BUFFER, data, 0, data ? capacity : 0);
+	return sink;
+}
+
+/// @brief a sink that writes into \a buf and never allocates. Output that
+/// does not fit sets LW_SINK_OVERFLOW and is counted by lwsink_size
+/// @param size size of \a buf, the text is always NUL terminated
+LWSINK *
+lwsink_fixed(char *buf, size_t size)
+{
+	if (buf == NULL || size == 0)
+		return NULL;
+	LWSINK *sink = (LWSINK *)lwmalloc(sizeof(LWSINK));
+	if (sink == NULL)
+		return NULL;
+	lwsink__init(sink, LWSINK_FIXED, buf, 0, size);
+	buf[0] = '\0';
+	return sink;
+}
+
+/// @brief a sink that writes to \a fd in chunks, the descriptor stays open
+LWSINK *
+lwsink_fd(int fd)
+{
+	if (fd < 0)
+		return NULL;
+	LWSINK *sink = sink_new(LWSINK_FD);
+	if (sink)
+		sink->fd = fd;
+	return sink;
+}
+
+/// @brief a sink that writes to \a file in chunks, the stream stays open
+LWSINK *
+lwsink_file(FILE *file)
+{
+	if (file == NULL)
+		return NULL;
+	LWSINK *sink = sink_new(LWSINK_FILE);
+	if (sink)
+		sink->file = file;
+	return sink;
+}
+
+/// @brief a sink that hands chunks of a few kilobytes to \a func
+LWSINK *
+lwsink_callback(lwgeom_text_sink func, void *udata)
+{
+	if (func == NULL)
+		return NULL;
+	LWSINK *sink = sink_new(LWSINK_CALLBACK);
+	if (sink)
+	{
+		sink->func = func;
+		sink->udata = udata;
+	}
+	return sink;
+}
+
+/// @brief write \a len bytes as they are, for separators between geometries
+int
+lwsink_write(LWSINK *sink, const char *data, size_t len)
+{
+	if (sink == NULL || (data == NULL && len > 0))
+		return LW_FAILURE;
+	lwsink__append(sink, data, len);
+	return sink->status == LW_SINK_OK ? LW_SUCCESS : LW_FAILURE;
+}
+
+/// @brief hand staged text of a streaming sink on, memory sinks have nothing
+/// to do
+int
+lwsink_flush(LWSINK *sink)
+{
+	if (sink == NULL)
+		return LW_FAILURE;
+	if (sink->kind != LWSINK_BUFFER && sink->kind != LWSINK_FIXED)
+	{
+		sink_flush_chunk(sink);
+		if (sink->kind == LWSINK_FILE && sink->status == LW_SINK_OK && fflush(sink->file) != 0)
+			sink->status = LW_SINK_ERROR;
+	}
+	return sink->status == LW_SINK_OK ? LW_SUCCESS : LW_FAILURE;
+}
+
+/// @brief LW_SINK_OK, LW_SINK_OVERFLOW when a fixed buffer is full or
+/// LW_SINK_ERROR when writing failed
+int
+lwsink_status(const LWSINK *sink)
+{
+	return sink ? sink->status : LW_SINK_ERROR;
+}
+
+/// @brief bytes written since the sink was made or reset, for a fixed sink
+/// this includes the bytes that did not fit
+size_t
+lwsink_size(const LWSINK *sink)
+{
+	return sink ? sink->passed + sink->len : 0;
+}
+
+/// @brief the NUL terminated text of a memory sink, NULL for streaming ones.
+/// The pointer is valid until the next write
+/// @param len receives the text length, may be NULL
+const char *
+lwsink_data(LWSINK *sink, size_t *len)
+{
+	if (len)
+		*len = 0;
+	if (sink == NULL)
+		return NULL;
+
+	switch (sink->kind)
+	{
+	case LWSINK_BUFFER:
+		if (lwsink__reserve(sink, 0) == NULL)
+			return NULL;
+		break;
+	case LWSINK_FIXED:
+		if (sink->status == LW_SINK_OVERFLOW)
+		{
+			if (len)
+				*len = sink->kept;
+			return sink->base;
+		}
+		break;
+	default:
+		return NULL;
+	}
+	sink->data[sink->len] = '\0';
+	if (len)
+		*len = sink->len;
+	return sink->data;
+}
+
+/// @brief empty the sink and clear its status, memory is kept and staged
+/// text of streaming sinks is dropped
+void
+lwsink_reset(LWSINK *sink)
+{
+	if (sink == NULL)
+		return;
+	if (sink->kind == LWSINK_FIXED)
+	{
+		sink->data = sink->base;
+		sink->capacity = sink->size;
+		sink->base[0] = '\0';
+	}
+	sink->len = 0;
+	sink->passed = 0;
+	sink->kept = 0;
+	sink->status = LW_SINK_OK;
+}
+
+/// @brief flush a streaming sink and release it, neither the descriptor nor
+/// the stream is closed
+void
+lwsink_free(LWSINK *sink)
+{
+	if (sink == NULL)
+		return;
+	if (sink->kind == LWSINK_BUFFER)
+		lwfree(sink->data);
+	else if (sink->kind != LWSINK_FIXED)
+		sink_flush_chunk(sink);
+	lwfree(sink);
+}
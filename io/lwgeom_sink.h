@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LWGEOM_SINK_H
+#define LWGEOM_SINK_H
+
+#include "liblwgeom_internel.h"
+
+/// Output sinks shared by the text writers. A writer asks for room with
+/// lwsink__reserve, formats into it and advances with lwsink__commit, so a
+/// coordinate costs no call and no copy whatever the sink is.
+///
+///   buffer    grows with lwrealloc and is kept across writes
+///   fixed     a caller buffer, when it fills up the sink keeps counting so
+///             that lwsink_size tells how much room the output needs
+///   fd, FILE  text is staged in a chunk and written whenever it fills up
+///   callback  the same chunk handed to a lwgeom_text_sink
+
+/// bytes staged by streaming sinks before they are written
+#define LWSINK_CHUNK_SIZE 4096
+/// largest reservation a writer may ask for, one point of four ordinates and
+/// its separators fits with ample room
+#define LWSINK_RESERVE_MAX 256
+
+enum {
+	LWSINK_BUFFER = 1,
+	LWSINK_FIXED,
+	LWSINK_FD,
+	LWSINK_FILE,
+	LWSINK_CALLBACK,
+};
+
+struct LWSINK {
+	char *data;      ///< text of memory sinks, the staged chunk of the others
+	size_t len;      ///< bytes in use of data
+	size_t capacity; ///< size of data, one byte is always left for a NUL
+	size_t passed;   ///< bytes handed on, or counted after an overflow
+	char *base;      ///< the caller buffer of a fixed sink
+	size_t size;     ///< size of base
+	size_t kept;     ///< bytes of base in use once it overflowed
+	int kind;
+	int status;
+	int fd;
+	FILE *file;
+	lwgeom_text_sink func;
+	void *udata;
+	char spill[LWSINK_RESERVE_MAX];
+};
+
+/// @brief set up a sink that lives on the stack, \a data is the growable
+/// buffer of a LWSINK_BUFFER sink and the chunk of a streaming one
+void lwsink__init(LWSINK *sink, int kind, char *data, size_t len, size_t capacity);
+
+/// @brief slow path of lwsink__reserve, returns NULL once the sink failed
+char *lwsink__make_room(LWSINK *sink, size_t n);
+
+/// @brief room for \a n more bytes, \a n is at most LWSINK_RESERVE_MAX unless
+/// the sink is a buffer
+static inline char *
+lwsink__reserve(LWSINK *sink, size_t n)
+{
+	if (sink->len + n < sink->capacity)
+		return sink->data + sink->len;
+	return lwsink__make_room(sink, n);
+}
+
+static inline void
+lwsink__commit(LWSINK *sink, size_t n)
+{
+	sink->len += n;
+}
+
+void lwsink__append(LWSINK *sink, const char *str, size_t n);
+void lwsink__append_str(LWSINK *sink, const char *str);
+
+/// @brief mark the write as failed, streaming sinks stay failed because part
+/// of the output is already gone
+static inline void
+lwsink__fail(LWSINK *sink)
+{
+	sink->status = LW_SINK_ERROR;
+}
+
+/// @brief position to give back to lwsink__end
+static inline size_t
+lwsink__begin(const LWSINK *sink)
+{
+	return sink->len;
+}
+
+/// @brief finish a write that started at \a mark, a failed write into memory
+/// is taken back so that the sink can take the next geometry
+int lwsink__end(LWSINK *sink, size_t mark);
+
+/// @brief write the points of \a obj, \a ndim ordinates each, ordinates are
+/// separated by \a cs and points by \a ts
+void lwsink__write_points(LWSINK *sink, const LWGEOM *obj, int ndim, int precision, char cs, char ts);
+
+#endif /* LWGEOM_SINK_H */
@@ -0,0 +1,621 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+
+#include <math.h>
+#include <string.h>
+
+/* ------------------------------ inner store ------------------------------- */
+
+/// geometries sharing one origin and one base offset
+#define STORE_BLOCK 64
+/// longest varint, enough for 64 bits
+#define STORE_VARINT_MAX 10
+/// largest grid value, deltas then stay well inside 64 bits
+#define STORE_GRID_MAX 4611686018427387904.0
+/// header bits next to the type in the low three bits
+#define STORE_HAS_Z 0x08
+#define STORE_HAS_M 0x10
+
+typedef struct {
+	uint64_t base;     ///< first byte of the block in data
+	int64_t origin[2]; ///< grid x and y the first vertex of a geometry is relative to
+} store_block;
+
+struct LWSTORE {
+	uint8_t *data;
+	size_t len;
+	size_t capacity;
+	store_block *blocks;
+	uint32_t *offsets; ///< start of every geometry within its block
+	size_t count;
+	size_t slots;     ///< capacity of offsets
+	size_t nblocks;
+	size_t block_capacity;
+	double scale[4];  ///< grid cells per unit for x, y, z and m
+	double mul[4];    ///< an ordinate is q * mul / div, one of them is 1
+	double div[4];
+};
+
+struct LWSCRATCH {
+	LWGEOM *nodes;
+	size_t *coord_at; ///< start of the coordinates of a node
+	size_t *child_at; ///< start of the children of a node
+	size_t nnodes;
+	size_t node_capacity;
+	size_t *children; ///< node indices, turned into pointers at the end
+	LWGEOM **ptrs;
+	size_t nchildren;
+	size_t child_capacity;
+	double *coords;
+	size_t ncoords;
+	size_t coord_capacity;
+};
+
+static void *
+store_grow(void *data, size_t *capacity, size_t need, size_t size)
+{
+	if (need <= *capacity)
+		return data;
+	size_t n = *capacity ? *capacity : 16;
+	while (n < need)
+		n *= 2;
+	void *grown = lwrealloc(data, n * size);
+	if (grown)
+		*capacity = n;
+	return grown;
+}
+
+static inline uint8_t *
+store_put_varint(uint8_t *p, uint64_t v)
+{
+	while (v >= 0x80)
+	{
+		*p++ = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+static inline uint8_t *
+store_put_delta(uint8_t *p, int64_t delta)
+{
+	return store_put_varint(p, (uint64_t)delta << 1 ^ (uint64_t)(delta >> 63));
+}
+
+/// @brief decode a varint written by the store, the data is trusted
+static inline __attribute__((always_inline)) uint64_t
+store_get_varint(const uint8_t **cur)
+{
+	const uint8_t *p = *cur;
+	uint64_t b = *p++;
+	uint64_t v = b & 0x7f;
+	for (int shift = 7; b >= 0x80; shift += 7)
+	{
+		b = *p++;
+		v |= (b & 0x7f) << shift;
+	}
+	*cur = p;
+	return v;
+}
+
+static inline int64_t
+store_get_delta(const uint8_t **cur)
+{
+	uint64_t v = store_get_varint(cur);
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/// @brief room for \a n more bytes of data
+static uint8_t *
+store_reserve(LWSTORE *store, size_t n)
+{
+	uint8_t *data = (uint8_t *)store_grow(store->data, &store->capacity, store->len + n, 1);
+	if (data == NULL)
+		return NULL;
+	store->data = data;
+	return data + store->len;
+}
+
+/// @brief ordinate slots of a vertex, x and y then z and m when present
+static void
+store_slots(int hasz, int hasm, int slot[4])
+{
+	int k = 2;
+	slot[0] = 0;
+	slot[1] = 1;
+	if (hasz)
+		slot[k++] = 2;
+	if (hasm)
+		slot[k++] = 3;
+}
+
+/// @brief append the vertices of \a obj as deltas from \a last
+static int
+store_put_points(LWSTORE *store, const LWGEOM *obj, int64_t last[4])
+{
+	int cdim = lwgeom_dim_coordinate(obj);
+	int slot[4];
+	store_slots(lwgeom_has_z(obj), lwgeom_has_m(obj), slot);
+	uint8_t *p = store_reserve(store, STORE_VARINT_MAX + (size_t)obj->npoints * cdim * STORE_VARINT_MAX);
+	if (p == NULL)
+		return LW_FAILURE;
+	uint8_t *start = p;
+	p = store_put_varint(p, obj->npoints);
+	const double *pp = obj->pp;
+	for (uint32_t i = 0; i < obj->npoints; i++)
+	{
+		for (int k = 0; k < cdim; k++)
+		{
+			int s = slot[k];
+			double q = round(*pp++ * store->scale[s]);
+			if (!(fabs(q) < STORE_GRID_MAX))
+				return LW_FAILURE;
+			p = store_put_delta(p, (int64_t)q - last[s]);
+			last[s] = (int64_t)q;
+		}
+	}
+	store->len += (size_t)(p - start);
+	return LW_SUCCESS;
+}
+
+static int
+store_put_count(LWSTORE *store, uint64_t n)
+{
+	uint8_t *p = store_reserve(store, STORE_VARINT_MAX);
+	if (p == NULL)
+		return LW_FAILURE;
+	store->len += (size_t)(store_put_varint(p, n) - p);
+	return LW_SUCCESS;
+}
+
+static int
+store_put_geometry(LWSTORE *store, const LWGEOM *obj, int64_t last[4])
+{
+	uint8_t *p = store_reserve(store, 1);
+	if (p == NULL)
+		return LW_FAILURE;
+	*p = (uint8_t)(obj->type | (lwgeom_has_z(obj) ? STORE_HAS_Z : 0) | (lwgeom_has_m(obj) ? STORE_HAS_M : 0));
+	store->len++;
+
+	switch (obj->type)
+	{
+	case POINTTYPE:
+	case LINETYPE:
+		return store_put_points(store, obj, last);
+	case POLYTYPE:
+		if (!store_put_count(store, obj->ngeoms))
+			return LW_FAILURE;
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			if (!store_put_points(store, obj->geoms[i], last))
+				return LW_FAILURE;
+		}
+		return LW_SUCCESS;
+	case MPOINTTYPE:
+	case MLINETYPE:
+	case MPOLYTYPE:
+	case COLLECTIONTYPE:
+		if (!store_put_count(store, obj->ngeoms))
+			return LW_FAILURE;
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			if (!store_put_geometry(store, obj->geoms[i], last))
+				return LW_FAILURE;
+		}
+		return LW_SUCCESS;
+	default:
+		return LW_FAILURE;
+	}
+}
+
+/// @brief a node of the scratch with its place among the children of its
+/// parent already reserved
+static size_t
+store_node(LWSCRATCH *scratch, uint8_t type, lwflags_t flags)
+{
+	size_t need = scratch->nnodes + 1;
+	size_t capacity = scratch->node_capacity;
+	LWGEOM *nodes = (LWGEOM *)store_grow(scratch->nodes, &capacity, need, sizeof(LWGEOM));
+	if (nodes == NULL)
+		return SIZE_MAX;
+	scratch->nodes = nodes;
+	if (capacity != scratch->node_capacity)
+	{
+		size_t *coord_at = (size_t *)lwrealloc(scratch->coord_at, capacity * sizeof(size_t));
+		if (coord_at)
+			scratch->coord_at = coord_at;
+		size_t *child_at = (size_t *)lwrealloc(scratch->child_at, capacity * sizeof(size_t));
+		if (child_at)
+			scratch->child_at = child_at;
+		if (coord_at == NULL || child_at == NULL)
+			return SIZE_MAX;
+		scratch->node_capacity = capacity;
+	}
+	size_t index = scratch->nnodes++;
+	LWGEOM *node = &scratch->nodes[index];
+	memset(node, 0, sizeof(LWGEOM));
+	node->type = type;
+	node->flags = flags | LW_FLAG_READONLY;
+	scratch->coord_at[index] = scratch->ncoords;
+	scratch->child_at[index] = scratch->nchildren;
+	return index;
+}
+
+static int
+store_get_points(const LWSTORE *store, LWSCRATCH *scratch, size_t index, const uint8_t **cur, int64_t last[4])
+{
+	LWGEOM *node = &scratch->nodes[index];
+	int hasz = lwgeom_has_z(node), hasm = lwgeom_has_m(node);
+	int cdim = 2 + hasz + hasm;
+	uint32_t n = (uint32_t)store_get_varint(cur);
+	if (n == 0)
+		return LW_SUCCESS;
+	size_t need = scratch->ncoords + (size_t)n * cdim;
+	double *coords = (double *)store_grow(scratch->coords, &scratch->coord_capacity, need, sizeof(double));
+	if (coords == NULL)
+		return LW_FAILURE;
+	scratch->coords = coords;
+	node->npoints = n;
+
+	int slot[4];
+	store_slots(hasz, hasm, slot);
+	double *out = coords + scratch->ncoords;
+	const uint8_t *p = *cur;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		for (int k = 0; k < cdim; k++)
+		{
+			int s = slot[k];
+			last[s] += store_get_delta(&p);
+			*out++ = (double)last[s] * store->mul[s] / store->div[s];
+		}
+	}
+	*cur = p;
+	scratch->ncoords = need;
+	return LW_SUCCESS;
+}
+
+/// @brief room for the children of \a index, filled in by the caller
+static size_t
+store_children(LWSCRATCH *scratch, size_t index, uint32_t n)
+{
+	if (n == 0)
+		return scratch->nchildren;
+	size_t capacity = scratch->child_capacity;
+	size_t need = scratch->nchildren + n;
+	size_t *children = (size_t *)store_grow(scratch->children, &capacity, need, sizeof(size_t));
+	if (children == NULL)
+		return SIZE_MAX;
+	scratch->children = children;
+	if (capacity != scratch->child_capacity)
+	{
+		LWGEOM **ptrs = (LWGEOM **)lwrealloc(scratch->ptrs, capacity * sizeof(LWGEOM *));
+		if (ptrs == NULL)
+			return SIZE_MAX;
+		scratch->ptrs = ptrs;
+		scratch->child_capacity = capacity;
+	}
+	size_t at = scratch->nchildren;
+	scratch->child_at[index] = at;
+	scratch->nodes[index].ngeoms = n;
+	scratch->nchildren = need;
+	return at;
+}
+
+static size_t
+store_get_geometry(const LWSTORE *store, LWSCRATCH *scratch, const uint8_t **cur, int64_t last[4])
+{
+	uint8_t head = *(*cur)++;
+	uint8_t type = head & 0x07;
+	lwflags_t flags = 0;
+	LWFLAGS_SET_Z(flags, (head & STORE_HAS_Z) != 0);
+	LWFLAGS_SET_M(flags, (head & STORE_HAS_M) != 0);
+	size_t index = store_node(scratch, type, flags);
+	if (index == SIZE_MAX)
+		return SIZE_MAX;
+	if (type == POINTTYPE || type == LINETYPE)
+		return store_get_points(store, scratch, index, cur, last) ? index : SIZE_MAX;
+
+	uint32_t n = (uint32_t)store_get_varint(cur);
+	size_t at = store_children(scratch, index, n);
+	if (at == SIZE_MAX)
+		return SIZE_MAX;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		size_t child;
+		if (type == POLYTYPE)
+		{
+			child = store_node(scratch, LINETYPE, flags | (i == 0 ? LW_FLAG_SHELL_RING : LW_FLAG_HOLE_RING));
+			if (child == SIZE_MAX || !store_get_points(store, scratch, child, cur, last))
+				return SIZE_MAX;
+		}
+		else if ((child = store_get_geometry(store, scratch, cur, last)) == SIZE_MAX)
+			return SIZE_MAX;
+		scratch->children[at + i] = child;
+	}
+	return index;
+}
+
+/// @brief turn the indices of the decoded nodes into pointers and compute the
+/// envelopes, children come after their parent so a backward pass sees them
+/// first
+static void
+store_link(LWSCRATCH *scratch)
+{
+	for (size_t i = scratch->nnodes; i-- > 0;)
+	{
+		LWGEOM *node = &scratch->nodes[i];
+		node->env.flags = node->flags & (LW_FLAG_Z | LW_FLAG_M);
+		if (node->npoints > 0)
+		{
+			node->pp = scratch->coords + scratch->coord_at[i];
+			node->env = lwgeom__query_envolpe(node->pp, (int)node->npoints, lwgeom_dim_coordinate(node));
+			node->env.flags = node->flags & (LW_FLAG_Z | LW_FLAG_M);
+		}
+		if (node->ngeoms == 0)
+			continue;
+		node->geoms = scratch->ptrs + scratch->child_at[i];
+		int empty = LW_TRUE;
+		for (uint32_t k = 0; k < node->ngeoms; k++)
+		{
+			LWGEOM *child = &scratch->nodes[scratch->children[scratch->child_at[i] + k]];
+			node->geoms[k] = child;
+			if (lwgeom__is_empty(child))
+				continue;
+			if (empty)
+			{
+				node->env.xmin = child->env.xmin;
+				node->env.xmax = child->env.xmax;
+				node->env.ymin = child->env.ymin;
+				node->env.ymax = child->env.ymax;
+				empty = LW_FALSE;
+				continue;
+			}
+			node->env.xmin = LWMIN(node->env.xmin, child->env.xmin);
+			node->env.xmax = LWMAX(node->env.xmax, child->env.xmax);
+			node->env.ymin = LWMIN(node->env.ymin, child->env.ymin);
+			node->env.ymax = LWMAX(node->env.ymax, child->env.ymax);
+		}
+	}
+}
+
+/// @brief grid x and y of the first vertex of \a obj, when it has one
+static int
+store_first_vertex(const LWSTORE *store, const LWGEOM *obj, int64_t origin[2])
+{
+	if (obj->npoints > 0)
+	{
+		for (int k = 0; k < 2; k++)
+		{
+			double q = round(obj->pp[k] * store->scale[k]);
+			if (!(fabs(q) < STORE_GRID_MAX))
+				return LW_FALSE;
+			origin[k] = (int64_t)q;
+		}
+		return LW_TRUE;
+	}
+	for (uint32_t i = 0; i < obj->ngeoms; i++)
+	{
+		if (store_first_vertex(store, obj->geoms[i], origin))
+			return LW_TRUE;
+	}
+	return LW_FALSE;
+}
+
+/* ------------------------------ output store ------------------------------ */
+
+/// @brief new empty store, coordinates are kept to \a precision_xy decimal
+/// places for x and y, \a precision_z and \a precision_m for z and m.
+/// Negative precisions round to tens, hundreds and so on
+LWSTORE *
+lwstore_new(int precision_xy, int precision_z, int precision_m)
+{
+	LWSTORE *store = (LWSTORE *)lwmalloc0(sizeof(LWSTORE));
+	if (store == NULL)
+		return NULL;
+	int precision[4] = {precision_xy, precision_xy, precision_z, precision_m};
+	for (int k = 0; k < 4; k++)
+	{
+		int p = LWMAX(-15, LWMIN(precision[k], 15));
+		store->scale[k] = pow(10, p);
+		store->mul[k] = p < 0 ? pow(10, -p) : 1;
+		store->div[k] = p > 0 ? pow(10, p) : 1;
+	}
+	return store;
+}
+
+void
+lwstore_free(LWSTORE *store)
+{
+	if (store == NULL)
+		return;
+	lwfree(store->data);
+	lwfree(store->blocks);
+	lwfree(store->offsets);
+	lwfree(store);
+}
+
+/// @brief append \a obj, NULL is kept as a geometry that decodes to NULL
+/// @return id of the geometry, LWSTORE_NONE when it could not be stored
+size_t
+lwstore_add(LWSTORE *store, const LWGEOM *obj)
+{
+	if (store == NULL)
+		return LWSTORE_NONE;
+
+	size_t id = store->count;
+	size_t b = id / STORE_BLOCK;
+	uint32_t *offsets = (uint32_t *)store_grow(store->offsets, &store->slots, id + 1, sizeof(uint32_t));
+	if (offsets == NULL)
+		return LWSTORE_NONE;
+	store->offsets = offsets;
+	if (b == store->nblocks)
+	{
+		store_block *blocks =
+		    (store_block *)store_grow(store->blocks, &store->block_capacity, b + 1, sizeof(store_block));
+		if (blocks == NULL)
+			return LWSTORE_NONE;
+		store->blocks = blocks;
+		blocks[b].base = store->len;
+		blocks[b].origin[0] = blocks[b].origin[1] = 0;
+		// the first geometry of a block gives the origin of all of them
+		if (obj && !store_first_vertex(store, obj, blocks[b].origin))
+			blocks[b].origin[0] = blocks[b].origin[1] = 0;
+		store->nblocks++;
+	}
+
+	const store_block *block = &store->blocks[b];
+	if (store->len - block->base > UINT32_MAX)
+		return LWSTORE_NONE;
+	size_t mark = store->len;
+	int64_t last[4] = {block->origin[0], block->origin[1], 0, 0};
+	uint8_t *p = obj ? NULL : store_reserve(store, 1);
+	if (obj == NULL && p)
+	{
+		*p = 0;
+		store->len++;
+	}
+	else if (obj == NULL || !store_put_geometry(store, obj, last))
+	{
+		store->len = mark;
+		if (id % STORE_BLOCK == 0)
+			store->nblocks--;
+		return LWSTORE_NONE;
+	}
+	store->offsets[id] = (uint32_t)(mark - block->base);
+	store->count++;
+	return id;
+}
+
+/// @brief give back the room kept for growth once the store is loaded
+void
+lwstore_trim(LWSTORE *store)
+{
+	if (store == NULL)
+		return;
+	if (store->len > 0 && store->len < store->capacity)
+	{
+		uint8_t *data = (uint8_t *)lwrealloc(store->data, store->len);
+		if (data)
+		{
+			store->data = data;
+			store->capacity = store->len;
+		}
+	}
+	if (store->count > 0 && store->count < store->slots)
+	{
+		uint32_t *offsets = (uint32_t *)lwrealloc(store->offsets, store->count * sizeof(uint32_t));
+		if (offsets)
+		{
+			store->offsets = offsets;
+			store->slots = store->count;
+		}
+	}
+	if (store->nblocks > 0)
+	{
+		store_block *blocks = (store_block *)lwrealloc(store->blocks, store->nblocks * sizeof(store_block));
+		if (blocks)
+		{
+			store->blocks = blocks;
+			store->block_capacity = store->nblocks;
+		}
+	}
+}
+
+size_t
+lwstore_count(const LWSTORE *store)
+{
+	return store ? store->count : 0;
+}
+
+/// @brief bytes held by the store
+size_t
+lwstore_memory(const LWSTORE *store)
+{
+	if (store == NULL)
+		return 0;
+	return sizeof(LWSTORE) + store->capacity + store->slots * sizeof(uint32_t) +
+	       store->block_capacity * sizeof(store_block);
+}
+
+/* ------------------------------- input store ------------------------------ */
+
+LWSCRATCH *
+lwscratch_new(void)
+{
+	return (LWSCRATCH *)lwmalloc0(sizeof(LWSCRATCH));
+}
+
+void
+lwscratch_free(LWSCRATCH *scratch)
+{
+	if (scratch == NULL)
+		return;
+	lwfree(scratch->nodes);
+	lwfree(scratch->coord_at);
+	lwfree(scratch->child_at);
+	lwfree(scratch->children);
+	lwfree(scratch->ptrs);
+	lwfree(scratch->coords);
+	lwfree(scratch);
+}
+
+/// @brief decode geometry \a id into \a scratch. The result belongs to the
+/// scratch and stays valid until its next use, it must not be freed
+/// @return the geometry, NULL for an unknown id or a stored NULL
+const LWGEOM *
+lwstore_decode(const LWSTORE *store, size_t id, LWSCRATCH *scratch)
+{
+	if (store == NULL || scratch == NULL || id >= store->count)
+		return NULL;
+	const store_block *block = &store->blocks[id / STORE_BLOCK];
+	const uint8_t *p = store->data + block->base + store->offsets[id];
+	if (*p == 0)
+		return NULL;
+
+	scratch->nnodes = scratch->nchildren = scratch->ncoords = 0;
+	int64_t last[4] = {block->origin[0], block->origin[1], 0, 0};
+	if (store_get_geometry(store, scratch, &p, last) == SIZE_MAX)
+		return NULL;
+	store_link(scratch);
+	return scratch->nodes;
+}
+
+/// @brief decode geometry \a id into a geometry of its own
+LWGEOM *
+lwstore_get(const LWSTORE *store, size_t id)
+{
+	LWSCRATCH scratch;
+	memset(&scratch, 0, sizeof(scratch));
+	const LWGEOM *view = lwstore_decode(store, id, &scratch);
+	LWGEOM *obj = view ? lwgeom_clone(view) : NULL;
+	lwfree(scratch.nodes);
+	lwfree(scratch.coord_at);
+	lwfree(scratch.child_at);
+	lwfree(scratch.children);
+	lwfree(scratch.ptrs);
+	lwfree(scratch.coords);
+	return obj;
+}
@@ -0,0 +1,1059 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "lwgeom_xml.h"
+#include "lwgeom_number.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ------------------------------- inner xml -------------------------------- */
+
+#define XML_CHUNK_SIZE (1 << 20)
+
+/// how far a tag or a number may extend before the input is declared malformed
+#define XML_TOKEN_MAX (16 << 20)
+
+/// markup kinds
+enum
+{
+	XML_START,
+	XML_END,
+	XML_CDATA,
+	XML_SKIP ///< comments, processing instructions and declarations
+};
+
+/// a geometry element that is still open
+typedef struct {
+	uint8_t type;
+	uint8_t ring;    ///< LinearRing, closed when it is built
+	int depth;       ///< element depth of its start tag
+	int dim;         ///< srsDimension in effect, 0 when not given
+	int cdim;        ///< ordinates per vertex, 0 until the first one
+	double *pp;
+	uint32_t npoints;
+	uint32_t capacity;
+	LWGEOM *geom;    ///< the children built so far
+} xml_frame;
+
+/// the coordinate element being read, its text may arrive in pieces but a
+/// piece never ends inside a number
+typedef struct {
+	int role;        ///< 0 outside coordinate elements
+	int depth;
+	int dim;         ///< ordinates per position of <pos> and <posList>
+	char cs;         ///< ordinate separator of <coordinates>
+	char ts;         ///< tuple separator of <coordinates>, 0 for blanks
+	double v[3];
+	int nv;
+	int after_cs;    ///< a separator ends no tuple right after an ordinate separator
+	int joint;       ///< a first vertex repeating the last one is dropped
+	int ordinate;    ///< the <X>, <Y> or <Z> being read, -1 outside
+	int seen;        ///< ordinates read in <coord>
+} xml_coords;
+
+struct LWXMLREADER {
+	const lwxml_element *elements;
+	lwxml_read_func read;
+	void *udata;
+	int fd;
+	void *map; ///< mmap'd file
+	size_t map_len;
+
+	char *buf; ///< input window, the mapping or the chunk buffer
+	size_t cap;
+	size_t len;
+	size_t pos;    ///< scan position in buf
+	size_t offset; ///< input offset of buf
+	int eof;
+	int owned;     ///< buf was allocated by the reader
+	int done;
+
+	int depth;     ///< element depth
+	int error;     ///< the geometry being read is malformed
+	const char *message;
+	size_t error_offset;
+	size_t start;  ///< input offset of the outermost geometry
+	xml_frame frames[LWPARSE_DEPTH_MAX + 1];
+	int nframes;
+	xml_coords coords;
+	LWGEOM *result;
+	lwparse *ctx;  ///< parse, or that of the document being read
+	lwparse parse; ///< limits of one geometry and the outcome of the last call
+};
+
+static inline int
+xml_blank(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static const lwxml_element *
+xml_lookup(const lwxml_element *elements, const char *name, size_t len)
+{
+	// namespace prefixes differ between documents, only the local name counts
+	const char *colon = memchr(name, ':', len);
+	if (colon)
+	{
+		len -= (size_t)(colon + 1 - name);
+		name = colon + 1;
+	}
+	for (const lwxml_element *el = elements; el->name; el++)
+	{
+		if (strlen(el->name) == len && memcmp(el->name, name, len) == 0)
+			return el;
+	}
+	return NULL;
+}
+
+/// @brief find the attribute \a name in the attribute text [p, end)
+static int
+xml_attr(const char *p, const char *end, const char *name, const char **value, size_t *len)
+{
+	size_t namelen = strlen(name);
+	while (p < end)
+	{
+		while (p < end && xml_blank(*p))
+			p++;
+		const char *key = p;
+		while (p < end && *p != '=' && !xml_blank(*p))
+			p++;
+		const char *keyend = p;
+		while (p < end && xml_blank(*p))
+			p++;
+		if (p == end || *p != '=')
+			return LW_FALSE;
+		p++;
+		while (p < end && xml_blank(*p))
+			p++;
+		if (p == end || (*p != '"' && *p != '\''))
+			return LW_FALSE;
+		char quote = *p++;
+		const char *val = p;
+		while (p < end && *p != quote)
+			p++;
+		if (p == end)
+			return LW_FALSE;
+		const char *colon = memchr(key, ':', (size_t)(keyend - key));
+		if (colon)
+			key = colon + 1;
+		if ((size_t)(keyend - key) == namelen && memcmp(key, name, namelen) == 0)
+		{
+			*value = val;
+			*len = (size_t)(p - val);
+			return LW_TRUE;
+		}
+		p++;
+	}
+	return LW_FALSE;
+}
+
+/// @brief small positive integer attribute, 0 when missing or malformed
+static int
+xml_attr_int(const char *p, const char *end, const char *name)
+{
+	const char *val;
+	size_t len;
+	if (!xml_attr(p, end, name, &val, &len) || len == 0 || len > 4)
+		return 0;
+	int v = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		if (val[i] < '0' || val[i] > '9')
+			return 0;
+		v = v * 10 + (val[i] - '0');
+	}
+	return v;
+}
+
+static void
+xml_error(LWXMLREADER *r, const char *message)
+{
+	if (r->error)
+		return;
+	r->error = LW_TRUE;
+	r->message = message;
+	r->error_offset = r->offset + r->pos;
+}
+
+/* ------------------------------ coordinates ------------------------------- */
+
+static void
+xml_add_vertex(LWXMLREADER *r, xml_frame *f, const double *v, int n)
+{
+	if (f->cdim == 0)
+		f->cdim = n;
+	else if (f->cdim != n)
+	{
+		xml_error(r, "mixed coordinate dimensions");
+		return;
+	}
+	if (r->coords.joint)
+	{
+		// pieces of one line share their end points
+		r->coords.joint = LW_FALSE;
+		if (memcmp(f->pp + (size_t)(f->npoints - 1) * n, v, sizeof(double) * n) == 0)
+			return;
+	}
+	if (f->type == POINTTYPE && f->npoints > 0)
+	{
+		xml_error(r, "point with more than one position");
+		return;
+	}
+	const char *error = lwparse__vertices(r->ctx, 1);
+	if (error)
+	{
+		xml_error(r, error);
+		return;
+	}
+	if (f->npoints == f->capacity)
+	{
+		if (f->capacity >= UINT32_MAX / 2)
+		{
+			xml_error(r, "too many positions");
+			return;
+		}
+		uint32_t capacity = f->capacity ? f->capacity * 2 : 16;
+		double *pp = (double *)lwrealloc(f->pp, sizeof(double) * capacity * n);
+		if (pp == NULL)
+		{
+			xml_error(r, lwparse__nomem(r->ctx));
+			return;
+		}
+		f->pp = pp;
+		f->capacity = capacity;
+	}
+	memcpy(f->pp + (size_t)f->npoints * n, v, sizeof(double) * n);
+	f->npoints++;
+}
+
+static void
+xml_end_tuple(LWXMLREADER *r)
+{
+	xml_coords *c = &r->coords;
+	if (c->nv < 2)
+		xml_error(r, "position with fewer than two ordinates");
+	else
+		xml_add_vertex(r, &r->frames[r->nframes - 1], c->v, c->nv);
+	c->nv = 0;
+}
+
+/// @brief parse a piece of coordinate text straight into the open frame
+static void
+xml_text(LWXMLREADER *r, const char *p, const char *end)
+{
+	xml_coords *c = &r->coords;
+	if (c->role == 0 || r->error)
+		return;
+	if (c->role == LWXML_COORD)
+	{
+		if (c->ordinate < 0)
+			return;
+		while (p < end && xml_blank(*p))
+			p++;
+		if (p == end)
+			return;
+		if (lwnumber_parse(p, end, &c->v[c->ordinate]) == NULL)
+			xml_error(r, "invalid number");
+		c->seen |= 1 << c->ordinate;
+		return;
+	}
+
+	while (p < end)
+	{
+		char ch = *p;
+		if (xml_blank(ch) || (ch == c->ts && c->role == LWXML_COORDINATES))
+		{
+			if (c->role == LWXML_COORDINATES && c->nv > 0 && !c->after_cs)
+				xml_end_tuple(r);
+			p++;
+			continue;
+		}
+		if (c->role == LWXML_COORDINATES && ch == c->cs)
+		{
+			if (c->nv == 0 || c->after_cs)
+			{
+				xml_error(r, "misplaced ordinate separator");
+				return;
+			}
+			c->after_cs = LW_TRUE;
+			p++;
+			continue;
+		}
+		double v;
+		const char *q = lwnumber_parse(p, end, &v);
+		if (q == NULL)
+		{
+			xml_error(r, "invalid number");
+			return;
+		}
+		p = q;
+		if (c->role == LWXML_COORDINATES)
+		{
+			if (c->nv > 0 && !c->after_cs)
+				xml_end_tuple(r);
+			if (c->nv == 3)
+			{
+				xml_error(r, "position with more than three ordinates");
+				return;
+			}
+			c->v[c->nv++] = v;
+			c->after_cs = LW_FALSE;
+		}
+		else
+		{
+			c->v[c->nv++] = v;
+			if (c->nv == c->dim)
+			{
+				xml_add_vertex(r, &r->frames[r->nframes - 1], c->v, c->dim);
+				c->nv = 0;
+			}
+		}
+		if (r->error)
+			return;
+	}
+}
+
+static void
+xml_coords_start(LWXMLREADER *r, int role, const char *attrs, const char *end)
+{
+	xml_coords *c = &r->coords;
+	xml_frame *f = &r->frames[r->nframes - 1];
+	// coordinates only belong to points and lines, those of an envelope or a
+	// box are not geometry
+	if (f->type != POINTTYPE && f->type != LINETYPE)
+		return;
+
+	memset(c, 0, sizeof(xml_coords));
+	c->role = role;
+	c->depth = r->depth;
+	c->ordinate = -1;
+	c->cs = ',';
+	c->dim = xml_attr_int(attrs, end, "srsDimension");
+	if (c->dim == 0)
+		c->dim = xml_attr_int(attrs, end, "dimension");
+	if (c->dim == 0)
+		c->dim = f->dim ? f->dim : 2;
+	if (c->dim < 2 || c->dim > 3)
+		xml_error(r, "unsupported srsDimension");
+
+	if (role == LWXML_COORDINATES)
+	{
+		const char *val;
+		size_t len;
+		if (xml_attr(attrs, end, "decimal", &val, &len) && (len != 1 || *val != '.'))
+			xml_error(r, "unsupported decimal separator");
+		if (xml_attr(attrs, end, "cs", &val, &len) && len == 1)
+			c->cs = *val;
+		if (xml_attr(attrs, end, "ts", &val, &len) && len == 1 && !xml_blank(*val))
+			c->ts = *val;
+	}
+	c->joint = (role == LWXML_COORDINATES || role == LWXML_POSLIST) && f->type == LINETYPE && f->npoints > 0;
+}
+
+static void
+xml_coords_end(LWXMLREADER *r)
+{
+	xml_coords *c = &r->coords;
+	if (!r->error)
+	{
+		switch (c->role)
+		{
+		case LWXML_COORDINATES:
+			if (c->after_cs)
+				xml_error(r, "misplaced ordinate separator");
+			else if (c->nv > 0)
+				xml_end_tuple(r);
+			break;
+		case LWXML_COORD:
+			if ((c->seen & 3) != 3)
+				xml_error(r, "coord without X and Y");
+			else
+				xml_add_vertex(r, &r->frames[r->nframes - 1], c->v, (c->seen & 4) ? 3 : 2);
+			break;
+		default:
+			if (c->nv != 0)
+				xml_error(r, "incomplete position");
+			break;
+		}
+	}
+	c->role = 0;
+}
+
+/* ------------------------------- geometries ------------------------------- */
+
+/// @brief give a collection the dimensions of its non empty children, empty
+/// ones follow them
+static int
+xml_fix_dims(LWGEOM *obj)
+{
+	int hasz = -1;
+	for (uint32_t i = 0; i < obj->ngeoms; i++)
+	{
+		if (lwgeom__is_empty(obj->geoms[i]))
+			continue;
+		int z = lwgeom_has_z(obj->geoms[i]);
+		if (hasz >= 0 && z != hasz)
+			return LW_FAILURE;
+		hasz = z;
+	}
+	if (hasz < 0)
+		return LW_SUCCESS;
+	LWFLAGS_SET_Z(obj->flags, hasz);
+	LWFLAGS_SET_Z(obj->env.flags, hasz);
+	for (uint32_t i = 0; i < obj->ngeoms; i++)
+	{
+		LWGEOM *child = obj->geoms[i];
+		if (child->npoints == 0 && lwgeom_has_z(child) != hasz)
+		{
+			LWFLAGS_SET_Z(child->flags, hasz);
+			LWFLAGS_SET_Z(child->env.flags, hasz);
+			xml_fix_dims(child);
+		}
+	}
+	return LW_SUCCESS;
+}
+
+/// @brief the geometry of a closing frame, its buffers move into it
+static LWGEOM *
+xml_build(LWXMLREADER *r, xml_frame *f, lwflags_t ring)
+{
+	if (f->type == POINTTYPE || f->type == LINETYPE)
+	{
+		int cdim = f->cdim ? f->cdim : 2;
+		if (f->ring && f->npoints > 0 && memcmp(f->pp, f->pp + (size_t)(f->npoints - 1) * cdim, sizeof(double) * cdim))
+		{
+			// KML rings are often left open
+			const double first[3] = {f->pp[0], f->pp[1], cdim > 2 ? f->pp[2] : 0};
+			r->coords.joint = LW_FALSE;
+			xml_add_vertex(r, f, first, cdim);
+			if (r->error)
+				return NULL;
+		}
+		if (f->type == LINETYPE && f->npoints == 1)
+		{
+			xml_error(r, "line with a single position");
+			return NULL;
+		}
+		if (f->ring && f->npoints > 0 && f->npoints < 4)
+		{
+			xml_error(r, "ring with fewer than four positions");
+			return NULL;
+		}
+		lwflags_t flags = ring;
+		LWFLAGS_SET_Z(flags, cdim == 3);
+		LWGEOM *obj = lwgeom__new_points(f->type, f->npoints, f->pp, flags, LW_FALSE);
+		if (obj == NULL)
+		{
+			xml_error(r, lwparse__nomem(r->ctx));
+			return NULL;
+		}
+		f->pp = NULL;
+		return obj;
+	}
+
+	LWGEOM *obj = f->geom ? f->geom : lwgeom__new(f->type, LW_FALSE, LW_FALSE);
+	f->geom = NULL;
+	if (obj == NULL)
+	{
+		xml_error(r, lwparse__nomem(r->ctx));
+		return NULL;
+	}
+	if (!xml_fix_dims(obj))
+	{
+		lwgeom_free(obj);
+		xml_error(r, "mixed coordinate dimensions");
+		return NULL;
+	}
+	return obj;
+}
+
+/// @brief close the innermost frame and hand its geometry to the parent
+/// @return LW_TRUE when the outermost geometry is complete
+static int
+xml_pop(LWXMLREADER *r)
+{
+	xml_frame *f = &r->frames[--r->nframes];
+	xml_frame *parent = r->nframes > 0 ? &r->frames[r->nframes - 1] : NULL;
+	LWGEOM *obj = NULL;
+	if (!r->error)
+	{
+		lwflags_t ring = 0;
+		if (parent && parent->type == POLYTYPE)
+			ring = (parent->geom && parent->geom->ngeoms > 0) ? LW_FLAG_HOLE_RING : LW_FLAG_SHELL_RING;
+		obj = xml_build(r, f, ring);
+	}
+	lwfree(f->pp);
+	if (f->geom)
+		lwgeom_free(f->geom);
+	memset(f, 0, sizeof(xml_frame));
+
+	if (parent == NULL)
+	{
+		r->result = obj;
+		return LW_TRUE;
+	}
+	if (obj == NULL)
+		return LW_FALSE;
+	if (parent->type == POINTTYPE || parent->type == LINETYPE || (parent->type == POLYTYPE && obj->type != LINETYPE))
+	{
+		lwgeom_free(obj);
+		xml_error(r, "unexpected geometry member");
+		return LW_FALSE;
+	}
+	if (parent->geom == NULL)
+		parent->geom = lwgeom__new(parent->type, LW_FALSE, LW_FALSE);
+	if (parent->geom == NULL || lwgeom__add(parent->geom, obj) == NULL)
+	{
+		lwgeom_free(obj);
+		xml_error(r, lwparse__nomem(r->ctx));
+	}
+	return LW_FALSE;
+}
+
+static void
+xml_start(LWXMLREADER *r, const char *name, size_t namelen, const char *attrs, const char *end)
+{
+	r->depth++;
+	const lwxml_element *el = xml_lookup(r->elements, name, namelen);
+	if (el == NULL)
+		return;
+
+	switch (el->role)
+	{
+	case LWXML_GEOMETRY:
+	case LWXML_RING: {
+		if (r->nframes == 0)
+		{
+			r->error = LW_FALSE;
+			r->message = NULL;
+			r->start = r->offset + r->pos;
+		}
+		else if (r->error)
+			return;
+		const char *error = lwparse__depth(r->ctx, r->nframes);
+		if (error)
+		{
+			xml_error(r, error);
+			return;
+		}
+		xml_frame *f = &r->frames[r->nframes];
+		memset(f, 0, sizeof(xml_frame));
+		f->type = el->role == LWXML_RING ? LINETYPE : el->type;
+		f->ring = el->role == LWXML_RING;
+		f->depth = r->depth;
+		f->dim = xml_attr_int(attrs, end, "srsDimension");
+		if (f->dim == 0 && r->nframes > 0)
+			f->dim = r->frames[r->nframes - 1].dim;
+		r->nframes++;
+		break;
+	}
+	case LWXML_ORDINATE:
+		if (r->coords.role == LWXML_COORD && r->depth == r->coords.depth + 1)
+			r->coords.ordinate = el->type;
+		break;
+	default:
+		if (r->nframes > 0 && !r->error && r->coords.role == 0)
+			xml_coords_start(r, el->role, attrs, end);
+		break;
+	}
+}
+
+/// @return LW_TRUE when the outermost geometry is complete
+static int
+xml_end(LWXMLREADER *r)
+{
+	int complete = LW_FALSE;
+	xml_coords *c = &r->coords;
+	if (c->role && r->depth == c->depth)
+		xml_coords_end(r);
+	else if (c->role == LWXML_COORD && r->depth == c->depth + 1)
+		c->ordinate = -1;
+	if (r->nframes > 0 && r->frames[r->nframes - 1].depth == r->depth)
+		complete = xml_pop(r);
+	r->depth--;
+	return complete;
+}
+
+/* ------------------------------- scanning --------------------------------- */
+
+/// @return pointer past \a term in [p, end), NULL when the window ends first
+static const char *
+xml_search(const char *p, const char *end, const char *term, size_t len)
+{
+	while ((size_t)(end - p) >= len)
+	{
+		const char *q = memchr(p, term[0], (size_t)(end - p) - len + 1);
+		if (q == NULL)
+			return NULL;
+		if (memcmp(q, term, len) == 0)
+			return q + len;
+		p = q + 1;
+	}
+	return NULL;
+}
+
+/// @brief find the end of the markup starting at the '<' at \a p
+/// @return pointer past it, NULL when the window ends first
+static const char *
+xml_markup(const char *p, const char *end, int *kind)
+{
+	if (end - p < 2)
+		return NULL;
+	if (p[1] == '?')
+	{
+		*kind = XML_SKIP;
+		return xml_search(p + 2, end, "?>", 2);
+	}
+	if (p[1] == '!')
+	{
+		if (end - p < 4)
+			return NULL;
+		if (p[2] == '-' && p[3] == '-')
+		{
+			*kind = XML_SKIP;
+			return xml_search(p + 4, end, "-->", 3);
+		}
+		if (end - p < 9)
+			return NULL;
+		if (memcmp(p, "<![CDATA[", 9) == 0)
+		{
+			*kind = XML_CDATA;
+			return xml_search(p + 9, end, "]]>", 3);
+		}
+		// a DOCTYPE internal subset holds '>' inside brackets
+		*kind = XML_SKIP;
+		int brackets = 0;
+		for (const char *q = p + 2; q < end; q++)
+		{
+			if (*q == '[')
+				brackets++;
+			else if (*q == ']')
+				brackets--;
+			else if (*q == '>' && brackets <= 0)
+				return q + 1;
+		}
+		return NULL;
+	}
+	*kind = p[1] == '/' ? XML_END : XML_START;
+	char quote = 0;
+	for (const char *q = p + 1; q < end; q++)
+	{
+		if (quote)
+		{
+			if (*q == quote)
+				quote = 0;
+		}
+		else if (*q == '"' || *q == '\'')
+			quote = *q;
+		else if (*q == '>')
+			return q + 1;
+	}
+	return NULL;
+}
+
+static LWXMLREADER *
+lwxml_reader__new(int format)
+{
+	const lwxml_element *elements;
+	switch (format)
+	{
+	case LW_FORMAT_GML2:
+	case LW_FORMAT_GML3:
+		elements = lwxml__gml_elements;
+		break;
+	case LW_FORMAT_KML:
+		elements = lwxml__kml_elements;
+		break;
+	default:
+		return NULL;
+	}
+	LWXMLREADER *r = (LWXMLREADER *)lwmalloc0(sizeof(LWXMLREADER));
+	if (r == NULL)
+		return NULL;
+	r->elements = elements;
+	r->fd = -1;
+	lwparse__init(&r->parse, NULL, LW_TRUE);
+	r->ctx = &r->parse;
+	return r;
+}
+
+/// @brief discard everything before \a keep and read more input
+/// @return LW_TRUE if data was added, LW_FALSE at the end of the input
+static int
+lwxml_reader__fill(LWXMLREADER *r, size_t keep)
+{
+	if (r->eof)
+		return LW_FALSE;
+	if (keep > 0)
+	{
+		memmove(r->buf, r->buf + keep, r->len - keep);
+		r->len -= keep;
+		r->pos -= keep;
+		r->offset += keep;
+	}
+	if (r->cap - r->len < XML_CHUNK_SIZE / 2)
+	{
+		// the window only grows when a single token is larger than it
+		size_t cap = r->cap ? r->cap * 2 : XML_CHUNK_SIZE;
+		char *buf = (char *)lwrealloc(r->buf, cap);
+		if (buf == NULL)
+		{
+			r->eof = LW_TRUE;
+			return LW_FALSE;
+		}
+		r->buf = buf;
+		r->cap = cap;
+	}
+	long n;
+	if (r->read)
+		n = r->read(r->udata, r->buf + r->len, r->cap - r->len);
+	else
+		n = (long)read(r->fd, r->buf + r->len, r->cap - r->len);
+	if (n <= 0)
+	{
+		r->eof = LW_TRUE;
+		return LW_FALSE;
+	}
+	r->len += (size_t)n;
+	return LW_TRUE;
+}
+
+static int
+lwxml_reader__fail(LWXMLREADER *r, const char *message)
+{
+	lwparse__fail(r->ctx, "XML", r->offset + r->pos, message);
+	r->done = LW_TRUE;
+	return -1;
+}
+
+/* ------------------------------- input xml -------------------------------- */
+
+/// @brief streaming reader over a callback that fills \a buf with up to
+/// \a len bytes and returns the count, 0 at the end and -1 on error
+/// @param format LW_FORMAT_GML2, LW_FORMAT_GML3 or LW_FORMAT_KML
+LWXMLREADER *
+lwxml_reader_callback(int format, lwxml_read_func read, void *udata)
+{
+	if (read == NULL)
+		return NULL;
+	LWXMLREADER *r = lwxml_reader__new(format);
+	if (r)
+	{
+		r->read = read;
+		r->udata = udata;
+		r->owned = LW_TRUE;
+	}
+	return r;
+}
+
+/// @brief streaming reader over a file descriptor, which is not closed
+LWXMLREADER *
+lwxml_reader_fd(int format, int fd)
+{
+	if (fd < 0)
+		return NULL;
+	LWXMLREADER *r = lwxml_reader__new(format);
+	if (r)
+	{
+		r->fd = fd;
+		r->owned = LW_TRUE;
+	}
+	return r;
+}
+
+/// @brief reader over memory that stays valid while the reader is used
+LWXMLREADER *
+lwxml_reader_memory(int format, const char *data, size_t len)
+{
+	if (data == NULL)
+		return NULL;
+	LWXMLREADER *r = lwxml_reader__new(format);
+	if (r)
+	{
+		r->buf = (char *)(uintptr_t)data;
+		r->len = r->cap = len;
+		r->eof = LW_TRUE;
+	}
+	return r;
+}
+
+/// @brief reader over a memory mapped file, pages are only touched as the
+/// scan reaches them so resident memory stays bounded by the OS
+LWXMLREADER *
+lwxml_reader_mmap(int format, const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+	madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	LWXMLREADER *r = lwxml_reader_memory(format, (const char *)map, (size_t)st.st_size);
+	if (r == NULL)
+	{
+		munmap(map, (size_t)st.st_size);
+		return NULL;
+	}
+	r->map = map;
+	r->map_len = (size_t)st.st_size;
+	return r;
+}
+
+void
+lwxml_reader_free(LWXMLREADER *r)
+{
+	if (r == NULL)
+		return;
+	for (int i = 0; i < r->nframes; i++)
+	{
+		lwfree(r->frames[i].pp);
+		if (r->frames[i].geom)
+			lwgeom_free(r->frames[i].geom);
+	}
+	if (r->map)
+		munmap(r->map, r->map_len);
+	if (r->owned)
+		lwfree(r->buf);
+	lwfree(r);
+}
+
+static int
+xml_next(LWXMLREADER *r, LWGEOM **geom)
+{
+	*geom = NULL;
+	if (r->done)
+		return 0;
+
+	for (;;)
+	{
+		if (r->nframes > 0 && !r->error && r->offset + r->pos - r->start > r->ctx->max_bytes)
+		{
+			r->ctx->code = LW_PARSE_BYTES;
+			xml_error(r, "geometry longer than max_bytes");
+		}
+		if (r->pos == r->len)
+		{
+			if (!lwxml_reader__fill(r, r->pos))
+			{
+				if (r->nframes > 0)
+					return lwxml_reader__fail(r, "unexpected end of input");
+				r->done = LW_TRUE;
+				return 0;
+			}
+			continue;
+		}
+
+		const char *p = r->buf + r->pos;
+		const char *end = r->buf + r->len;
+		if (*p != '<')
+		{
+			const char *q = memchr(p, '<', (size_t)(end - p));
+			if (q == NULL && !r->eof)
+			{
+				// text outside coordinates is dropped, coordinates are read
+				// up to the last separator and the rest waits for more input
+				size_t keep = r->len;
+				if (r->coords.role)
+				{
+					const char *s = end;
+					while (s > p && !xml_blank(s[-1]) && s[-1] != ',')
+						s--;
+					xml_text(r, p, s);
+					keep = (size_t)(s - r->buf);
+					if (r->len - keep > XML_TOKEN_MAX)
+						return lwxml_reader__fail(r, "number too long");
+				}
+				r->pos = keep;
+				lwxml_reader__fill(r, keep);
+				continue;
+			}
+			if (q == NULL)
+				q = end;
+			xml_text(r, p, q);
+			r->pos = (size_t)(q - r->buf);
+			continue;
+		}
+
+		int kind;
+		const char *t = xml_markup(p, end, &kind);
+		if (t == NULL)
+		{
+			if (r->eof)
+				return lwxml_reader__fail(r, "unexpected end of input");
+			if (r->len - r->pos > XML_TOKEN_MAX)
+				return lwxml_reader__fail(r, "markup too long");
+			lwxml_reader__fill(r, r->pos);
+			continue;
+		}
+
+		int complete = LW_FALSE;
+		if (kind == XML_START)
+		{
+			const char *name = p + 1;
+			const char *q = name;
+			while (q < t - 1 && !xml_blank(*q) && *q != '/' && *q != '>')
+				q++;
+			if (q == name)
+				return lwxml_reader__fail(r, "invalid start tag");
+			int empty = t[-2] == '/';
+			xml_start(r, name, (size_t)(q - name), q, t - 1 - empty);
+			if (empty)
+				complete = xml_end(r);
+		}
+		else if (kind == XML_END)
+		{
+			if (r->depth == 0)
+				return lwxml_reader__fail(r, "unbalanced end tag");
+			complete = xml_end(r);
+		}
+		else if (kind == XML_CDATA)
+			xml_text(r, p + 9, t - 3);
+		r->pos = (size_t)(t - r->buf);
+
+		if (complete)
+		{
+			if (r->error)
+			{
+				lwgeom_free(r->result);
+				r->result = NULL;
+				lwparse__fail(r->ctx, "XML", r->error_offset, r->message);
+				r->error = LW_FALSE;
+				return -1;
+			}
+			*geom = r->result;
+			r->result = NULL;
+			return 1;
+		}
+	}
+}
+
+/// @brief read the next outermost geometry of the document
+///
+/// The document is scanned as a stream of tags and text, no tree is built.
+/// Coordinate text is parsed straight into the vertex array of the geometry
+/// being read, so memory holds the input window and that one geometry.
+/// Geometries are found at any depth, inside feature members or placemarks.
+/// @param geom receives the geometry
+/// @return 1 for a geometry, 0 at the end of the document, -1 on error. A
+/// malformed geometry is skipped, reading may continue after it.
+int
+lwxml_reader_next(LWXMLREADER *r, LWGEOM **geom)
+{
+	lwparse__reset(&r->parse);
+	return xml_next(r, geom);
+}
+
+/// @brief limit the bytes, vertices and nesting of each geometry, NULL
+/// restores the defaults
+void
+lwxml_reader_set_limits(LWXMLREADER *r, const LWPARSE_LIMITS *limits)
+{
+	lwparse__init(&r->parse, limits, r->parse.notice);
+}
+
+/// @brief outcome of the last call to lwxml_reader_next
+const LWPARSE_RESULT *
+lwxml_reader_result(const LWXMLREADER *r)
+{
+	return &r->parse.result;
+}
+
+/// @brief read every geometry of a document in memory, several become a
+/// GEOMETRYCOLLECTION
+LWGEOM *
+lwxml__read_document(const lwxml_element *elements, const char *data, size_t len, lwparse *ctx)
+{
+	if (data == NULL || !lwparse__text(ctx, "XML", data, &len))
+		return NULL;
+	LWXMLREADER *r = (LWXMLREADER *)lwmalloc0(sizeof(LWXMLREADER));
+	if (r == NULL)
+	{
+		lwparse__fail(ctx, "XML", 0, lwparse__nomem(ctx));
+		return NULL;
+	}
+	r->ctx = ctx;
+	r->elements = elements;
+	r->fd = -1;
+	r->buf = (char *)(uintptr_t)data;
+	r->len = r->cap = len;
+	r->eof = LW_TRUE;
+
+	LWGEOM *result = NULL;
+	LWGEOM *geom;
+	int collected = LW_FALSE;
+	int rc;
+	while ((rc = xml_next(r, &geom)) == 1)
+	{
+		if (result == NULL)
+		{
+			result = geom;
+			continue;
+		}
+		if (!collected)
+		{
+			LWGEOM *collection = lwgeom__new(COLLECTIONTYPE, LW_FALSE, LW_FALSE);
+			if (collection == NULL || lwgeom__add(collection, result) == NULL)
+			{
+				lwgeom_free(collection);
+				lwgeom_free(geom);
+				lwparse__fail(ctx, "XML", r->pos, lwparse__nomem(ctx));
+				rc = -1;
+				break;
+			}
+			result = collection;
+			collected = LW_TRUE;
+		}
+		if (lwgeom__add(result, geom) == NULL)
+		{
+			lwgeom_free(geom);
+			lwparse__fail(ctx, "XML", r->pos, lwparse__nomem(ctx));
+			rc = -1;
+			break;
+		}
+	}
+	lwxml_reader_free(r);
+	if (rc == 0 && collected && !xml_fix_dims(result))
+	{
+		lwparse__fail(ctx, "XML", len, "mixed coordinate dimensions");
+		rc = -1;
+	}
+	if (rc != 0)
+	{
+		lwgeom_free(result);
+		return NULL;
+	}
+	if (result == NULL)
+		lwparse__fail(ctx, "XML", len, "no geometry found");
+	return result;
+}
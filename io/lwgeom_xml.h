@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LWGEOM_XML_H
+#define LWGEOM_XML_H
+
+#include "lwgeom_parse.h"
+
+/// Event scanner and geometry builder shared by the GML and KML readers. The
+/// dialects only differ in which element names get which role.
+
+/// element roles
+enum
+{
+	LWXML_GEOMETRY = 1, ///< opens a geometry of lwxml_element.type
+	LWXML_RING,         ///< a linear ring, closed when it isn't
+	LWXML_COORDINATES,  ///< tuples split by blanks, ordinates by commas
+	LWXML_POSLIST,      ///< ordinates split by blanks, srsDimension per position
+	LWXML_POS,          ///< a single position
+	LWXML_COORD,        ///< GML 2 <coord> holding <X>, <Y> and <Z>
+	LWXML_ORDINATE      ///< <X>, <Y> or <Z>, lwxml_element.type is the index
+};
+
+typedef struct {
+	const char *name; ///< local name, the namespace prefix is ignored
+	uint8_t role;
+	uint8_t type;
+} lwxml_element;
+
+/// element tables, terminated by a NULL name
+extern const lwxml_element lwxml__gml_elements[];
+extern const lwxml_element lwxml__kml_elements[];
+
+/// @brief read every geometry of a document in memory, several become a
+/// GEOMETRYCOLLECTION. The limits of \a ctx apply to the whole document
+LWGEOM *lwxml__read_document(const lwxml_element *elements, const char *data, size_t len, lwparse *ctx);
+
+#endif /* LWGEOM_XML_H */
@@ -22,8 +22,28 @@
 
 #include "liblwgeom_internel.h"
 
+#include "lwgeom_parse.h"
+#include <string.h>
+
+LWGEOM *
+lwgeom__read_ewkb(const char *data, size_t len, lwparse *ctx)
+{
+	if (data == NULL)
+		return NULL;
+	if (len == 0 || data[0] == '0')
+		return lwgeom__read_hexwkb(data, len, ctx);
+	return lwgeom__read_wkb((const uint8_t *)data, len, LW_FALSE, ctx);
+}
+
+/// @brief parse EWKB, binary or hex encoded. The SRID is accepted and skipped,
+/// LWGEOM does not carry one.
+///
+/// The first byte of binary EWKB is the byte order 0 or 1, hex text always
+/// starts with the character '0', so both forms are told apart without a flag.
 LWGEOM *
 lwgeom_read_ewkb(const char *data, size_t len)
 {
-	return NULL;
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	return lwgeom__read_ewkb(data, len, &ctx);
 }
@@ -22,8 +22,53 @@
 
 #include "liblwgeom_internel.h"
 
+#include "lwgeom_parse.h"
+#include <string.h>
+#include <strings.h>
+
+LWGEOM *
+lwgeom__read_ewkt(const char *data, size_t len, lwparse *ctx)
+{
+	if (data == NULL || !lwparse__text(ctx, "EWKT", data, &len))
+		return NULL;
+	const char *p = data;
+	const char *end = data + len;
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+		p++;
+	if (end - p >= 5 && strncasecmp(p, "SRID=", 5) == 0)
+	{
+		const char *q = p + 5;
+		if (q < end && (*q == '-' || *q == '+'))
+			q++;
+		const char *digits = q;
+		while (q < end && *q >= '0' && *q <= '9')
+			q++;
+		if (q == digits || q == end || *q != ';')
+		{
+			lwparse__fail(ctx, "EWKT", (size_t)(q - data), "bad SRID prefix");
+			return NULL;
+		}
+		p = q + 1;
+	}
+	if (p == end)
+	{
+		lwparse__fail(ctx, "EWKT", (size_t)(p - data), "missing geometry");
+		return NULL;
+	}
+	// offsets stay those of the whole text
+	ctx->base += (size_t)(p - data);
+	LWGEOM *obj = lwgeom__read_wkt(p, (size_t)(end - p), ctx);
+	ctx->base -= (size_t)(p - data);
+	return obj;
+}
+
+/// @brief parse EWKT, WKT with an optional "SRID=n;" prefix. The SRID is
+/// accepted and skipped, LWGEOM does not carry one. The dimension spellings
+/// of EWKT such as POINTM are read by the WKT reader itself
 LWGEOM *
 lwgeom_read_ewkt(const char *data, size_t len)
 {
-	return NULL;
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	return lwgeom__read_ewkt(data, len, &ctx);
 }
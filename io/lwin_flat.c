@@ -0,0 +1,455 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+#include "lwgeom_flat.h"
+#include "lwgeom_parse.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ------------------------------- inner flat ------------------------------- */
+
+/// records closer than this are fetched with one read from a range source
+#define FLAT_GAP 16384
+/// upper bound of one coalesced record read
+#define FLAT_GROUP_MAX (16 << 20)
+
+struct LWFLATREADER {
+	const uint8_t *map;   ///< the whole file for memory and mapped sources
+	size_t maplen;
+	int mapped;           ///< map is unmapped on close
+	lwflat_read_func read;
+	void *udata;
+	uint8_t *scratch;     ///< range source reads
+	size_t scratch_size;
+	uint64_t count;
+	uint16_t node_size;
+	LWBOX extent;
+	uint64_t index_offset;
+	uint64_t data_offset;
+	uint64_t data_size;
+	uint64_t levels[2 * FLAT_LEVELS_MAX];
+	int nlevels;
+};
+
+/// node ranges still to visit on one level of a query
+typedef struct {
+	uint64_t *pp; ///< start, end pairs
+	size_t n;
+	size_t capacity;
+} flat_ranges;
+
+typedef struct {
+	uint64_t index;  ///< record position in the file
+	uint64_t offset; ///< record start relative to the records
+	uint64_t end;
+} flat_hit;
+
+typedef struct {
+	flat_hit *pp;
+	size_t n;
+	size_t capacity;
+} flat_hits;
+
+/// @brief the bytes [offset, offset + len) of the file, pointing into the
+/// mapping or read into the scratch buffer, which the next fetch reuses
+static const uint8_t *
+flat_fetch(LWFLATREADER *reader, uint64_t offset, size_t len)
+{
+	if (reader->map)
+	{
+		if (offset > reader->maplen || len > reader->maplen - offset)
+			return NULL;
+		return reader->map + offset;
+	}
+	if (len > reader->scratch_size)
+	{
+		uint8_t *scratch = (uint8_t *)lwrealloc(reader->scratch, len);
+		if (scratch == NULL)
+			return NULL;
+		reader->scratch = scratch;
+		reader->scratch_size = len;
+	}
+	if (!reader->read(reader->scratch, len, offset, reader->udata))
+		return NULL;
+	return reader->scratch;
+}
+
+static LWFLATREADER *
+flat_open(LWFLATREADER *reader, uint64_t size)
+{
+	const uint8_t *h = flat_fetch(reader, 0, FLAT_HEADER_SIZE);
+	if (h == NULL || memcmp(h, FLAT_MAGIC, FLAT_MAGIC_SIZE) != 0)
+	{
+		lwnotice("flat parse error at offset 0: %s", "not a flat layer file");
+		return NULL;
+	}
+	reader->count = flat_load_u64(h + FLAT_HEADER_COUNT);
+	reader->node_size = (uint16_t)(h[FLAT_HEADER_NODE_SIZE] | h[FLAT_HEADER_NODE_SIZE + 1] << 8);
+	reader->extent.xmin = flat_load_double(h + FLAT_HEADER_EXTENT);
+	reader->extent.ymin = flat_load_double(h + FLAT_HEADER_EXTENT + 8);
+	reader->extent.xmax = flat_load_double(h + FLAT_HEADER_EXTENT + 16);
+	reader->extent.ymax = flat_load_double(h + FLAT_HEADER_EXTENT + 24);
+	reader->data_size = flat_load_u64(h + FLAT_HEADER_DATA_SIZE);
+
+	// the node count must fit the file size arithmetic
+	if (reader->node_size < 2 || reader->count > ((uint64_t)1 << 48))
+	{
+		lwnotice("flat parse error at offset %zu: %s", (size_t)FLAT_HEADER_COUNT, "bad index dimensions");
+		return NULL;
+	}
+	reader->nlevels = flat_levels(reader->count, reader->node_size, reader->levels);
+	uint64_t nnodes = reader->nlevels ? reader->levels[1] : 0;
+	reader->index_offset = FLAT_HEADER_SIZE;
+	reader->data_offset = FLAT_HEADER_SIZE + nnodes * FLAT_NODE_BYTES;
+	if (reader->data_size > size || reader->data_offset > size - reader->data_size)
+	{
+		lwnotice("flat parse error at offset %zu: %s", (size_t)FLAT_HEADER_DATA_SIZE, "file is truncated");
+		return NULL;
+	}
+	return reader;
+}
+
+static int
+flat_ranges_add(flat_ranges *ranges, uint64_t start, uint64_t end)
+{
+	// children of neighbouring branches are neighbours too
+	if (ranges->n > 0 && ranges->pp[2 * ranges->n - 1] == start)
+	{
+		ranges->pp[2 * ranges->n - 1] = end;
+		return LW_SUCCESS;
+	}
+	if (ranges->n == ranges->capacity)
+	{
+		size_t capacity = ranges->capacity ? ranges->capacity * 2 : 64;
+		uint64_t *pp = (uint64_t *)lwrealloc(ranges->pp, capacity * 2 * sizeof(uint64_t));
+		if (pp == NULL)
+			return LW_FAILURE;
+		ranges->pp = pp;
+		ranges->capacity = capacity;
+	}
+	ranges->pp[2 * ranges->n] = start;
+	ranges->pp[2 * ranges->n + 1] = end;
+	ranges->n++;
+	return LW_SUCCESS;
+}
+
+static int
+flat_hits_add(flat_hits *hits, uint64_t index, uint64_t offset, uint64_t end)
+{
+	if (hits->n == hits->capacity)
+	{
+		size_t capacity = hits->capacity ? hits->capacity * 2 : 64;
+		flat_hit *pp = (flat_hit *)lwrealloc(hits->pp, capacity * sizeof(flat_hit));
+		if (pp == NULL)
+			return LW_FAILURE;
+		hits->pp = pp;
+		hits->capacity = capacity;
+	}
+	hits->pp[hits->n++] = (flat_hit){index, offset, end};
+	return LW_SUCCESS;
+}
+
+static inline int
+flat_node_intersects(const uint8_t *p, const LWBOX *box)
+{
+	return !(flat_load_double(p) > box->xmax || flat_load_double(p + 8) > box->ymax ||
+		 flat_load_double(p + 16) < box->xmin || flat_load_double(p + 24) < box->ymin);
+}
+
+/// @brief walk the tree one level at a time, every run of neighbouring nodes
+/// is one fetch, and collect the records whose leaves meet \a box in file
+/// order
+static int
+flat_search(LWFLATREADER *reader, const LWBOX *box, flat_hits *hits)
+{
+	flat_ranges cur = {0};
+	flat_ranges next = {0};
+	const uint64_t *levels = reader->levels;
+	int top = reader->nlevels - 1;
+	int ret = flat_ranges_add(&cur, levels[2 * top], levels[2 * top + 1]);
+
+	for (int level = top; level >= 0 && ret; level--)
+	{
+		next.n = 0;
+		for (size_t r = 0; r < cur.n && ret; r++)
+		{
+			uint64_t start = cur.pp[2 * r];
+			uint64_t end = cur.pp[2 * r + 1];
+			// one more leaf tells where the last record ends
+			uint64_t stop = (level == 0 && end < levels[1]) ? end + 1 : end;
+			const uint8_t *p = flat_fetch(reader,
+						      reader->index_offset + start * FLAT_NODE_BYTES,
+						      (size_t)(stop - start) * FLAT_NODE_BYTES);
+			if (p == NULL)
+			{
+				lwnotice("flat parse error at offset %zu: %s",
+					 (size_t)(reader->index_offset + start * FLAT_NODE_BYTES),
+					 "index is truncated");
+				ret = LW_FAILURE;
+				break;
+			}
+			for (uint64_t i = start; i < end && ret; i++, p += FLAT_NODE_BYTES)
+			{
+				if (!flat_node_intersects(p, box))
+					continue;
+				uint64_t offset = flat_load_u64(p + 32);
+				if (level > 0)
+				{
+					uint64_t first = levels[2 * (level - 1)];
+					uint64_t last = levels[2 * (level - 1) + 1];
+					if (offset < first || offset >= last)
+					{
+						lwnotice("flat parse error at offset %zu: %s",
+							 (size_t)(reader->index_offset + i * FLAT_NODE_BYTES),
+							 "bad child index");
+						ret = LW_FAILURE;
+						break;
+					}
+					ret = flat_ranges_add(&next, offset, LWMIN(offset + reader->node_size, last));
+					continue;
+				}
+				uint64_t rend = i + 1 < levels[1] ? flat_load_u64(p + FLAT_NODE_BYTES + 32) : reader->data_size;
+				if (offset > rend || rend > reader->data_size || rend - offset < 4)
+				{
+					lwnotice("flat parse error at offset %zu: %s",
+						 (size_t)(reader->index_offset + i * FLAT_NODE_BYTES),
+						 "bad record offset");
+					ret = LW_FAILURE;
+					break;
+				}
+				ret = flat_hits_add(hits, i - levels[0], offset, rend);
+			}
+		}
+		flat_ranges t = cur;
+		cur = next;
+		next = t;
+	}
+	lwfree(cur.pp);
+	lwfree(next.pp);
+	return ret;
+}
+
+/// @brief decode the record at \a p, \a size bytes up to the next record
+/// @param offset position of the record in the file
+static LWGEOM *
+flat_decode(const LWFLATREADER *reader, const uint8_t *p, uint64_t size, uint64_t offset)
+{
+	uint32_t len = flat_load_u32(p);
+	if (len > size - 4)
+	{
+		lwnotice("flat parse error at offset %zu: %s", (size_t)offset, "record overruns its slot");
+		return NULL;
+	}
+	// geometries from a mapping keep their coordinates in it, errors are
+	// reported at their offset in the file
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	ctx.base = (size_t)offset + 4;
+	return lwgeom__read_wkb(p + 4, len, reader->map != NULL, &ctx);
+}
+
+/* ------------------------------- input flat ------------------------------- */
+
+/// @brief open a flat layer file in memory, \a data must outlive the reader
+/// and every geometry it returns
+LWFLATREADER *
+lwflat_open_memory(const void *data, size_t len)
+{
+	if (data == NULL)
+		return NULL;
+	LWFLATREADER *reader = (LWFLATREADER *)lwmalloc0(sizeof(LWFLATREADER));
+	if (reader == NULL)
+		return NULL;
+	reader->map = (const uint8_t *)data;
+	reader->maplen = len;
+	if (flat_open(reader, len) == NULL)
+	{
+		lwfree(reader);
+		return NULL;
+	}
+	return reader;
+}
+
+/// @brief open a flat layer file through a range read callback, every fetch
+/// of a query is one call, so remote files need a few requests per query
+LWFLATREADER *
+lwflat_open_reader(lwflat_read_func read, void *udata)
+{
+	if (read == NULL)
+		return NULL;
+	LWFLATREADER *reader = (LWFLATREADER *)lwmalloc0(sizeof(LWFLATREADER));
+	if (reader == NULL)
+		return NULL;
+	reader->read = read;
+	reader->udata = udata;
+	if (flat_open(reader, UINT64_MAX) == NULL)
+	{
+		lwfree(reader->scratch);
+		lwfree(reader);
+		return NULL;
+	}
+	return reader;
+}
+
+/// @brief map a flat layer file, queries only touch the pages of the index
+/// nodes they visit and of the matching records
+LWFLATREADER *
+lwflat_open(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < FLAT_HEADER_SIZE)
+	{
+		close(fd);
+		return NULL;
+	}
+	void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+	// no read ahead, a query jumps between a few nodes and records
+	madvise(map, (size_t)st.st_size, MADV_RANDOM);
+
+	LWFLATREADER *reader = lwflat_open_memory(map, (size_t)st.st_size);
+	if (reader == NULL)
+	{
+		munmap(map, (size_t)st.st_size);
+		return NULL;
+	}
+	reader->mapped = LW_TRUE;
+	return reader;
+}
+
+/// @brief close the reader, geometries returned from a mapped file must be
+/// freed first
+void
+lwflat_close(LWFLATREADER *reader)
+{
+	if (reader == NULL)
+		return;
+	if (reader->mapped)
+		munmap((void *)reader->map, reader->maplen);
+	lwfree(reader->scratch);
+	lwfree(reader);
+}
+
+size_t
+lwflat_count(const LWFLATREADER *reader)
+{
+	return reader ? (size_t)reader->count : 0;
+}
+
+/// @brief extent of all records, LW_FAILURE for an empty layer
+int
+lwflat_extent(const LWFLATREADER *reader, LWBOX *extent)
+{
+	if (reader == NULL || extent == NULL || reader->count == 0)
+		return LW_FAILURE;
+	*extent = reader->extent;
+	return LW_SUCCESS;
+}
+
+/// @brief read the record at position \a index of the file
+LWGEOM *
+lwflat_get(LWFLATREADER *reader, size_t index)
+{
+	if (reader == NULL || index >= reader->count)
+		return NULL;
+	uint64_t leaf = reader->levels[0] + index;
+	int last = leaf + 1 == reader->levels[1];
+	const uint8_t *p =
+	    flat_fetch(reader, reader->index_offset + leaf * FLAT_NODE_BYTES, (last ? 1 : 2) * FLAT_NODE_BYTES);
+	if (p == NULL)
+		return NULL;
+	uint64_t offset = flat_load_u64(p + 32);
+	uint64_t end = last ? reader->data_size : flat_load_u64(p + FLAT_NODE_BYTES + 32);
+	if (offset > end || end > reader->data_size || end - offset < 4)
+	{
+		lwnotice("flat parse error at offset %zu: %s",
+			 (size_t)(reader->index_offset + leaf * FLAT_NODE_BYTES),
+			 "bad record offset");
+		return NULL;
+	}
+	p = flat_fetch(reader, reader->data_offset + offset, (size_t)(end - offset));
+	return p ? flat_decode(reader, p, end - offset, reader->data_offset + offset) : NULL;
+}
+
+/// @brief deliver every record whose envelope meets \a box, in file order
+///
+/// The tree is searched level by level and only the matching records are
+/// read, records close together in the file share one fetch.
+/// @param func receives each geometry, NULL for a record that fails to
+/// decode, and its position in the file, returns 0 to stop
+/// @return number of records delivered
+size_t
+lwflat_query(LWFLATREADER *reader, const LWBOX *box, lwflat_query_func func, void *udata)
+{
+	flat_hits hits = {0};
+	size_t delivered = 0;
+	if (reader == NULL || box == NULL || func == NULL || reader->nlevels == 0)
+		return 0;
+	if (!flat_search(reader, box, &hits))
+	{
+		lwfree(hits.pp);
+		return 0;
+	}
+
+	for (size_t h = 0; h < hits.n;)
+	{
+		const flat_hit *first = hits.pp + h;
+		size_t g = h + 1;
+		while (g < hits.n && hits.pp[g].offset - hits.pp[g - 1].end <= FLAT_GAP &&
+		       hits.pp[g].end - first->offset <= FLAT_GROUP_MAX)
+			g++;
+		const uint8_t *base =
+		    flat_fetch(reader, reader->data_offset + first->offset, (size_t)(hits.pp[g - 1].end - first->offset));
+		if (base == NULL)
+		{
+			lwnotice("flat parse error at offset %zu: %s",
+				 (size_t)(reader->data_offset + first->offset),
+				 "record is truncated");
+			break;
+		}
+		for (; h < g; h++)
+		{
+			const flat_hit *hit = hits.pp + h;
+			LWGEOM *obj = flat_decode(reader,
+						  base + (hit->offset - first->offset),
+						  hit->end - hit->offset,
+						  reader->data_offset + hit->offset);
+			delivered++;
+			if (!func(obj, (size_t)hit->index, udata))
+			{
+				lwfree(hits.pp);
+				return delivered;
+			}
+		}
+	}
+	lwfree(hits.pp);
+	return delivered;
+}
@@ -0,0 +1,367 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+
+#include "lwgeom_parse.h"
+#include "lwgeom_xml.h"
+#include "lwpool.h"
+#include <string.h>
+#include <strings.h>
+
+/* ------------------------------ inner format ------------------------------ */
+
+/// inputs read per task
+#define FORMAT_BLOCK 256
+/// bytes of an XML document searched for the markers of its dialect
+#define FORMAT_XML_WINDOW 4096
+
+/// EWKB flags in the high bits of the type word, Z, M and SRID
+#define FORMAT_EWKB_FLAGS 0xE0000000u
+
+typedef struct {
+	const char *const *inputs;
+	const size_t *lens;
+	size_t count;
+	int format;
+	const LWPARSE_LIMITS *limits;
+	LWGEOM **geoms;
+	int *errors;
+	LWPARSE_RESULT *results;
+} format_job;
+
+static const char *const format_wkt_types[] = {
+	"POINT",
+	"LINESTRING",
+	"LINEARRING",
+	"POLYGON",
+	"MULTIPOINT",
+	"MULTILINESTRING",
+	"MULTIPOLYGON",
+	"GEOMETRYCOLLECTION",
+};
+
+static int
+format_hex(char c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static uint8_t
+format_hex_byte(const char *p)
+{
+	uint8_t v = 0;
+	for (int i = 0; i < 2; i++)
+		v = (uint8_t)(v << 4 | (p[i] <= '9' ? p[i] - '0' : (p[i] | 0x20) - 'a' + 10));
+	return v;
+}
+
+/// @brief WKB or EWKB from the byte order mark and the type word
+static int
+format_wkb(const uint8_t *b)
+{
+	uint32_t type = b[0] ? (uint32_t)b[4] << 24 | (uint32_t)b[3] << 16 | (uint32_t)b[2] << 8 | b[1]
+			     : (uint32_t)b[1] << 24 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 8 | b[4];
+	return type & FORMAT_EWKB_FLAGS ? LW_FORMAT_EWKB : LW_FORMAT_WKB;
+}
+
+static int
+format_contains(const char *p, const char *end, const char *needle)
+{
+	size_t n = strlen(needle);
+	for (; (size_t)(end - p) >= n; p++)
+	{
+		if (*p == *needle && memcmp(p, needle, n) == 0)
+			return LW_TRUE;
+	}
+	return LW_FALSE;
+}
+
+/// @brief tell GML 2, GML 3 and KML apart by the names used near the start of
+/// the document
+static int
+format_xml(const char *p, const char *end)
+{
+	if (end - p > FORMAT_XML_WINDOW)
+		end = p + FORMAT_XML_WINDOW;
+	if (format_contains(p, end, "gml"))
+	{
+		static const char *const gml3[] = {"posList", ":pos", "exterior", "interior", "Surface", "Curve", "/gml/3"};
+		for (size_t i = 0; i < sizeof(gml3) / sizeof(gml3[0]); i++)
+		{
+			if (format_contains(p, end, gml3[i]))
+				return LW_FORMAT_GML3;
+		}
+		return LW_FORMAT_GML2;
+	}
+	if (format_contains(p, end, "kml") || format_contains(p, end, "Placemark") ||
+	    format_contains(p, end, "<coordinates"))
+		return LW_FORMAT_KML;
+	return 0;
+}
+
+/// @brief WKT or EWKT from the leading keyword
+static int
+format_text(const char *p, const char *end)
+{
+	if (end - p >= 5 && strncasecmp(p, "SRID=", 5) == 0)
+		return LW_FORMAT_EWKT;
+	size_t len = 0;
+	while (p + len < end && ((p[len] | 0x20) >= 'a' && (p[len] | 0x20) <= 'z'))
+		len++;
+	for (size_t i = 0; i < sizeof(format_wkt_types) / sizeof(format_wkt_types[0]); i++)
+	{
+		size_t n = strlen(format_wkt_types[i]);
+		if (len >= n && len <= n + 2 && strncasecmp(p, format_wkt_types[i], n) == 0)
+			return LW_FORMAT_WKT;
+	}
+	return 0;
+}
+
+/// @brief read \a data as \a format with the limits of \a ctx, LW_FORMAT_AUTO
+/// detects the format first
+static LWGEOM *
+format_parse(int format, const char *data, size_t len, lwparse *ctx)
+{
+	if (data == NULL || len == 0)
+	{
+		ctx->code = format == LW_FORMAT_AUTO ? LW_PARSE_FORMAT : LW_PARSE_SYNTAX;
+		lwparse__fail(ctx, "geometry", 0, "empty input");
+		return NULL;
+	}
+	if (format == LW_FORMAT_AUTO)
+		format = lwgeom_detect_format(data, len);
+
+	LWGEOM *obj;
+	switch (format)
+	{
+	case LW_FORMAT_WKT:
+		obj = lwgeom__read_wkt(data, len, ctx);
+		break;
+	case LW_FORMAT_EWKT:
+		obj = lwgeom__read_ewkt(data, len, ctx);
+		break;
+	case LW_FORMAT_WKB:
+		obj = lwgeom__read_wkb((const uint8_t *)data, len, LW_FALSE, ctx);
+		break;
+	case LW_FORMAT_HEXWKB:
+		obj = lwgeom__read_hexwkb(data, len, ctx);
+		break;
+	case LW_FORMAT_EWKB:
+		obj = lwgeom__read_ewkb(data, len, ctx);
+		break;
+	case LW_FORMAT_GEOJSON:
+		obj = lwgeom__read_geojson(data, len, ctx);
+		break;
+	case LW_FORMAT_GML2:
+	case LW_FORMAT_GML3:
+		obj = lwxml__read_document(lwxml__gml_elements, data, len, ctx);
+		break;
+	case LW_FORMAT_KML:
+		obj = lwxml__read_document(lwxml__kml_elements, data, len, ctx);
+		break;
+	case LW_FORMAT_TWKB:
+		obj = lwgeom__read_twkb(data, len, ctx);
+		break;
+	case LW_FORMAT_SERIALIZED:
+		obj = lwgeom__read_serialized(data, len, LW_FALSE, ctx);
+		break;
+	case LW_FORMAT_POLYLINE:
+		obj = lwgeom__read_polyline(data, len, 5, ctx);
+		break;
+	case LW_FORMAT_POLYLINE6:
+		obj = lwgeom__read_polyline(data, len, 6, ctx);
+		break;
+	default:
+		ctx->code = LW_PARSE_FORMAT;
+		lwparse__fail(ctx, "geometry", 0, "format not recognized");
+		return NULL;
+	}
+	// the readers record every failure they detect, building the result is
+	// all that is left to fail
+	if (obj == NULL && ctx->result.code == LW_PARSE_OK)
+		lwparse__fail(ctx, "geometry", 0, lwparse__nomem(ctx));
+	return obj;
+}
+
+static void
+format__read_block(size_t index, void *udata)
+{
+	format_job *job = (format_job *)udata;
+	size_t end = LWMIN((index + 1) * FORMAT_BLOCK, job->count);
+	for (size_t i = index * FORMAT_BLOCK; i < end; i++)
+	{
+		const char *data = job->inputs[i];
+		size_t len = data == NULL ? 0 : job->lens ? job->lens[i] : strlen(data);
+		// without results failures go to lwnotice, empty inputs never did
+		lwparse ctx;
+		lwparse__init(&ctx, job->limits, job->results == NULL && len != 0);
+		LWGEOM *obj = format_parse(job->format, data, len, &ctx);
+		job->geoms[i] = obj;
+		if (job->results)
+			job->results[i] = ctx.result;
+		if (job->errors)
+		{
+			int code = ctx.result.code;
+			job->errors[i] = obj ? LW_READ_OK : code == LW_PARSE_FORMAT ? LW_READ_FORMAT : LW_READ_INVALID;
+		}
+	}
+}
+
+/* ------------------------------ input format ------------------------------ */
+
+/// @brief guess the format of \a data from its first bytes. Binary WKB starts
+/// with its byte order mark, hex WKB with "00" or "01", GeoJSON with '{', the
+/// XML dialects with '<' and WKT with a geometry keyword
+/// @return one of LW_FORMAT_*, 0 when the format is not recognized
+int
+lwgeom_detect_format(const char *data, size_t len)
+{
+	if (data == NULL || len == 0)
+		return 0;
+	const uint8_t *b = (const uint8_t *)data;
+	if (b[0] <= 1)
+		return len >= 5 ? format_wkb(b) : 0;
+
+	const char *p = data;
+	const char *end = data + len;
+	if (len >= 3 && b[0] == 0xEF && b[1] == 0xBB && b[2] == 0xBF)
+		p += 3;
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+		p++;
+	if (p == end)
+		return 0;
+
+	switch (*p)
+	{
+	case '{':
+		return LW_FORMAT_GEOJSON;
+	case '<':
+		return format_xml(p, end);
+	case '0':
+		if (end - p >= 10)
+		{
+			for (int i = 0; i < 10; i++)
+			{
+				if (!format_hex(p[i]))
+					return 0;
+			}
+			uint8_t head[5];
+			for (int i = 0; i < 5; i++)
+				head[i] = format_hex_byte(p + 2 * i);
+			if (head[0] <= 1)
+				return format_wkb(head) == LW_FORMAT_EWKB ? LW_FORMAT_EWKB : LW_FORMAT_HEXWKB;
+		}
+		return 0;
+	default:
+		return format_text(p, end);
+	}
+}
+
+/// @brief read \a data as \a format, one of LW_FORMAT_*
+LWGEOM *
+lwgeom_read_format(int format, const char *data, size_t len)
+{
+	if (data == NULL || len == 0)
+		return NULL;
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	return format_parse(format, data, len, &ctx);
+}
+
+/// @brief read \a data in whatever format lwgeom_detect_format finds
+LWGEOM *
+lwgeom_read_any(const char *data, size_t len)
+{
+	return lwgeom_read_format(LW_FORMAT_AUTO, data, len);
+}
+
+/// @brief read \a data as \a format without reporting through lwnotice
+///
+/// The reader stops at the first vertex, level or byte over \a limits, so a
+/// hostile input costs no more than the limits allow.
+/// @param format one of LW_FORMAT_*, or LW_FORMAT_AUTO to detect the format
+/// @param limits NULL for the defaults
+/// @param result receives the outcome, may be NULL
+/// @return the geometry, NULL when result->code says why not
+LWGEOM *
+lwgeom_parse(int format, const char *data, size_t len, const LWPARSE_LIMITS *limits, LWPARSE_RESULT *result)
+{
+	lwparse ctx;
+	lwparse__init(&ctx, limits, LW_FALSE);
+	LWGEOM *obj = format_parse(format, data, len, &ctx);
+	if (result)
+		*result = ctx.result;
+	return obj;
+}
+
+/// @brief read \a count inputs in parallel into \a geoms
+/// @param lens input lengths, NULL when every input is NUL terminated text
+/// @param format one of LW_FORMAT_*, or LW_FORMAT_AUTO to detect the format
+/// of every input on its own
+/// @param errors receives LW_READ_OK or the reason geoms[i] is NULL, may be
+/// NULL
+/// @return number of inputs read
+size_t
+lwgeom_read_many(const char *const *inputs,
+		 const size_t *lens,
+		 size_t count,
+		 int format,
+		 int nthreads,
+		 LWGEOM **geoms,
+		 int *errors)
+{
+	if (inputs == NULL || geoms == NULL)
+		return 0;
+	format_job job = {inputs, lens, count, format, NULL, geoms, errors, NULL};
+	lwpool_run((count + FORMAT_BLOCK - 1) / FORMAT_BLOCK, nthreads, format__read_block, &job);
+
+	size_t read = 0;
+	for (size_t i = 0; i < count; i++)
+		read += geoms[i] != NULL;
+	return read;
+}
+
+/// @brief lwgeom_read_many with \a limits on every input, the outcome of
+/// geoms[i] goes to results[i] instead of lwnotice
+/// @param results receives one LWPARSE_RESULT per input, may be NULL
+/// @return number of inputs read
+size_t
+lwgeom_parse_many(const char *const *inputs,
+		  const size_t *lens,
+		  size_t count,
+		  int format,
+		  const LWPARSE_LIMITS *limits,
+		  int nthreads,
+		  LWGEOM **geoms,
+		  LWPARSE_RESULT *results)
+{
+	if (inputs == NULL || geoms == NULL)
+		return 0;
+	format_job job = {inputs, lens, count, format, limits, geoms, NULL, results};
+	lwpool_run((count + FORMAT_BLOCK - 1) / FORMAT_BLOCK, nthreads, format__read_block, &job);
+
+	size_t read = 0;
+	for (size_t i = 0; i < count; i++)
+		read += geoms[i] != NULL;
+	return read;
+}
@@ -0,0 +1,383 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "lwgeom_geoarrow.h"
+
+#include "lwgeom_parse.h"
+#include "lwpool.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ----------------------------- inner geoarrow ----------------------------- */
+
+typedef struct {
+	const int32_t *offsets; ///< moved by the array offset, length + 1 entries
+	int64_t length;
+} ga_level;
+
+typedef struct {
+	uint8_t type;
+	int depth;
+	int hasz;
+	int hasm;
+	int ndim;
+	int separated;
+	int borrow;
+	const uint8_t *validity;
+	int64_t validity_offset;
+	ga_level levels[GA_DEPTH_MAX];
+	/// vertex 0 of every ordinate, moved by the array offsets. Interleaved
+	/// coordinates only use the first with a stride of ndim
+	const double *coords[4];
+	int64_t nv;
+	const uint8_t *wkb;
+	LWGEOM **geoms;
+	size_t count;
+} ga_reader;
+
+/// @brief find the extension name in Arrow metadata, an int32 pair count
+/// followed by every key and value as an int32 length and its bytes
+static uint8_t
+ga_extension_type(const char *metadata)
+{
+	if (metadata == NULL)
+		return 0;
+	int32_t n, klen, vlen;
+	const char *p = metadata;
+	memcpy(&n, p, 4);
+	p += 4;
+	for (int32_t i = 0; i < n; i++)
+	{
+		memcpy(&klen, p, 4);
+		const char *key = p + 4;
+		p = key + klen;
+		memcpy(&vlen, p, 4);
+		const char *value = p + 4;
+		p = value + vlen;
+		if ((size_t)klen != strlen(GA_KEY_NAME) || memcmp(key, GA_KEY_NAME, (size_t)klen) != 0)
+			continue;
+		for (uint8_t type = POINTTYPE; type <= COLLECTIONTYPE; type++)
+		{
+			const char *name = ga_extension_name(type);
+			if ((size_t)vlen == strlen(name) && memcmp(value, name, (size_t)vlen) == 0)
+				return type;
+		}
+		return 0;
+	}
+	return 0;
+}
+
+/// @brief the double values of an array of format "g", moved by its offset
+static const double *
+ga_doubles(const struct ArrowSchema *schema, const struct ArrowArray *array)
+{
+	if (strcmp(schema->format, "g") != 0 || array->n_buffers != 2 || array->buffers[1] == NULL)
+		return NULL;
+	return (const double *)array->buffers[1] + array->offset;
+}
+
+/// @brief take the coordinate array apart, interleaved or separated
+static int
+ga_parse_coords(ga_reader *r, const struct ArrowSchema *schema, const struct ArrowArray *array)
+{
+	r->nv = array->length;
+	if (strncmp(schema->format, "+w:", 3) == 0)
+	{
+		r->ndim = atoi(schema->format + 3);
+		if (r->ndim < 2 || r->ndim > 4 || schema->n_children != 1 || array->n_children != 1)
+			return LW_FAILURE;
+		// the name of the values tells xyz from xym
+		const char *dims = schema->children[0]->name;
+		r->hasm = r->ndim == 4 || (r->ndim == 3 && dims && strcmp(dims, "xym") == 0);
+		r->hasz = r->ndim - 2 - r->hasm;
+		r->coords[0] = ga_doubles(schema->children[0], array->children[0]);
+		if (r->coords[0] == NULL && r->nv > 0)
+			return LW_FAILURE;
+		if (r->coords[0])
+			r->coords[0] += array->offset * r->ndim;
+		return LW_SUCCESS;
+	}
+	if (strcmp(schema->format, "+s") != 0 || schema->n_children < 2 || schema->n_children > 4 ||
+	    array->n_children != schema->n_children)
+		return LW_FAILURE;
+
+	// ordinates are matched by name, x and y are required
+	static const char names[] = "xyzm";
+	const double *ordinates[4] = {NULL, NULL, NULL, NULL};
+	for (int64_t i = 0; i < schema->n_children; i++)
+	{
+		const char *name = schema->children[i]->name;
+		const char *at = name && name[0] && !name[1] ? strchr(names, name[0]) : NULL;
+		const double *v = ga_doubles(schema->children[i], array->children[i]);
+		if (at == NULL || (v == NULL && r->nv > 0))
+			return LW_FAILURE;
+		ordinates[at - names] = v ? v + array->offset : v;
+	}
+	if (r->nv > 0 && (ordinates[0] == NULL || ordinates[1] == NULL))
+		return LW_FAILURE;
+	r->separated = LW_TRUE;
+	r->hasz = ordinates[2] != NULL;
+	r->hasm = ordinates[3] != NULL;
+	r->ndim = 2 + r->hasz + r->hasm;
+	int k = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		if (ordinates[i] || i < 2)
+			r->coords[k++] = ordinates[i];
+	}
+	return LW_SUCCESS;
+}
+
+/// @brief offsets must rise and stay within the \a next elements below
+static int
+ga_check_offsets(const ga_level *level, int64_t next)
+{
+	if (level->length > 0 && level->offsets == NULL)
+		return LW_FAILURE;
+	for (int64_t i = 0; i < level->length; i++)
+	{
+		if (level->offsets[i] < 0 || level->offsets[i] > level->offsets[i + 1])
+			return LW_FAILURE;
+	}
+	return level->length == 0 || level->offsets[level->length] <= next;
+}
+
+static int
+ga_parse(ga_reader *r, const struct ArrowSchema *schema, const struct ArrowArray *array)
+{
+	r->type = ga_extension_type(schema->metadata);
+	if (r->type == 0 && strcmp(schema->format, "z") == 0)
+		r->type = COLLECTIONTYPE;
+	if (r->type == 0)
+		return LW_FAILURE;
+	r->depth = ga_depth(r->type);
+	r->validity = array->n_buffers > 0 && array->null_count != 0 ? (const uint8_t *)array->buffers[0] : NULL;
+	r->validity_offset = array->offset;
+
+	if (r->type == COLLECTIONTYPE)
+	{
+		if (strcmp(schema->format, "z") != 0 || array->n_buffers != 3)
+			return LW_FAILURE;
+		r->levels[0].offsets = (const int32_t *)array->buffers[1] + array->offset;
+		r->levels[0].length = array->length;
+		r->wkb = (const uint8_t *)array->buffers[2];
+		return ga_check_offsets(&r->levels[0], INT32_MAX) && (r->wkb || array->length == 0);
+	}
+
+	for (int k = 0; k < r->depth; k++)
+	{
+		if (strcmp(schema->format, "+l") != 0 || schema->n_children != 1 || array->n_children != 1 ||
+		    array->n_buffers != 2 || array->buffers[1] == NULL)
+			return LW_FAILURE;
+		r->levels[k].offsets = (const int32_t *)array->buffers[1] + array->offset;
+		r->levels[k].length = array->length;
+		schema = schema->children[0];
+		array = array->children[0];
+	}
+	if (!ga_parse_coords(r, schema, array))
+		return LW_FAILURE;
+	for (int k = 0; k < r->depth; k++)
+	{
+		if (!ga_check_offsets(&r->levels[k], k + 1 < r->depth ? r->levels[k + 1].length : r->nv))
+			return LW_FAILURE;
+	}
+	return LW_SUCCESS;
+}
+
+static LWGEOM *
+ga_add(LWGEOM *mobj, LWGEOM *obj)
+{
+	if (obj == NULL || lwgeom__add(mobj, obj) == NULL)
+	{
+		lwgeom_free(obj);
+		lwgeom_free(mobj);
+		return NULL;
+	}
+	return mobj;
+}
+
+/// @brief \a n vertices from \a v as a geometry of \a type, interleaved
+/// coordinates are borrowed when allowed and aligned
+static LWGEOM *
+ga_read_run(const ga_reader *r, uint8_t type, int64_t v, int64_t n)
+{
+	if (n == 0)
+		return lwgeom__new(type, r->hasz, r->hasm);
+
+	lwflags_t flags = 0;
+	LWFLAGS_SET_Z(flags, r->hasz);
+	LWFLAGS_SET_M(flags, r->hasm);
+	size_t ndim = (size_t)r->ndim;
+	if (!r->separated)
+	{
+		const double *src = r->coords[0] + v * ndim;
+		if (r->borrow && ((uintptr_t)src % sizeof(double)) == 0)
+			return lwgeom__new_points(type, (uint32_t)n, (double *)src, flags, LW_TRUE);
+	}
+
+	double *pp = (double *)lwmalloc((size_t)n * ndim * sizeof(double));
+	if (pp == NULL)
+		return NULL;
+	if (!r->separated)
+		memcpy(pp, r->coords[0] + v * ndim, (size_t)n * ndim * sizeof(double));
+	else
+	{
+		for (size_t k = 0; k < ndim; k++)
+		{
+			const double *src = r->coords[k] + v;
+			for (int64_t j = 0; j < n; j++)
+				pp[j * ndim + k] = src[j];
+		}
+	}
+	LWGEOM *obj = lwgeom__new_points(type, (uint32_t)n, pp, flags, LW_FALSE);
+	if (obj == NULL)
+		lwfree(pp);
+	return obj;
+}
+
+/// @brief a point whose ordinates are all NaN is POINT EMPTY
+static LWGEOM *
+ga_read_point(const ga_reader *r, int64_t v)
+{
+	for (int k = 0; k < r->ndim; k++)
+	{
+		double d = r->separated ? r->coords[k][v] : r->coords[0][v * r->ndim + k];
+		if (!isnan(d))
+			return ga_read_run(r, POINTTYPE, v, 1);
+	}
+	return lwgeom__new(POINTTYPE, r->hasz, r->hasm);
+}
+
+/// @brief polygon \a e of \a level, its rings are the elements of the level
+/// below
+static LWGEOM *
+ga_read_polygon(const ga_reader *r, int level, int64_t e)
+{
+	const int32_t *rings = r->levels[level].offsets;
+	const int32_t *vertices = r->levels[level + 1].offsets;
+	LWGEOM *poly = lwgeom__new(POLYTYPE, r->hasz, r->hasm);
+	if (poly == NULL)
+		return NULL;
+	for (int32_t i = rings[e]; i < rings[e + 1]; i++)
+	{
+		LWGEOM *ring = ga_read_run(r, LINETYPE, vertices[i], vertices[i + 1] - vertices[i]);
+		if (ring)
+			ring->flags |= i == rings[e] ? LW_FLAG_SHELL_RING : LW_FLAG_HOLE_RING;
+		if (!ga_add(poly, ring))
+			return NULL;
+	}
+	return poly;
+}
+
+static LWGEOM *
+ga_read_row(const ga_reader *r, int64_t i)
+{
+	const int32_t *o = r->levels[0].offsets;
+	switch (r->type)
+	{
+	case POINTTYPE:
+		return ga_read_point(r, i);
+	case LINETYPE:
+		return ga_read_run(r, LINETYPE, o[i], o[i + 1] - o[i]);
+	case POLYTYPE:
+		return ga_read_polygon(r, 0, i);
+	case COLLECTIONTYPE: {
+		lwparse ctx;
+		lwparse__init(&ctx, NULL, LW_TRUE);
+		return lwgeom__read_wkb(r->wkb + o[i], (size_t)(o[i + 1] - o[i]), r->borrow, &ctx);
+	}
+	default:
+		break;
+	}
+
+	LWGEOM *mobj = lwgeom__new(r->type, r->hasz, r->hasm);
+	if (mobj == NULL)
+		return NULL;
+	const int32_t *o1 = r->levels[1].offsets;
+	for (int32_t e = o[i]; e < o[i + 1]; e++)
+	{
+		LWGEOM *obj;
+		if (r->type == MPOINTTYPE)
+			obj = ga_read_point(r, e);
+		else if (r->type == MLINETYPE)
+			obj = ga_read_run(r, LINETYPE, o1[e], o1[e + 1] - o1[e]);
+		else
+			obj = ga_read_polygon(r, 1, e);
+		if (!ga_add(mobj, obj))
+			return NULL;
+	}
+	return mobj;
+}
+
+static void
+ga__read_block(size_t index, void *udata)
+{
+	ga_reader *r = (ga_reader *)udata;
+	size_t last = LWMIN((index + 1) * GA_BLOCK, r->count);
+	for (size_t i = index * GA_BLOCK; i < last; i++)
+	{
+		int64_t bit = r->validity_offset + (int64_t)i;
+		if (r->validity && !(r->validity[bit / 8] & (1 << (bit % 8))))
+			r->geoms[i] = NULL;
+		else
+			r->geoms[i] = ga_read_row(r, (int64_t)i);
+	}
+}
+
+/* ----------------------------- input geoarrow ----------------------------- */
+
+/// @brief import a GeoArrow array of a native layout, interleaved or
+/// separated, or of geoarrow.wkb, on the thread pool
+/// @param options LW_GEOARROW_BORROW lets geometries point at the 8 byte
+/// aligned interleaved coordinates or native WKB of the array
+/// @param geoms receives array->length geometries, NULL for null rows and
+/// rows that could not be converted
+/// @return number of rows converted
+size_t
+lwgeom_read_geoarrow(const struct ArrowSchema *schema,
+		     const struct ArrowArray *array,
+		     int options,
+		     int nthreads,
+		     LWGEOM **geoms)
+{
+	if (schema == NULL || array == NULL || geoms == NULL || array->length < 0)
+		return 0;
+
+	ga_reader r;
+	memset(&r, 0, sizeof(r));
+	r.borrow = (options & LW_GEOARROW_BORROW) != 0;
+	r.geoms = geoms;
+	r.count = (size_t)array->length;
+	if (!ga_parse(&r, schema, array))
+	{
+		lwnotice("GeoArrow import: unsupported or inconsistent array of format %s", schema->format);
+		memset(geoms, 0, r.count * sizeof(LWGEOM *));
+		return 0;
+	}
+	lwpool_run((r.count + GA_BLOCK - 1) / GA_BLOCK, nthreads, ga__read_block, &r);
+
+	size_t n = 0;
+	for (size_t i = 0; i < r.count; i++)
+		n += geoms[i] != NULL;
+	return n;
+}
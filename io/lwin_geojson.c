@@ -22,8 +22,1227 @@
 
 #include "liblwgeom_internel.h"
 
+#include "lwgeom_number.h"
+#include "lwgeom_parse.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ---------------------------- structural scan ----------------------------- */
+
+/// Scanning for the end of a JSON value only has to stop at quotes, escapes
+/// and brackets. Eight bytes are tested at a time (SWAR), so runs of
+/// coordinates and property text are skipped a word per step.
+
+#define GJ_ONES  UINT64_C(0x0101010101010101)
+#define GJ_HIGHS UINT64_C(0x8080808080808080)
+
+/// @brief high bit set in every byte of \a w equal to \a c
+static inline uint64_t
+gj_match(uint64_t w, uint8_t c)
+{
+	uint64_t x = w ^ (GJ_ONES * c);
+	return (x - GJ_ONES) & ~x & GJ_HIGHS;
+}
+
+/// @brief first quote, backslash or bracket in [p, end)
+static const char *
+gj_find_structural(const char *p, const char *end, int in_string)
+{
+	while (end - p >= 8)
+	{
+		uint64_t w;
+		memcpy(&w, p, 8);
+		uint64_t m;
+		if (in_string)
+		{
+			m = gj_match(w, '"') | gj_match(w, '\\');
+		}
+		else
+		{
+			// '[' and ']' differ from '{' and '}' only in bit 0x20
+			uint64_t f = w | (GJ_ONES * 0x20);
+			m = gj_match(w, '"') | gj_match(f, '{') | gj_match(f, '}');
+		}
+		if (m)
+			break;
+		p += 8;
+	}
+	for (; p < end; p++)
+	{
+		char c = *p;
+		if (c == '"' || (in_string ? c == '\\' : (c == '{' || c == '}' || c == '[' || c == ']')))
+			return p;
+	}
+	return end;
+}
+
+/// resumable state of a scan for the end of a value
+typedef struct {
+	int depth;
+	int in_string;
+	int escape; ///< the previous chunk ended in a backslash
+} gj_scan;
+
+/// @brief advance over the remainder of an object, array or string
+/// @return pointer past the value, NULL if [p, end) ends first
+static const char *
+gj_scan_value(gj_scan *scan, const char *p, const char *end, const char **resume)
+{
+	if (scan->escape && p < end)
+	{
+		p++;
+		scan->escape = 0;
+	}
+	while (p < end)
+	{
+		p = gj_find_structural(p, end, scan->in_string);
+		if (p == end)
+			break;
+		char c = *p++;
+		if (scan->in_string)
+		{
+			if (c == '\\')
+			{
+				if (p == end)
+				{
+					scan->escape = 1;
+					break;
+				}
+				p++;
+			}
+			else
+			{
+				scan->in_string = 0;
+				if (scan->depth == 0)
+					return p;
+			}
+		}
+		else if (c == '"')
+		{
+			scan->in_string = 1;
+		}
+		else if (c == '{' || c == '[')
+		{
+			scan->depth++;
+		}
+		else if (--scan->depth == 0)
+		{
+			return p;
+		}
+	}
+	*resume = p;
+	return NULL;
+}
+
+/* ------------------------------ json walking ------------------------------ */
+
+static inline const char *
+gj_skip_space(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+		p++;
+	return p;
+}
+
+/// @brief end of the complete value starting at \a p, NULL if malformed
+static const char *
+gj_skip_value(const char *p, const char *end)
+{
+	if (p >= end)
+		return NULL;
+	if (*p == '{' || *p == '[' || *p == '"')
+	{
+		gj_scan scan = {0, 0, 0};
+		const char *resume;
+		if (*p == '"')
+			scan.in_string = 1;
+		else
+			scan.depth = 1;
+		return gj_scan_value(&scan, p + 1, end, &resume);
+	}
+	// number, true, false or null
+	const char *q = p;
+	while (q < end && *q != ',' && *q != '}' && *q != ']' && *q != ' ' && *q != '\t' && *q != '\n' && *q != '\r')
+		q++;
+	return q > p ? q : NULL;
+}
+
+/// @brief read a string, the content is returned raw without unescaping
+static const char *
+gj_read_string(const char *p, const char *end, const char **str, size_t *len)
+{
+	if (p >= end || *p != '"')
+		return NULL;
+	const char *q = gj_skip_value(p, end);
+	if (q == NULL)
+		return NULL;
+	*str = p + 1;
+	*len = (size_t)(q - p - 2);
+	return q;
+}
+
+static int
+gj_equals(const char *str, size_t len, const char *word)
+{
+	return strlen(word) == len && memcmp(str, word, len) == 0;
+}
+
+/// Iterates the members of an object: call with *p at '{' first, then with
+/// the position past each value until it returns 0.
+static int
+gj_next_member(const char **p, const char *end, const char **key, size_t *keylen, int *first)
+{
+	const char *q = gj_skip_space(*p, end);
+	if (*first)
+	{
+		if (q >= end || *q != '{')
+			return -1;
+		q = gj_skip_space(q + 1, end);
+		*first = 0;
+		if (q < end && *q == '}')
+		{
+			*p = q + 1;
+			return 0;
+		}
+	}
+	else
+	{
+		if (q < end && *q == '}')
+		{
+			*p = q + 1;
+			return 0;
+		}
+		if (q >= end || *q != ',')
+			return -1;
+		q = gj_skip_space(q + 1, end);
+	}
+	q = gj_read_string(q, end, key, keylen);
+	if (q == NULL)
+		return -1;
+	q = gj_skip_space(q, end);
+	if (q >= end || *q != ':')
+		return -1;
+	*p = gj_skip_space(q + 1, end);
+	return 1;
+}
+
+/* ------------------------------- coordinates ------------------------------ */
+
+/// Coordinates are read straight from the text into a scratch buffer that is
+/// reused for every sequence, without building any intermediate tree.
+typedef struct {
+	double *scratch;
+	size_t scratch_size;
+	int hasz;
+	int hasm;
+	int dims_fixed;
+	const char *start; ///< offsets of errors are counted from here
+	const char *error;
+	size_t error_offset;
+	lwparse *ctx;
+} gj_parser;
+
+static void
+gj_set_error(gj_parser *parser, const char *at, const char *message)
+{
+	if (parser->error)
+		return;
+	parser->error = message;
+	parser->error_offset = (size_t)(at - parser->start);
+}
+
+static int
+gj_reserve(gj_parser *parser, size_t need)
+{
+	if (need <= parser->scratch_size)
+		return LW_TRUE;
+	size_t size = parser->scratch_size ? parser->scratch_size : 256;
+	while (size < need)
+		size *= 2;
+	double *scratch = (double *)lwrealloc(parser->scratch, size * sizeof(double));
+	if (scratch == NULL)
+		return LW_FALSE;
+	parser->scratch = scratch;
+	parser->scratch_size = size;
+	return LW_TRUE;
+}
+
+/// @brief read a position "[x, y]", "[x, y, z]" or "[x, y, z, m]"
+static const char *
+gj_read_position(gj_parser *parser, const char *p, const char *end, size_t off)
+{
+	p = gj_skip_space(p, end);
+	const char *start = p;
+	const char *error = lwparse__vertices(parser->ctx, 1);
+	if (error == NULL && !gj_reserve(parser, off + 4))
+		error = lwparse__nomem(parser->ctx);
+	if (error)
+	{
+		gj_set_error(parser, start, error);
+		return NULL;
+	}
+	double c[4] = {0, 0, 0, 0};
+	int n = 0;
+	if (p >= end || *p != '[')
+		goto fail;
+	p = gj_skip_space(p + 1, end);
+	while (p < end && *p != ']')
+	{
+		if (n > 0)
+		{
+			if (*p != ',')
+				goto fail;
+			p = gj_skip_space(p + 1, end);
+		}
+		double v;
+		p = lwnumber_parse(p, end, &v);
+		if (p == NULL || n == 4)
+			goto fail;
+		c[n++] = v;
+		p = gj_skip_space(p, end);
+	}
+	if (p >= end || n < 2)
+		goto fail;
+
+	if (!parser->dims_fixed)
+	{
+		parser->hasz = n >= 3;
+		parser->hasm = n == 4;
+		parser->dims_fixed = LW_TRUE;
+	}
+	int cdim = LW_POINTBYTESIZE(parser->hasz, parser->hasm);
+	if (n != cdim)
+	{
+		gj_set_error(parser, start, "positions with different dimensions");
+		return NULL;
+	}
+	memcpy(parser->scratch + off, c, (size_t)cdim * sizeof(double));
+	return p + 1;
+
+fail:
+	gj_set_error(parser, start, "invalid position");
+	return NULL;
+}
+
+/// @brief read "[pos, pos, ...]" as one geometry of \a type
+static const char *
+gj_read_positions(gj_parser *parser, const char *p, const char *end, uint8_t type, LWGEOM **out)
+{
+	*out = NULL;
+	p = gj_skip_space(p, end);
+	if (p >= end || *p != '[')
+	{
+		gj_set_error(parser, p, "expected an array of positions");
+		return NULL;
+	}
+	p = gj_skip_space(p + 1, end);
+	uint32_t npoints = 0;
+	while (p < end && *p != ']')
+	{
+		if (npoints > 0)
+		{
+			if (*p != ',')
+			{
+				gj_set_error(parser, p, "expected ','");
+				return NULL;
+			}
+			p++;
+		}
+		p = gj_read_position(parser, p, end, (size_t)npoints * LW_POINTBYTESIZE(parser->hasz, parser->hasm));
+		if (p == NULL)
+			return NULL;
+		npoints++;
+		p = gj_skip_space(p, end);
+	}
+	if (p >= end)
+	{
+		gj_set_error(parser, p, "unterminated array");
+		return NULL;
+	}
+
+	LWGEOM *obj;
+	if (npoints == 0)
+	{
+		obj = lwgeom__new(type, parser->hasz, parser->hasm);
+	}
+	else
+	{
+		size_t msize = (size_t)npoints * LW_POINTBYTESIZE(parser->hasz, parser->hasm) * sizeof(double);
+		double *pp = (double *)lwmalloc(msize);
+		if (pp == NULL)
+		{
+			gj_set_error(parser, p, lwparse__nomem(parser->ctx));
+			return NULL;
+		}
+		memcpy(pp, parser->scratch, msize);
+		lwflags_t flags = 0;
+		LWFLAGS_SET_Z(flags, parser->hasz);
+		LWFLAGS_SET_M(flags, parser->hasm);
+		obj = lwgeom__new_points(type, npoints, pp, flags, LW_FALSE);
+		if (obj == NULL)
+			lwfree(pp);
+	}
+	if (obj == NULL)
+	{
+		gj_set_error(parser, p, lwparse__nomem(parser->ctx));
+		return NULL;
+	}
+	*out = obj;
+	return p + 1;
+}
+
+static LWGEOM *
+gj_add(gj_parser *parser, const char *at, LWGEOM *mobj, LWGEOM *obj)
+{
+	if (obj == NULL)
+	{
+		lwgeom_free(mobj);
+		return NULL;
+	}
+	if (lwgeom__add(mobj, obj) == NULL)
+	{
+		gj_set_error(parser, at, lwparse__nomem(parser->ctx));
+		lwgeom_free(obj);
+		lwgeom_free(mobj);
+		return NULL;
+	}
+	return mobj;
+}
+
+/// @brief read the "coordinates" member of a geometry that is not a
+/// GeometryCollection
+static const char *
+gj_read_coordinates(gj_parser *parser, const char *p, const char *end, uint8_t type, LWGEOM **out)
+{
+	*out = NULL;
+	if (type == POINTTYPE)
+	{
+		p = gj_skip_space(p, end);
+		// an empty array is POINT EMPTY
+		const char *q = p < end && *p == '[' ? gj_skip_space(p + 1, end) : NULL;
+		if (q && q < end && *q == ']')
+		{
+			*out = lwgeom__new(POINTTYPE, parser->hasz, parser->hasm);
+			return q + 1;
+		}
+		p = gj_read_position(parser, p, end, 0);
+		if (p == NULL)
+			return NULL;
+		*out = lwgeom_point(parser->scratch, parser->hasz, parser->hasm);
+		if (*out == NULL)
+		{
+			gj_set_error(parser, p, lwparse__nomem(parser->ctx));
+			return NULL;
+		}
+		return p;
+	}
+	if (type == LINETYPE)
+		return gj_read_positions(parser, p, end, LINETYPE, out);
+
+	uint8_t child = type == MPOLYTYPE ? POLYTYPE : (type == MPOINTTYPE ? POINTTYPE : LINETYPE);
+	LWGEOM *mobj = lwgeom__new(type, parser->hasz, parser->hasm);
+	if (mobj == NULL)
+		return NULL;
+	p = gj_skip_space(p, end);
+	if (p >= end || *p != '[')
+	{
+		gj_set_error(parser, p, "expected an array");
+		lwgeom_free(mobj);
+		return NULL;
+	}
+	p = gj_skip_space(p + 1, end);
+	while (p < end && *p != ']')
+	{
+		if (mobj->ngeoms > 0)
+		{
+			if (*p != ',')
+			{
+				gj_set_error(parser, p, "expected ','");
+				lwgeom_free(mobj);
+				return NULL;
+			}
+			p++;
+		}
+		LWGEOM *obj;
+		if (type == POLYTYPE)
+		{
+			p = gj_read_positions(parser, p, end, LINETYPE, &obj);
+			if (obj)
+				obj->flags |= mobj->ngeoms == 0 ? LW_FLAG_SHELL_RING : LW_FLAG_HOLE_RING;
+		}
+		else
+		{
+			p = gj_read_coordinates(parser, p, end, child, &obj);
+		}
+		if (!gj_add(parser, p, mobj, obj))
+			return NULL;
+		p = gj_skip_space(p, end);
+	}
+	if (p >= end)
+	{
+		gj_set_error(parser, p, "unterminated array");
+		lwgeom_free(mobj);
+		return NULL;
+	}
+	*out = mobj;
+	return p + 1;
+}
+
+/* -------------------------------- geometries ------------------------------ */
+
+static const struct {
+	const char *name;
+	uint8_t type;
+} gj_types[] = {
+	{"Point", POINTTYPE},
+	{"LineString", LINETYPE},
+	{"Polygon", POLYTYPE},
+	{"MultiPoint", MPOINTTYPE},
+	{"MultiLineString", MLINETYPE},
+	{"MultiPolygon", MPOLYTYPE},
+	{"GeometryCollection", COLLECTIONTYPE},
+};
+
+/// @brief apply the final dimensions to empty parts created before the first
+/// position was seen
+static void
+gj_fix_dims(LWGEOM *obj, int hasz, int hasm)
+{
+	LWFLAGS_SET_Z(obj->flags, hasz);
+	LWFLAGS_SET_M(obj->flags, hasm);
+	LWFLAGS_SET_Z(obj->env.flags, hasz);
+	LWFLAGS_SET_M(obj->env.flags, hasm);
+	for (uint32_t i = 0; i < obj->ngeoms; i++)
+	{
+		if (obj->geoms[i]->npoints == 0)
+			gj_fix_dims(obj->geoms[i], hasz, hasm);
+	}
+}
+
+static const char *gj_read_geometry(gj_parser *parser, const char *p, const char *end, int depth, LWGEOM **out);
+
+static const char *
+gj_read_geometries(gj_parser *parser, const char *p, const char *end, int depth, LWGEOM **out)
+{
+	*out = NULL;
+	LWGEOM *mobj = lwgeom__new(COLLECTIONTYPE, 0, 0);
+	if (mobj == NULL)
+		return NULL;
+	p = gj_skip_space(p, end);
+	if (p >= end || *p != '[')
+	{
+		gj_set_error(parser, p, "expected an array of geometries");
+		lwgeom_free(mobj);
+		return NULL;
+	}
+	p = gj_skip_space(p + 1, end);
+	int hasz = 0, hasm = 0;
+	while (p < end && *p != ']')
+	{
+		if (mobj->ngeoms > 0)
+		{
+			if (*p != ',')
+			{
+				gj_set_error(parser, p, "expected ','");
+				lwgeom_free(mobj);
+				return NULL;
+			}
+			p = gj_skip_space(p + 1, end);
+		}
+		// every member infers its own dimensions
+		parser->dims_fixed = LW_FALSE;
+		LWGEOM *obj;
+		p = gj_read_geometry(parser, p, end, depth + 1, &obj);
+		if (obj)
+		{
+			hasz |= lwgeom_has_z(obj);
+			hasm |= lwgeom_has_m(obj);
+		}
+		if (!gj_add(parser, p, mobj, obj))
+			return NULL;
+		p = gj_skip_space(p, end);
+	}
+	if (p >= end)
+	{
+		gj_set_error(parser, p, "unterminated array");
+		lwgeom_free(mobj);
+		return NULL;
+	}
+	LWFLAGS_SET_Z(mobj->flags, hasz);
+	LWFLAGS_SET_M(mobj->flags, hasm);
+	mobj->env.flags = mobj->flags & (LW_FLAG_Z | LW_FLAG_M);
+	*out = mobj;
+	return p + 1;
+}
+
+/// @brief read a geometry object, members may come in any order
+static const char *
+gj_read_geometry(gj_parser *parser, const char *p, const char *end, int depth, LWGEOM **out)
+{
+	*out = NULL;
+	const char *error = lwparse__depth(parser->ctx, depth);
+	if (error)
+	{
+		gj_set_error(parser, p, error);
+		return NULL;
+	}
+
+	const char *start = p;
+	const char *at = p;
+	const char *coords = NULL;
+	const char *geoms = NULL;
+	int type = 0;
+	const char *key;
+	size_t keylen;
+	int first = 1;
+	int r;
+	while ((r = gj_next_member(&p, end, &key, &keylen, &first)) > 0)
+	{
+		at = p;
+		if (gj_equals(key, keylen, "type"))
+		{
+			const char *name;
+			size_t namelen;
+			if (gj_read_string(p, end, &name, &namelen) == NULL)
+				break;
+			for (size_t i = 0; i < sizeof(gj_types) / sizeof(gj_types[0]); i++)
+			{
+				if (gj_equals(name, namelen, gj_types[i].name))
+					type = gj_types[i].type;
+			}
+			if (type == 0)
+			{
+				gj_set_error(parser, p, "unknown geometry type");
+				return NULL;
+			}
+		}
+		else if (gj_equals(key, keylen, "coordinates"))
+		{
+			coords = p;
+		}
+		else if (gj_equals(key, keylen, "geometries"))
+		{
+			geoms = p;
+		}
+		p = gj_skip_value(p, end);
+		if (p == NULL)
+			break;
+	}
+	if (r != 0)
+	{
+		gj_set_error(parser, p ? p : at, "invalid geometry object");
+		return NULL;
+	}
+	if (type == 0)
+	{
+		gj_set_error(parser, start, "geometry without type");
+		return NULL;
+	}
+
+	if (type == COLLECTIONTYPE)
+	{
+		if (geoms == NULL)
+		{
+			gj_set_error(parser, start, "GeometryCollection without geometries");
+			return NULL;
+		}
+		if (gj_read_geometries(parser, geoms, end, depth, out) == NULL)
+			return NULL;
+		return p;
+	}
+	if (coords == NULL)
+	{
+		gj_set_error(parser, start, "geometry without coordinates");
+		return NULL;
+	}
+	parser->dims_fixed = LW_FALSE;
+	parser->hasz = parser->hasm = LW_FALSE;
+	if (gj_read_coordinates(parser, coords, end, (uint8_t)type, out) == NULL)
+		return NULL;
+	if (type != POINTTYPE && type != LINETYPE)
+		gj_fix_dims(*out, parser->hasz, parser->hasm);
+	return p;
+}
+
+/// @brief read one feature object, the geometry may be null
+/// @return LW_TRUE on success
+static int
+gj_read_feature(gj_parser *parser, const char *p, const char *end, LWGEOM **geom, const char **props,
+		size_t *props_len)
+{
+	*geom = NULL;
+	*props = NULL;
+	*props_len = 0;
+	const char *key;
+	size_t keylen;
+	int first = 1;
+	int r;
+	const char *value = p;
+	while ((r = gj_next_member(&p, end, &key, &keylen, &first)) > 0)
+	{
+		value = p;
+		p = gj_skip_value(p, end);
+		if (p == NULL)
+			break;
+		if (gj_equals(key, keylen, "geometry") && *geom == NULL)
+		{
+			if (*value == '{' && gj_read_geometry(parser, value, p, 0, geom) == NULL)
+				return LW_FALSE;
+		}
+		else if (gj_equals(key, keylen, "properties"))
+		{
+			*props = value;
+			*props_len = (size_t)(p - value);
+		}
+	}
+	if (r != 0)
+	{
+		gj_set_error(parser, p ? p : value, "invalid feature object");
+		lwgeom_free(*geom);
+		*geom = NULL;
+		return LW_FALSE;
+	}
+	return LW_TRUE;
+}
+
+/* ------------------------------ input geojson ----------------------------- */
+
+LWGEOM *
+lwgeom__read_geojson(const char *data, size_t len, lwparse *ctx)
+{
+	if (data == NULL || !lwparse__text(ctx, "GeoJSON", data, &len))
+		return NULL;
+	const char *end = data + len;
+	const char *p = gj_skip_space(data, end);
+
+	// look at "type" first, it may follow the other members
+	const char *type = NULL;
+	size_t typelen = 0;
+	const char *features = NULL;
+	const char *q = p, *key;
+	size_t keylen;
+	int first = 1;
+	while (gj_next_member(&q, end, &key, &keylen, &first) > 0)
+	{
+		if (gj_equals(key, keylen, "type"))
+			gj_read_string(q, end, &type, &typelen);
+		else if (gj_equals(key, keylen, "features"))
+			features = q;
+		q = gj_skip_value(q, end);
+		if (q == NULL)
+			break;
+	}
+
+	gj_parser parser;
+	memset(&parser, 0, sizeof(parser));
+	parser.start = data;
+	parser.ctx = ctx;
+	LWGEOM *obj = NULL;
+	if (type && gj_equals(type, typelen, "Feature"))
+	{
+		const char *props;
+		size_t props_len;
+		gj_read_feature(&parser, p, end, &obj, &props, &props_len);
+		if (obj == NULL)
+			gj_set_error(&parser, p, "feature without geometry");
+	}
+	else if (type && gj_equals(type, typelen, "FeatureCollection"))
+	{
+		obj = lwgeom__new(COLLECTIONTYPE, 0, 0);
+		q = features ? gj_skip_space(features, end) : NULL;
+		if (obj == NULL)
+			gj_set_error(&parser, p, lwparse__nomem(ctx));
+		else if (q == NULL || q >= end || *q != '[')
+			gj_set_error(&parser, features ? features : p, "FeatureCollection without features");
+		else
+			q = gj_skip_space(q + 1, end);
+		for (size_t n = 0; obj && !parser.error && q < end && *q != ']'; n++)
+		{
+			if (n > 0)
+			{
+				if (*q != ',')
+				{
+					gj_set_error(&parser, q, "expected ','");
+					break;
+				}
+				q = gj_skip_space(q + 1, end);
+			}
+			const char *fend = gj_skip_value(q, end);
+			LWGEOM *geom;
+			const char *props;
+			size_t props_len;
+			if (fend == NULL || !gj_read_feature(&parser, q, fend, &geom, &props, &props_len))
+			{
+				gj_set_error(&parser, q, "invalid feature");
+				break;
+			}
+			if (geom && !gj_add(&parser, q, obj, geom))
+				obj = NULL;
+			q = gj_skip_space(fend, end);
+		}
+		if (obj && obj->ngeoms > 0)
+		{
+			LWFLAGS_SET_Z(obj->flags, lwgeom_has_z(obj->geoms[0]));
+			LWFLAGS_SET_M(obj->flags, lwgeom_has_m(obj->geoms[0]));
+			obj->env.flags = obj->flags & (LW_FLAG_Z | LW_FLAG_M);
+		}
+	}
+	else
+	{
+		q = gj_read_geometry(&parser, p, end, 0, &obj);
+		if (q && gj_skip_space(q, end) != end)
+			gj_set_error(&parser, gj_skip_space(q, end), "unexpected text after geometry");
+	}
+	lwfree(parser.scratch);
+
+	if (parser.error)
+	{
+		lwparse__fail(ctx, "GeoJSON", parser.error_offset, parser.error);
+		lwgeom_free(obj);
+		return NULL;
+	}
+	return obj;
+}
+
+/// @brief parse a GeoJSON geometry. A Feature yields its geometry and a
+/// FeatureCollection a GEOMETRYCOLLECTION of the feature geometries.
 LWGEOM *
 lwgeom_read_geojson(const char *data, size_t len)
 {
-	return NULL;
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	return lwgeom__read_geojson(data, len, &ctx);
+}
+
+/* ---------------------------- streaming reader ---------------------------- */
+
+#define GJ_CHUNK_SIZE (1 << 20)
+
+/// how far a member name may extend before the input is declared malformed
+#define GJ_KEY_MAX 4096
+
+enum
+{
+	GJ_START,	///< before the top level '{'
+	GJ_MEMBER,	///< before a top level member or the closing '}'
+	GJ_SKIP,	///< inside a top level value that is not "features"
+	GJ_FEATURES,	///< before a feature or the closing ']'
+	GJ_FEATURE,	///< inside a feature object
+	GJ_DONE
+};
+
+struct LWGEOJSONREADER {
+	lwgeojson_read_func read;
+	void *udata;
+	int fd;
+	void *map; ///< mmap'd file
+	size_t map_len;
+
+	char *buf; ///< input window, the mapping or the chunk buffer
+	size_t cap;
+	size_t len;
+	size_t pos; ///< scan position in buf
+	size_t mark; ///< start of the feature being scanned
+	size_t offset; ///< input offset of buf
+	int eof;
+	int owned; ///< buf was allocated by the reader
+
+	int state;
+	int first; ///< no member or feature has been read at this level yet
+	gj_scan scan;
+	gj_parser parser;
+	lwparse parse; ///< limits of one feature and the outcome of the last call
+};
+
+static LWGEOJSONREADER *
+lwgeojson_reader__new(void)
+{
+	LWGEOJSONREADER *r = (LWGEOJSONREADER *)lwmalloc(sizeof(LWGEOJSONREADER));
+	if (r == NULL)
+		return NULL;
+	memset(r, 0, sizeof(LWGEOJSONREADER));
+	r->fd = -1;
+	r->state = GJ_START;
+	lwparse__init(&r->parse, NULL, LW_TRUE);
+	r->parser.ctx = &r->parse;
+	return r;
+}
+
+/// @brief discard everything before \a keep and read more input
+/// @return LW_TRUE if data was added, LW_FALSE at the end of the input
+static int
+lwgeojson_reader__fill(LWGEOJSONREADER *r, size_t keep)
+{
+	if (r->eof)
+		return LW_FALSE;
+	if (keep > 0)
+	{
+		memmove(r->buf, r->buf + keep, r->len - keep);
+		r->len -= keep;
+		r->pos -= keep;
+		r->mark = r->mark > keep ? r->mark - keep : 0;
+		r->offset += keep;
+	}
+	if (r->cap - r->len < GJ_CHUNK_SIZE / 2)
+	{
+		// the window only grows when a single feature is larger than it
+		size_t cap = r->cap ? r->cap * 2 : GJ_CHUNK_SIZE;
+		char *buf = (char *)lwrealloc(r->buf, cap);
+		if (buf == NULL)
+		{
+			r->eof = LW_TRUE;
+			return LW_FALSE;
+		}
+		r->buf = buf;
+		r->cap = cap;
+	}
+	long n;
+	if (r->read)
+	{
+		n = r->read(r->udata, r->buf + r->len, r->cap - r->len);
+	}
+	else
+	{
+		n = (long)read(r->fd, r->buf + r->len, r->cap - r->len);
+	}
+	if (n <= 0)
+	{
+		r->eof = LW_TRUE;
+		return LW_FALSE;
+	}
+	r->len += (size_t)n;
+	return LW_TRUE;
+}
+
+/// @brief streaming reader over a callback that fills \a buf with up to
+/// \a len bytes and returns the count, 0 at the end and -1 on error
+LWGEOJSONREADER *
+lwgeojson_reader_callback(lwgeojson_read_func read, void *udata)
+{
+	if (read == NULL)
+		return NULL;
+	LWGEOJSONREADER *r = lwgeojson_reader__new();
+	if (r)
+	{
+		r->read = read;
+		r->udata = udata;
+		r->owned = LW_TRUE;
+	}
+	return r;
+}
+
+/// @brief streaming reader over a file descriptor, which is not closed
+LWGEOJSONREADER *
+lwgeojson_reader_fd(int fd)
+{
+	if (fd < 0)
+		return NULL;
+	LWGEOJSONREADER *r = lwgeojson_reader__new();
+	if (r)
+	{
+		r->fd = fd;
+		r->owned = LW_TRUE;
+	}
+	return r;
+}
+
+/// @brief reader over memory that stays valid while the reader is used
+LWGEOJSONREADER *
+lwgeojson_reader_memory(const char *data, size_t len)
+{
+	if (data == NULL)
+		return NULL;
+	LWGEOJSONREADER *r = lwgeojson_reader__new();
+	if (r)
+	{
+		r->buf = (char *)(uintptr_t)data;
+		r->len = r->cap = len;
+		r->eof = LW_TRUE;
+	}
+	return r;
+}
+
+/// @brief reader over a memory mapped file, pages are only touched as the
+/// scan reaches them so resident memory stays bounded by the OS
+LWGEOJSONREADER *
+lwgeojson_reader_mmap(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+	madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	LWGEOJSONREADER *r = lwgeojson_reader_memory((const char *)map, (size_t)st.st_size);
+	if (r == NULL)
+	{
+		munmap(map, (size_t)st.st_size);
+		return NULL;
+	}
+	r->map = map;
+	r->map_len = (size_t)st.st_size;
+	return r;
+}
+
+void
+lwgeojson_reader_free(LWGEOJSONREADER *r)
+{
+	if (r == NULL)
+		return;
+	if (r->map)
+		munmap(r->map, r->map_len);
+	if (r->owned)
+		lwfree(r->buf);
+	lwfree(r->parser.scratch);
+	lwfree(r);
+}
+
+static int
+lwgeojson_reader__fail(LWGEOJSONREADER *r, const char *message)
+{
+	lwparse__fail(&r->parse, "GeoJSON", r->offset + r->pos, message);
+	r->state = GJ_DONE;
+	return -1;
+}
+
+/// @brief limits applied to every feature, max_bytes is the size of one
+/// feature object and also bounds the memory the reader holds
+void
+lwgeojson_reader_set_limits(LWGEOJSONREADER *r, const LWPARSE_LIMITS *limits)
+{
+	lwparse__init(&r->parse, limits, LW_TRUE);
+}
+
+/// @brief outcome of the last lwgeojson_reader_next, the code is LW_PARSE_OK
+/// unless it returned -1
+const LWPARSE_RESULT *
+lwgeojson_reader_result(const LWGEOJSONREADER *r)
+{
+	return &r->parse.result;
+}
+
+/// @brief read the next feature of a FeatureCollection
+///
+/// Only the feature being parsed is held in memory. The properties are
+/// returned as the raw JSON text of the "properties" member, valid until the
+/// next call.
+/// @param geom receives the geometry, NULL for a feature with a null geometry
+/// @return 1 for a feature, 0 at the end of the collection, -1 on error. A
+/// malformed feature is skipped, reading may continue after it.
+int
+lwgeojson_reader_next(LWGEOJSONREADER *r, LWGEOM **geom, const char **props, size_t *props_len)
+{
+	*geom = NULL;
+	*props = NULL;
+	*props_len = 0;
+	lwparse__reset(&r->parse);
+
+	for (;;)
+	{
+		const char *end = r->buf + r->len;
+		const char *p = gj_skip_space(r->buf + r->pos, end);
+		if (r->state != GJ_FEATURE && r->state != GJ_SKIP)
+			r->pos = (size_t)(p - r->buf);
+		if (r->state == GJ_DONE)
+			return 0;
+		if (p == end && r->state != GJ_FEATURE && r->state != GJ_SKIP)
+		{
+			if (!lwgeojson_reader__fill(r, r->pos))
+				return r->state == GJ_START ? 0 : lwgeojson_reader__fail(r, "unexpected end of input");
+			continue;
+		}
+
+		switch (r->state)
+		{
+		case GJ_START:
+			if (*p != '{')
+				return lwgeojson_reader__fail(r, "input is not a JSON object");
+			r->pos++;
+			r->state = GJ_MEMBER;
+			r->first = LW_TRUE;
+			break;
+
+		case GJ_MEMBER: {
+			if (*p == '}')
+			{
+				r->state = GJ_DONE;
+				return 0;
+			}
+			const char *q = p;
+			if (!r->first)
+			{
+				if (*q != ',')
+					return lwgeojson_reader__fail(r, "expected ','");
+				q = gj_skip_space(q + 1, end);
+			}
+			if (q < end && *q != '"')
+				return lwgeojson_reader__fail(r, "expected a member name");
+			const char *key = NULL;
+			size_t keylen = 0;
+			q = gj_read_string(q, end, &key, &keylen);
+			if (q)
+				q = gj_skip_space(q, end);
+			if (q == NULL || q == end)
+			{
+				// the name is split by the end of the window
+				if ((size_t)(end - p) > GJ_KEY_MAX)
+					return lwgeojson_reader__fail(r, "invalid member");
+				if (!lwgeojson_reader__fill(r, r->pos))
+					return lwgeojson_reader__fail(r, "unexpected end of input");
+				break;
+			}
+			if (*q != ':')
+				return lwgeojson_reader__fail(r, "expected ':'");
+			r->first = LW_FALSE;
+			int features = gj_equals(key, keylen, "features");
+			r->pos = (size_t)(gj_skip_space(q + 1, end) - r->buf);
+			if (features)
+			{
+				r->state = GJ_FEATURES;
+				r->scan.depth = -1; // '[' not consumed yet
+			}
+			else
+			{
+				r->state = GJ_SKIP;
+				r->scan.depth = -1; // value not started yet
+			}
+			break;
+		}
+
+		case GJ_SKIP: {
+			// the value is not needed, scanned bytes are discarded right away
+			if (r->scan.depth == -1)
+			{
+				p = gj_skip_space(p, end);
+				if (p == end)
+				{
+					r->pos = r->len;
+					if (!lwgeojson_reader__fill(r, r->pos))
+						return lwgeojson_reader__fail(r, "unexpected end of input");
+					break;
+				}
+				memset(&r->scan, 0, sizeof(r->scan));
+				if (*p == '{' || *p == '[')
+					r->scan.depth = 1;
+				else if (*p == '"')
+					r->scan.in_string = 1;
+				else
+					r->scan.depth = -2; // scalar
+				p++;
+			}
+			const char *q;
+			if (r->scan.depth == -2)
+			{
+				q = p;
+				while (q < end && *q != ',' && *q != '}' && *q != ' ' && *q != '\t' && *q != '\n' && *q != '\r')
+					q++;
+				if (q == end && !r->eof)
+					q = NULL;
+			}
+			else
+			{
+				const char *resume = end;
+				q = gj_scan_value(&r->scan, p, end, &resume);
+				if (q == NULL)
+					p = resume;
+			}
+			if (q == NULL)
+			{
+				r->pos = (size_t)(p - r->buf);
+				if (!lwgeojson_reader__fill(r, r->pos))
+					return lwgeojson_reader__fail(r, "unexpected end of input");
+				break;
+			}
+			r->pos = (size_t)(q - r->buf);
+			r->state = GJ_MEMBER;
+			break;
+		}
+
+		case GJ_FEATURES:
+			if (r->scan.depth < 0)
+			{
+				if (*p != '[')
+					return lwgeojson_reader__fail(r, "\"features\" is not an array");
+				r->pos++;
+				r->scan.depth = 0;
+				r->first = LW_TRUE;
+				break;
+			}
+			if (*p == ']')
+			{
+				r->pos++;
+				r->state = GJ_MEMBER;
+				r->first = LW_FALSE;
+				break;
+			}
+			if (!r->first)
+			{
+				if (*p != ',')
+					return lwgeojson_reader__fail(r, "expected ','");
+				p = gj_skip_space(p + 1, end);
+				r->pos = (size_t)(p - r->buf);
+				r->first = LW_TRUE;
+				if (p == end)
+					break;
+			}
+			if (*p != '{')
+				return lwgeojson_reader__fail(r, "feature is not an object");
+			r->first = LW_FALSE;
+			r->mark = r->pos;
+			r->pos++;
+			memset(&r->scan, 0, sizeof(r->scan));
+			r->scan.depth = 1;
+			r->state = GJ_FEATURE;
+			break;
+
+		case GJ_FEATURE: {
+			const char *resume = end;
+			const char *q = gj_scan_value(&r->scan, r->buf + r->pos, end, &resume);
+			if (q == NULL)
+			{
+				r->pos = (size_t)(resume - r->buf);
+				// the window would have to grow past the limit to hold the
+				// feature, reading cannot continue
+				r->parse.base = r->offset + r->mark;
+				if (!lwparse__bytes(&r->parse, "GeoJSON", r->pos - r->mark))
+				{
+					r->state = GJ_DONE;
+					return -1;
+				}
+				// keep the feature, only the bytes before it can go
+				if (!lwgeojson_reader__fill(r, r->mark))
+					return lwgeojson_reader__fail(r, "unexpected end of input");
+				break;
+			}
+			r->pos = (size_t)(q - r->buf);
+			r->state = GJ_FEATURES;
+			r->scan.depth = 0;
+
+			// offsets in the feature are reported as offsets in the input
+			r->parse.base = r->offset + r->mark;
+			if (!lwparse__bytes(&r->parse, "GeoJSON", r->pos - r->mark))
+				return -1;
+			r->parser.start = r->buf + r->mark;
+			r->parser.error = NULL;
+			if (!gj_read_feature(&r->parser, r->buf + r->mark, q, geom, props, props_len))
+			{
+				lwparse__fail(&r->parse, "GeoJSON", r->parser.error_offset, r->parser.error);
+				return -1;
+			}
+			return 1;
+		}
+		}
+	}
 }
@@ -19,16 +19,50 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  */
-#include "liblwgeom_internel.h"
 
+#include "lwgeom_xml.h"
+
+/// GML 2 and GML 3 share one table, a GML 2 document only uses the older
+/// names and GML 3 readers accept both
+const lwxml_element lwxml__gml_elements[] = {
+    {"Point", LWXML_GEOMETRY, POINTTYPE},
+    {"LineString", LWXML_GEOMETRY, LINETYPE},
+    {"Curve", LWXML_GEOMETRY, LINETYPE},
+    {"LinearRing", LWXML_RING, LINETYPE},
+    {"Polygon", LWXML_GEOMETRY, POLYTYPE},
+    {"PolygonPatch", LWXML_GEOMETRY, POLYTYPE},
+    {"MultiPoint", LWXML_GEOMETRY, MPOINTTYPE},
+    {"MultiLineString", LWXML_GEOMETRY, MLINETYPE},
+    {"MultiCurve", LWXML_GEOMETRY, MLINETYPE},
+    {"MultiPolygon", LWXML_GEOMETRY, MPOLYTYPE},
+    {"MultiSurface", LWXML_GEOMETRY, MPOLYTYPE},
+    {"MultiGeometry", LWXML_GEOMETRY, COLLECTIONTYPE},
+    {"coordinates", LWXML_COORDINATES, 0},
+    {"posList", LWXML_POSLIST, 0},
+    {"pos", LWXML_POS, 0},
+    {"coord", LWXML_COORD, 0},
+    {"X", LWXML_ORDINATE, 0},
+    {"Y", LWXML_ORDINATE, 1},
+    {"Z", LWXML_ORDINATE, 2},
+    {NULL, 0, 0},
+};
+
+/// @brief read the geometries of a GML 2 document, members of a feature
+/// collection become a GEOMETRYCOLLECTION
 LWGEOM *
 lwgeom_read_gml2(const char *data, size_t len)
 {
-	return NULL;
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	return lwxml__read_document(lwxml__gml_elements, data, len, &ctx);
 }
 
+/// @brief read the geometries of a GML 3 document, <pos> and <posList> take
+/// srsDimension from themselves or from the enclosing geometry
 LWGEOM *
 lwgeom_read_gml3(const char *data, size_t len)
 {
-	return NULL;
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	return lwxml__read_document(lwxml__gml_elements, data, len, &ctx);
 }
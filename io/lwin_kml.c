@@ -20,10 +20,24 @@
  * IN THE SOFTWARE.
  */
 
-#include "liblwgeom_internel.h"
+#include "lwgeom_xml.h"
 
+const lwxml_element lwxml__kml_elements[] = {
+    {"Point", LWXML_GEOMETRY, POINTTYPE},
+    {"LineString", LWXML_GEOMETRY, LINETYPE},
+    {"LinearRing", LWXML_RING, LINETYPE},
+    {"Polygon", LWXML_GEOMETRY, POLYTYPE},
+    {"MultiGeometry", LWXML_GEOMETRY, COLLECTIONTYPE},
+    {"coordinates", LWXML_COORDINATES, 0},
+    {NULL, 0, 0},
+};
+
+/// @brief read the geometries of a KML document, several placemarks become
+/// a GEOMETRYCOLLECTION
 LWGEOM *
 lwgeom_read_kml(const char *data, size_t len)
 {
-	return NULL;
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	return lwxml__read_document(lwxml__kml_elements, data, len, &ctx);
 }
@@ -0,0 +1,310 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+
+#include "lwpool.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ------------------------------ inner lines ------------------------------- */
+
+/// A file holding one geometry per line is cut into chunks of about this many
+/// bytes, each ending on a line boundary, and every chunk is parsed as a task.
+#define LINES_CHUNK_SIZE (1 << 20)
+
+/// In ordered mode chunks are parsed in rounds of this many per thread, so the
+/// geometries waiting to be delivered stay bounded.
+#define LINES_ROUND 4
+
+typedef struct {
+	LWGEOM *geom;
+	size_t line;
+} lines_item;
+
+typedef struct {
+	const char *start;
+	const char *end;
+	size_t first_line; ///< number of the first line of the chunk, from 1
+	lines_item *items;
+	size_t nitems;
+	size_t capacity;
+} lines_chunk;
+
+typedef struct {
+	lines_chunk *chunks;
+	size_t base; ///< first chunk of the current round
+	int format;
+	lwgeom_line_func func;
+	void *udata;
+	atomic_int stop;
+} lines_job;
+
+static inline int
+lines_is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v';
+}
+
+/// @brief parse one line, blank lines yield NULL with \a blank set. GeoJSON
+/// text sequences put an RS character in front of every record, it is skipped
+static LWGEOM *
+lines_parse(int format, const char *p, const char *end, int *blank)
+{
+	while (p < end && (lines_is_blank(*p) || *p == '\x1e'))
+		p++;
+	while (end > p && lines_is_blank(end[-1]))
+		end--;
+	*blank = p == end;
+	if (*blank)
+		return NULL;
+	if (format == LW_FORMAT_GEOJSON)
+		return lwgeom_read_geojson(p, (size_t)(end - p));
+	return lwgeom_read_wkt(p, (size_t)(end - p));
+}
+
+static int
+lines_push(lines_chunk *chunk, LWGEOM *geom, size_t line)
+{
+	if (chunk->nitems == chunk->capacity)
+	{
+		size_t capacity = chunk->capacity ? chunk->capacity * 2 : 64;
+		lines_item *items = (lines_item *)lwrealloc(chunk->items, capacity * sizeof(lines_item));
+		if (items == NULL)
+			return LW_FAILURE;
+		chunk->items = items;
+		chunk->capacity = capacity;
+	}
+	chunk->items[chunk->nitems].geom = geom;
+	chunk->items[chunk->nitems].line = line;
+	chunk->nitems++;
+	return LW_SUCCESS;
+}
+
+static size_t
+lines_count(const char *p, const char *end)
+{
+	size_t n = 0;
+	while ((p = (const char *)memchr(p, '\n', (size_t)(end - p))) != NULL)
+	{
+		n++;
+		p++;
+	}
+	return n;
+}
+
+static void
+lines__count_chunk(size_t index, void *udata)
+{
+	lines_chunk *chunk = &((lines_job *)udata)->chunks[index];
+	chunk->first_line = lines_count(chunk->start, chunk->end);
+}
+
+/// @brief call \a visit for every line of \a chunk, stops when it returns 0
+static void
+lines_walk(lines_job *job, lines_chunk *chunk, int (*visit)(lines_job *, lines_chunk *, LWGEOM *, size_t))
+{
+	const char *p = chunk->start;
+	size_t line = chunk->first_line;
+	while (p < chunk->end && !atomic_load_explicit(&job->stop, memory_order_relaxed))
+	{
+		const char *eol = (const char *)memchr(p, '\n', (size_t)(chunk->end - p));
+		if (eol == NULL)
+			eol = chunk->end;
+		int blank;
+		LWGEOM *geom = lines_parse(job->format, p, eol, &blank);
+		if (!blank && !visit(job, chunk, geom, line))
+			break;
+		p = eol + 1;
+		line++;
+	}
+}
+
+static int
+lines__keep(lines_job *job, lines_chunk *chunk, LWGEOM *geom, size_t line)
+{
+	if (lines_push(chunk, geom, line))
+		return LW_TRUE;
+	lwgeom_free(geom);
+	atomic_store(&job->stop, LW_TRUE);
+	return LW_FALSE;
+}
+
+static int
+lines__deliver(lines_job *job, lines_chunk *chunk, LWGEOM *geom, size_t line)
+{
+	(void)chunk;
+	if (job->func(geom, line, job->udata))
+		return LW_TRUE;
+	atomic_store(&job->stop, LW_TRUE);
+	return LW_FALSE;
+}
+
+static void
+lines__parse_chunk(size_t index, void *udata)
+{
+	lines_job *job = (lines_job *)udata;
+	lines_walk(job, &job->chunks[job->base + index], lines__keep);
+}
+
+static void
+lines__parse_deliver(size_t index, void *udata)
+{
+	lines_job *job = (lines_job *)udata;
+	lines_walk(job, &job->chunks[index], lines__deliver);
+}
+
+/// @brief cut [data, data + len) into chunks that end on a newline
+static lines_chunk *
+lines_split(const char *data, size_t len, size_t *nchunks)
+{
+	size_t count = len / LINES_CHUNK_SIZE + 1;
+	lines_chunk *chunks = (lines_chunk *)lwmalloc0(count * sizeof(lines_chunk));
+	if (chunks == NULL)
+		return NULL;
+	const char *p = data;
+	const char *end = data + len;
+	size_t n = 0;
+	while (p < end)
+	{
+		const char *cut = end;
+		if ((size_t)(end - p) > LINES_CHUNK_SIZE)
+		{
+			cut = (const char *)memchr(p + LINES_CHUNK_SIZE, '\n', (size_t)(end - p - LINES_CHUNK_SIZE));
+			cut = cut ? cut + 1 : end;
+		}
+		chunks[n].start = p;
+		chunks[n].end = cut;
+		n++;
+		p = cut;
+	}
+	*nchunks = n;
+	return chunks;
+}
+
+/* ------------------------------- input lines ------------------------------ */
+
+/// @brief read text holding one geometry per line, WKT or GeoJSON (a GeoJSON
+/// text sequence is accepted too). Chunks of lines are parsed in parallel on
+/// the thread pool. Blank lines are skipped but still counted.
+/// @param format LW_FORMAT_WKT or LW_FORMAT_GEOJSON
+/// @param nthreads number of threads, see lwpool_nthreads
+/// @param ordered when set \a func is called on the calling thread in line
+/// order, otherwise it is called from the worker threads as soon as a line is
+/// parsed and must be thread safe
+/// @param func receives every geometry with its line number, NULL where the
+/// line could not be parsed, and returns 0 to stop reading
+/// @return LW_SUCCESS when every line was delivered
+int
+lwgeom_read_lines(const char *data,
+		  size_t len,
+		  int format,
+		  int nthreads,
+		  int ordered,
+		  lwgeom_line_func func,
+		  void *udata)
+{
+	if (data == NULL || func == NULL || (format != LW_FORMAT_WKT && format != LW_FORMAT_GEOJSON))
+		return LW_FAILURE;
+
+	size_t nchunks = 0;
+	lines_chunk *chunks = lines_split(data, len, &nchunks);
+	if (chunks == NULL)
+		return LW_FAILURE;
+
+	lines_job job = {.chunks = chunks, .base = 0, .format = format, .func = func, .udata = udata};
+	atomic_init(&job.stop, LW_FALSE);
+	nthreads = lwpool_nthreads(nthreads);
+
+	// line numbers come from a parallel newline count and a prefix sum
+	lwpool_run(nchunks, nthreads, lines__count_chunk, &job);
+	size_t line = 1;
+	for (size_t i = 0; i < nchunks; i++)
+	{
+		size_t n = chunks[i].first_line;
+		chunks[i].first_line = line;
+		line += n;
+	}
+
+	if (!ordered)
+	{
+		lwpool_run(nchunks, nthreads, lines__parse_deliver, &job);
+	}
+	else
+	{
+		size_t round = (size_t)nthreads * LINES_ROUND;
+		for (job.base = 0; job.base < nchunks; job.base += round)
+		{
+			size_t count = LWMIN(round, nchunks - job.base);
+			if (!atomic_load(&job.stop))
+				lwpool_run(count, nthreads, lines__parse_chunk, &job);
+			for (size_t i = job.base; i < job.base + count; i++)
+			{
+				for (size_t k = 0; k < chunks[i].nitems; k++)
+				{
+					lines_item *item = &chunks[i].items[k];
+					if (atomic_load(&job.stop))
+						lwgeom_free(item->geom);
+					else if (!func(item->geom, item->line, udata))
+						atomic_store(&job.stop, LW_TRUE);
+				}
+				lwfree(chunks[i].items);
+				chunks[i].items = NULL;
+			}
+		}
+	}
+
+	lwfree(chunks);
+	return atomic_load(&job.stop) ? LW_FAILURE : LW_SUCCESS;
+}
+
+/// @brief lwgeom_read_lines over a memory mapped file
+int
+lwgeom_read_lines_file(const char *path, int format, int nthreads, int ordered, lwgeom_line_func func, void *udata)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return LW_FAILURE;
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return LW_FAILURE;
+	}
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return lwgeom_read_lines("", 0, format, nthreads, ordered, func, udata);
+	}
+	void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return LW_FAILURE;
+
+	int ret = lwgeom_read_lines((const char *)map, (size_t)st.st_size, format, nthreads, ordered, func, udata);
+	munmap(map, (size_t)st.st_size);
+	return ret;
+}
@@ -22,26 +22,643 @@
 
 #include "liblwgeom_internel.h"
 
+#include "lwpool.h"
+#include <math.h>
+#include <string.h>
+
 typedef struct {
 	int sdo_starting_offset;
 	int sdo_etype;
 	int sdo_interpretation;
 } GEOM_SDO_ELEM_INFO;
 
-LWGEOM *
-lwgeom_read_ora(const LWGEOM_SDO sdo, int flag)
+/* ------------------------------- inner ora -------------------------------- */
+
+/// SDO_ETYPE values, ORA_RING and ORA_COMPOUND_RING are the Oracle 8 forms
+/// whose orientation tells exterior from interior
+#define ORA_POINT               1
+#define ORA_LINE                2
+#define ORA_RING                3
+#define ORA_COMPOUND_LINE       4
+#define ORA_COMPOUND_RING       5
+#define ORA_SHELL               1003
+#define ORA_HOLE                2003
+#define ORA_COMPOUND_SHELL      1005
+#define ORA_COMPOUND_HOLE       2005
+
+/// arcs and circles are stroked with this many segments per quarter circle
+/// unless the caller asks for another count
+#define ORA_SEGMENTS 16
+
+/// rows converted per task by the batch reader
+#define ORA_BATCH_BLOCK 256
+
+typedef struct {
+	const GEOM_SDO_ELEM_INFO *elems;
+	size_t nelems;
+	const double *ords;
+	size_t nverts; ///< vertices in sdo_ordinates
+	int dim;       ///< ordinates per vertex in sdo_ordinates
+	int zpos;      ///< index of Z in an SDO vertex, -1 without Z
+	int mpos;      ///< index of M in an SDO vertex, -1 without M
+	LWBOOLEAN hasz;
+	LWBOOLEAN hasm;
+	int cdim;
+	int segments;
+	double *pp; ///< vertices of the element being read, LWGEOM layout
+	uint32_t npoints;
+	uint32_t capacity;
+	const char *error;
+} ora_reader;
+
+static void
+ora_set_error(ora_reader *r, const char *error)
+{
+	if (r->error == NULL)
+		r->error = error;
+}
+
+static double *
+ora_reserve(ora_reader *r, size_t n)
+{
+	if (r->error)
+		return NULL;
+	if (r->npoints + n > UINT32_MAX)
+	{
+		ora_set_error(r, "too many vertices");
+		return NULL;
+	}
+	if (r->npoints + n > r->capacity)
+	{
+		size_t capacity = r->capacity ? r->capacity : 16;
+		while (capacity < r->npoints + n)
+			capacity *= 2;
+		double *pp = (double *)lwrealloc(r->pp, capacity * r->cdim * sizeof(double));
+		if (pp == NULL)
+		{
+			ora_set_error(r, "out of memory");
+			return NULL;
+		}
+		r->pp = pp;
+		r->capacity = (uint32_t)capacity;
+	}
+	return r->pp + (size_t)r->npoints * r->cdim;
+}
+
+/// @brief SDO vertex \a v in LWGEOM layout
+static inline void
+ora_fetch(const ora_reader *r, size_t v, double *out)
+{
+	const double *src = r->ords + v * r->dim;
+	out[0] = src[0];
+	out[1] = src[1];
+	int k = 2;
+	if (r->hasz)
+		out[k++] = src[r->zpos];
+	if (r->hasm)
+		out[k] = src[r->mpos];
+}
+
+/// @brief append SDO vertices [from, to), the vertex shared with the previous
+/// subelement of a compound element is skipped when \a skip_first is set
+static void
+ora_copy(ora_reader *r, size_t from, size_t to, int skip_first)
+{
+	if (skip_first && r->npoints > 0 && from < to)
+		from++;
+	if (from >= to)
+		return;
+	double *out = ora_reserve(r, to - from);
+	if (out == NULL)
+		return;
+	// X Y [Z] [M] in SDO order is already the LWGEOM layout
+	if (r->dim == r->cdim && (!r->hasz || r->zpos == 2) && (!r->hasm || r->mpos == 2 + r->hasz))
+		memcpy(out, r->ords + from * r->dim, (to - from) * r->dim * sizeof(double));
+	else
+		for (size_t v = from; v < to; v++, out += r->cdim)
+			ora_fetch(r, v, out);
+	r->npoints += (uint32_t)(to - from);
+}
+
+/// @brief circle through \a a, \a b and \a c, LW_FALSE when they are collinear
+static int
+ora_circle_center(const double *a, const double *b, const double *c, double *cx, double *cy, double *radius)
+{
+	double bx = b[0] - a[0], by = b[1] - a[1];
+	double qx = c[0] - a[0], qy = c[1] - a[1];
+	double d = 2.0 * (bx * qy - by * qx);
+	if (fabs(d) <= 1e-12 * (bx * bx + by * by + qx * qx + qy * qy))
+		return LW_FALSE;
+	double b2 = bx * bx + by * by;
+	double q2 = qx * qx + qy * qy;
+	double ux = (qy * b2 - by * q2) / d;
+	double uy = (bx * q2 - qx * b2) / d;
+	*cx = a[0] + ux;
+	*cy = a[1] + uy;
+	*radius = sqrt(ux * ux + uy * uy);
+	return LW_TRUE;
+}
+
+/// @brief append the stroked arc from \a a through \a b to \a c, without \a a.
+/// Z and M are interpolated along the arc, a to b and then b to c
+static void
+ora_arc(ora_reader *r, const double *a, const double *b, const double *c)
+{
+	double cx, cy, radius;
+	if (!ora_circle_center(a, b, c, &cx, &cy, &radius))
+	{
+		// a degenerate arc is the straight line through its points
+		double *out = ora_reserve(r, 2);
+		if (out == NULL)
+			return;
+		memcpy(out, b, r->cdim * sizeof(double));
+		memcpy(out + r->cdim, c, r->cdim * sizeof(double));
+		r->npoints += 2;
+		return;
+	}
+
+	double a0 = atan2(a[1] - cy, a[0] - cx);
+	double a1 = atan2(b[1] - cy, b[0] - cx);
+	double a2 = atan2(c[1] - cy, c[0] - cx);
+	int ccw = (b[0] - a[0]) * (c[1] - b[1]) - (b[1] - a[1]) * (c[0] - b[0]) > 0;
+	double sweep1 = a1 - a0;
+	double sweep = a2 - a0;
+	if (ccw)
+	{
+		while (sweep1 <= 0)
+			sweep1 += 2 * M_PI;
+		while (sweep <= 0)
+			sweep += 2 * M_PI;
+	}
+	else
+	{
+		while (sweep1 >= 0)
+			sweep1 -= 2 * M_PI;
+		while (sweep >= 0)
+			sweep -= 2 * M_PI;
+	}
+
+	size_t n = (size_t)ceil(fabs(sweep) / (M_PI / 2) * r->segments);
+	if (n < 2)
+		n = 2;
+	double *out = ora_reserve(r, n);
+	if (out == NULL)
+		return;
+	double f1 = sweep1 / sweep;
+	for (size_t i = 1; i < n; i++, out += r->cdim)
+	{
+		double f = (double)i / (double)n;
+		double t = a0 + sweep * f;
+		out[0] = cx + radius * cos(t);
+		out[1] = cy + radius * sin(t);
+		for (int k = 2; k < r->cdim; k++)
+			out[k] = f < f1 ? a[k] + (b[k] - a[k]) * (f / f1) : b[k] + (c[k] - b[k]) * ((f - f1) / (1 - f1));
+	}
+	memcpy(out, c, r->cdim * sizeof(double));
+	r->npoints += (uint32_t)n;
+}
+
+/// @brief append a closed ring around the circle through three points,
+/// starting at \a a in the requested direction
+static void
+ora_circle(ora_reader *r, const double *a, const double *b, const double *c, int ccw)
+{
+	double cx, cy, radius;
+	if (!ora_circle_center(a, b, c, &cx, &cy, &radius))
+	{
+		ora_set_error(r, "circle points are collinear");
+		return;
+	}
+	size_t n = (size_t)r->segments * 4;
+	double *out = ora_reserve(r, n + 1);
+	if (out == NULL)
+		return;
+	double a0 = atan2(a[1] - cy, a[0] - cx);
+	double step = (ccw ? 2 : -2) * M_PI / (double)n;
+	for (size_t i = 0; i < n; i++, out += r->cdim)
+	{
+		memcpy(out, a, r->cdim * sizeof(double));
+		out[0] = cx + radius * cos(a0 + step * (double)i);
+		out[1] = cy + radius * sin(a0 + step * (double)i);
+	}
+	memcpy(out, r->pp + (size_t)r->npoints * r->cdim, r->cdim * sizeof(double));
+	r->npoints += (uint32_t)(n + 1);
+}
+
+/// @brief first vertex of element \a i
+static inline size_t
+ora_start(const ora_reader *r, size_t i)
+{
+	return (size_t)(r->elems[i].sdo_starting_offset - 1) / (size_t)r->dim;
+}
+
+/// @brief end of the vertices of element \a i, where the next one starts
+static inline size_t
+ora_end(const ora_reader *r, size_t i)
+{
+	return i + 1 < r->nelems ? ora_start(r, i + 1) : r->nverts;
+}
+
+/// @brief append the vertices [from, to) of a line or ring with the given
+/// SDO_INTERPRETATION, 1 for straight segments and 2 for circular arcs
+static void
+ora_read_segments(ora_reader *r, size_t from, size_t to, int interp, int skip_first)
+{
+	if (interp == 1)
+	{
+		ora_copy(r, from, to, skip_first);
+		return;
+	}
+	if (interp != 2 || to - from < 3 || (to - from) % 2 == 0)
+	{
+		ora_set_error(r, "invalid arc string");
+		return;
+	}
+	ora_copy(r, from, from + 1, skip_first);
+	double a[4], b[4], c[4];
+	for (size_t v = from; v + 2 < to && !r->error; v += 2)
+	{
+		ora_fetch(r, v, a);
+		ora_fetch(r, v + 1, b);
+		ora_fetch(r, v + 2, c);
+		ora_arc(r, a, b, c);
+	}
+}
+
+/// @brief read the line or ring starting at element \a *i into r->pp,
+/// \a *i is moved past the subelements of a compound element
+static void
+ora_read_path(ora_reader *r, size_t *i, int ccw)
+{
+	const GEOM_SDO_ELEM_INFO *e = &r->elems[*i];
+	int etype = e->sdo_etype % 1000;
+	r->npoints = 0;
+	if (etype == ORA_COMPOUND_LINE || etype == ORA_COMPOUND_RING)
+	{
+		size_t first = *i + 1;
+		size_t last = *i + (size_t)e->sdo_interpretation;
+		if (e->sdo_interpretation < 1 || last >= r->nelems)
+		{
+			ora_set_error(r, "invalid compound element");
+			return;
+		}
+		// subelements share their end vertex with the start of the next one
+		for (size_t k = first; k <= last && !r->error; k++)
+		{
+			size_t to = k < last ? ora_start(r, k + 1) + 1 : ora_end(r, last);
+			ora_read_segments(r, ora_start(r, k), LWMIN(to, r->nverts), r->elems[k].sdo_interpretation, k > first);
+		}
+		*i = last;
+		return;
+	}
+
+	size_t from = ora_start(r, *i);
+	size_t to = ora_end(r, *i);
+	double a[4], b[4], c[4];
+	switch (etype == ORA_LINE ? 0 : e->sdo_interpretation)
+	{
+	case 3:
+		// optimized rectangle, lower left and upper right corner
+		if (to - from != 2)
+		{
+			ora_set_error(r, "invalid rectangle");
+			return;
+		}
+		ora_fetch(r, from, a);
+		ora_fetch(r, from + 1, c);
+		double *out = ora_reserve(r, 5);
+		if (out == NULL)
+			return;
+		const double xs[5] = {a[0], c[0], c[0], a[0], a[0]};
+		const double ys[5] = {a[1], a[1], c[1], c[1], a[1]};
+		for (int k = 0; k < 5; k++, out += r->cdim)
+		{
+			int v = ccw ? k : 4 - k;
+			memcpy(out, a, r->cdim * sizeof(double));
+			out[0] = xs[v];
+			out[1] = ys[v];
+		}
+		r->npoints = 5;
+		return;
+	case 4:
+		// circle through three points on its circumference
+		if (to - from != 3)
+		{
+			ora_set_error(r, "invalid circle");
+			return;
+		}
+		ora_fetch(r, from, a);
+		ora_fetch(r, from + 1, b);
+		ora_fetch(r, from + 2, c);
+		ora_circle(r, a, b, c, ccw);
+		return;
+	default:
+		ora_read_segments(r, from, to, e->sdo_interpretation, LW_FALSE);
+		return;
+	}
+}
+
+/// @brief LW_TRUE when the vertices in r->pp run counterclockwise
+static int
+ora_is_ccw(const ora_reader *r)
+{
+	double area = 0;
+	const double *pp = r->pp;
+	for (uint32_t k = 0; k + 1 < r->npoints; k++, pp += r->cdim)
+		area += pp[0] * pp[r->cdim + 1] - pp[r->cdim] * pp[1];
+	return area > 0;
+}
+
+/// @brief hand the vertices in r->pp over to a new geometry
+static LWGEOM *
+ora_take_points(ora_reader *r, uint8_t type, lwflags_t flags)
+{
+	if (r->error)
+		return NULL;
+	double *pp = r->pp;
+	if (r->npoints < r->capacity)
+	{
+		double *shrunk = (double *)lwrealloc(pp, (size_t)r->npoints * r->cdim * sizeof(double));
+		if (shrunk)
+			pp = shrunk;
+	}
+	flags |= (r->hasz ? LW_FLAG_Z : 0) | (r->hasm ? LW_FLAG_M : 0);
+	LWGEOM *obj = lwgeom__new_points(type, r->npoints, pp, flags, LW_FALSE);
+	if (obj == NULL)
+	{
+		lwfree(pp);
+		ora_set_error(r, "out of memory");
+	}
+	r->pp = NULL;
+	r->npoints = r->capacity = 0;
+	return obj;
+}
+
+static void
+ora_add(ora_reader *r, LWGEOM *mobj, LWGEOM *obj)
+{
+	if (obj == NULL)
+		return;
+	if (lwgeom__add(mobj, obj) == NULL)
+	{
+		lwgeom_free(obj);
+		ora_set_error(r, "out of memory");
+	}
+}
+
+/// @brief add the points of a point element, a cluster of several points
+/// becomes a MULTIPOINT inside a collection
+static void
+ora_read_points(ora_reader *r, LWGEOM *mobj, size_t i)
+{
+	size_t from = ora_start(r, i);
+	size_t count = (size_t)r->elems[i].sdo_interpretation;
+	if (from + count > ora_end(r, i))
+	{
+		ora_set_error(r, "point cluster exceeds its ordinates");
+		return;
+	}
+	LWGEOM *target = mobj;
+	if (mobj->type == COLLECTIONTYPE && count > 1)
+	{
+		target = lwgeom__new(MPOINTTYPE, r->hasz, r->hasm);
+		if (target == NULL)
+		{
+			ora_set_error(r, "out of memory");
+			return;
+		}
+	}
+	for (size_t v = from; v < from + count && !r->error; v++)
+	{
+		r->npoints = 0;
+		ora_copy(r, v, v + 1, LW_FALSE);
+		ora_add(r, target, ora_take_points(r, POINTTYPE, 0));
+	}
+	// the cluster joins the collection once its envelope is complete
+	if (target == mobj)
+		return;
+	if (r->error)
+		lwgeom_free(target);
+	else
+		ora_add(r, mobj, target);
+}
+
+static int
+ora_init(ora_reader *r, const LWGEOM_SDO *sdo, int segments)
+{
+	memset(r, 0, sizeof(*r));
+	r->segments = segments > 0 ? segments : ORA_SEGMENTS;
+
+	int d = sdo->sdo_gtype / 1000;
+	int l = (sdo->sdo_gtype / 100) % 10;
+	if (d == 0)
+		d = 2;
+	if (d < 2 || d > 4 || l > d || (l > 0 && l < 3))
+	{
+		ora_set_error(r, "invalid SDO_GTYPE dimension");
+		return LW_FAILURE;
+	}
+	r->dim = d;
+	r->mpos = l > 0 ? l - 1 : (d == 4 ? 3 : -1);
+	r->zpos = d - 2 - (r->mpos >= 0) > 0 ? (r->mpos == 2 ? 3 : 2) : -1;
+	r->hasz = r->zpos >= 0;
+	r->hasm = r->mpos >= 0;
+	r->cdim = LW_POINTBYTESIZE(r->hasz, r->hasm);
+
+	if (sdo->sdo_elem_count % 3 != 0 || sdo->sdo_ord_count % (size_t)d != 0 ||
+	    (sdo->sdo_elem_count > 0 && sdo->sdo_elem_info == NULL) ||
+	    (sdo->sdo_ord_count > 0 && sdo->sdo_ordinates == NULL))
+	{
+		ora_set_error(r, "invalid array sizes");
+		return LW_FAILURE;
+	}
+	r->elems = (const GEOM_SDO_ELEM_INFO *)sdo->sdo_elem_info;
+	r->nelems = sdo->sdo_elem_count / 3;
+	r->ords = sdo->sdo_ordinates;
+	r->nverts = sdo->sdo_ord_count / (size_t)d;
+
+	int previous = 1;
+	for (size_t i = 0; i < r->nelems; i++)
+	{
+		int offset = r->elems[i].sdo_starting_offset;
+		if (offset < previous || (size_t)offset > sdo->sdo_ord_count || (offset - 1) % d != 0)
+		{
+			ora_set_error(r, "invalid SDO_STARTING_OFFSET");
+			return LW_FAILURE;
+		}
+		previous = offset;
+	}
+	return LW_SUCCESS;
+}
+
+/// @brief convert one SDO_GEOMETRY, \a segments is the number of segments per
+/// quarter circle used to stroke arcs and circles, 0 for the default
+static LWGEOM *
+ora_read(const LWGEOM_SDO *sdo, int segments)
 {
-	int dimension = 2 > (sdo.sdo_gtype / 1000) ? 2 : (sdo.sdo_gtype / 1000);
+	ora_reader r;
+	if (!ora_init(&r, sdo, segments))
+	{
+		lwnotice("SDO_GEOMETRY error: %s", r.error);
+		return NULL;
+	}
+
+	int tt = sdo->sdo_gtype % 100;
+	static const uint8_t types[8] = {0, MPOINTTYPE, MLINETYPE, MPOLYTYPE, COLLECTIONTYPE, MPOINTTYPE, MLINETYPE,
+					 MPOLYTYPE};
+	if (tt < 1 || tt > 7)
+	{
+		lwnotice("SDO_GEOMETRY error: unsupported SDO_GTYPE %d", sdo->sdo_gtype);
+		return NULL;
+	}
+	LWGEOM *mobj = lwgeom__new(types[tt], r.hasz, r.hasm);
+	if (mobj == NULL)
+		return NULL;
 
-	int tt = sdo.sdo_gtype % 100;
-	if (tt > 0 && tt < 4)
+	LWGEOM *poly = NULL;
+	for (size_t i = 0; i < r.nelems && !r.error; i++)
 	{
-		GEOM_SDO_ELEM_INFO *pElemInfo = (GEOM_SDO_ELEM_INFO *)sdo.sdo_elem_info;
-		for (int i = 0; i < sdo.sdo_elem_count / 3; i++) {}
+		const GEOM_SDO_ELEM_INFO *e = &r.elems[i];
+		int etype = e->sdo_etype;
+		int want = 0;
+		switch (etype)
+		{
+		case ORA_POINT:
+			// interpretation 0 is the orientation vector of an oriented point
+			if (e->sdo_interpretation == 0)
+				break;
+			want = MPOINTTYPE;
+			if (mobj->type == want || mobj->type == COLLECTIONTYPE)
+				ora_read_points(&r, mobj, i);
+			break;
+		case ORA_LINE:
+		case ORA_COMPOUND_LINE:
+			want = MLINETYPE;
+			if (mobj->type == want || mobj->type == COLLECTIONTYPE)
+			{
+				ora_read_path(&r, &i, LW_TRUE);
+				ora_add(&r, mobj, ora_take_points(&r, LINETYPE, 0));
+			}
+			break;
+		case ORA_RING:
+		case ORA_COMPOUND_RING:
+		case ORA_SHELL:
+		case ORA_COMPOUND_SHELL:
+		case ORA_HOLE:
+		case ORA_COMPOUND_HOLE:
+			want = MPOLYTYPE;
+			if (mobj->type != want && mobj->type != COLLECTIONTYPE)
+				break;
+			int shell = etype / 1000 == 1 || (etype < 1000 && poly == NULL);
+			ora_read_path(&r, &i, etype < 1000 || shell);
+			if (r.error)
+				break;
+			if (etype < 1000)
+				shell = poly == NULL || ora_is_ccw(&r);
+			if (r.npoints < 4)
+				ora_set_error(&r, "ring with fewer than four points");
+			else if (shell)
+			{
+				poly = lwgeom__new(POLYTYPE, r.hasz, r.hasm);
+				if (poly == NULL)
+					ora_set_error(&r, "out of memory");
+				else
+				{
+					ora_add(&r, poly, ora_take_points(&r, LINETYPE, LW_FLAG_SHELL_RING));
+					ora_add(&r, mobj, poly);
+				}
+			}
+			else if (poly == NULL)
+				ora_set_error(&r, "interior ring without exterior ring");
+			else
+				ora_add(&r, poly, ora_take_points(&r, LINETYPE, LW_FLAG_HOLE_RING));
+			break;
+		default:
+			ora_set_error(&r, "unsupported SDO_ETYPE");
+			break;
+		}
+		if (want && mobj->type != want && mobj->type != COLLECTIONTYPE)
+			ora_set_error(&r, "element does not match SDO_GTYPE");
+		if (want != MPOLYTYPE && want != 0)
+			poly = NULL;
 	}
-	else if (tt > 4 && tt < 8)
+	lwfree(r.pp);
+
+	// the single geometry types were read as a multi geometry of one
+	if (!r.error && tt < 4)
+	{
+		static const uint8_t simple[4] = {0, POINTTYPE, LINETYPE, POLYTYPE};
+		if (mobj->ngeoms > 1)
+			ora_set_error(&r, "more than one element for a single geometry");
+		else if (mobj->ngeoms == 1)
+		{
+			LWGEOM *obj = mobj->geoms[0];
+			mobj->ngeoms = 0;
+			lwgeom_free(mobj);
+			return obj;
+		}
+		else
+		{
+			lwgeom_free(mobj);
+			return lwgeom__new(simple[tt], r.hasz, r.hasm);
+		}
+	}
+	if (r.error)
 	{
-		// multi LWGEOM
+		lwnotice("SDO_GEOMETRY error: %s", r.error);
+		lwgeom_free(mobj);
+		return NULL;
 	}
-	return NULL;
+	return mobj;
+}
+
+/* -------------------------------- input ora ------------------------------- */
+
+/// @brief convert an Oracle SDO_GEOMETRY. Arcs, circles and compound elements
+/// are stroked into straight segments, the LRS measure becomes M.
+/// @param flag number of segments per quarter circle used to stroke arcs and
+/// circles, 0 or less for the default
+LWGEOM *
+lwgeom_read_ora(const LWGEOM_SDO sdo, int flag)
+{
+	return ora_read(&sdo, flag);
+}
+
+typedef struct {
+	const LWGEOM_SDO *sdos;
+	size_t count;
+	int segments;
+	LWGEOM **geoms;
+} ora_batch;
+
+static void
+ora__read_block(size_t index, void *udata)
+{
+	ora_batch *b = (ora_batch *)udata;
+	size_t last = LWMIN((index + 1) * ORA_BATCH_BLOCK, b->count);
+	for (size_t i = index * ORA_BATCH_BLOCK; i < last; i++)
+	{
+		const LWGEOM_SDO *sdo = &b->sdos[i];
+		// a gtype of 0 stands for a NULL SDO_GEOMETRY in an array fetch
+		b->geoms[i] = sdo->sdo_gtype == 0 ? NULL : ora_read(sdo, b->segments);
+	}
+}
+
+/// @brief convert an array of SDO_GEOMETRY values, as filled by an array
+/// fetch, on the thread pool
+/// @param geoms receives \a count geometries, NULL for rows that are NULL or
+/// could not be converted
+/// @return number of rows converted
+size_t
+lwgeom_read_ora_batch(const LWGEOM_SDO *sdos, size_t count, int flag, int nthreads, LWGEOM **geoms)
+{
+	if (sdos == NULL || geoms == NULL)
+		return 0;
+	ora_batch b = {sdos, count, flag, geoms};
+	lwpool_run((count + ORA_BATCH_BLOCK - 1) / ORA_BATCH_BLOCK, nthreads, ora__read_block, &b);
+
+	size_t n = 0;
+	for (size_t i = 0; i < count; i++)
+		n += geoms[i] != NULL;
+	return n;
 }
@@ -0,0 +1,281 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+
+#include "lwgeom_parse.h"
+#include "lwpool.h"
+#include <math.h>
+#include <string.h>
+
+/* ----------------------------- inner polyline ----------------------------- */
+
+/// strings sized and decoded per task
+#define POLYLINE_BLOCK 256
+/// marks a string that failed the scan
+#define POLYLINE_BAD SIZE_MAX
+
+typedef struct {
+	const char *const *polylines;
+	const size_t *lens;
+	double div;
+	size_t *npoints; ///< points per string, POLYLINE_BAD for a malformed one
+	size_t *offsets; ///< start of each string in the arena, in points
+	double *coords;
+	LWGEOM **geoms;
+	size_t count;
+} polyline_job;
+
+/// one bit per byte lane of a 64 bit word
+#define POLYLINE_LANES 0x0101010101010101ull
+#define POLYLINE_HIGH  0x8080808080808080ull
+
+/// @brief count the values of a polyline, one per character without the
+/// continuation bit, and check that every character is in 63..126. Eight
+/// characters are tested at a time in the lanes of a 64 bit word
+static size_t
+polyline_count(const uint8_t *p, size_t len, int *valid)
+{
+	size_t n = 0, i = 0;
+	uint64_t bad = 0;
+	for (; i + 8 <= len; i += 8)
+	{
+		uint64_t w;
+		memcpy(&w, p + i, sizeof(w));
+		// with every lane below 128 the additions carry into no other lane,
+		// a lane at 128 or above is already marked bad by w itself
+		bad |= (w | (w + POLYLINE_LANES) | ~(w + 65 * POLYLINE_LANES)) & POLYLINE_HIGH;
+		n += (size_t)__builtin_popcountll(~(w + 33 * POLYLINE_LANES) & POLYLINE_HIGH);
+	}
+	for (; i < len; i++)
+	{
+		uint8_t c = (uint8_t)(p[i] - 63);
+		n += c < 0x20;
+		bad |= c > 0x3f;
+	}
+	*valid = !bad;
+	return n;
+}
+
+/// @brief number of points in a polyline, POLYLINE_BAD with \a error set when
+/// it is malformed
+static size_t
+polyline_scan(const uint8_t *p, size_t len, const char **error)
+{
+	int valid;
+	size_t n = polyline_count(p, len, &valid);
+	if (!valid)
+		*error = "invalid character";
+	else if (len > 0 && (uint8_t)(p[len - 1] - 63) >= 0x20)
+		*error = "truncated value";
+	else if (n % 2 != 0 || n / 2 > UINT32_MAX)
+		*error = "latitude without longitude";
+	else
+		return n / 2;
+	return POLYLINE_BAD;
+}
+
+/// @brief decode one value, the scan has made sure that the last character
+/// of the string ends a value
+static inline __attribute__((always_inline)) int64_t
+polyline_value(const uint8_t **cur)
+{
+	const uint8_t *p = *cur;
+	uint64_t c = (uint64_t)(*p++ - 63);
+	uint64_t v = c & 0x1f;
+	for (unsigned shift = 5; c >= 0x20; shift += 5)
+	{
+		c = (uint64_t)(*p++ - 63);
+		// values past 64 bits are garbage but stay defined
+		v |= shift < 64 ? (c & 0x1f) << shift : 0;
+	}
+	*cur = p;
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/// @brief decode \a npoints points of a scanned polyline into \a out as x, y,
+/// latitude comes first and is stored as y
+static void
+polyline_decode(const uint8_t *p, size_t npoints, double div, double *out)
+{
+	int64_t x = 0, y = 0;
+	for (size_t i = 0; i < npoints; i++, out += 2)
+	{
+		y += polyline_value(&p);
+		x += polyline_value(&p);
+		out[0] = (double)x / div;
+		out[1] = (double)y / div;
+	}
+}
+
+static void
+polyline__scan_block(size_t index, void *udata)
+{
+	polyline_job *job = (polyline_job *)udata;
+	size_t end = LWMIN((index + 1) * POLYLINE_BLOCK, job->count);
+	for (size_t i = index * POLYLINE_BLOCK; i < end; i++)
+	{
+		const char *s = job->polylines[i];
+		const char *error = NULL;
+		if (s == NULL)
+			job->npoints[i] = POLYLINE_BAD;
+		else
+			job->npoints[i] = polyline_scan((const uint8_t *)s, job->lens ? job->lens[i] : strlen(s), &error);
+	}
+}
+
+static void
+polyline__decode_block(size_t index, void *udata)
+{
+	polyline_job *job = (polyline_job *)udata;
+	size_t end = LWMIN((index + 1) * POLYLINE_BLOCK, job->count);
+	for (size_t i = index * POLYLINE_BLOCK; i < end; i++)
+	{
+		job->geoms[i] = NULL;
+		if (job->npoints[i] == POLYLINE_BAD)
+			continue;
+		size_t n = job->npoints[i];
+		if (n == 0)
+		{
+			job->geoms[i] = lwgeom__new(LINETYPE, LW_FALSE, LW_FALSE);
+			continue;
+		}
+		double *pp = job->coords + 2 * job->offsets[i];
+		polyline_decode((const uint8_t *)job->polylines[i], n, job->div, pp);
+		job->geoms[i] = lwgeom__new_points(LINETYPE, (uint32_t)n, pp, 0, LW_TRUE);
+	}
+}
+
+/* ----------------------------- input polyline ----------------------------- */
+
+LWGEOM *
+lwgeom__read_polyline(const char *data, size_t len, int precision, lwparse *ctx)
+{
+	if (data == NULL || precision < 0 || precision > 10 || !lwparse__bytes(ctx, "polyline", len))
+		return NULL;
+
+	// the scan counts every point before the decode makes room for them
+	const uint8_t *p = (const uint8_t *)data;
+	const char *error = NULL;
+	size_t npoints = polyline_scan(p, len, &error);
+	if (npoints == POLYLINE_BAD)
+	{
+		size_t at = 0;
+		while (at < len && (uint8_t)(p[at] - 63) <= 0x3f)
+			at++;
+		lwparse__fail(ctx, "polyline", LWMIN(at, len), error);
+		return NULL;
+	}
+	if ((error = lwparse__vertices(ctx, npoints)) != NULL)
+	{
+		// the first point over the limit starts after two values per point
+		// that was still allowed
+		size_t at = 0;
+		for (size_t values = 0; values < 2 * (ctx->max_vertices - ctx->vertices); at++)
+			values += (uint8_t)(p[at] - 63) < 0x20;
+		lwparse__fail(ctx, "polyline", at, error);
+		return NULL;
+	}
+	if (npoints == 0)
+		return lwgeom__new(LINETYPE, LW_FALSE, LW_FALSE);
+
+	double *pp = (double *)lwmalloc(npoints * 2 * sizeof(double));
+	LWGEOM *obj = NULL;
+	if (pp)
+	{
+		polyline_decode(p, npoints, pow(10, precision), pp);
+		obj = lwgeom__new_points(LINETYPE, (uint32_t)npoints, pp, 0, LW_FALSE);
+	}
+	if (obj == NULL)
+	{
+		lwfree(pp);
+		lwparse__fail(ctx, "polyline", 0, lwparse__nomem(ctx));
+	}
+	return obj;
+}
+
+/// @brief read an Encoded Polyline into a linestring
+/// @param precision decimal places the polyline was written with, 5 or 6
+LWGEOM *
+lwgeom_read_polyline(const char *polyline, size_t len, int precision)
+{
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	return lwgeom__read_polyline(polyline, len, precision, &ctx);
+}
+
+/// @brief read many Encoded Polylines into linestrings that share one
+/// coordinate arena. The strings are scanned first so that the arena is
+/// allocated once, then decoded in parallel
+/// @param lens string lengths, NULL for NUL terminated strings
+/// @param coords receives the arena, to be released with lwfree once the
+/// read-only geometries over it are freed
+/// @param geoms receives one linestring per string, NULL for a malformed one
+/// @return number of strings decoded
+size_t
+lwgeom_read_polyline_batch(const char *const *polylines,
+			   const size_t *lens,
+			   size_t count,
+			   int precision,
+			   int nthreads,
+			   double **coords,
+			   LWGEOM **geoms)
+{
+	if (coords)
+		*coords = NULL;
+	if (polylines == NULL || coords == NULL || geoms == NULL || precision < 0 || precision > 10)
+		return 0;
+
+	size_t *npoints = (size_t *)lwmalloc(LWMAX(count, 1) * 2 * sizeof(size_t));
+	if (npoints == NULL)
+		return 0;
+	polyline_job job = {polylines, lens, pow(10, precision), npoints, npoints + count, NULL, geoms, count};
+	size_t nblocks = (count + POLYLINE_BLOCK - 1) / POLYLINE_BLOCK;
+	lwpool_run(nblocks, nthreads, polyline__scan_block, &job);
+
+	// a bad string takes no room in the arena
+	size_t total = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		job.offsets[i] = total;
+		if (npoints[i] != POLYLINE_BAD)
+			total += npoints[i];
+	}
+
+	if (total > 0)
+	{
+		job.coords = (double *)lwmalloc(total * 2 * sizeof(double));
+		if (job.coords == NULL)
+		{
+			lwfree(npoints);
+			return 0;
+		}
+	}
+	lwpool_run(nblocks, nthreads, polyline__decode_block, &job);
+	lwfree(npoints);
+
+	size_t decoded = 0;
+	for (size_t i = 0; i < count; i++)
+		decoded += geoms[i] != NULL;
+	*coords = job.coords;
+	return decoded;
+}
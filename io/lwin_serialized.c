@@ -0,0 +1,312 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+
+#include "lwgeom_parse.h"
+#include "lwgeom_serialized.h"
+
+/* --------------------------- inner serialized ----------------------------- */
+
+typedef struct {
+	const uint8_t *start;
+	const uint8_t *cur;
+	const uint8_t *end;
+	int cdim;
+	lwflags_t dims;
+	LWBOOLEAN borrow;
+	const char *error;
+	lwparse *ctx;
+} ser_parser;
+
+static LWGEOM *ser_read_body(ser_parser *parser, int depth);
+
+static void
+ser_set_error(ser_parser *parser, const char *message)
+{
+	if (parser->error == NULL)
+		parser->error = message;
+}
+
+/// @brief \a npoints vertices at the cursor, referenced in place when the
+/// parser borrows and they are 8 byte aligned
+static LWGEOM *
+ser_read_points(ser_parser *parser, uint8_t type, uint32_t npoints, lwflags_t ring)
+{
+	if (npoints == 0)
+	{
+		LWGEOM *obj = lwgeom__new(type, LWFLAGS_GET_Z(parser->dims), LWFLAGS_GET_M(parser->dims));
+		if (obj)
+			obj->flags |= ring;
+		return obj;
+	}
+	size_t size = (size_t)npoints * parser->cdim * sizeof(double);
+	if (size / parser->cdim / sizeof(double) != npoints || size > (size_t)(parser->end - parser->cur))
+	{
+		ser_set_error(parser, "coordinate count exceeds serialized length");
+		return NULL;
+	}
+	const char *error = lwparse__vertices(parser->ctx, npoints);
+	if (error)
+	{
+		ser_set_error(parser, error);
+		return NULL;
+	}
+	double *pp;
+	int borrow = parser->borrow && ((uintptr_t)parser->cur & 7) == 0;
+	if (borrow)
+		pp = (double *)(uintptr_t)parser->cur;
+	else if ((pp = (double *)lwmalloc(size)) != NULL)
+		memcpy(pp, parser->cur, size);
+	else
+	{
+		ser_set_error(parser, lwparse__nomem(parser->ctx));
+		return NULL;
+	}
+	parser->cur += size;
+	LWGEOM *obj = lwgeom__new_points(type, npoints, pp, parser->dims | ring, borrow);
+	if (obj == NULL && !borrow)
+		lwfree(pp);
+	return obj;
+}
+
+static LWGEOM *
+ser_add(ser_parser *parser, LWGEOM *mobj, LWGEOM *obj)
+{
+	if (obj == NULL || lwgeom__add(mobj, obj) == NULL)
+	{
+		if (obj)
+			ser_set_error(parser, lwparse__nomem(parser->ctx));
+		lwgeom_free(obj);
+		lwgeom_free(mobj);
+		return NULL;
+	}
+	return mobj;
+}
+
+static LWGEOM *
+ser_read_polygon(ser_parser *parser, uint32_t nrings)
+{
+	size_t counts = ((size_t)nrings * 4 + 7) & ~(size_t)7;
+	if (counts > (size_t)(parser->end - parser->cur))
+	{
+		ser_set_error(parser, "ring count exceeds serialized length");
+		return NULL;
+	}
+	const uint8_t *count = parser->cur;
+	parser->cur += counts;
+	LWGEOM *poly = lwgeom__new(POLYTYPE, LWFLAGS_GET_Z(parser->dims), LWFLAGS_GET_M(parser->dims));
+	for (uint32_t i = 0; poly && i < nrings; i++)
+	{
+		lwflags_t ring = i == 0 ? LW_FLAG_SHELL_RING : LW_FLAG_HOLE_RING;
+		poly = ser_add(parser, poly, ser_read_points(parser, LINETYPE, ser_load_u32(count + 4 * (size_t)i), ring));
+	}
+	return poly;
+}
+
+static LWGEOM *
+ser_read_body(ser_parser *parser, int depth)
+{
+	if (parser->end - parser->cur < 8)
+	{
+		ser_set_error(parser, "truncated geometry");
+		return NULL;
+	}
+	uint32_t type = ser_load_u32(parser->cur);
+	uint32_t count = ser_load_u32(parser->cur + 4);
+	parser->cur += 8;
+
+	switch (type)
+	{
+	case POINTTYPE:
+		if (count > 1)
+		{
+			ser_set_error(parser, "point with more than one vertex");
+			return NULL;
+		}
+		return ser_read_points(parser, POINTTYPE, count, 0);
+	case LINETYPE:
+		return ser_read_points(parser, LINETYPE, count, 0);
+	case POLYTYPE:
+		return ser_read_polygon(parser, count);
+	case MPOINTTYPE:
+	case MLINETYPE:
+	case MPOLYTYPE:
+	case COLLECTIONTYPE:
+		break;
+	default:
+		ser_set_error(parser, "unknown geometry type");
+		return NULL;
+	}
+
+	const char *error = lwparse__depth(parser->ctx, depth + 1);
+	if (error)
+	{
+		ser_set_error(parser, error);
+		return NULL;
+	}
+	// every member takes at least its type and count
+	if ((uint64_t)count * 8 > (uint64_t)(parser->end - parser->cur))
+	{
+		ser_set_error(parser, "member count exceeds serialized length");
+		return NULL;
+	}
+	LWGEOM *mobj = lwgeom__new((uint8_t)type, LWFLAGS_GET_Z(parser->dims), LWFLAGS_GET_M(parser->dims));
+	for (uint32_t i = 0; mobj && i < count; i++)
+	{
+		const uint8_t *at = parser->cur;
+		LWGEOM *obj = ser_read_body(parser, depth + 1);
+		if (obj && type != COLLECTIONTYPE && obj->type != type - 3)
+		{
+			parser->cur = at;
+			ser_set_error(parser, "member type does not match the collection");
+			lwgeom_free(obj);
+			lwgeom_free(mobj);
+			return NULL;
+		}
+		mobj = ser_add(parser, mobj, obj);
+	}
+	return mobj;
+}
+
+/* --------------------------- input serialized ----------------------------- */
+
+LWGEOM *
+lwgeom__read_serialized(const char *data, size_t len, int borrow, lwparse *ctx)
+{
+	if (data == NULL || !lwparse__bytes(ctx, "serialized", len))
+		return NULL;
+	ser_parser parser;
+	memset(&parser, 0, sizeof(parser));
+	parser.start = (const uint8_t *)data;
+	parser.cur = parser.start;
+	parser.borrow = borrow;
+	parser.ctx = ctx;
+
+	LWGEOM *obj = NULL;
+	uint32_t size = len >= SER_HEADER_SIZE ? ser_load_u32(parser.start) : 0;
+	uint8_t flags = len >= SER_HEADER_SIZE ? parser.start[5] : 0;
+	if (len < SER_HEADER_SIZE || size < SER_HEADER_SIZE || size > len)
+		ser_set_error(&parser, "bad size in header");
+	else if (flags & ~(SER_FLAG_Z | SER_FLAG_M | SER_FLAG_BOX))
+		ser_set_error(&parser, "unknown flags in header");
+	else
+	{
+		parser.end = parser.start + size;
+		parser.cur += SER_HEADER_SIZE + ((flags & SER_FLAG_BOX) ? SER_BOX_SIZE : 0);
+		LWFLAGS_SET_Z(parser.dims, (flags & SER_FLAG_Z) != 0);
+		LWFLAGS_SET_M(parser.dims, (flags & SER_FLAG_M) != 0);
+		parser.cdim = 2 + ((flags & SER_FLAG_Z) != 0) + ((flags & SER_FLAG_M) != 0);
+		if (parser.cur > parser.end)
+			ser_set_error(&parser, "truncated box");
+		else if ((obj = ser_read_body(&parser, 0)) != NULL)
+		{
+			if (obj->type != parser.start[4])
+				ser_set_error(&parser, "header type does not match the geometry");
+			else if (parser.cur != parser.end)
+				ser_set_error(&parser, "unexpected bytes after geometry");
+		}
+	}
+
+	if (parser.error)
+	{
+		lwparse__fail(ctx, "serialized", (size_t)(parser.cur - parser.start), parser.error);
+		lwgeom_free(obj);
+		return NULL;
+	}
+	return obj;
+}
+
+/// @brief read a geometry written by lwgeom_write_serialized
+LWGEOM *
+lwgeom_read_serialized(const char *data, size_t len)
+{
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	return lwgeom__read_serialized(data, len, LW_FALSE, &ctx);
+}
+
+/// @brief read a geometry written by lwgeom_write_serialized without copying
+/// its coordinates. When \a data is 8 byte aligned the coordinate arrays are
+/// referenced in place and flagged LW_FLAG_READONLY, the buffer must outlive
+/// the returned geometry
+LWGEOM *
+lwgeom_read_serialized_view(const char *data, size_t len)
+{
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	return lwgeom__read_serialized(data, len, LW_TRUE, &ctx);
+}
+
+/// @brief geometry type of a serialization, 0 when the header is missing
+uint8_t
+lwserialized_type(const char *data, size_t len)
+{
+	if (data == NULL || len < SER_HEADER_SIZE)
+		return 0;
+	return (uint8_t)data[4];
+}
+
+/// @brief envelope of a serialization read from its header, nothing is
+/// decoded. The box of a geometry other than a point is the float box, which
+/// may be slightly larger than the envelope
+/// @return LW_FAILURE for an empty geometry or a bad header
+int
+lwserialized_box(const char *data, size_t len, LWBOX *box)
+{
+	if (data == NULL || box == NULL || len < SER_HEADER_SIZE)
+		return LW_FAILURE;
+	const uint8_t *p = (const uint8_t *)data;
+	memset(box, 0, sizeof(LWBOX));
+	if (p[5] & SER_FLAG_BOX)
+	{
+		if (len < SER_HEADER_SIZE + SER_BOX_SIZE)
+			return LW_FAILURE;
+		float f[4];
+		memcpy(f, p + SER_HEADER_SIZE, sizeof(f));
+		box->xmin = f[0];
+		box->ymin = f[1];
+		box->xmax = f[2];
+		box->ymax = f[3];
+		return LW_SUCCESS;
+	}
+	// a point is its own box, its vertex follows the type and count words
+	if (p[4] != POINTTYPE || len < SER_HEADER_SIZE + 24 || ser_load_u32(p + SER_HEADER_SIZE + 4) != 1)
+		return LW_FAILURE;
+	double xy[2];
+	memcpy(xy, p + SER_HEADER_SIZE + 8, sizeof(xy));
+	box->xmin = box->xmax = xy[0];
+	box->ymin = box->ymax = xy[1];
+	return LW_SUCCESS;
+}
+
+/// @brief whether the envelope of a serialization intersects \a box, tested
+/// on the header alone. A false answer is exact, a true one may come from the
+/// float box being slightly larger than the geometry
+int
+lwserialized_intersects(const char *data, size_t len, const LWBOX *box)
+{
+	LWBOX env;
+	if (box == NULL || !lwserialized_box(data, len, &env))
+		return LW_FALSE;
+	return lwbox_intersects(env, *box);
+}
@@ -0,0 +1,603 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+
+#include "lwpool.h"
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ------------------------------- inner shp -------------------------------- */
+
+#define SHP_HEADER_SIZE 100
+#define SHP_FILE_CODE   9994
+#define SHP_VERSION     1000
+/// bytes of a record header, the record number and the content length
+#define SHP_RECORD_HEADER 8
+/// bytes of an index record, the offset and the content length
+#define SHP_INDEX_RECORD 8
+/// records decoded per task
+#define SHP_BLOCK 256
+/// measures below this are "no data"
+#define SHP_NO_DATA -1e38
+
+enum {
+	SHP_NULL = 0,
+	SHP_POINT = 1,
+	SHP_POLYLINE = 3,
+	SHP_POLYGON = 5,
+	SHP_MULTIPOINT = 8,
+};
+
+struct LWSHPREADER {
+	const uint8_t *shp;
+	size_t shp_len;
+	const uint8_t *shx; ///< NULL when the records were found by a scan
+	size_t shx_len;
+	size_t map_len;     ///< size of the mapped .shp, 0 when not mapped
+	uint64_t *offsets;  ///< record starts found by the scan
+	size_t count;
+	LWBOX extent;
+};
+
+typedef struct {
+	const LWSHPREADER *reader;
+	const LWBOX *box;
+	LWGEOM **geoms;
+} shp_job;
+
+static inline uint32_t
+shp_load_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline uint32_t
+shp_load_le32(const uint8_t *p)
+{
+	return (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+}
+
+static inline double
+shp_load_double(const uint8_t *p)
+{
+	uint64_t u = 0;
+	for (int i = 7; i >= 0; i--)
+		u = (u << 8) | p[i];
+	double v;
+	memcpy(&v, &u, sizeof(double));
+	return v;
+}
+
+/// @brief content of record \a index, NULL when it lies outside the file
+static const uint8_t *
+shp_record(const LWSHPREADER *reader, size_t index, size_t *len)
+{
+	uint64_t offset;
+	if (reader->shx)
+		offset = (uint64_t)shp_load_be32(reader->shx + SHP_HEADER_SIZE + index * SHP_INDEX_RECORD) * 2;
+	else
+		offset = reader->offsets[index];
+	if (offset < SHP_HEADER_SIZE || offset > reader->shp_len - SHP_RECORD_HEADER)
+		return NULL;
+	const uint8_t *p = reader->shp + offset;
+	uint64_t size = (uint64_t)shp_load_be32(p + 4) * 2;
+	if (size < 4 || size > reader->shp_len - offset - SHP_RECORD_HEADER)
+		return NULL;
+	*len = (size_t)size;
+	return p + SHP_RECORD_HEADER;
+}
+
+/// @brief gather \a n vertices, the XY pairs at \a xy and the Z and M arrays
+/// when present, into a LWGEOM of \a type
+static LWGEOM *
+shp_points(uint8_t type, const uint8_t *xy, uint32_t n, const uint8_t *z, const uint8_t *m)
+{
+	if (n == 0)
+		return lwgeom__new(type, z != NULL, m != NULL);
+
+	int cdim = 2 + (z != NULL) + (m != NULL);
+	double *pp = (double *)lwmalloc((size_t)n * cdim * sizeof(double));
+	if (pp == NULL)
+		return NULL;
+	double *q = pp;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		*q++ = shp_load_double(xy + 16 * (size_t)i);
+		*q++ = shp_load_double(xy + 16 * (size_t)i + 8);
+		if (z)
+			*q++ = shp_load_double(z + 8 * (size_t)i);
+		if (m)
+		{
+			double v = shp_load_double(m + 8 * (size_t)i);
+			*q++ = v < SHP_NO_DATA ? NAN : v;
+		}
+	}
+	lwflags_t flags = 0;
+	LWFLAGS_SET_Z(flags, z != NULL);
+	LWFLAGS_SET_M(flags, m != NULL);
+	LWGEOM *obj = lwgeom__new_points(type, n, pp, flags, LW_FALSE);
+	if (obj == NULL)
+		lwfree(pp);
+	return obj;
+}
+
+static LWGEOM *
+shp_add(LWGEOM *mobj, LWGEOM *obj)
+{
+	if (obj == NULL || lwgeom__add(mobj, obj) == NULL)
+	{
+		lwgeom_free(obj);
+		lwgeom_free(mobj);
+		return NULL;
+	}
+	return mobj;
+}
+
+/// @brief crossing test of (x, y) against a closed ring
+static int
+shp_ring_contains(const LWGEOM *ring, double x, double y)
+{
+	if (x < ring->env.xmin || x > ring->env.xmax || y < ring->env.ymin || y > ring->env.ymax)
+		return LW_FALSE;
+	int cdim = lwgeom_dim_coordinate(ring);
+	const double *pp = ring->pp;
+	int inside = LW_FALSE;
+	for (uint32_t i = 0, j = ring->npoints - 1; i < ring->npoints; j = i++)
+	{
+		double xi = pp[i * cdim], yi = pp[i * cdim + 1];
+		double xj = pp[j * cdim], yj = pp[j * cdim + 1];
+		if ((yi > y) != (yj > y) && x < (xj - xi) * (y - yi) / (yj - yi) + xi)
+			inside = !inside;
+	}
+	return inside;
+}
+
+/// @brief assemble polygons from rings in file order. Shells are clockwise
+/// and holes counterclockwise. With one shell every hole belongs to it,
+/// otherwise a hole goes to the smallest shell that holds its first vertex
+/// and a hole outside every shell becomes a shell itself
+static LWGEOM *
+shp_assemble(LWGEOM **rings, uint32_t nrings, int hasz, int hasm)
+{
+	uint8_t *hole = (uint8_t *)lwmalloc0(LWMAX(nrings, 1));
+	int32_t *owner = (int32_t *)lwmalloc(LWMAX(nrings, 1) * sizeof(int32_t));
+	LWGEOM *result = NULL;
+	if (hole == NULL || owner == NULL)
+		goto done;
+
+	uint32_t nshells = 0;
+	for (uint32_t i = 0; i < nrings; i++)
+	{
+		const LWGEOM *r = rings[i];
+		hole[i] = r->npoints > 0 && nv_ccw(r->pp, (int)r->npoints, lwgeom_dim_coordinate(r));
+		nshells += !hole[i];
+	}
+	// a file that winds every ring the same wrong way has no holes at all
+	if (nshells == 0)
+		memset(hole, 0, nrings);
+
+	int32_t last_shell = -1;
+	for (uint32_t i = 0; i < nrings; i++)
+	{
+		owner[i] = -1;
+		if (!hole[i])
+		{
+			last_shell = (int32_t)i;
+			continue;
+		}
+		if (nshells == 1)
+		{
+			owner[i] = last_shell >= 0 ? last_shell : -1;
+			if (owner[i] >= 0)
+				continue;
+		}
+		double best = INFINITY;
+		double x = rings[i]->pp[0], y = rings[i]->pp[1];
+		for (uint32_t s = 0; s < nrings; s++)
+		{
+			if (hole[s])
+				continue;
+			const LWBOX *e = &rings[s]->env;
+			double area = (e->xmax - e->xmin) * (e->ymax - e->ymin);
+			if (area < best && shp_ring_contains(rings[s], x, y))
+			{
+				best = area;
+				owner[i] = (int32_t)s;
+			}
+		}
+		if (owner[i] < 0)
+			hole[i] = LW_FALSE;
+	}
+
+	// one polygon per shell, rings keep their file order within it
+	uint32_t npolys = 0;
+	for (uint32_t i = 0; i < nrings; i++)
+		npolys += !hole[i];
+	result = lwgeom__new(npolys == 1 ? POLYTYPE : MPOLYTYPE, hasz, hasm);
+	if (result == NULL)
+		goto done;
+	for (uint32_t s = 0; s < nrings; s++)
+	{
+		if (hole[s])
+			continue;
+		LWGEOM *poly = npolys == 1 ? result : lwgeom__new(POLYTYPE, hasz, hasm);
+		if (poly == NULL)
+			goto fail;
+		rings[s]->flags |= LW_FLAG_SHELL_RING;
+		int ok = lwgeom__add(poly, rings[s]) != NULL;
+		if (ok)
+			rings[s] = NULL;
+		for (uint32_t i = s + 1; ok && i < nrings; i++)
+		{
+			if (!hole[i] || owner[i] != (int32_t)s)
+				continue;
+			rings[i]->flags |= LW_FLAG_HOLE_RING;
+			ok = lwgeom__add(poly, rings[i]) != NULL;
+			if (ok)
+				rings[i] = NULL;
+		}
+		if (poly != result)
+		{
+			if (!ok || lwgeom__add(result, poly) == NULL)
+			{
+				lwgeom_free(poly);
+				goto fail;
+			}
+		}
+		else if (!ok)
+			goto fail;
+	}
+	goto done;
+
+fail:
+	lwgeom_free(result);
+	result = NULL;
+done:
+	for (uint32_t i = 0; i < nrings; i++)
+		lwgeom_free(rings[i]);
+	lwfree(hole);
+	lwfree(owner);
+	return result;
+}
+
+static int
+shp_box_misses(const uint8_t *p, const LWBOX *box)
+{
+	return shp_load_double(p) > box->xmax || shp_load_double(p + 8) > box->ymax ||
+	       shp_load_double(p + 16) < box->xmin || shp_load_double(p + 24) < box->ymin;
+}
+
+/// @brief decode the content of one record, NULL for a null shape, a record
+/// outside \a box or a malformed one
+static LWGEOM *
+shp_decode(const uint8_t *p, size_t len, const LWBOX *box)
+{
+	uint32_t shape = shp_load_le32(p);
+	uint32_t base = shape % 10;
+	int hasz = shape / 10 == 1;
+	int hasm = shape / 10 == 2;
+	if (shape == SHP_NULL || shape > 28 || (base != SHP_POINT && base != SHP_POLYLINE && base != SHP_POLYGON &&
+						base != SHP_MULTIPOINT))
+		return NULL;
+
+	if (base == SHP_POINT)
+	{
+		if (len < 20 + 8 * (size_t)(hasz + hasm))
+			return NULL;
+		double x = shp_load_double(p + 4), y = shp_load_double(p + 12);
+		if (box && (x < box->xmin || x > box->xmax || y < box->ymin || y > box->ymax))
+			return NULL;
+		// the measure of a PointZ is optional
+		const uint8_t *z = hasz ? p + 20 : NULL;
+		const uint8_t *m = hasm ? p + 20 : (hasz && len >= 36 ? p + 28 : NULL);
+		return shp_points(POINTTYPE, p + 4, 1, z, m);
+	}
+
+	if (len < 40 || (box && shp_box_misses(p + 4, box)))
+		return NULL;
+	uint32_t nparts = 0, npoints;
+	size_t at = 36;
+	if (base != SHP_MULTIPOINT)
+	{
+		nparts = shp_load_le32(p + at);
+		at += 4;
+		if (len < at + 4)
+			return NULL;
+	}
+	npoints = shp_load_le32(p + at);
+	at += 4;
+	const uint8_t *parts = p + at;
+	if ((uint64_t)nparts * 4 + (uint64_t)npoints * 16 > len - at)
+		return NULL;
+	const uint8_t *xy = parts + 4 * (size_t)nparts;
+	at += 4 * (size_t)nparts + 16 * (size_t)npoints;
+
+	// Z and M each follow as a range and one value per point, the M of a
+	// Z shape is optional
+	const uint8_t *z = NULL, *m = NULL;
+	size_t section = 16 + 8 * (size_t)npoints;
+	if (hasz)
+	{
+		if (len - at < section)
+			return NULL;
+		z = p + at + 16;
+		at += section;
+	}
+	if ((hasm || hasz) && len - at >= section)
+		m = p + at + 16;
+	else if (hasm)
+		return NULL;
+	hasm = m != NULL;
+
+	if (base == SHP_MULTIPOINT)
+	{
+		LWGEOM *mobj = lwgeom__new(MPOINTTYPE, hasz, hasm);
+		for (uint32_t i = 0; mobj && i < npoints; i++)
+			mobj = shp_add(mobj, shp_points(POINTTYPE, xy + 16 * (size_t)i, 1, z ? z + 8 * (size_t)i : NULL,
+							m ? m + 8 * (size_t)i : NULL));
+		return mobj;
+	}
+
+	LWGEOM **items = (LWGEOM **)lwmalloc0(LWMAX(nparts, 1) * sizeof(LWGEOM *));
+	if (items == NULL)
+		return NULL;
+	int ok = LW_TRUE;
+	for (uint32_t i = 0; ok && i < nparts; i++)
+	{
+		uint32_t start = shp_load_le32(parts + 4 * (size_t)i);
+		uint32_t end = i + 1 < nparts ? shp_load_le32(parts + 4 * (size_t)(i + 1)) : npoints;
+		if (start > end || end > npoints)
+		{
+			ok = LW_FALSE;
+			break;
+		}
+		items[i] = shp_points(LINETYPE, xy + 16 * (size_t)start, end - start, z ? z + 8 * (size_t)start : NULL,
+				      m ? m + 8 * (size_t)start : NULL);
+		ok = items[i] != NULL;
+	}
+
+	LWGEOM *obj = NULL;
+	if (ok && base == SHP_POLYGON)
+	{
+		obj = shp_assemble(items, nparts, hasz, hasm);
+		lwfree(items);
+		return obj;
+	}
+	if (ok && nparts == 1)
+	{
+		obj = items[0];
+		items[0] = NULL;
+	}
+	else if (ok)
+	{
+		obj = lwgeom__new(MLINETYPE, hasz, hasm);
+		for (uint32_t i = 0; obj && i < nparts; i++)
+		{
+			obj = shp_add(obj, items[i]);
+			items[i] = NULL;
+		}
+	}
+	for (uint32_t i = 0; i < nparts; i++)
+		lwgeom_free(items[i]);
+	lwfree(items);
+	return obj;
+}
+
+static void
+shp__read_block(size_t index, void *udata)
+{
+	shp_job *job = (shp_job *)udata;
+	size_t start = index * SHP_BLOCK;
+	size_t end = LWMIN(start + SHP_BLOCK, job->reader->count);
+	for (size_t i = start; i < end; i++)
+	{
+		size_t len = 0;
+		const uint8_t *p = shp_record(job->reader, i, &len);
+		job->geoms[i] = p ? shp_decode(p, len, job->box) : NULL;
+	}
+}
+
+/// @brief record starts found by walking the record headers
+static int
+shp_scan(LWSHPREADER *reader)
+{
+	size_t capacity = 0;
+	uint64_t offset = SHP_HEADER_SIZE;
+	while (offset + SHP_RECORD_HEADER <= reader->shp_len)
+	{
+		uint64_t size = (uint64_t)shp_load_be32(reader->shp + offset + 4) * 2;
+		if (size > reader->shp_len - offset - SHP_RECORD_HEADER)
+			break;
+		if (reader->count == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 1024;
+			uint64_t *offsets = (uint64_t *)lwrealloc(reader->offsets, capacity * sizeof(uint64_t));
+			if (offsets == NULL)
+				return LW_FAILURE;
+			reader->offsets = offsets;
+		}
+		reader->offsets[reader->count++] = offset;
+		offset += SHP_RECORD_HEADER + size;
+	}
+	return LW_SUCCESS;
+}
+
+static void *
+shp_map(const char *path, size_t *len)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	void *map = NULL;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED)
+			map = NULL;
+		else
+			*len = (size_t)st.st_size;
+	}
+	close(fd);
+	return map;
+}
+
+/* ------------------------------- input shp -------------------------------- */
+
+LWSHPREADER *
+lwshp_open_memory(const void *shp, size_t shp_len, const void *shx, size_t shx_len)
+{
+	const uint8_t *p = (const uint8_t *)shp;
+	if (p == NULL || shp_len < SHP_HEADER_SIZE || shp_load_be32(p) != SHP_FILE_CODE ||
+	    shp_load_le32(p + 28) != SHP_VERSION)
+	{
+		lwnotice("shapefile parse error at offset 0: not a .shp file");
+		return NULL;
+	}
+
+	LWSHPREADER *reader = (LWSHPREADER *)lwmalloc0(sizeof(LWSHPREADER));
+	if (reader == NULL)
+		return NULL;
+	reader->shp = p;
+	reader->shp_len = LWMIN(shp_len, (size_t)shp_load_be32(p + 24) * 2);
+	if (reader->shp_len < SHP_HEADER_SIZE)
+		reader->shp_len = shp_len;
+	reader->extent.xmin = shp_load_double(p + 36);
+	reader->extent.ymin = shp_load_double(p + 44);
+	reader->extent.xmax = shp_load_double(p + 52);
+	reader->extent.ymax = shp_load_double(p + 60);
+	reader->extent.zmin = shp_load_double(p + 68);
+	reader->extent.zmax = shp_load_double(p + 76);
+
+	// a missing or damaged index falls back to a scan of the records
+	const uint8_t *x = (const uint8_t *)shx;
+	if (x && shx_len >= SHP_HEADER_SIZE && shp_load_be32(x) == SHP_FILE_CODE)
+	{
+		reader->shx = x;
+		reader->shx_len = shx_len;
+		reader->count = (shx_len - SHP_HEADER_SIZE) / SHP_INDEX_RECORD;
+	}
+	else if (shp_scan(reader) == LW_FAILURE)
+	{
+		lwfree(reader->offsets);
+		lwfree(reader);
+		return NULL;
+	}
+	return reader;
+}
+
+LWSHPREADER *
+lwshp_open(const char *path)
+{
+	size_t shp_len = 0, shx_len = 0;
+	void *shp = shp_map(path, &shp_len);
+	if (shp == NULL)
+		return NULL;
+
+	// the index sits next to the .shp, with the extension in the same case
+	void *shx = NULL;
+	size_t n = strlen(path);
+	char *index = (char *)lwmalloc(n + 1);
+	if (index && n > 4 && path[n - 4] == '.')
+	{
+		memcpy(index, path, n + 1);
+		index[n - 1] = index[n - 1] == 'P' ? 'X' : 'x';
+		shx = shp_map(index, &shx_len);
+	}
+	lwfree(index);
+	if (shx)
+		madvise(shx, shx_len, MADV_WILLNEED);
+
+	LWSHPREADER *reader = lwshp_open_memory(shp, shp_len, shx, shx_len);
+	if (reader == NULL || (shx && reader->shx == NULL))
+	{
+		if (shx)
+			munmap(shx, shx_len);
+		shx = NULL;
+	}
+	if (reader == NULL)
+	{
+		munmap(shp, shp_len);
+		return NULL;
+	}
+	reader->map_len = shp_len;
+	madvise(shp, shp_len, MADV_RANDOM);
+	return reader;
+}
+
+void
+lwshp_close(LWSHPREADER *reader)
+{
+	if (reader == NULL)
+		return;
+	if (reader->map_len)
+	{
+		munmap((void *)reader->shp, reader->map_len);
+		if (reader->shx)
+			munmap((void *)reader->shx, reader->shx_len);
+	}
+	lwfree(reader->offsets);
+	lwfree(reader);
+}
+
+size_t
+lwshp_count(const LWSHPREADER *reader)
+{
+	return reader ? reader->count : 0;
+}
+
+int
+lwshp_extent(const LWSHPREADER *reader, LWBOX *extent)
+{
+	if (reader == NULL || reader->count == 0 || extent == NULL)
+		return LW_FAILURE;
+	*extent = reader->extent;
+	return LW_SUCCESS;
+}
+
+LWGEOM *
+lwshp_get(const LWSHPREADER *reader, size_t index)
+{
+	if (reader == NULL || index >= reader->count)
+		return NULL;
+	size_t len = 0;
+	const uint8_t *p = shp_record(reader, index, &len);
+	return p ? shp_decode(p, len, NULL) : NULL;
+}
+
+size_t
+lwshp_read(const LWSHPREADER *reader, const LWBOX *box, int nthreads, LWGEOM **geoms)
+{
+	if (reader == NULL || geoms == NULL)
+		return 0;
+	shp_job job = {reader, box, geoms};
+	lwpool_run((reader->count + SHP_BLOCK - 1) / SHP_BLOCK, nthreads, shp__read_block, &job);
+	size_t decoded = 0;
+	for (size_t i = 0; i < reader->count; i++)
+		decoded += geoms[i] != NULL;
+	return decoded;
+}
@@ -0,0 +1,510 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+
+#include "lwgeom_parse.h"
+#include <math.h>
+#include <string.h>
+
+/* ------------------------------ inner twkb -------------------------------- */
+
+/// metadata header bits
+#define TWKB_BBOX     0x01
+#define TWKB_SIZE     0x02
+#define TWKB_IDLIST   0x04
+#define TWKB_EXTENDED 0x08
+#define TWKB_EMPTY    0x10
+
+/// longest varint, enough for 64 bits
+#define TWKB_VARINT_MAX 10
+
+typedef struct {
+	const uint8_t *start;
+	const uint8_t *cur;
+	const uint8_t *end;
+	int cdim;
+	LWBOOLEAN hasz;
+	LWBOOLEAN hasm;
+	double mul[4]; ///< a vertex ordinate is q * mul / div, one of them is 1
+	double div[4];
+	int64_t last[4];
+	const char *error;
+	lwparse *ctx;
+} twkb_parser;
+
+static LWGEOM *twkb_read_geometry(twkb_parser *parser, int depth);
+
+static void
+twkb_set_error(twkb_parser *parser, const char *message)
+{
+	if (parser->error == NULL)
+		parser->error = message;
+}
+
+/// @brief decode a varint when at least TWKB_VARINT_MAX bytes are left
+/// @return pointer past the varint, NULL when it runs over ten bytes
+static inline const uint8_t *
+twkb_get_uvarint(const uint8_t *p, uint64_t *v)
+{
+	uint64_t b = *p++;
+	if (b < 0x80)
+	{
+		*v = b;
+		return p;
+	}
+	uint64_t result = b & 0x7f;
+	for (int shift = 7; shift < 70; shift += 7)
+	{
+		b = *p++;
+		result |= (b & 0x7f) << shift;
+		if (b < 0x80)
+		{
+			*v = result;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static int
+twkb_read_uvarint(twkb_parser *parser, uint64_t *v)
+{
+	if (parser->end - parser->cur >= TWKB_VARINT_MAX)
+	{
+		const uint8_t *p = twkb_get_uvarint(parser->cur, v);
+		if (p == NULL)
+		{
+			twkb_set_error(parser, "varint longer than ten bytes");
+			return LW_FALSE;
+		}
+		parser->cur = p;
+		return LW_TRUE;
+	}
+	uint64_t result = 0;
+	for (int shift = 0; parser->cur < parser->end; shift += 7)
+	{
+		uint8_t b = *parser->cur++;
+		result |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+		{
+			*v = result;
+			return LW_TRUE;
+		}
+	}
+	twkb_set_error(parser, "truncated varint");
+	return LW_FALSE;
+}
+
+static inline int64_t
+twkb_unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static int
+twkb_read_count(twkb_parser *parser, uint32_t *n)
+{
+	uint64_t v;
+	if (!twkb_read_uvarint(parser, &v))
+		return LW_FALSE;
+	// every element takes at least one byte
+	if (v > UINT32_MAX || v > (uint64_t)(parser->end - parser->cur))
+	{
+		twkb_set_error(parser, "count exceeds TWKB length");
+		return LW_FALSE;
+	}
+	*n = (uint32_t)v;
+	return LW_TRUE;
+}
+
+static void
+twkb_set_precision(twkb_parser *parser, int k, int precision)
+{
+	parser->mul[k] = precision < 0 ? pow(10, -precision) : 1;
+	parser->div[k] = precision > 0 ? pow(10, precision) : 1;
+}
+
+/// @brief decode \a npoints vertices into \a out, called with a constant
+/// \a cdim so that the ordinate loop unrolls
+/// @return LW_FALSE on a bad varint
+static inline __attribute__((always_inline)) int
+twkb_decode(twkb_parser *parser, double *out, uint32_t npoints, int cdim)
+{
+	const uint8_t *p = parser->cur;
+	const uint8_t *end = parser->end;
+	size_t margin = (size_t)cdim * TWKB_VARINT_MAX;
+	int64_t last[4];
+	double mul[4], div[4];
+	memcpy(last, parser->last, sizeof(last));
+	memcpy(mul, parser->mul, sizeof(mul));
+	memcpy(div, parser->div, sizeof(div));
+	for (uint32_t i = 0; i < npoints; i++)
+	{
+		// bounds are checked once per vertex while the input has room for
+		// the longest encoding, byte by byte near its end
+		int fast = (size_t)(end - p) >= margin;
+		for (int k = 0; k < cdim; k++)
+		{
+			uint64_t v;
+			if (fast)
+				p = twkb_get_uvarint(p, &v);
+			else
+			{
+				parser->cur = p;
+				p = twkb_read_uvarint(parser, &v) ? parser->cur : NULL;
+			}
+			if (p == NULL)
+				return LW_FALSE;
+			last[k] += twkb_unzigzag(v);
+			// division keeps q / 10^p correctly rounded, the decimal value
+			// that was written reads back exactly
+			*out++ = (double)last[k] * mul[k] / div[k];
+		}
+	}
+	memcpy(parser->last, last, sizeof(last));
+	parser->cur = p;
+	return LW_TRUE;
+}
+
+/// @brief decode \a npoints delta encoded vertices
+static LWGEOM *
+twkb_read_points(twkb_parser *parser, uint8_t type, uint32_t npoints)
+{
+	if (npoints == 0)
+		return lwgeom__new(type, parser->hasz, parser->hasm);
+	int cdim = parser->cdim;
+	if ((uint64_t)npoints * cdim > (uint64_t)(parser->end - parser->cur))
+	{
+		twkb_set_error(parser, "coordinate count exceeds TWKB length");
+		return NULL;
+	}
+	const char *error = lwparse__vertices(parser->ctx, npoints);
+	if (error)
+	{
+		twkb_set_error(parser, error);
+		return NULL;
+	}
+	double *pp = (double *)lwmalloc((size_t)npoints * cdim * sizeof(double));
+	if (pp == NULL)
+	{
+		twkb_set_error(parser, lwparse__nomem(parser->ctx));
+		return NULL;
+	}
+
+	int ok;
+	switch (cdim)
+	{
+	case 2:
+		ok = twkb_decode(parser, pp, npoints, 2);
+		break;
+	case 3:
+		ok = twkb_decode(parser, pp, npoints, 3);
+		break;
+	default:
+		ok = twkb_decode(parser, pp, npoints, 4);
+		break;
+	}
+	if (!ok)
+	{
+		twkb_set_error(parser, "invalid varint");
+		lwfree(pp);
+		return NULL;
+	}
+
+	lwflags_t flags = 0;
+	LWFLAGS_SET_Z(flags, parser->hasz);
+	LWFLAGS_SET_M(flags, parser->hasm);
+	LWGEOM *obj = lwgeom__new_points(type, npoints, pp, flags, LW_FALSE);
+	if (obj == NULL)
+	{
+		lwfree(pp);
+		twkb_set_error(parser, lwparse__nomem(parser->ctx));
+	}
+	return obj;
+}
+
+static LWGEOM *
+twkb_read_line(twkb_parser *parser, uint8_t type, lwflags_t ring)
+{
+	uint32_t npoints;
+	if (!twkb_read_count(parser, &npoints))
+		return NULL;
+	LWGEOM *obj = twkb_read_points(parser, type, npoints);
+	if (obj)
+		obj->flags |= ring;
+	return obj;
+}
+
+static LWGEOM *
+twkb_read_polygon(twkb_parser *parser)
+{
+	uint32_t nrings;
+	if (!twkb_read_count(parser, &nrings))
+		return NULL;
+	LWGEOM *poly = lwgeom__new(POLYTYPE, parser->hasz, parser->hasm);
+	for (uint32_t i = 0; poly && i < nrings; i++)
+	{
+		LWGEOM *ring = twkb_read_line(parser, LINETYPE, i == 0 ? LW_FLAG_SHELL_RING : LW_FLAG_HOLE_RING);
+		if (ring == NULL || lwgeom__add(poly, ring) == NULL)
+		{
+			lwgeom_free(ring);
+			lwgeom_free(poly);
+			return NULL;
+		}
+	}
+	return poly;
+}
+
+/// @brief read the parts of a multi geometry or the members of a collection
+static LWGEOM *
+twkb_read_collection(twkb_parser *parser, uint8_t type, uint8_t meta, int depth)
+{
+	uint32_t ngeoms;
+	if (!twkb_read_count(parser, &ngeoms))
+		return NULL;
+	if (meta & TWKB_IDLIST)
+	{
+		// identifiers have no place in an LWGEOM
+		for (uint32_t i = 0; i < ngeoms; i++)
+		{
+			uint64_t id;
+			if (!twkb_read_uvarint(parser, &id))
+				return NULL;
+		}
+	}
+
+	LWBOOLEAN hasz = parser->hasz, hasm = parser->hasm;
+	LWGEOM *mobj = lwgeom__new(type, hasz, hasm);
+	for (uint32_t i = 0; mobj && i < ngeoms; i++)
+	{
+		LWGEOM *obj = NULL;
+		switch (type)
+		{
+		case MPOINTTYPE:
+			obj = twkb_read_points(parser, POINTTYPE, 1);
+			break;
+		case MLINETYPE:
+			obj = twkb_read_line(parser, LINETYPE, 0);
+			break;
+		case MPOLYTYPE:
+			obj = twkb_read_polygon(parser);
+			break;
+		default:
+			obj = twkb_read_geometry(parser, depth + 1);
+			break;
+		}
+		if (obj && type == COLLECTIONTYPE && (lwgeom_has_z(obj) != hasz || lwgeom_has_m(obj) != hasm))
+			twkb_set_error(parser, "collection member dimensions differ");
+		if (obj == NULL || parser->error || lwgeom__add(mobj, obj) == NULL)
+		{
+			lwgeom_free(obj);
+			lwgeom_free(mobj);
+			return NULL;
+		}
+	}
+	return mobj;
+}
+
+static LWGEOM *
+twkb_read_geometry(twkb_parser *parser, int depth)
+{
+	const char *error = lwparse__depth(parser->ctx, depth);
+	if (error)
+	{
+		twkb_set_error(parser, error);
+		return NULL;
+	}
+	if (parser->end - parser->cur < 2)
+	{
+		twkb_set_error(parser, "unexpected end of TWKB");
+		return NULL;
+	}
+	uint8_t header = *parser->cur++;
+	uint8_t meta = *parser->cur++;
+	uint8_t type = header & 0x0f;
+	if (type < POINTTYPE || type > COLLECTIONTYPE)
+	{
+		twkb_set_error(parser, "unknown geometry type");
+		return NULL;
+	}
+	twkb_set_precision(parser, 0, (int)twkb_unzigzag(header >> 4));
+	twkb_set_precision(parser, 1, (int)twkb_unzigzag(header >> 4));
+
+	parser->hasz = parser->hasm = LW_FALSE;
+	if (meta & TWKB_EXTENDED)
+	{
+		if (parser->cur == parser->end)
+		{
+			twkb_set_error(parser, "unexpected end of TWKB");
+			return NULL;
+		}
+		uint8_t ext = *parser->cur++;
+		parser->hasz = (ext & 0x01) != 0;
+		parser->hasm = (ext & 0x02) != 0;
+		if (parser->hasz)
+			twkb_set_precision(parser, 2, (ext >> 2) & 0x07);
+		if (parser->hasm)
+			twkb_set_precision(parser, parser->hasz ? 3 : 2, (ext >> 5) & 0x07);
+	}
+	parser->cdim = LW_POINTBYTESIZE(parser->hasz, parser->hasm);
+
+	const uint8_t *end = NULL;
+	if (meta & TWKB_SIZE)
+	{
+		uint64_t size;
+		if (!twkb_read_uvarint(parser, &size))
+			return NULL;
+		if (size > (uint64_t)(parser->end - parser->cur))
+		{
+			twkb_set_error(parser, "size exceeds TWKB length");
+			return NULL;
+		}
+		end = parser->cur + size;
+	}
+	if (meta & TWKB_EMPTY)
+		return lwgeom__new(type, parser->hasz, parser->hasm);
+	if (meta & TWKB_BBOX)
+	{
+		for (int k = 0; k < 2 * parser->cdim; k++)
+		{
+			uint64_t v;
+			if (!twkb_read_uvarint(parser, &v))
+				return NULL;
+		}
+	}
+
+	memset(parser->last, 0, sizeof(parser->last));
+	LWGEOM *obj;
+	switch (type)
+	{
+	case POINTTYPE:
+		obj = twkb_read_points(parser, POINTTYPE, 1);
+		break;
+	case LINETYPE:
+		obj = twkb_read_line(parser, LINETYPE, 0);
+		break;
+	case POLYTYPE:
+		obj = twkb_read_polygon(parser);
+		break;
+	default:
+		obj = twkb_read_collection(parser, type, meta, depth);
+		break;
+	}
+	if (obj && end && parser->cur != end)
+	{
+		twkb_set_error(parser, "geometry does not match its size");
+		lwgeom_free(obj);
+		return NULL;
+	}
+	return obj;
+}
+
+/* -------------------------------- input twkb ------------------------------ */
+
+LWGEOM *
+lwgeom__read_twkb(const char *data, size_t len, lwparse *ctx)
+{
+	if (data == NULL || !lwparse__bytes(ctx, "TWKB", len))
+		return NULL;
+	twkb_parser parser;
+	memset(&parser, 0, sizeof(parser));
+	parser.start = (const uint8_t *)data;
+	parser.cur = parser.start;
+	parser.end = parser.cur + len;
+	parser.ctx = ctx;
+
+	LWGEOM *obj = twkb_read_geometry(&parser, 0);
+	if (obj && parser.cur != parser.end)
+		twkb_set_error(&parser, "unexpected bytes after geometry");
+	if (parser.error)
+	{
+		lwparse__fail(ctx, "TWKB", (size_t)(parser.cur - parser.start), parser.error);
+		lwgeom_free(obj);
+		return NULL;
+	}
+	return obj;
+}
+
+/// @brief parse one Tiny WKB geometry
+LWGEOM *
+lwgeom_read_twkb(const char *data, size_t len)
+{
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	return lwgeom__read_twkb(data, len, &ctx);
+}
+
+/// @brief parse consecutive TWKB records, as written by
+/// lwgeom_write_twkb_batch
+/// @param geoms receives an array allocated with lwmalloc
+/// @return number of geometries, 0 when the input is empty or invalid
+size_t
+lwgeom_read_twkb_batch(const char *data, size_t len, LWGEOM ***geoms)
+{
+	if (geoms == NULL)
+		return 0;
+	*geoms = NULL;
+	if (data == NULL)
+		return 0;
+
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	twkb_parser parser;
+	memset(&parser, 0, sizeof(parser));
+	parser.start = (const uint8_t *)data;
+	parser.cur = parser.start;
+	parser.end = parser.cur + len;
+	parser.ctx = &ctx;
+
+	LWGEOM **out = NULL;
+	size_t n = 0, capacity = 0;
+	while (parser.cur < parser.end)
+	{
+		LWGEOM *obj = twkb_read_geometry(&parser, 0);
+		if (obj == NULL)
+			break;
+		if (n == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 16;
+			LWGEOM **grown = (LWGEOM **)lwrealloc(out, capacity * sizeof(LWGEOM *));
+			if (grown == NULL)
+			{
+				lwgeom_free(obj);
+				twkb_set_error(&parser, lwparse__nomem(&ctx));
+				break;
+			}
+			out = grown;
+		}
+		out[n++] = obj;
+	}
+	if (parser.error)
+	{
+		lwparse__fail(&ctx, "TWKB", (size_t)(parser.cur - parser.start), parser.error);
+		for (size_t i = 0; i < n; i++)
+			lwgeom_free(out[i]);
+		lwfree(out);
+		return 0;
+	}
+	*geoms = out;
+	return n;
+}
@@ -22,8 +22,438 @@
 
 #include "liblwgeom_internel.h"
 
+#include "lwgeom_parse.h"
+#include <math.h>
+#include <string.h>
+
+/* ----------------------------- static read wkb ---------------------------- */
+
+#define WKB_XDR 0 ///< big endian
+#define WKB_NDR 1 ///< little endian
+
+#define WKB_ZFLAG    0x80000000u ///< EWKB
+#define WKB_MFLAG    0x40000000u
+#define WKB_SRIDFLAG 0x20000000u
+
+typedef struct {
+	const uint8_t *start;
+	const uint8_t *cur;
+	const uint8_t *end;
+	int swap;   ///< byte order of the current geometry differs from the host
+	int borrow; ///< coordinates may point into the input
+	const char *error;
+	lwparse *ctx;
+} wkb_parser;
+
+static LWGEOM *wkb_read_geometry(wkb_parser *parser, int depth);
+
+static inline int
+wkb_machine_endian(void)
+{
+	const uint16_t one = 1;
+	return *(const uint8_t *)&one ? WKB_NDR : WKB_XDR;
+}
+
+static void
+wkb_set_error(wkb_parser *parser, const char *message)
+{
+	if (parser->error == NULL)
+		parser->error = message;
+}
+
+static int
+wkb_read_uint32(wkb_parser *parser, uint32_t *v)
+{
+	if ((size_t)(parser->end - parser->cur) < 4)
+	{
+		wkb_set_error(parser, "unexpected end of WKB");
+		return LW_FALSE;
+	}
+	uint32_t u;
+	memcpy(&u, parser->cur, 4);
+	*v = parser->swap ? __builtin_bswap32(u) : u;
+	parser->cur += 4;
+	return LW_TRUE;
+}
+
+/// @brief swap the bytes of \a n doubles in place
+///
+/// Straight-line loop over 64-bit words, compilers turn this into vector
+/// byte shuffles.
+static void
+wkb_swap_doubles(uint64_t *restrict words, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		words[i] = __builtin_bswap64(words[i]);
+}
+
+/// @brief map or copy \a npoints coordinates
+/// @param borrowed set when the returned array points into the input
+static double *
+wkb_read_coords(wkb_parser *parser, uint32_t npoints, int cdim, int *borrowed)
+{
+	*borrowed = LW_FALSE;
+	size_t avail = (size_t)(parser->end - parser->cur);
+	if ((size_t)npoints > avail / ((size_t)cdim * sizeof(double)))
+	{
+		wkb_set_error(parser, "coordinate count exceeds WKB length");
+		return NULL;
+	}
+	const char *error = lwparse__vertices(parser->ctx, npoints);
+	if (error)
+	{
+		wkb_set_error(parser, error);
+		return NULL;
+	}
+	size_t n = (size_t)npoints * cdim;
+	const uint8_t *src = parser->cur;
+	parser->cur += n * sizeof(double);
+
+	if (parser->borrow && !parser->swap && ((uintptr_t)src % sizeof(double)) == 0)
+	{
+		*borrowed = LW_TRUE;
+		return (double *)(uintptr_t)src;
+	}
+
+	double *pp = (double *)lwmalloc(n * sizeof(double));
+	if (pp == NULL)
+	{
+		wkb_set_error(parser, lwparse__nomem(parser->ctx));
+		return NULL;
+	}
+	memcpy(pp, src, n * sizeof(double));
+	if (parser->swap)
+		wkb_swap_doubles((uint64_t *)pp, n);
+	return pp;
+}
+
+static LWGEOM *
+wkb_read_points(wkb_parser *parser, uint8_t type, uint32_t npoints, int hasz, int hasm)
+{
+	if (npoints == 0)
+		return lwgeom__new(type, hasz, hasm);
+
+	int borrowed;
+	double *pp = wkb_read_coords(parser, npoints, LW_POINTBYTESIZE(hasz, hasm), &borrowed);
+	if (pp == NULL)
+		return NULL;
+
+	lwflags_t flags = 0;
+	LWFLAGS_SET_Z(flags, hasz);
+	LWFLAGS_SET_M(flags, hasm);
+	LWGEOM *obj = lwgeom__new_points(type, npoints, pp, flags, borrowed);
+	if (obj == NULL)
+	{
+		if (!borrowed)
+			lwfree(pp);
+		wkb_set_error(parser, lwparse__nomem(parser->ctx));
+	}
+	return obj;
+}
+
+/// @brief a point whose ordinates are all NaN is the WKB encoding of POINT EMPTY
+static LWGEOM *
+wkb_read_point(wkb_parser *parser, int hasz, int hasm)
+{
+	int cdim = LW_POINTBYTESIZE(hasz, hasm);
+	LWGEOM *obj = wkb_read_points(parser, POINTTYPE, 1, hasz, hasm);
+	if (obj == NULL)
+		return NULL;
+	for (int i = 0; i < cdim; i++)
+	{
+		if (!isnan(obj->pp[i]))
+			return obj;
+	}
+	if (!(obj->flags & LW_FLAG_READONLY))
+		lwfree(obj->pp);
+	obj->pp = NULL;
+	obj->npoints = 0;
+	obj->flags &= ~LW_FLAG_READONLY;
+	memset(&obj->env, 0, sizeof(obj->env));
+	obj->env.flags = obj->flags & (LW_FLAG_Z | LW_FLAG_M);
+	return obj;
+}
+
+static LWGEOM *
+wkb_add(wkb_parser *parser, LWGEOM *mobj, LWGEOM *obj)
+{
+	if (obj == NULL)
+	{
+		lwgeom_free(mobj);
+		return NULL;
+	}
+	if (lwgeom__add(mobj, obj) == NULL)
+	{
+		wkb_set_error(parser, lwparse__nomem(parser->ctx));
+		lwgeom_free(obj);
+		lwgeom_free(mobj);
+		return NULL;
+	}
+	return mobj;
+}
+
+static LWGEOM *
+wkb_read_polygon(wkb_parser *parser, int hasz, int hasm)
+{
+	uint32_t nrings;
+	if (!wkb_read_uint32(parser, &nrings))
+		return NULL;
+	// every ring needs at least its point count
+	if (nrings > (size_t)(parser->end - parser->cur) / 4)
+	{
+		wkb_set_error(parser, "ring count exceeds WKB length");
+		return NULL;
+	}
+	LWGEOM *poly = lwgeom__new(POLYTYPE, hasz, hasm);
+	if (poly == NULL)
+		return NULL;
+	for (uint32_t i = 0; i < nrings; i++)
+	{
+		uint32_t npoints;
+		if (!wkb_read_uint32(parser, &npoints))
+		{
+			lwgeom_free(poly);
+			return NULL;
+		}
+		LWGEOM *ring = wkb_read_points(parser, LINETYPE, npoints, hasz, hasm);
+		if (ring)
+			ring->flags |= i == 0 ? LW_FLAG_SHELL_RING : LW_FLAG_HOLE_RING;
+		if (!wkb_add(parser, poly, ring))
+			return NULL;
+	}
+	return poly;
+}
+
+static LWGEOM *
+wkb_read_collection(wkb_parser *parser, uint8_t type, int hasz, int hasm, int depth)
+{
+	uint32_t ngeoms;
+	if (!wkb_read_uint32(parser, &ngeoms))
+		return NULL;
+	// every member needs at least its byte order and type
+	if (ngeoms > (size_t)(parser->end - parser->cur) / 5)
+	{
+		wkb_set_error(parser, "geometry count exceeds WKB length");
+		return NULL;
+	}
+	LWGEOM *mobj = lwgeom__new(type, hasz, hasm);
+	if (mobj == NULL)
+		return NULL;
+	for (uint32_t i = 0; i < ngeoms; i++)
+	{
+		LWGEOM *obj = wkb_read_geometry(parser, depth + 1);
+		if (obj && ((type != COLLECTIONTYPE && obj->type != type - 3) || lwgeom_has_z(obj) != hasz ||
+			    lwgeom_has_m(obj) != hasm))
+		{
+			wkb_set_error(parser, "invalid member in WKB collection");
+			lwgeom_free(obj);
+			obj = NULL;
+		}
+		if (!wkb_add(parser, mobj, obj))
+			return NULL;
+	}
+	return mobj;
+}
+
+static LWGEOM *
+wkb_read_geometry(wkb_parser *parser, int depth)
+{
+	const char *error = lwparse__depth(parser->ctx, depth);
+	if (error)
+	{
+		wkb_set_error(parser, error);
+		return NULL;
+	}
+	if (parser->cur >= parser->end)
+	{
+		wkb_set_error(parser, "unexpected end of WKB");
+		return NULL;
+	}
+	uint8_t order = *parser->cur++;
+	if (order != WKB_XDR && order != WKB_NDR)
+	{
+		wkb_set_error(parser, "invalid WKB byte order");
+		return NULL;
+	}
+	parser->swap = order != wkb_machine_endian();
+
+	uint32_t wkbtype;
+	if (!wkb_read_uint32(parser, &wkbtype))
+		return NULL;
+
+	// EWKB flags in the high bits, ISO dimensions as thousands
+	int hasz = (wkbtype & WKB_ZFLAG) != 0;
+	int hasm = (wkbtype & WKB_MFLAG) != 0;
+	if (wkbtype & WKB_SRIDFLAG)
+	{
+		uint32_t srid;
+		if (!wkb_read_uint32(parser, &srid))
+			return NULL;
+	}
+	uint32_t base = wkbtype & 0x0fffffff;
+	switch (base / 1000)
+	{
+	case 0:
+		break;
+	case 1:
+		hasz = LW_TRUE;
+		break;
+	case 2:
+		hasm = LW_TRUE;
+		break;
+	case 3:
+		hasz = hasm = LW_TRUE;
+		break;
+	default:
+		wkb_set_error(parser, "unknown WKB geometry type");
+		return NULL;
+	}
+	base %= 1000;
+
+	switch (base)
+	{
+	case POINTTYPE:
+		return wkb_read_point(parser, hasz, hasm);
+	case LINETYPE: {
+		uint32_t npoints;
+		if (!wkb_read_uint32(parser, &npoints))
+			return NULL;
+		return wkb_read_points(parser, LINETYPE, npoints, hasz, hasm);
+	}
+	case POLYTYPE:
+		return wkb_read_polygon(parser, hasz, hasm);
+	case MPOINTTYPE:
+	case MLINETYPE:
+	case MPOLYTYPE:
+	case COLLECTIONTYPE:
+		return wkb_read_collection(parser, (uint8_t)base, hasz, hasm, depth);
+	default:
+		wkb_set_error(parser, "unknown WKB geometry type");
+		return NULL;
+	}
+}
+
+/* ------------------------------- hex decoding ----------------------------- */
+
+/// nibble value of a hex digit, 0x10 marks characters that are not hex
+static const uint8_t wkb_hex_nibble[256] = {
+#define X 0x10
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, X, X, X, X, X, X,
+	X, 10, 11, 12, 13, 14, 15, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, 10, 11, 12, 13, 14, 15, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+	X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+#undef X
+};
+
+/// @brief decode hex text into lwmalloc'd bytes
+///
+/// The loop has no data dependent branches, invalid digits are collected in
+/// an error mask that is tested once at the end.
+uint8_t *
+lwgeom__hex_decode(const char *hex, size_t len, size_t *size)
+{
+	if (len % 2)
+		return NULL;
+	size_t n = len / 2;
+	uint8_t *out = (uint8_t *)lwmalloc(n ? n : 1);
+	if (out == NULL)
+		return NULL;
+
+	const uint8_t *in = (const uint8_t *)hex;
+	uint8_t err = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		uint8_t hi = wkb_hex_nibble[in[2 * i]];
+		uint8_t lo = wkb_hex_nibble[in[2 * i + 1]];
+		err |= hi | lo;
+		out[i] = (uint8_t)((hi << 4) | (lo & 0x0f));
+	}
+	if (err & 0x10)
+	{
+		lwfree(out);
+		return NULL;
+	}
+	*size = n;
+	return out;
+}
+
+/// @brief parse binary WKB, ISO and EWKB type codes are both accepted
+/// @param borrow let native endian, 8 byte aligned coordinate arrays point
+/// into \a data instead of copying them
+LWGEOM *
+lwgeom__read_wkb(const uint8_t *data, size_t len, int borrow, lwparse *ctx)
+{
+	if (!lwparse__bytes(ctx, "WKB", len))
+		return NULL;
+	wkb_parser parser = {data, data, data + len, 0, borrow, NULL, ctx};
+	LWGEOM *obj = wkb_read_geometry(&parser, 0);
+	if (obj && parser.cur != parser.end)
+		wkb_set_error(&parser, "unexpected bytes after WKB geometry");
+	if (parser.error)
+	{
+		lwparse__fail(ctx, "WKB", (size_t)(parser.cur - parser.start), parser.error);
+		lwgeom_free(obj);
+		return NULL;
+	}
+	return obj;
+}
+
+/// @brief parse hex encoded WKB, \a len may be 0 for a NUL terminated string
+LWGEOM *
+lwgeom__read_hexwkb(const char *data, size_t len, lwparse *ctx)
+{
+	if (data == NULL || !lwparse__text(ctx, "WKB", data, &len))
+		return NULL;
+	size_t size;
+	uint8_t *bytes = lwgeom__hex_decode(data, len, &size);
+	if (bytes == NULL)
+	{
+		// the failure is only looked for once the fast decode has failed
+		size_t at = 0;
+		while (at < len && wkb_hex_nibble[(uint8_t)data[at]] != 0x10)
+			at++;
+		lwparse__fail(ctx, "WKB", at, at < len || len % 2 ? "invalid hex string" : lwparse__nomem(ctx));
+		return NULL;
+	}
+	// offsets of the decoded bytes are reported as offsets into the text
+	ctx->hex = LW_TRUE;
+	LWGEOM *obj = lwgeom__read_wkb(bytes, size, LW_FALSE, ctx);
+	ctx->hex = LW_FALSE;
+	lwfree(bytes);
+	return obj;
+}
+
+/* -------------------------------- input wkb ------------------------------- */
+
+/// @brief parse WKB, or hex encoded WKB when \a hex is set (\a len may then be
+/// 0 for a NUL terminated string). Coordinates are always copied.
 LWGEOM *
 lwgeom_read_wkb(const char *wkb, size_t len, int hex)
 {
-	return NULL;
+	if (wkb == NULL)
+		return NULL;
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	if (hex)
+		return lwgeom__read_hexwkb(wkb, len, &ctx);
+	return lwgeom__read_wkb((const uint8_t *)wkb, len, LW_FALSE, &ctx);
+}
+
+/// @brief parse binary WKB without copying coordinates where possible
+///
+/// Coordinate arrays that are native endian and 8 byte aligned in \a wkb are
+/// referenced in place and flagged LW_FLAG_READONLY, the buffer must outlive
+/// the returned geometry. Other arrays are copied as in lwgeom_read_wkb.
+LWGEOM *
+lwgeom_read_wkb_view(const char *wkb, size_t len)
+{
+	if (wkb == NULL)
+		return NULL;
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	return lwgeom__read_wkb((const uint8_t *)wkb, len, LW_TRUE, &ctx);
 }
@@ -22,333 +22,543 @@
 
 #include "liblwgeom_internel.h"
 
-#include "lwgeom_ordinate.h"
-#include "stok.h"
+#include "lwgeom_number.h"
+#include "lwgeom_parse.h"
 #include <assert.h>
-#include <ctype.h>
+#include <strings.h>
 #include <string.h>
-#include <locale.h>
 
 /* ----------------------------- static read wkt ---------------------------- */
 
-static char *wkt_next_word(stok_t *token);
-static double wkt_get_next_number(stok_t *token);
-static void wkt_get_coordinates(stok_t *token, lwgeom_ordinate *flag, double **coordinates, int *num);
-static void wkt_get_precise_coordinates(stok_t *token, lwgeom_ordinate *flag, double *coordinates);
-static char *wkt_get_next_empty_or_opener(stok_t *token, lwgeom_ordinate *flag);
-static char *wkt_get_next_closer_comma(stok_t *token);
-static LWGEOM *wkt_read_point(stok_t *token, lwgeom_ordinate *flag);
-static LWGEOM *wkt_read_linestring(stok_t *token, lwgeom_ordinate *flag);
-static LWGEOM *wkt_read_linearring(stok_t *token, lwgeom_ordinate *flag);
-static LWGEOM *wkt_read_polygon(stok_t *token, lwgeom_ordinate *flag);
-static LWGEOM *wkt_read_multipoint(stok_t *token, lwgeom_ordinate *flag);
-static LWGEOM *wkt_read_multilinestring(stok_t *token, lwgeom_ordinate *flag);
-static LWGEOM *wkt_read_multipolygon(stok_t *token, lwgeom_ordinate *flag);
+/// The reader walks the text exactly once. Coordinates of the sequence being
+/// parsed are collected in a scratch buffer that grows geometrically and is
+/// reused for every sequence, each finished sequence is then copied once into
+/// an exactly sized point array.
+typedef struct {
+	const char *start;
+	const char *cur;
+	const char *end;
+	const char *error; ///< first error message, NULL while the parse is valid
+	size_t error_offset;
+	int hasz;
+	int hasm;
+	int dims_fixed; ///< dimensions were declared or inferred from a tuple
+	int depth;      ///< level of the geometry being read
+	double *scratch;
+	size_t scratch_size; ///< number of doubles in scratch
+	lwparse *ctx;
+} wkt_parser;
+
+static LWGEOM *wkt_read_geometry(wkt_parser *parser);
 
-/* -------------------------------- input wkt ------------------------------- */
-
-LWGEOM *
-lwgeom_read_wkt(const char *data, size_t len)
+static void
+wkt_set_error(wkt_parser *parser, const char *message)
 {
-	char *p = setlocale(LC_NUMERIC, NULL);
-	setlocale(LC_NUMERIC, "C");
+	if (parser->error)
+		return;
+	parser->error = message;
+	parser->error_offset = (size_t)(parser->cur - parser->start);
+}
 
-	stok_t token;
-	stok_init(&token, (char *)data);
+static inline void
+wkt_skip_space(wkt_parser *parser)
+{
+	while (parser->cur < parser->end &&
+	       (*parser->cur == ' ' || *parser->cur == '\t' || *parser->cur == '\n' || *parser->cur == '\r'))
+		parser->cur++;
+}
 
-	lwgeom_ordinate flags = lwgeom_ordinate_XY();
-	lwgeom_ordinate new_flags = lwgeom_ordinate_XY();
-	char *type = wkt_next_word(&token);
-	if (strcmp(type, "EMPTY") == 0)
+/// @brief consume \a c if it is the next non blank character
+static inline int
+wkt_accept(wkt_parser *parser, char c)
+{
+	wkt_skip_space(parser);
+	if (parser->cur < parser->end && *parser->cur == c)
 	{
-		memcpy(&new_flags, &flags, sizeof(lwgeom_ordinate));
-	}
-	else
-	{
-		if (strlen(type) >= 2 && 0 == strncmp(type + strlen(type) - 2, "ZM", 2))
-		{
-			lwgeom_ordinate_setZ(&new_flags, LW_TRUE);
-			lwgeom_ordinate_setM(&new_flags, LW_TRUE);
-			new_flags.changeAllowed = LW_FALSE;
-		}
-		else if (strlen(type) >= 1 && 0 == strncmp(type + strlen(type) - 1, "M", 1))
-		{
-			lwgeom_ordinate_setM(&new_flags, LW_TRUE);
-			new_flags.changeAllowed = LW_FALSE;
-		}
-		else if (strlen(type) >= 1 && 0 == strncmp(type + strlen(type) - 1, "Z", 1))
-		{
-			lwgeom_ordinate_setZ(&new_flags, LW_TRUE);
-			new_flags.changeAllowed = LW_FALSE;
-		}
+		parser->cur++;
+		return LW_TRUE;
 	}
+	return LW_FALSE;
+}
 
-	if (strncmp(type, "POINT", 5) == 0)
-	{
-		return wkt_read_point(&token, &new_flags);
-	}
-	else if (strncmp(type, "LINESTRING", 10) == 0)
+static int
+wkt_expect(wkt_parser *parser, char c)
+{
+	if (wkt_accept(parser, c))
+		return LW_TRUE;
+	wkt_set_error(parser, c == '(' ? "expected '('" : (c == ')' ? "expected ')'" : "expected ','"));
+	return LW_FALSE;
+}
+
+static inline int
+wkt_is_alpha(char c)
+{
+	return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+/// @brief read the next keyword, the word is not copied
+static size_t
+wkt_read_word(wkt_parser *parser, const char **word)
+{
+	wkt_skip_space(parser);
+	*word = parser->cur;
+	while (parser->cur < parser->end && wkt_is_alpha(*parser->cur))
+		parser->cur++;
+	return (size_t)(parser->cur - *word);
+}
+
+static int
+wkt_word_equals(const char *word, size_t len, const char *keyword)
+{
+	return strlen(keyword) == len && strncasecmp(word, keyword, len) == 0;
+}
+
+/// @brief consume the keyword if it is next in the input
+static int
+wkt_accept_word(wkt_parser *parser, const char *keyword)
+{
+	const char *save = parser->cur;
+	const char *word;
+	size_t len = wkt_read_word(parser, &word);
+	if (len > 0 && wkt_word_equals(word, len, keyword))
+		return LW_TRUE;
+	parser->cur = save;
+	return LW_FALSE;
+}
+
+static int
+wkt_read_number(wkt_parser *parser, double *value)
+{
+	wkt_skip_space(parser);
+	const char *next = lwnumber_parse(parser->cur, parser->end, value);
+	if (next == NULL)
 	{
-		return wkt_read_linestring(&token, &new_flags);
+		wkt_set_error(parser, "expected a number");
+		return LW_FALSE;
 	}
-	else if (strncmp(type, "LINEARRING ", 10) == 0)
+	parser->cur = next;
+	return LW_TRUE;
+}
+
+/* ---------------------------- coordinate tuples --------------------------- */
+
+static inline int
+wkt_cdim(const wkt_parser *parser)
+{
+	return LW_POINTBYTESIZE(parser->hasz, parser->hasm);
+}
+
+static inline int
+wkt_number_follows(wkt_parser *parser)
+{
+	wkt_skip_space(parser);
+	if (parser->cur >= parser->end)
+		return LW_FALSE;
+	char c = *parser->cur;
+	return (unsigned)(c - '0') < 10 || c == '-' || c == '+' || c == '.';
+}
+
+/// @brief make sure the scratch buffer holds \a need doubles
+static int
+wkt_reserve(wkt_parser *parser, size_t need)
+{
+	if (need <= parser->scratch_size)
+		return LW_TRUE;
+	size_t size = parser->scratch_size ? parser->scratch_size : 64;
+	while (size < need)
+		size *= 2;
+	double *scratch = (double *)lwrealloc(parser->scratch, size * sizeof(double));
+	if (scratch == NULL)
 	{
-		return wkt_read_linearring(&token, &new_flags);
+		wkt_set_error(parser, lwparse__nomem(parser->ctx));
+		return LW_FALSE;
 	}
-	else if (strncmp(type, "POLYGON", 7) == 0)
+	parser->scratch = scratch;
+	parser->scratch_size = size;
+	return LW_TRUE;
+}
+
+/// @brief read one tuple at scratch offset \a off, inferring undeclared
+/// dimensions from the first tuple of the geometry
+static int
+wkt_read_tuple(wkt_parser *parser, size_t off)
+{
+	const char *error = lwparse__vertices(parser->ctx, 1);
+	if (error)
 	{
-		return wkt_read_polygon(&token, &new_flags);
+		wkt_set_error(parser, error);
+		return LW_FALSE;
 	}
-	else if (strncmp(type, "MULTIPOINT", 10) == 0)
+	if (!wkt_reserve(parser, off + 4))
+		return LW_FALSE;
+	double *c = parser->scratch + off;
+	if (!wkt_read_number(parser, &c[0]) || !wkt_read_number(parser, &c[1]))
+		return LW_FALSE;
+
+	if (!parser->dims_fixed)
 	{
-		return wkt_read_multipoint(&token, &new_flags);
+		if (wkt_number_follows(parser))
+		{
+			parser->hasz = LW_TRUE;
+			if (!wkt_read_number(parser, &c[2]))
+				return LW_FALSE;
+			if (wkt_number_follows(parser))
+			{
+				parser->hasm = LW_TRUE;
+				if (!wkt_read_number(parser, &c[3]))
+					return LW_FALSE;
+			}
+		}
+		parser->dims_fixed = LW_TRUE;
+		return LW_TRUE;
 	}
-	else if (strncmp(type, "MULTILINESTRING", 15) == 0)
+
+	int cdim = wkt_cdim(parser);
+	for (int i = 2; i < cdim; i++)
 	{
-		return wkt_read_multilinestring(&token, &new_flags);
+		if (!wkt_read_number(parser, &c[i]))
+			return LW_FALSE;
 	}
-	else if (strncmp(type, "MULTIPOLYGON", 12) == 0)
+	if (wkt_number_follows(parser))
 	{
-		return wkt_read_multipolygon(&token, &new_flags);
+		wkt_set_error(parser, "too many ordinates in coordinate");
+		return LW_FALSE;
 	}
-	// else if (strncmp(type, "CIRCULARSTRING", 14) == 0) {
-	//     return NULL;
-	// }
-	// else if (strncmp(type, "COMPOUNDCURVE", 13) == 0) {
-	//     return NULL;
-	// }
-	// else if (strncmp(type, "CURVEPOLYGON", 12) == 0) {
-	//     return NULL;
-	// }
-	// else if (strncmp(type, "MULTICURVE", 10) == 0) {
-	//     return NULL;
-	// }
-	// else if (strncmp(type, "MULTISURFACE", 12) == 0) {
-	//     return NULL;
-	// }
-	// else if (strncmp(type, "GEOMETRYCOLLECTION", 18) == 0) {
-	//     return NULL;
-	// }
-
-	setlocale(LC_NUMERIC, p);
-	return NULL;
+	return LW_TRUE;
 }
 
-/* ----------------------------- static read wkt ---------------------------- */
+/// @brief read "x y, x y, ..." into the scratch buffer
+/// @return number of points, 0 on error
+static uint32_t
+wkt_read_tuples(wkt_parser *parser)
+{
+	uint32_t npoints = 0;
+	do
+	{
+		if (!wkt_read_tuple(parser, (size_t)npoints * wkt_cdim(parser)))
+			return 0;
+		npoints++;
+	} while (wkt_accept(parser, ','));
+	return npoints;
+}
 
-char *
-wkt_next_word(stok_t *token)
+/// @brief move \a npoints points out of the scratch buffer into a geometry
+static LWGEOM *
+wkt_make_points(wkt_parser *parser, uint8_t type, uint32_t npoints)
 {
-	int type = stok_next_token(token);
-	switch (type)
+	if (npoints == 0)
+		return lwgeom__new(type, parser->hasz, parser->hasm);
+
+	size_t msize = (size_t)npoints * wkt_cdim(parser) * sizeof(double);
+	double *pp = (double *)lwmalloc(msize);
+	if (pp == NULL)
 	{
-	case STOK_EOF:
-	case STOK_EOL:
-	case STOK_NUM:
-		return "";
-	case STOK_WORD: {
-		char *word = token->stok;
-		char *str = word;
-		while (*str)
-		{
-			*str = (char)toupper((unsigned char)*str);
-			str++;
-		}
-		return word;
+		wkt_set_error(parser, lwparse__nomem(parser->ctx));
+		return NULL;
 	}
-	case '(':
-		return "(";
-	case ')':
-		return ")";
-	case ',':
-		return ",";
-	};
-	return "";
+	memcpy(pp, parser->scratch, msize);
+
+	lwflags_t flags = 0;
+	LWFLAGS_SET_Z(flags, parser->hasz);
+	LWFLAGS_SET_M(flags, parser->hasm);
+	LWGEOM *obj = lwgeom__new_points(type, npoints, pp, flags, LW_FALSE);
+	if (obj == NULL)
+		lwfree(pp);
+	return obj;
 }
 
-double
-wkt_get_next_number(stok_t *token)
+/// @brief read "EMPTY" or "(x y, ...)"
+static LWGEOM *
+wkt_read_sequence(wkt_parser *parser, uint8_t type)
 {
-	int type = stok_next_token(token);
-	switch (type)
+	if (wkt_accept_word(parser, "EMPTY"))
+		return wkt_make_points(parser, type, 0);
+	if (!wkt_expect(parser, '('))
+		return NULL;
+	uint32_t npoints = wkt_read_tuples(parser);
+	if (npoints == 0 || !wkt_expect(parser, ')'))
+		return NULL;
+	if (type == POINTTYPE && npoints != 1)
 	{
-	case STOK_NUM:
-		return token->ntok;
-	default:
-		return 0.0;
+		wkt_set_error(parser, "point must have exactly one coordinate");
+		return NULL;
 	}
-	return 0;
+	return wkt_make_points(parser, type, npoints);
 }
 
-void
-wkt_get_coordinates(stok_t *token, lwgeom_ordinate *flag, double **coordinates, int *num)
+/* ----------------------------- geometry bodies ---------------------------- */
+
+static LWGEOM *
+wkt_add(wkt_parser *parser, LWGEOM *mobj, LWGEOM *obj)
 {
-	char *nexttok = wkt_get_next_empty_or_opener(token, flag);
-	if (strcmp(nexttok, "EMPTY") == 0)
+	if (obj == NULL)
 	{
-		return;
+		lwgeom_free(mobj);
+		return NULL;
 	}
-	double c[4] = {0.0};
-	wkt_get_precise_coordinates(token, flag, c);
-
-	// calloc coordinates with cdim
-	int cdim = (flag->value & LWORDINATE_VALUE_Z) ? 3 : 2;
-	*coordinates = (double *)lwcalloc(cdim, sizeof(double));
-	if (*coordinates == NULL)
+	if (lwgeom__add(mobj, obj) == NULL)
 	{
-		return;
+		wkt_set_error(parser, lwparse__nomem(parser->ctx));
+		lwgeom_free(obj);
+		lwgeom_free(mobj);
+		return NULL;
 	}
-	*num = 1;
-	memcpy(*coordinates, c, cdim * sizeof(double));
+	return mobj;
+}
 
-	nexttok = wkt_get_next_closer_comma(token);
-	while (strcmp(nexttok, ")") != 0)
+/// @brief rings are stored as line children flagged as shell or hole
+static LWGEOM *
+wkt_read_polygon_body(wkt_parser *parser)
+{
+	LWGEOM *poly = lwgeom__new(POLYTYPE, parser->hasz, parser->hasm);
+	if (poly == NULL)
+		return NULL;
+	if (wkt_accept_word(parser, "EMPTY"))
+		return poly;
+	if (!wkt_expect(parser, '('))
 	{
-		memset(c, 0, sizeof(c));
-		wkt_get_precise_coordinates(token, flag, c);
-		*coordinates = (double *)lwrealloc(*coordinates, (*num + 1) * sizeof(double) * (cdim));
-		if (*coordinates == NULL)
-		{
-			lwfree(*coordinates);
-			*num = 0;
-			// log error
-			return;
-		}
-		memcpy((*coordinates) + ((*num) * cdim), c, cdim * sizeof(double));
-		(*num)++;
-		nexttok = wkt_get_next_closer_comma(token);
+		lwgeom_free(poly);
+		return NULL;
 	}
+	do
+	{
+		LWGEOM *ring = wkt_read_sequence(parser, LINETYPE);
+		if (ring)
+			ring->flags |= poly->ngeoms == 0 ? LW_FLAG_SHELL_RING : LW_FLAG_HOLE_RING;
+		if (!wkt_add(parser, poly, ring))
+			return NULL;
+	} while (wkt_accept(parser, ','));
+	if (!wkt_expect(parser, ')'))
+	{
+		lwgeom_free(poly);
+		return NULL;
+	}
+	return poly;
 }
 
-char *
-wkt_get_next_empty_or_opener(stok_t *token, lwgeom_ordinate *flag)
+/// @brief MULTIPOINT accepts both "((1 2), (3 4))" and "(1 2, 3 4)"
+static LWGEOM *
+wkt_read_multipoint_item(wkt_parser *parser)
 {
-	char *nextword = wkt_next_word(token);
-	if (strcmp(nextword, "ZM") == 0)
+	wkt_skip_space(parser);
+	if (parser->cur < parser->end && (*parser->cur == '(' || wkt_is_alpha(*parser->cur)))
+		return wkt_read_sequence(parser, POINTTYPE);
+	if (!wkt_read_tuple(parser, 0))
+		return NULL;
+	return wkt_make_points(parser, POINTTYPE, 1);
+}
+
+static LWGEOM *
+wkt_read_collection_body(wkt_parser *parser, uint8_t type)
+{
+	LWGEOM *mobj = lwgeom__new(type, parser->hasz, parser->hasm);
+	if (mobj == NULL)
+		return NULL;
+	if (wkt_accept_word(parser, "EMPTY"))
+		return mobj;
+	if (!wkt_expect(parser, '('))
 	{
-		nextword = wkt_next_word(token);
+		lwgeom_free(mobj);
+		return NULL;
 	}
-	else
+	do
 	{
-		if (strcmp(nextword, "Z") == 0)
+		LWGEOM *obj = NULL;
+		switch (type)
 		{
-			nextword = wkt_next_word(token);
+		case MPOINTTYPE:
+			obj = wkt_read_multipoint_item(parser);
+			break;
+		case MLINETYPE:
+			obj = wkt_read_sequence(parser, LINETYPE);
+			break;
+		case MPOLYTYPE:
+			obj = wkt_read_polygon_body(parser);
+			break;
+		default: {
+			// members carry their own keyword, undeclared dimensions are
+			// inherited from the collection
+			int hasz = parser->hasz, hasm = parser->hasm, fixed = parser->dims_fixed;
+			parser->depth++;
+			obj = wkt_read_geometry(parser);
+			parser->depth--;
+			if (obj && fixed && (lwgeom_has_z(obj) != hasz || lwgeom_has_m(obj) != hasm))
+			{
+				wkt_set_error(parser, "mixed dimensionality in collection");
+				lwgeom_free(obj);
+				obj = NULL;
+			}
+			if (obj && !fixed)
+			{
+				parser->hasz = lwgeom_has_z(obj);
+				parser->hasm = lwgeom_has_m(obj);
+				parser->dims_fixed = !lwgeom__is_empty(obj);
+			}
+			break;
 		}
-		if (strcmp(nextword, "M") == 0)
-		{
-			nextword = wkt_next_word(token);
 		}
-	}
-
-	if (strcmp(nextword, "(") == 0 || strcmp(nextword, "EMPTY") == 0)
+		if (!wkt_add(parser, mobj, obj))
+			return NULL;
+	} while (wkt_accept(parser, ','));
+	if (!wkt_expect(parser, ')'))
 	{
-		return nextword;
+		lwgeom_free(mobj);
+		return NULL;
 	}
-	return "";
+	return mobj;
 }
 
-char *
-wkt_get_next_closer_comma(stok_t *token)
+/// @brief apply the final dimensions to a geometry whose dimensions were only
+/// known after some of its (empty) parts had been created
+static void
+wkt_fix_dims(LWGEOM *obj, int hasz, int hasm)
 {
-	char *nextWord = wkt_next_word(token);
-	if (strcmp(nextWord, ",") == 0 || strcmp(nextWord, ")") == 0)
+	LWFLAGS_SET_Z(obj->flags, hasz);
+	LWFLAGS_SET_M(obj->flags, hasm);
+	LWFLAGS_SET_Z(obj->env.flags, hasz);
+	LWFLAGS_SET_M(obj->env.flags, hasm);
+	for (uint32_t i = 0; i < obj->ngeoms; i++)
 	{
-		return nextWord;
+		if (obj->geoms[i]->npoints == 0)
+			wkt_fix_dims(obj->geoms[i], hasz, hasm);
 	}
-	return NULL;
 }
 
-static void
-wkt_get_precise_coordinates(stok_t *token, lwgeom_ordinate *flag, double *coordinates)
+static const struct {
+	const char *name;
+	uint8_t type;
+} wkt_types[] = {
+	{"POINT", POINTTYPE},
+	{"LINESTRING", LINETYPE},
+	{"LINEARRING", LINETYPE},
+	{"POLYGON", POLYTYPE},
+	{"MULTIPOINT", MPOINTTYPE},
+	{"MULTILINESTRING", MLINETYPE},
+	{"MULTIPOLYGON", MPOLYTYPE},
+	{"GEOMETRYCOLLECTION", COLLECTIONTYPE},
+};
+
+/// @brief read a dimension tag, "Z", "M" or "ZM"
+static int
+wkt_parse_dims(const char *word, size_t len, int *hasz, int *hasm)
 {
-	coordinates[0] = wkt_get_next_number(token);
-	coordinates[1] = wkt_get_next_number(token);
-
-	// Check for undeclared Z dimension
-	if (flag->changeAllowed && (stok_peek_next_token(token) == STOK_NUM))
-		lwgeom_ordinate_setZ(flag, LW_TRUE);
-
-	if (flag->value & LWORDINATE_VALUE_Z)
-		coordinates[2] = wkt_get_next_number(token);
-
-	// Check for undeclared M dimension
-	if (flag->changeAllowed && (flag->value & LWORDINATE_VALUE_Z) && (stok_peek_next_token(token) == STOK_NUM))
-		lwgeom_ordinate_setM(flag, LW_TRUE);
-
-	if (flag->value & LWORDINATE_VALUE_M)
-		coordinates[3] = wkt_get_next_number(token);
-
-	flag->changeAllowed = LW_FALSE;
+	if (wkt_word_equals(word, len, "Z"))
+		*hasz = LW_TRUE;
+	else if (wkt_word_equals(word, len, "M"))
+		*hasm = LW_TRUE;
+	else if (wkt_word_equals(word, len, "ZM"))
+		*hasz = *hasm = LW_TRUE;
+	else
+		return LW_FALSE;
+	return LW_TRUE;
 }
 
-LWGEOM *
-wkt_read_point(stok_t *token, lwgeom_ordinate *flag)
+static LWGEOM *
+wkt_read_geometry(wkt_parser *parser)
 {
-	double *coord = NULL;
-	int n = 0;
-	wkt_get_coordinates(token, flag, &coord, &n);
-	if (coord && n == 1)
+	const char *error = lwparse__depth(parser->ctx, parser->depth);
+	if (error)
 	{
+		wkt_set_error(parser, error);
+		return NULL;
 	}
-	return NULL;
-}
+	const char *word;
+	size_t len = wkt_read_word(parser, &word);
 
-LWGEOM *
-wkt_read_linestring(stok_t *token, lwgeom_ordinate *flag)
-{
-	double *coord = NULL;
-	int n = 0;
-	wkt_get_coordinates(token, flag, &coord, &n);
-	if (coord && n > 1)
+	int type = 0;
+	size_t suffix = 0;
+	for (size_t i = 0; i < sizeof(wkt_types) / sizeof(wkt_types[0]); i++)
 	{
+		size_t n = strlen(wkt_types[i].name);
+		if (len >= n && len <= n + 2 && strncasecmp(word, wkt_types[i].name, n) == 0)
+		{
+			type = wkt_types[i].type;
+			suffix = len - n;
+			break;
+		}
+	}
+	int hasz = LW_FALSE, hasm = LW_FALSE;
+	if (type == 0 || (suffix && !wkt_parse_dims(word + len - suffix, suffix, &hasz, &hasm)))
+	{
+		parser->cur = word;
+		wkt_set_error(parser, "unknown geometry type");
+		return NULL;
 	}
-	return NULL;
-}
 
-LWGEOM *
-wkt_read_linearring(stok_t *token, lwgeom_ordinate *flag)
-{
-	double *coord = NULL;
-	int n = 0;
-	wkt_get_coordinates(token, flag, &coord, &n);
-	if (coord && n > 1)
+	// the tag may also follow the keyword as a separate word, "POINT Z (...)"
+	const char *save = parser->cur;
+	const char *tag;
+	size_t taglen = wkt_read_word(parser, &tag);
+	if (suffix == 0 && taglen > 0 && wkt_parse_dims(tag, taglen, &hasz, &hasm))
+		suffix = taglen;
+	else
+		parser->cur = save;
+
+	if (suffix)
+	{
+		parser->hasz = hasz;
+		parser->hasm = hasm;
+		parser->dims_fixed = LW_TRUE;
+	}
+
+	LWGEOM *obj;
+	switch (type)
 	{
+	case POINTTYPE:
+	case LINETYPE:
+		obj = wkt_read_sequence(parser, (uint8_t)type);
+		break;
+	case POLYTYPE:
+		obj = wkt_read_polygon_body(parser);
+		break;
+	default:
+		obj = wkt_read_collection_body(parser, (uint8_t)type);
+		break;
 	}
-	return NULL;
+	if (obj && type != POINTTYPE && type != LINETYPE)
+		wkt_fix_dims(obj, parser->hasz, parser->hasm);
+	return obj;
 }
 
+/* -------------------------------- input wkt ------------------------------- */
+
 LWGEOM *
-wkt_read_polygon(stok_t *token, lwgeom_ordinate *flag)
+lwgeom__read_wkt(const char *data, size_t len, lwparse *ctx)
 {
-	char *nextToken = wkt_get_next_empty_or_opener(token, flag);
-	if (strncmp(nextToken, "EMPTY", 5) == 0)
+	if (data == NULL || !lwparse__text(ctx, "WKT", data, &len))
 		return NULL;
 
-	LWGEOM **subs = (LWGEOM **)lwcalloc(1, sizeof(LWGEOM *));
-	if (subs == NULL)
-		return NULL;
-	LWGEOM *shell = wkt_read_linearring(token, flag);
-	subs[0] = shell;
-	nextToken = wkt_get_next_closer_comma(token);
-	while (strcmp(nextToken, ",") == 0) {}
+	wkt_parser parser;
+	memset(&parser, 0, sizeof(parser));
+	parser.start = data;
+	parser.cur = data;
+	parser.end = data + len;
+	parser.ctx = ctx;
 
-	return NULL;
-}
+	LWGEOM *obj = wkt_read_geometry(&parser);
+	if (obj)
+	{
+		wkt_skip_space(&parser);
+		if (parser.cur != parser.end)
+			wkt_set_error(&parser, "unexpected text after geometry");
+	}
+	lwfree(parser.scratch);
 
-LWGEOM *
-wkt_read_multipoint(stok_t *token, lwgeom_ordinate *flag)
-{
-	return NULL;
+	if (parser.error)
+	{
+		lwparse__fail(ctx, "WKT", parser.error_offset, parser.error);
+		lwgeom_free(obj);
+		return NULL;
+	}
+	return obj;
 }
 
+/// @brief parse OGC WKT, \a len may be 0 for a NUL terminated string
+/// @return geometry, or NULL when the text is not valid WKT
 LWGEOM *
-wkt_read_multilinestring(stok_t *token, lwgeom_ordinate *flag)
+lwgeom_read_wkt(const char *data, size_t len)
 {
-	return NULL;
+	lwparse ctx;
+	lwparse__init(&ctx, NULL, LW_TRUE);
+	return lwgeom__read_wkt(data, len, &ctx);
 }
-
-LWGEOM *
-wkt_read_multipolygon(stok_t *token, lwgeom_ordinate *flag)
-{
-	return NULL;
-}
\ No newline at end of file
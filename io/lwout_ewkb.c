@@ -22,8 +22,10 @@
 
 #include "liblwgeom_internel.h"
 
+/// @brief write little endian EWKB, dimensions are carried in the high bits
+/// of the type code. LWGEOM has no SRID, so the SRID flag is never set.
 int
 lwgeom_write_ewkb(const LWGEOM *g, char **data, size_t *len)
 {
-	return 0;
+	return lwgeom__write_wkb(g, LW_WKB_EXTENDED | LW_WKB_NDR, data, len);
 }
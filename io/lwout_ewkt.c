@@ -22,8 +22,18 @@
 
 #include "liblwgeom_internel.h"
 
+/// @brief write EWKT to \a sink, the dimension is told by the ordinate count
+/// and only geometries with M but no Z carry a suffix, as in POINTM(1 2 3)
+/// @param precision decimal places, negative for the fewest digits that read
+/// back to the same value
 int
-lwgeom_write_ewkt(const LWGEOM *g, char **data, size_t *len)
+lwgeom_write_ewkt_to(const LWGEOM *obj, int precision, LWSINK *sink)
 {
-	return 0;
+	return lwgeom__write_wkt(obj, precision, LW_TRUE, sink);
+}
+
+int
+lwgeom_write_ewkt(const LWGEOM *obj, char **data, size_t *len)
+{
+	return lwgeom__write_text(lwgeom_write_ewkt_to, obj, data, len);
 }
@@ -0,0 +1,290 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+#include "lwgeom_flat.h"
+#include "lwgeom_spatial_sort.h"
+#include "lwpool.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <string.h>
+#include <unistd.h>
+
+/* ------------------------------- inner flat ------------------------------- */
+
+/// records sized and written per task
+#define FLAT_BLOCK 1024
+
+#define FLAT_WKB_VARIANT (LW_WKB_ISO | LW_WKB_NDR)
+
+typedef struct {
+	LWGEOM *const *geoms;
+	const uint64_t *order; ///< input index of every record in file order
+	size_t count;
+	size_t *sizes;         ///< WKB bytes of every record
+	uint8_t *leads;        ///< first coordinate offset in the WKB, modulo 8
+	uint64_t *offsets;     ///< record positions, count + 1 entries
+	uint8_t *leaves;
+	uint8_t *records;
+	int *failed;           ///< one flag per block
+} flat_job;
+
+/// @brief offset of the first coordinate array within the ISO WKB of \a obj
+static size_t
+flat_lead(const LWGEOM *obj)
+{
+	switch (obj->type)
+	{
+	case POINTTYPE:
+		return 5;
+	case LINETYPE:
+		return 9;
+	case POLYTYPE:
+		return 13;
+	default:
+		return obj->ngeoms ? 9 + flat_lead(obj->geoms[0]) : 9;
+	}
+}
+
+static void
+flat_store_node(uint8_t *p, const LWBOX *env, uint64_t offset)
+{
+	flat_store_double(p, env->xmin);
+	flat_store_double(p + 8, env->ymin);
+	flat_store_double(p + 16, env->xmax);
+	flat_store_double(p + 24, env->ymax);
+	flat_store_u64(p + 32, offset);
+}
+
+static void
+flat__size_block(size_t block, void *udata)
+{
+	flat_job *job = (flat_job *)udata;
+	size_t last = LWMIN((block + 1) * FLAT_BLOCK, job->count);
+	for (size_t k = block * FLAT_BLOCK; k < last; k++)
+	{
+		const LWGEOM *obj = job->geoms[job->order[k]];
+		job->sizes[k] = lwgeom_wkb_size(obj, FLAT_WKB_VARIANT);
+		job->leads[k] = (uint8_t)(flat_lead(obj) & 7);
+		if (job->sizes[k] > UINT32_MAX)
+			job->failed[block] = LW_TRUE;
+	}
+}
+
+static void
+flat__write_block(size_t block, void *udata)
+{
+	flat_job *job = (flat_job *)udata;
+	size_t last = LWMIN((block + 1) * FLAT_BLOCK, job->count);
+	for (size_t k = block * FLAT_BLOCK; k < last; k++)
+	{
+		const LWGEOM *obj = job->geoms[job->order[k]];
+		uint64_t end = k ? job->offsets[k - 1] + 4 + job->sizes[k - 1] : 0;
+		memset(job->records + end, 0, job->offsets[k] - end);
+
+		uint8_t *p = job->records + job->offsets[k];
+		flat_store_u32(p, (uint32_t)job->sizes[k]);
+		if (lwgeom_write_wkb_buffer(obj, FLAT_WKB_VARIANT, p + 4, job->sizes[k]) != job->sizes[k])
+			job->failed[block] = LW_TRUE;
+		flat_store_node(job->leaves + k * FLAT_NODE_BYTES, &obj->env, job->offsets[k]);
+	}
+}
+
+/// @brief fill the branch levels bottom up from the leaves
+static void
+flat_write_branches(uint8_t *index, const uint64_t *bounds, int nlevels, uint16_t node_size)
+{
+	for (int level = 1; level < nlevels; level++)
+	{
+		uint64_t child = bounds[2 * (level - 1)];
+		uint64_t child_end = bounds[2 * (level - 1) + 1];
+		for (uint64_t i = bounds[2 * level]; i < bounds[2 * level + 1]; i++, child += node_size)
+		{
+			LWBOX env = {0};
+			uint64_t last = LWMIN(child + node_size, child_end);
+			env.xmin = env.ymin = DBL_MAX;
+			env.xmax = env.ymax = -DBL_MAX;
+			for (uint64_t c = child; c < last; c++)
+			{
+				const uint8_t *p = index + c * FLAT_NODE_BYTES;
+				env.xmin = LWMIN(env.xmin, flat_load_double(p));
+				env.ymin = LWMIN(env.ymin, flat_load_double(p + 8));
+				env.xmax = LWMAX(env.xmax, flat_load_double(p + 16));
+				env.ymax = LWMAX(env.ymax, flat_load_double(p + 24));
+			}
+			flat_store_node(index + i * FLAT_NODE_BYTES, &env, child);
+		}
+	}
+}
+
+static int
+flat_write_fd(int fd, const char *data, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(fd, data, len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return LW_FAILURE;
+		}
+		data += n;
+		len -= (size_t)n;
+	}
+	return LW_SUCCESS;
+}
+
+/* ------------------------------- output flat ------------------------------ */
+
+/// @brief write a layer as a flat layer file, a FlatGeobuf style container
+/// with a packed Hilbert R-tree in front of length prefixed WKB records
+///
+/// The geometries are stored in Hilbert order of their envelope centres,
+/// the leaves of the tree are the records and every branch covers
+/// \a node_size nodes of the level below. Records are written in parallel
+/// blocks straight into the output buffer.
+/// @param node_size children per branch, 0 for FLAT_NODE_SIZE_DEFAULT
+/// @param nthreads number of threads, see lwpool_nthreads
+/// @param data receives the file contents allocated with lwmalloc
+/// @param order receives the input index of every record in file order when
+/// not NULL, \a count entries
+int
+lwgeom_write_flat(LWGEOM *const *geoms,
+		  size_t count,
+		  uint16_t node_size,
+		  int nthreads,
+		  char **data,
+		  size_t *len,
+		  uint64_t *order)
+{
+	if (geoms == NULL || data == NULL || node_size == 1)
+		return LW_FAILURE;
+	if (node_size == 0)
+		node_size = FLAT_NODE_SIZE_DEFAULT;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (geoms[i] == NULL)
+			return LW_FAILURE;
+	}
+
+	uint64_t bounds[2 * FLAT_LEVELS_MAX];
+	int nlevels = flat_levels(count, node_size, bounds);
+	size_t index_size = nlevels ? (size_t)bounds[1] * FLAT_NODE_BYTES : 0;
+	size_t nblocks = (count + FLAT_BLOCK - 1) / FLAT_BLOCK;
+
+	flat_job job = {.geoms = geoms, .count = count};
+	uint64_t *ids = (uint64_t *)lwmalloc(sizeof(uint64_t) * LWMAX(count, 1));
+	job.sizes = (size_t *)lwmalloc(sizeof(size_t) * LWMAX(count, 1));
+	job.leads = (uint8_t *)lwmalloc(LWMAX(count, 1));
+	job.offsets = (uint64_t *)lwmalloc(sizeof(uint64_t) * (count + 1));
+	job.failed = (int *)lwmalloc0(sizeof(int) * LWMAX(nblocks, 1));
+	uint8_t *out = NULL;
+	int ret = LW_FAILURE;
+	if (!ids || !job.sizes || !job.leads || !job.offsets || !job.failed)
+		goto done;
+	if (lwgeom_spatial_order((LWGEOM **)geoms, count, LWSORT_HILBERT, ids, nthreads) != LW_SUCCESS)
+		goto done;
+	job.order = ids;
+
+	lwpool_run(nblocks, nthreads, flat__size_block, &job);
+	for (size_t b = 0; b < nblocks; b++)
+	{
+		if (job.failed[b])
+			goto done;
+	}
+
+	// pad every record so its coordinates land on 8 byte boundaries of the
+	// file, a mapped reader can then use them in place
+	size_t data_offset = FLAT_HEADER_SIZE + index_size;
+	uint64_t pos = 0;
+	for (size_t k = 0; k < count; k++)
+	{
+		pos += (8 - ((data_offset + pos + 4 + job.leads[k]) & 7)) & 7;
+		job.offsets[k] = pos;
+		pos += 4 + job.sizes[k];
+	}
+	job.offsets[count] = pos;
+
+	size_t size = data_offset + (size_t)pos;
+	out = (uint8_t *)lwmalloc(size);
+	if (out == NULL)
+		goto done;
+	job.leaves = out + FLAT_HEADER_SIZE + (nlevels ? bounds[0] * FLAT_NODE_BYTES : 0);
+	job.records = out + data_offset;
+	lwpool_run(nblocks, nthreads, flat__write_block, &job);
+	for (size_t b = 0; b < nblocks; b++)
+	{
+		if (job.failed[b])
+			goto done;
+	}
+	flat_write_branches(out + FLAT_HEADER_SIZE, bounds, nlevels, node_size);
+
+	memset(out, 0, FLAT_HEADER_SIZE);
+	memcpy(out, FLAT_MAGIC, FLAT_MAGIC_SIZE);
+	flat_store_u64(out + FLAT_HEADER_COUNT, count);
+	out[FLAT_HEADER_NODE_SIZE] = (uint8_t)node_size;
+	out[FLAT_HEADER_NODE_SIZE + 1] = (uint8_t)(node_size >> 8);
+	if (nlevels)
+		memcpy(out + FLAT_HEADER_EXTENT, out + FLAT_HEADER_SIZE, 32);
+	flat_store_u64(out + FLAT_HEADER_DATA_SIZE, pos);
+
+	if (order)
+		memcpy(order, ids, sizeof(uint64_t) * count);
+	*data = (char *)out;
+	if (len)
+		*len = size;
+	out = NULL;
+	ret = LW_SUCCESS;
+
+done:
+	lwfree(out);
+	lwfree(ids);
+	lwfree(job.sizes);
+	lwfree(job.leads);
+	lwfree(job.offsets);
+	lwfree(job.failed);
+	return ret;
+}
+
+/// @brief lwgeom_write_flat into the file at \a path, which is created or
+/// truncated
+int
+lwgeom_write_flat_file(LWGEOM *const *geoms,
+		       size_t count,
+		       uint16_t node_size,
+		       int nthreads,
+		       const char *path,
+		       uint64_t *order)
+{
+	char *data;
+	size_t len;
+	if (path == NULL || !lwgeom_write_flat(geoms, count, node_size, nthreads, &data, &len, order))
+		return LW_FAILURE;
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	int ret = fd >= 0 && flat_write_fd(fd, data, len);
+	if (fd >= 0 && close(fd) != 0)
+		ret = LW_FAILURE;
+	lwfree(data);
+	return ret ? LW_SUCCESS : LW_FAILURE;
+}
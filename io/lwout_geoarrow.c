@@ -0,0 +1,621 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "lwgeom_geoarrow.h"
+
+#include "lwpool.h"
+#include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+
+/* ----------------------------- inner geoarrow ----------------------------- */
+
+/// arrays of an export, the lists, the coordinates and up to four ordinates
+#define GA_NODES_MAX (GA_DEPTH_MAX + 5)
+/// buffers of an export, validity, offsets, coordinates and WKB
+#define GA_BUFFERS_MAX (GA_DEPTH_MAX + 6)
+
+enum {
+	GA_COUNT,
+	GA_FILL,
+	GA_CHECK,
+};
+
+typedef struct {
+	LWGEOM *const *geoms;
+	size_t count;
+	uint8_t type;
+	int depth;
+	int ncol; ///< columns of starts
+	int hasz;
+	int hasm;
+	int ndim;
+	int separated;
+	int borrowed; ///< coords[0] is the pp of the geometries
+	/// per row the first element of the levels below the row and the first
+	/// vertex, or the first WKB byte. Row count holds the totals
+	size_t *starts;
+	int32_t *offsets[GA_DEPTH_MAX];
+	double *coords[4];
+	uint8_t *wkb;
+} ga_writer;
+
+typedef struct {
+	int mode;
+	size_t pos[GA_DEPTH_MAX]; ///< next element of every level below the rows
+	size_t nv;                ///< next vertex
+	const double *first;      ///< first coordinate, for GA_CHECK
+	const double *next;       ///< where the next run starts when contiguous
+	int contiguous;
+} ga_cursor;
+
+/// Every array and schema of an export shares one holder, released with its
+/// last node so that a consumer may move children out as the interface allows
+typedef struct {
+	atomic_int refs;
+	void *owned[GA_BUFFERS_MAX]; ///< the validity bitmap first
+	struct ArrowArray nodes[GA_NODES_MAX];
+	struct ArrowArray *children[GA_NODES_MAX][4];
+	const void *buffers[GA_NODES_MAX][3];
+} ga_array_holder;
+
+typedef struct {
+	atomic_int refs;
+	char *metadata;
+	struct ArrowSchema nodes[GA_NODES_MAX];
+	struct ArrowSchema *children[GA_NODES_MAX][4];
+} ga_schema_holder;
+
+/// @brief the layout that holds every geometry, COLLECTIONTYPE for WKB when
+/// the types or the dimensions differ
+static uint8_t
+ga_layout(LWGEOM *const *geoms, size_t count, int *hasz, int *hasm)
+{
+	uint8_t base = 0;
+	int multi = LW_FALSE;
+	for (size_t i = 0; i < count; i++)
+	{
+		const LWGEOM *g = geoms[i];
+		if (g == NULL)
+			continue;
+		if (g->type >= COLLECTIONTYPE)
+			return COLLECTIONTYPE;
+		uint8_t b = g->type > POLYTYPE ? g->type - 3 : g->type;
+		if (base == 0)
+		{
+			base = b;
+			*hasz = lwgeom_has_z(g);
+			*hasm = lwgeom_has_m(g);
+		}
+		else if (b != base || lwgeom_has_z(g) != *hasz || lwgeom_has_m(g) != *hasm)
+			return COLLECTIONTYPE;
+		multi |= g->type > POLYTYPE;
+	}
+	if (base == 0)
+		return POINTTYPE;
+	return multi ? base + 3 : base;
+}
+
+/// @brief a run of vertices, a line, a ring or a member point
+static void
+ga_run(const ga_writer *w, ga_cursor *c, const LWGEOM *g)
+{
+	size_t n = g->npoints;
+	if (n == 0)
+		return;
+	if (c->mode == GA_FILL && !w->borrowed)
+	{
+		size_t ndim = (size_t)w->ndim;
+		if (!w->separated)
+			memcpy(w->coords[0] + c->nv * ndim, g->pp, n * ndim * sizeof(double));
+		else
+		{
+			for (size_t k = 0; k < ndim; k++)
+			{
+				double *dst = w->coords[k] + c->nv;
+				const double *src = g->pp + k;
+				for (size_t j = 0; j < n; j++, src += ndim)
+					dst[j] = *src;
+			}
+		}
+	}
+	else if (c->mode == GA_CHECK)
+	{
+		if (c->first == NULL)
+			c->first = g->pp;
+		else if (g->pp != c->next)
+			c->contiguous = LW_FALSE;
+		c->next = g->pp + n * w->ndim;
+	}
+	c->nv += n;
+}
+
+/// @brief end an element of \a level, its offset is where its children end
+static void
+ga_close(const ga_writer *w, ga_cursor *c, int level)
+{
+	if (c->mode == GA_FILL)
+	{
+		size_t end = c->nv;
+		if (level + 1 < w->depth)
+			end = c->pos[level + 1];
+		w->offsets[level][c->pos[level] + 1] = (int32_t)end;
+	}
+	c->pos[level]++;
+}
+
+/// a single geometry in a multi layout is its own only member
+static inline uint32_t
+ga_nmembers(const ga_writer *w, const LWGEOM *g)
+{
+	return g->type == w->type ? g->ngeoms : 1;
+}
+
+static inline const LWGEOM *
+ga_member(const ga_writer *w, const LWGEOM *g, uint32_t i)
+{
+	return g->type == w->type ? g->geoms[i] : g;
+}
+
+/// @brief visit the vertex runs of a row in the order they are written
+static void
+ga_walk(const ga_writer *w, ga_cursor *c, const LWGEOM *g)
+{
+	switch (w->type)
+	{
+	case LINETYPE:
+		ga_run(w, c, g);
+		break;
+	case POLYTYPE:
+		for (uint32_t r = 0; r < g->ngeoms; r++)
+		{
+			ga_run(w, c, g->geoms[r]);
+			ga_close(w, c, 1);
+		}
+		break;
+	case MPOINTTYPE:
+		// GeoArrow has no empty member point, those are left out
+		for (uint32_t i = 0; i < ga_nmembers(w, g); i++)
+			ga_run(w, c, ga_member(w, g, i));
+		break;
+	case MLINETYPE:
+		for (uint32_t i = 0; i < ga_nmembers(w, g); i++)
+		{
+			ga_run(w, c, ga_member(w, g, i));
+			ga_close(w, c, 1);
+		}
+		break;
+	case MPOLYTYPE:
+		for (uint32_t i = 0; i < ga_nmembers(w, g); i++)
+		{
+			const LWGEOM *poly = ga_member(w, g, i);
+			for (uint32_t r = 0; r < poly->ngeoms; r++)
+			{
+				ga_run(w, c, poly->geoms[r]);
+				ga_close(w, c, 2);
+			}
+			ga_close(w, c, 1);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/// @brief write the coordinate of row \a i of a point layout, NaN for a NULL
+/// or empty point
+static void
+ga_fill_point(const ga_writer *w, size_t i, const LWGEOM *g)
+{
+	int has = g && g->npoints > 0;
+	for (int k = 0; k < w->ndim; k++)
+	{
+		double v = has ? g->pp[k] : NAN;
+		if (w->separated)
+			w->coords[k][i] = v;
+		else
+			w->coords[0][i * w->ndim + k] = v;
+	}
+}
+
+static void
+ga__size_block(size_t index, void *udata)
+{
+	ga_writer *w = (ga_writer *)udata;
+	size_t last = LWMIN((index + 1) * GA_BLOCK, w->count);
+	for (size_t i = index * GA_BLOCK; i < last; i++)
+	{
+		const LWGEOM *g = w->geoms[i];
+		size_t *row = w->starts + (i + 1) * w->ncol;
+		if (w->type == COLLECTIONTYPE)
+		{
+			row[0] = g ? lwgeom_wkb_size(g, LW_WKB_ISO) : 0;
+			continue;
+		}
+		ga_cursor c = {.mode = GA_COUNT};
+		if (g)
+			ga_walk(w, &c, g);
+		for (int k = 1; k < w->depth; k++)
+			row[k - 1] = c.pos[k];
+		row[w->depth - 1] = c.nv;
+	}
+}
+
+static void
+ga__fill_block(size_t index, void *udata)
+{
+	ga_writer *w = (ga_writer *)udata;
+	size_t last = LWMIN((index + 1) * GA_BLOCK, w->count);
+	for (size_t i = index * GA_BLOCK; i < last; i++)
+	{
+		const LWGEOM *g = w->geoms[i];
+		if (w->type == POINTTYPE)
+		{
+			if (!w->borrowed)
+				ga_fill_point(w, i, g);
+			continue;
+		}
+		const size_t *row = w->starts + i * w->ncol;
+		w->offsets[0][i + 1] = (int32_t)row[w->ncol];
+		if (g == NULL)
+			continue;
+		if (w->type == COLLECTIONTYPE)
+		{
+			lwgeom_write_wkb_buffer(g, LW_WKB_ISO, w->wkb + row[0], row[w->ncol] - row[0]);
+			continue;
+		}
+		ga_cursor c = {.mode = GA_FILL};
+		for (int k = 1; k < w->depth; k++)
+			c.pos[k] = row[k - 1];
+		c.nv = row[w->depth - 1];
+		ga_walk(w, &c, g);
+	}
+}
+
+/// @brief the coordinates of all rows when they follow each other in memory
+/// as they would in the coordinate buffer, NULL otherwise
+static const double *
+ga_borrowable(const ga_writer *w)
+{
+	if (w->type == POINTTYPE)
+	{
+		for (size_t i = 0; i < w->count; i++)
+		{
+			const LWGEOM *g = w->geoms[i];
+			if (g == NULL || g->npoints == 0 || g->pp != w->geoms[0]->pp + i * w->ndim)
+				return NULL;
+		}
+		return w->count ? w->geoms[0]->pp : NULL;
+	}
+	ga_cursor c = {.mode = GA_CHECK};
+	c.contiguous = LW_TRUE;
+	for (size_t i = 0; i < w->count && c.contiguous; i++)
+	{
+		if (w->geoms[i])
+			ga_walk(w, &c, w->geoms[i]);
+	}
+	return c.contiguous ? c.first : NULL;
+}
+
+static const char *
+ga_level_name(uint8_t type, int level)
+{
+	static const char *const names[][GA_DEPTH_MAX] = {
+	    [LINETYPE] = {"vertices"},
+	    [POLYTYPE] = {"rings", "vertices"},
+	    [MPOINTTYPE] = {"points"},
+	    [MLINETYPE] = {"linestrings", "vertices"},
+	    [MPOLYTYPE] = {"polygons", "rings", "vertices"},
+	};
+	return names[type][level];
+}
+
+/// @brief extension metadata, an int32 pair count followed by every key and
+/// value as an int32 length and its bytes
+static char *
+ga_metadata(const char *extension)
+{
+	const char *kv[4] = {GA_KEY_NAME, extension, GA_KEY_METADATA, "{}"};
+	size_t size = 4;
+	for (int i = 0; i < 4; i++)
+		size += 4 + strlen(kv[i]);
+	char *metadata = (char *)lwmalloc(size);
+	if (metadata == NULL)
+		return NULL;
+	char *p = metadata;
+	int32_t n = 2;
+	memcpy(p, &n, 4);
+	p += 4;
+	for (int i = 0; i < 4; i++)
+	{
+		n = (int32_t)strlen(kv[i]);
+		memcpy(p, &n, 4);
+		memcpy(p + 4, kv[i], (size_t)n);
+		p += 4 + n;
+	}
+	return metadata;
+}
+
+static void
+ga_release_array(struct ArrowArray *array)
+{
+	ga_array_holder *h = (ga_array_holder *)array->private_data;
+	for (int64_t i = 0; i < array->n_children; i++)
+	{
+		if (array->children[i]->release)
+			array->children[i]->release(array->children[i]);
+	}
+	array->release = NULL;
+	if (atomic_fetch_sub(&h->refs, 1) == 1)
+	{
+		for (int i = 0; i < GA_BUFFERS_MAX; i++)
+			lwfree(h->owned[i]);
+		lwfree(h);
+	}
+}
+
+static void
+ga_release_schema(struct ArrowSchema *schema)
+{
+	ga_schema_holder *h = (ga_schema_holder *)schema->private_data;
+	for (int64_t i = 0; i < schema->n_children; i++)
+	{
+		if (schema->children[i]->release)
+			schema->children[i]->release(schema->children[i]);
+	}
+	schema->release = NULL;
+	if (atomic_fetch_sub(&h->refs, 1) == 1)
+	{
+		lwfree(h->metadata);
+		lwfree(h);
+	}
+}
+
+/// @brief add an array to the holder, \a parent is -1 for the root
+static int
+ga_add_array(ga_array_holder *h, int parent, int64_t length, int64_t null_count, int nbuffers, const void *b1, const void *b2)
+{
+	int i = atomic_fetch_add(&h->refs, 1);
+	struct ArrowArray *a = &h->nodes[i];
+	h->buffers[i][0] = h->owned[0];
+	h->buffers[i][1] = b1;
+	h->buffers[i][2] = b2;
+	a->length = length;
+	a->null_count = null_count;
+	a->offset = 0;
+	a->n_buffers = nbuffers;
+	a->n_children = 0;
+	a->buffers = h->buffers[i];
+	a->children = h->children[i];
+	a->dictionary = NULL;
+	a->release = ga_release_array;
+	a->private_data = h;
+	// only the rows carry a validity bitmap
+	if (parent >= 0)
+	{
+		h->buffers[i][0] = NULL;
+		h->nodes[parent].children[h->nodes[parent].n_children++] = a;
+	}
+	return i;
+}
+
+static int
+ga_add_schema(ga_schema_holder *h, int parent, const char *format, const char *name)
+{
+	int i = atomic_fetch_add(&h->refs, 1);
+	struct ArrowSchema *s = &h->nodes[i];
+	s->format = format;
+	s->name = name;
+	s->metadata = NULL;
+	s->flags = 0;
+	s->n_children = 0;
+	s->children = h->children[i];
+	s->dictionary = NULL;
+	s->release = ga_release_schema;
+	s->private_data = h;
+	if (parent >= 0)
+		h->nodes[parent].children[h->nodes[parent].n_children++] = s;
+	else
+	{
+		s->metadata = h->metadata;
+		s->flags = ARROW_FLAG_NULLABLE;
+	}
+	return i;
+}
+
+/// @brief build the schema and the array trees over the filled buffers
+static void
+ga_build(const ga_writer *w, ga_schema_holder *sh, ga_array_holder *ah, int64_t null_count)
+{
+	static const char *const fixed_formats[] = {NULL, NULL, "+w:2", "+w:3", "+w:4"};
+	static const char *const dim_names[] = {"xy", "xyz", "xym", "xyzm"};
+	const char *ordinate_names[4] = {"x", "y", w->hasz ? "z" : "m", "m"};
+
+	const size_t *totals = w->starts + w->count * w->ncol;
+	int sp = -1, ap = -1;
+	if (w->type == COLLECTIONTYPE)
+	{
+		ga_add_schema(sh, -1, "z", "geometry");
+		ga_add_array(ah, -1, (int64_t)w->count, null_count, 3, w->offsets[0], w->wkb);
+		return;
+	}
+	for (int k = 0; k < w->depth; k++)
+	{
+		sp = ga_add_schema(sh, sp, "+l", k == 0 ? "geometry" : ga_level_name(w->type, k - 1));
+		if (k == 0)
+			ap = ga_add_array(ah, ap, (int64_t)w->count, null_count, 2, w->offsets[k], NULL);
+		else
+			ap = ga_add_array(ah, ap, (int64_t)totals[k - 1], 0, 2, w->offsets[k], NULL);
+	}
+
+	const char *name = w->depth ? ga_level_name(w->type, w->depth - 1) : "geometry";
+	int64_t nv = w->depth ? (int64_t)totals[w->depth - 1] : (int64_t)w->count;
+	if (w->depth)
+		null_count = 0;
+	if (!w->separated)
+	{
+		sp = ga_add_schema(sh, sp, fixed_formats[w->ndim], name);
+		ap = ga_add_array(ah, ap, nv, null_count, 1, NULL, NULL);
+		ga_add_schema(sh, sp, "g", dim_names[w->hasz + 2 * w->hasm]);
+		ga_add_array(ah, ap, nv * w->ndim, 0, 2, w->coords[0], NULL);
+		return;
+	}
+	sp = ga_add_schema(sh, sp, "+s", name);
+	ap = ga_add_array(ah, ap, nv, null_count, 1, NULL, NULL);
+	for (int k = 0; k < w->ndim; k++)
+	{
+		ga_add_schema(sh, sp, "g", ordinate_names[k]);
+		ga_add_array(ah, ap, nv, 0, 2, w->coords[k], NULL);
+	}
+}
+
+/* ---------------------------- output geoarrow ----------------------------- */
+
+/// @brief export geometries as one GeoArrow array through the Arrow C data
+/// interface. Geometries of one type and dimension, single and multi mixed,
+/// take a native layout, anything else or LW_GEOARROW_WKB geoarrow.wkb
+/// @param geoms \a count geometries, NULL for a null row
+/// @param options LW_GEOARROW_SEPARATED, LW_GEOARROW_WKB and
+/// LW_GEOARROW_BORROW, which shares the coordinates of geometries that lie
+/// back to back in memory as those of a batch reader do, instead of copying
+/// @param schema receives the type, release it with its release callback
+/// @param array receives the data, release it with its release callback
+int
+lwgeom_write_geoarrow(LWGEOM *const *geoms,
+		      size_t count,
+		      int options,
+		      int nthreads,
+		      struct ArrowSchema *schema,
+		      struct ArrowArray *array)
+{
+	if ((geoms == NULL && count > 0) || schema == NULL || array == NULL || count >= INT32_MAX)
+		return LW_FAILURE;
+
+	ga_writer w;
+	memset(&w, 0, sizeof(w));
+	w.geoms = geoms;
+	w.count = count;
+	w.type = (options & LW_GEOARROW_WKB) ? COLLECTIONTYPE : ga_layout(geoms, count, &w.hasz, &w.hasm);
+	w.depth = ga_depth(w.type);
+	w.ncol = LWMAX(w.depth, 1);
+	w.ndim = 2 + w.hasz + w.hasm;
+	w.separated = (options & LW_GEOARROW_SEPARATED) != 0;
+
+	ga_array_holder *ah = (ga_array_holder *)lwmalloc0(sizeof(ga_array_holder));
+	ga_schema_holder *sh = (ga_schema_holder *)lwmalloc0(sizeof(ga_schema_holder));
+	w.starts = (size_t *)lwmalloc((count + 1) * w.ncol * sizeof(size_t));
+	if (ah == NULL || sh == NULL || w.starts == NULL)
+		goto fail;
+	atomic_init(&ah->refs, 0);
+	atomic_init(&sh->refs, 0);
+	int nowned = 1;
+
+	int64_t null_count = 0;
+	for (size_t i = 0; i < count; i++)
+		null_count += geoms[i] == NULL;
+	if (null_count > 0)
+	{
+		uint8_t *validity = (uint8_t *)lwmalloc0((count + 7) / 8);
+		if (validity == NULL)
+			goto fail;
+		ah->owned[0] = validity;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (geoms[i])
+				validity[i / 8] |= (uint8_t)(1 << (i % 8));
+		}
+	}
+
+	size_t nblocks = (count + GA_BLOCK - 1) / GA_BLOCK;
+	size_t *totals = w.starts + count * w.ncol;
+	size_t nv = count;
+	if (w.type != POINTTYPE)
+	{
+		lwpool_run(nblocks, nthreads, ga__size_block, &w);
+		for (int k = 0; k < w.ncol; k++)
+		{
+			size_t sum = 0;
+			w.starts[k] = 0;
+			for (size_t i = 1; i <= count; i++)
+			{
+				sum += w.starts[i * w.ncol + k];
+				w.starts[i * w.ncol + k] = sum;
+			}
+			// every offset is an int32
+			if (sum > INT32_MAX)
+				goto fail;
+		}
+		for (int k = 0; k < w.ncol; k++)
+		{
+			size_t n = (k == 0 ? count : totals[k - 1]) + 1;
+			w.offsets[k] = (int32_t *)lwmalloc(n * sizeof(int32_t));
+			ah->owned[nowned++] = w.offsets[k];
+			if (w.offsets[k] == NULL)
+				goto fail;
+			w.offsets[k][0] = 0;
+		}
+		nv = totals[w.ncol - 1];
+	}
+
+	if (w.type == COLLECTIONTYPE)
+	{
+		w.wkb = (uint8_t *)lwmalloc(LWMAX(nv, 1));
+		ah->owned[nowned++] = w.wkb;
+		if (w.wkb == NULL)
+			goto fail;
+	}
+	else if ((options & LW_GEOARROW_BORROW) && !w.separated && (w.coords[0] = (double *)ga_borrowable(&w)) != NULL)
+		w.borrowed = LW_TRUE;
+	else
+	{
+		for (int k = 0; k < (w.separated ? w.ndim : 1); k++)
+		{
+			w.coords[k] = (double *)lwmalloc(LWMAX(nv, 1) * (w.separated ? 1 : w.ndim) * sizeof(double));
+			ah->owned[nowned++] = w.coords[k];
+			if (w.coords[k] == NULL)
+				goto fail;
+		}
+	}
+
+	sh->metadata = ga_metadata(ga_extension_name(w.type));
+	if (sh->metadata == NULL)
+		goto fail;
+	lwpool_run(nblocks, nthreads, ga__fill_block, &w);
+	ga_build(&w, sh, ah, null_count);
+	lwfree(w.starts);
+	*schema = sh->nodes[0];
+	*array = ah->nodes[0];
+	return LW_SUCCESS;
+
+fail:
+	if (ah)
+	{
+		for (int i = 0; i < GA_BUFFERS_MAX; i++)
+			lwfree(ah->owned[i]);
+	}
+	if (sh)
+		lwfree(sh->metadata);
+	lwfree(ah);
+	lwfree(sh);
+	lwfree(w.starts);
+	return LW_FAILURE;
+}
@@ -20,10 +20,213 @@
  * IN THE SOFTWARE.
  */
 
-#include "liblwgeom_internel.h"
+#include "lwgeom_sink.h"
 
+#include "lwgeom_number.h"
+#include <math.h>
+#include <string.h>
+
+/* ----------------------------- inner geojson ------------------------------ */
+
+typedef struct {
+	LWSINK *sink;
+	int precision;
+} gj_writer;
+
+/// @brief write a number into \a p, JSON has no spelling for NaN or infinity
+static size_t
+gj_format(gj_writer *w, double v, char *p)
+{
+	if (!isfinite(v))
+	{
+		lwsink__fail(w->sink);
+		return 0;
+	}
+	return (size_t)lwnumber_format_precision(v, w->precision, p);
+}
+
+/// @brief write "[x,y],[x,y],..." without the enclosing brackets, M values
+/// have no place in a GeoJSON position and are dropped
+static void
+gj_write_positions(gj_writer *w, const LWGEOM *obj)
+{
+	int cdim = lwgeom_dim_coordinate(obj);
+	int ndim = lwgeom_has_z(obj) ? 3 : 2;
+	const double *pp = obj->pp;
+	for (uint32_t i = 0; i < obj->npoints; i++, pp += cdim)
+	{
+		// one reservation per position, every number fits LWNUMBER_BUFSIZE
+		char *p = lwsink__reserve(w->sink, (size_t)ndim * (LWNUMBER_BUFSIZE + 1) + 3);
+		if (p == NULL)
+			return;
+		char *start = p;
+		if (i > 0)
+			*p++ = ',';
+		*p++ = '[';
+		for (int k = 0; k < ndim; k++)
+		{
+			if (k > 0)
+				*p++ = ',';
+			p += gj_format(w, pp[k], p);
+		}
+		*p++ = ']';
+		lwsink__commit(w->sink, (size_t)(p - start));
+	}
+}
+
+static const char *
+gj_type_name(uint8_t type)
+{
+	switch (type)
+	{
+	case POINTTYPE:
+		return "Point";
+	case LINETYPE:
+		return "LineString";
+	case POLYTYPE:
+		return "Polygon";
+	case MPOINTTYPE:
+		return "MultiPoint";
+	case MLINETYPE:
+		return "MultiLineString";
+	case MPOLYTYPE:
+		return "MultiPolygon";
+	case COLLECTIONTYPE:
+		return "GeometryCollection";
+	default:
+		return NULL;
+	}
+}
+
+/// @brief write the value of the "coordinates" member of \a obj
+static void
+gj_write_coordinates(gj_writer *w, const LWGEOM *obj)
+{
+	switch (obj->type)
+	{
+	case POINTTYPE:
+		// a point is a single position, an empty point an empty array
+		if (obj->npoints == 0)
+			lwsink__append(w->sink, "[]", 2);
+		else
+			gj_write_positions(w, obj);
+		break;
+	case LINETYPE:
+		lwsink__append(w->sink, "[", 1);
+		gj_write_positions(w, obj);
+		lwsink__append(w->sink, "]", 1);
+		break;
+	case POLYTYPE:
+	case MLINETYPE:
+	case MPOLYTYPE:
+		lwsink__append(w->sink, "[", 1);
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			if (i > 0)
+				lwsink__append(w->sink, ",", 1);
+			gj_write_coordinates(w, obj->geoms[i]);
+		}
+		lwsink__append(w->sink, "]", 1);
+		break;
+	case MPOINTTYPE:
+		lwsink__append(w->sink, "[", 1);
+		for (uint32_t i = 0, n = 0; i < obj->ngeoms; i++)
+		{
+			// empty points have no position to write
+			if (obj->geoms[i]->npoints == 0)
+				continue;
+			if (n++ > 0)
+				lwsink__append(w->sink, ",", 1);
+			gj_write_positions(w, obj->geoms[i]);
+		}
+		lwsink__append(w->sink, "]", 1);
+		break;
+	default:
+		lwsink__fail(w->sink);
+		break;
+	}
+}
+
+static void
+gj_write_bbox(gj_writer *w, const LWBOX *box)
+{
+	char *p = lwsink__reserve(w->sink, 4 * (LWNUMBER_BUFSIZE + 1) + 10);
+	if (p == NULL)
+		return;
+	char *start = p;
+	memcpy(p, ",\"bbox\":[", 9);
+	p += 9;
+	const double v[4] = {box->xmin, box->ymin, box->xmax, box->ymax};
+	for (int k = 0; k < 4; k++)
+	{
+		if (k > 0)
+			*p++ = ',';
+		p += gj_format(w, v[k], p);
+	}
+	*p++ = ']';
+	lwsink__commit(w->sink, (size_t)(p - start));
+}
+
+static void
+gj_write_geometry(gj_writer *w, const LWGEOM *obj, int options)
+{
+	const char *name = gj_type_name(obj->type);
+	if (name == NULL)
+	{
+		lwsink__fail(w->sink);
+		return;
+	}
+	lwsink__append(w->sink, "{\"type\":\"", 9);
+	lwsink__append_str(w->sink, name);
+	lwsink__append(w->sink, "\"", 1);
+	if ((options & LW_GEOJSON_BBOX) && !lwgeom__is_empty(obj))
+		gj_write_bbox(w, &obj->env);
+	if (obj->type == COLLECTIONTYPE)
+	{
+		lwsink__append(w->sink, ",\"geometries\":[", 15);
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			if (i > 0)
+				lwsink__append(w->sink, ",", 1);
+			// members carry no bbox of their own, the collection has it
+			gj_write_geometry(w, obj->geoms[i], options & ~LW_GEOJSON_BBOX);
+		}
+		lwsink__append(w->sink, "]}", 2);
+		return;
+	}
+	lwsink__append(w->sink, ",\"coordinates\":", 15);
+	gj_write_coordinates(w, obj);
+	lwsink__append(w->sink, "}", 1);
+}
+
+/// @brief write GeoJSON for \a obj to \a sink
+/// @param precision decimal places, negative for the shortest text that reads
+/// back to the same value
+/// @param options LW_GEOJSON_BBOX to add a "bbox" member from the envelope
+int
+lwgeom_write_geojson_to(const LWGEOM *obj, int precision, int options, LWSINK *sink)
+{
+	if (obj == NULL || sink == NULL)
+		return LW_FAILURE;
+
+	size_t mark = lwsink__begin(sink);
+	gj_writer w = {sink, precision};
+	gj_write_geometry(&w, obj, options);
+	return lwsink__end(sink, mark);
+}
+
+static int
+gj_write_default(const LWGEOM *obj, int precision, LWSINK *sink)
+{
+	return lwgeom_write_geojson_to(obj, precision, 0, sink);
+}
+
+/// @brief write an RFC 7946 geometry object, numbers are written with the
+/// fewest digits that read back to the same value
+/// @param data receives a NUL terminated string allocated with lwmalloc
+/// @param len receives the string length, may be NULL
 int
-lwgeom_write_geojson(const LWGEOM *g, char **data, size_t *len)
+lwgeom_write_geojson(const LWGEOM *obj, char **data, size_t *len)
 {
-	return 0;
+	return lwgeom__write_text(gj_write_default, obj, data, len);
 }
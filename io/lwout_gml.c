@@ -20,16 +20,195 @@
  * IN THE SOFTWARE.
  */
 
-#include "liblwgeom_internel.h"
+#include "lwgeom_sink.h"
 
+/* -------------------------------- inner gml ------------------------------- */
+
+typedef struct {
+	LWSINK *sink;
+	int precision;
+	int version;
+} gml_writer;
+
+/// @brief element names of GML 2 and GML 3, the multi types were renamed
+static const char *
+gml_type_name(const gml_writer *w, uint8_t type)
+{
+	switch (type)
+	{
+	case POINTTYPE:
+		return "Point";
+	case LINETYPE:
+		return "LineString";
+	case POLYTYPE:
+		return "Polygon";
+	case MPOINTTYPE:
+		return "MultiPoint";
+	case MLINETYPE:
+		return w->version == 2 ? "MultiLineString" : "MultiCurve";
+	case MPOLYTYPE:
+		return w->version == 2 ? "MultiPolygon" : "MultiSurface";
+	case COLLECTIONTYPE:
+		return "MultiGeometry";
+	default:
+		return NULL;
+	}
+}
+
+static const char *
+gml_member_name(const gml_writer *w, uint8_t type)
+{
+	switch (type)
+	{
+	case MPOINTTYPE:
+		return "pointMember";
+	case MLINETYPE:
+		return w->version == 2 ? "lineStringMember" : "curveMember";
+	case MPOLYTYPE:
+		return w->version == 2 ? "polygonMember" : "surfaceMember";
+	default:
+		return "geometryMember";
+	}
+}
+
+static void
+gml_open(gml_writer *w, const char *name)
+{
+	lwsink__append(w->sink, "<gml:", 5);
+	lwsink__append_str(w->sink, name);
+	lwsink__append(w->sink, ">", 1);
+}
+
+static void
+gml_close(gml_writer *w, const char *name)
+{
+	lwsink__append(w->sink, "</gml:", 6);
+	lwsink__append_str(w->sink, name);
+	lwsink__append(w->sink, ">", 1);
+}
+
+/// @brief write the coordinates of a point, a line or a ring, M values have
+/// no place in GML and are dropped
+static void
+gml_write_points(gml_writer *w, const LWGEOM *obj)
+{
+	int ndim = lwgeom_has_z(obj) ? 3 : 2;
+	if (w->version == 2)
+	{
+		gml_open(w, "coordinates");
+		lwsink__write_points(w->sink, obj, ndim, w->precision, ',', ' ');
+		gml_close(w, "coordinates");
+		return;
+	}
+	if (obj->type == POINTTYPE)
+		lwsink__append_str(w->sink, ndim == 3 ? "<gml:pos srsDimension=\"3\">" : "<gml:pos>");
+	else
+		lwsink__append_str(w->sink,
+				   ndim == 3 ? "<gml:posList srsDimension=\"3\">" : "<gml:posList srsDimension=\"2\">");
+	lwsink__write_points(w->sink, obj, ndim, w->precision, ' ', ' ');
+	gml_close(w, obj->type == POINTTYPE ? "pos" : "posList");
+}
+
+static void
+gml_write_polygon(gml_writer *w, const LWGEOM *obj)
+{
+	for (uint32_t i = 0; i < obj->ngeoms; i++)
+	{
+		const char *boundary;
+		if (w->version == 2)
+			boundary = i == 0 ? "outerBoundaryIs" : "innerBoundaryIs";
+		else
+			boundary = i == 0 ? "exterior" : "interior";
+		gml_open(w, boundary);
+		gml_open(w, "LinearRing");
+		gml_write_points(w, obj->geoms[i]);
+		gml_close(w, "LinearRing");
+		gml_close(w, boundary);
+	}
+}
+
+static void
+gml_write_geometry(gml_writer *w, const LWGEOM *obj)
+{
+	const char *name = gml_type_name(w, obj->type);
+	if (name == NULL)
+	{
+		lwsink__fail(w->sink);
+		return;
+	}
+	if (lwgeom__is_empty(obj))
+	{
+		lwsink__append(w->sink, "<gml:", 5);
+		lwsink__append_str(w->sink, name);
+		lwsink__append(w->sink, "/>", 2);
+		return;
+	}
+
+	gml_open(w, name);
+	switch (obj->type)
+	{
+	case POINTTYPE:
+	case LINETYPE:
+		gml_write_points(w, obj);
+		break;
+	case POLYTYPE:
+		gml_write_polygon(w, obj);
+		break;
+	default: {
+		const char *member = gml_member_name(w, obj->type);
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			gml_open(w, member);
+			gml_write_geometry(w, obj->geoms[i]);
+			gml_close(w, member);
+		}
+		break;
+	}
+	}
+	gml_close(w, name);
+}
+
+static int
+gml_write(const LWGEOM *obj, int precision, int version, LWSINK *sink)
+{
+	if (obj == NULL || sink == NULL)
+		return LW_FAILURE;
+
+	size_t mark = lwsink__begin(sink);
+	gml_writer w = {sink, precision, version};
+	gml_write_geometry(&w, obj);
+	return lwsink__end(sink, mark);
+}
+
+/* -------------------------------- output gml ------------------------------ */
+
+/// @brief write a GML 2 geometry to \a sink, coordinates are written as
+/// <gml:coordinates> tuples
+/// @param precision decimal places, negative for the fewest digits that read
+/// back to the same value
 int
-lwgeom_write_gml2(const LWGEOM *g, char **data, size_t *len)
+lwgeom_write_gml2_to(const LWGEOM *obj, int precision, LWSINK *sink)
 {
-	return 0;
+	return gml_write(obj, precision, 2, sink);
 }
 
+/// @brief write a GML 3 geometry to \a sink, coordinates are written as
+/// <gml:pos> and <gml:posList>, multi lines and polygons as MultiCurve and
+/// MultiSurface
 int
-lwgeom_write_gml3(const LWGEOM *g, char **data, size_t *len)
+lwgeom_write_gml3_to(const LWGEOM *obj, int precision, LWSINK *sink)
 {
-	return 0;
-}
\ No newline at end of file
+	return gml_write(obj, precision, 3, sink);
+}
+
+int
+lwgeom_write_gml2(const LWGEOM *obj, char **data, size_t *len)
+{
+	return lwgeom__write_text(lwgeom_write_gml2_to, obj, data, len);
+}
+
+int
+lwgeom_write_gml3(const LWGEOM *obj, char **data, size_t *len)
+{
+	return lwgeom__write_text(lwgeom_write_gml3_to, obj, data, len);
+}
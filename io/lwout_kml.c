@@ -20,10 +20,105 @@
  * IN THE SOFTWARE.
  */
 
-#include "liblwgeom_internel.h"
+#include "lwgeom_sink.h"
+
+/* -------------------------------- inner kml ------------------------------- */
+
+typedef struct {
+	LWSINK *sink;
+	int precision;
+} kml_writer;
+
+static void
+kml_open(kml_writer *w, const char *name)
+{
+	lwsink__append(w->sink, "<", 1);
+	lwsink__append_str(w->sink, name);
+	lwsink__append(w->sink, ">", 1);
+}
+
+static void
+kml_close(kml_writer *w, const char *name)
+{
+	lwsink__append(w->sink, "</", 2);
+	lwsink__append_str(w->sink, name);
+	lwsink__append(w->sink, ">", 1);
+}
+
+/// @brief write "lon,lat[,alt] ..." in a <coordinates> element, KML has no
+/// measure and M values are dropped
+static void
+kml_write_points(kml_writer *w, const LWGEOM *obj)
+{
+	kml_open(w, "coordinates");
+	lwsink__write_points(w->sink, obj, lwgeom_has_z(obj) ? 3 : 2, w->precision, ',', ' ');
+	kml_close(w, "coordinates");
+}
+
+static void
+kml_write_geometry(kml_writer *w, const LWGEOM *obj)
+{
+	switch (obj->type)
+	{
+	case POINTTYPE:
+		kml_open(w, "Point");
+		kml_write_points(w, obj);
+		kml_close(w, "Point");
+		break;
+	case LINETYPE:
+		kml_open(w, "LineString");
+		kml_write_points(w, obj);
+		kml_close(w, "LineString");
+		break;
+	case POLYTYPE:
+		kml_open(w, "Polygon");
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			const char *boundary = i == 0 ? "outerBoundaryIs" : "innerBoundaryIs";
+			kml_open(w, boundary);
+			kml_open(w, "LinearRing");
+			kml_write_points(w, obj->geoms[i]);
+			kml_close(w, "LinearRing");
+			kml_close(w, boundary);
+		}
+		kml_close(w, "Polygon");
+		break;
+	case MPOINTTYPE:
+	case MLINETYPE:
+	case MPOLYTYPE:
+	case COLLECTIONTYPE:
+		// KML has a single container for every kind of collection
+		kml_open(w, "MultiGeometry");
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			kml_write_geometry(w, obj->geoms[i]);
+		kml_close(w, "MultiGeometry");
+		break;
+	default:
+		lwsink__fail(w->sink);
+		break;
+	}
+}
+
+/* -------------------------------- output kml ------------------------------ */
+
+/// @brief write a KML 2.2 geometry to \a sink, coordinates are expected to be
+/// longitude and latitude in degrees
+/// @param precision decimal places, negative for the fewest digits that read
+/// back to the same value
+int
+lwgeom_write_kml_to(const LWGEOM *obj, int precision, LWSINK *sink)
+{
+	if (obj == NULL || sink == NULL)
+		return LW_FAILURE;
+
+	size_t mark = lwsink__begin(sink);
+	kml_writer w = {sink, precision};
+	kml_write_geometry(&w, obj);
+	return lwsink__end(sink, mark);
+}
 
 int
-lwgeom_write_kml(const LWGEOM *g, char **data, size_t *len)
+lwgeom_write_kml(const LWGEOM *obj, char **data, size_t *len)
 {
-	return 0;
+	return lwgeom__write_text(lwgeom_write_kml_to, obj, data, len);
 }
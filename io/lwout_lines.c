@@ -0,0 +1,193 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+
+#include "lwgeom_sink.h"
+#include "lwpool.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+/* ------------------------------ inner lines ------------------------------- */
+
+/// Geometries are written in blocks of this many, every block into its own
+/// buffer on one of the pool threads.
+#define LINES_BLOCK_SIZE 1024
+
+/// The fd writer handles this many blocks per thread at a time and reuses the
+/// block buffers from one round to the next.
+#define LINES_ROUND 4
+
+typedef struct {
+	LWGEOM *const *geoms;
+	size_t ngeoms;
+	int format;
+	size_t base; ///< first block of the current round
+	LWSINK *buffers; ///< one buffer sink per block
+	atomic_int error;
+} lines_writer;
+
+/// @brief write one geometry and its newline, a NULL geometry leaves the line
+/// empty so that line numbers keep matching the array
+static int
+lines_write_one(LWSINK *buf, const LWGEOM *obj, int format)
+{
+	int ok = LW_SUCCESS;
+	if (obj != NULL && format == LW_FORMAT_GEOJSON)
+		ok = lwgeom_write_geojson_to(obj, -1, 0, buf);
+	else if (obj != NULL)
+		ok = lwgeom_write_wkt_to(obj, -1, buf);
+	return ok && lwsink_write(buf, "\n", 1);
+}
+
+static void
+lines__write_block(size_t index, void *udata)
+{
+	lines_writer *w = (lines_writer *)udata;
+	size_t block = w->base + index;
+	LWSINK *buf = &w->buffers[index];
+	lwsink_reset(buf);
+	size_t first = block * LINES_BLOCK_SIZE;
+	size_t last = LWMIN(first + LINES_BLOCK_SIZE, w->ngeoms);
+	for (size_t i = first; i < last && !atomic_load_explicit(&w->error, memory_order_relaxed); i++)
+	{
+		if (!lines_write_one(buf, w->geoms[i], w->format))
+			atomic_store(&w->error, LW_TRUE);
+	}
+}
+
+/// @brief buffer sinks that live in one array, kept across rounds
+static LWSINK *
+lines_new_buffers(size_t count)
+{
+	LWSINK *buffers = (LWSINK *)lwmalloc(count * sizeof(LWSINK));
+	for (size_t i = 0; buffers && i < count; i++)
+		lwsink__init(&buffers[i], LWSINK_BUFFER, NULL, 0, 0);
+	return buffers;
+}
+
+static void
+lines_free_buffers(LWSINK *buffers, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		lwfree(buffers[i].data);
+	lwfree(buffers);
+}
+
+static int
+lines_write_fd(int fd, const char *data, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(fd, data, len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return LW_FAILURE;
+		}
+		data += n;
+		len -= (size_t)n;
+	}
+	return LW_SUCCESS;
+}
+
+/* ------------------------------ output lines ------------------------------ */
+
+/// @brief write one geometry per line, WKT or GeoJSON, with blocks of
+/// geometries written in parallel and then concatenated
+/// @param format LW_FORMAT_WKT or LW_FORMAT_GEOJSON
+/// @param nthreads number of threads, see lwpool_nthreads
+/// @param data receives a NUL terminated string allocated with lwmalloc
+/// @param len receives the string length, may be NULL
+int
+lwgeom_write_lines(LWGEOM *const *geoms, size_t ngeoms, int format, int nthreads, char **data, size_t *len)
+{
+	if ((geoms == NULL && ngeoms > 0) || data == NULL || (format != LW_FORMAT_WKT && format != LW_FORMAT_GEOJSON))
+		return LW_FAILURE;
+
+	size_t nblocks = (ngeoms + LINES_BLOCK_SIZE - 1) / LINES_BLOCK_SIZE;
+	LWSINK *buffers = lines_new_buffers(nblocks + 1);
+	if (buffers == NULL)
+		return LW_FAILURE;
+	lines_writer w = {.geoms = geoms, .ngeoms = ngeoms, .format = format, .base = 0, .buffers = buffers};
+	atomic_init(&w.error, LW_FALSE);
+	lwpool_run(nblocks, nthreads, lines__write_block, &w);
+
+	size_t total = 0;
+	for (size_t i = 0; i < nblocks; i++)
+		total += buffers[i].len;
+	char *out = atomic_load(&w.error) ? NULL : (char *)lwmalloc(total + 1);
+	if (out == NULL)
+	{
+		lines_free_buffers(buffers, nblocks);
+		return LW_FAILURE;
+	}
+	char *p = out;
+	for (size_t i = 0; i < nblocks; i++)
+	{
+		if (buffers[i].len)
+			memcpy(p, buffers[i].data, buffers[i].len);
+		p += buffers[i].len;
+	}
+	*p = '\0';
+	lines_free_buffers(buffers, nblocks);
+
+	*data = out;
+	if (len)
+		*len = total;
+	return LW_SUCCESS;
+}
+
+/// @brief lwgeom_write_lines straight to a file descriptor, memory use is
+/// bounded by a few blocks per thread whatever the number of geometries
+int
+lwgeom_write_lines_fd(LWGEOM *const *geoms, size_t ngeoms, int format, int nthreads, int fd)
+{
+	if ((geoms == NULL && ngeoms > 0) || fd < 0 || (format != LW_FORMAT_WKT && format != LW_FORMAT_GEOJSON))
+		return LW_FAILURE;
+
+	nthreads = lwpool_nthreads(nthreads);
+	size_t nblocks = (ngeoms + LINES_BLOCK_SIZE - 1) / LINES_BLOCK_SIZE;
+	size_t round = LWMIN((size_t)nthreads * LINES_ROUND, nblocks);
+	LWSINK *buffers = lines_new_buffers(round + 1);
+	if (buffers == NULL)
+		return LW_FAILURE;
+	lines_writer w = {.geoms = geoms, .ngeoms = ngeoms, .format = format, .base = 0, .buffers = buffers};
+	atomic_init(&w.error, LW_FALSE);
+
+	for (; w.base < nblocks && !atomic_load(&w.error); w.base += round)
+	{
+		size_t count = LWMIN(round, nblocks - w.base);
+		lwpool_run(count, nthreads, lines__write_block, &w);
+		for (size_t i = 0; i < count && !atomic_load(&w.error); i++)
+		{
+			if (!lines_write_fd(fd, buffers[i].data, buffers[i].len))
+				atomic_store(&w.error, LW_TRUE);
+		}
+	}
+
+	lines_free_buffers(buffers, round);
+	return atomic_load(&w.error) ? LW_FAILURE : LW_SUCCESS;
+}
@@ -0,0 +1,792 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+
+#include <math.h>
+#include <string.h>
+
+/* ------------------------------- inner mvt -------------------------------- */
+
+/// command integers carry the id in the low three bits and the repeat count
+/// above them
+#define MVT_MOVETO             1
+#define MVT_LINETO             2
+#define MVT_CLOSEPATH          7
+#define MVT_COMMAND(id, count) (((uint32_t)(count) << 3) | (uint32_t)(id))
+#define MVT_COUNT_MAX          ((size_t)1 << 29)
+
+/// feature geometry types
+#define MVT_POINT      1
+#define MVT_LINESTRING 2
+#define MVT_POLYGON    3
+
+/// protobuf keys of the tile, layer and feature messages
+#define MVT_KEY(field, wire) (((uint32_t)(field) << 3) | (uint32_t)(wire))
+#define MVT_WIRE_VARINT      0
+#define MVT_WIRE_LENGTH      2
+#define MVT_TILE_LAYERS      3
+#define MVT_LAYER_NAME       1
+#define MVT_LAYER_FEATURES   2
+#define MVT_LAYER_EXTENT     5
+#define MVT_LAYER_VERSION    15
+#define MVT_FEATURE_ID       1
+#define MVT_FEATURE_TYPE     3
+#define MVT_FEATURE_GEOMETRY 4
+
+/// room reserved for a varint before its value is known
+#define MVT_VARINT_MAX 10
+
+/// 2D points in tile grid units
+typedef struct {
+	double *pp;
+	size_t npoints;
+	size_t capacity;
+} mvt_points;
+
+/// Encoder state, the scratch buffers live as long as the encoder so a layer
+/// doesn't allocate per feature.
+typedef struct {
+	double scale[2];  ///< grid = world * scale + offset, y grows down
+	double offset[2];
+	double clip[4];   ///< buffered tile as xmin, ymin, xmax, ymax in grid units
+	uint32_t *cmds;
+	size_t len;
+	size_t capacity;
+	int32_t cursor[2]; ///< parameters are deltas across all parts of a geometry
+	mvt_points a;      ///< transformed input
+	mvt_points b;      ///< clipping output
+	mvt_points q;      ///< quantized vertices
+	int error;
+} mvt_encoder;
+
+typedef struct {
+	uint8_t *data;
+	size_t len;
+	size_t capacity;
+	int error;
+} mvt_buffer;
+
+static int
+mvt_init(mvt_encoder *enc, const LWMVT_TILE *tile)
+{
+	memset(enc, 0, sizeof(mvt_encoder));
+	if (tile == NULL || tile->extent == 0 || (uint64_t)tile->extent + 2 * (uint64_t)tile->buffer >= (1u << 30))
+		return LW_FAILURE;
+	double width = tile->bounds.xmax - tile->bounds.xmin;
+	double height = tile->bounds.ymax - tile->bounds.ymin;
+	if (!(width > 0 && height > 0 && isfinite(width) && isfinite(height)))
+		return LW_FAILURE;
+
+	double extent = (double)tile->extent;
+	enc->scale[0] = extent / width;
+	enc->scale[1] = -extent / height;
+	enc->offset[0] = -tile->bounds.xmin * enc->scale[0];
+	enc->offset[1] = tile->bounds.ymax * extent / height;
+	enc->clip[0] = enc->clip[1] = -(double)tile->buffer;
+	enc->clip[2] = enc->clip[3] = extent + (double)tile->buffer;
+	return LW_SUCCESS;
+}
+
+static void
+mvt_free(mvt_encoder *enc)
+{
+	lwfree(enc->cmds);
+	lwfree(enc->a.pp);
+	lwfree(enc->b.pp);
+	lwfree(enc->q.pp);
+}
+
+static double *
+mvt_reserve_points(mvt_encoder *enc, mvt_points *pts, size_t n)
+{
+	if (enc->error)
+		return NULL;
+	if (n > pts->capacity)
+	{
+		size_t capacity = pts->capacity ? pts->capacity : 64;
+		while (n > capacity)
+			capacity *= 2;
+		double *pp = (double *)lwrealloc(pts->pp, capacity * 2 * sizeof(double));
+		if (pp == NULL)
+		{
+			enc->error = LW_TRUE;
+			return NULL;
+		}
+		pts->pp = pp;
+		pts->capacity = capacity;
+	}
+	return pts->pp;
+}
+
+static uint32_t *
+mvt_reserve_cmds(mvt_encoder *enc, size_t n)
+{
+	if (enc->error)
+		return NULL;
+	if (enc->len + n > enc->capacity)
+	{
+		size_t capacity = enc->capacity ? enc->capacity : 256;
+		while (enc->len + n > capacity)
+			capacity *= 2;
+		uint32_t *cmds = (uint32_t *)lwrealloc(enc->cmds, capacity * sizeof(uint32_t));
+		if (cmds == NULL)
+		{
+			enc->error = LW_TRUE;
+			return NULL;
+		}
+		enc->cmds = cmds;
+		enc->capacity = capacity;
+	}
+	return enc->cmds + enc->len;
+}
+
+/// @brief the envelope in grid units as xmin, ymin, xmax, ymax
+static void
+mvt_envelope(const mvt_encoder *enc, const LWBOX *env, double *box)
+{
+	box[0] = env->xmin * enc->scale[0] + enc->offset[0];
+	box[2] = env->xmax * enc->scale[0] + enc->offset[0];
+	box[1] = env->ymax * enc->scale[1] + enc->offset[1];
+	box[3] = env->ymin * enc->scale[1] + enc->offset[1];
+}
+
+static inline int
+mvt_box_outside(const mvt_encoder *enc, const double *box)
+{
+	return box[2] < enc->clip[0] || box[0] > enc->clip[2] || box[3] < enc->clip[1] || box[1] > enc->clip[3];
+}
+
+static inline int
+mvt_box_inside(const mvt_encoder *enc, const double *box)
+{
+	return box[0] >= enc->clip[0] && box[2] <= enc->clip[2] && box[1] >= enc->clip[1] && box[3] <= enc->clip[3];
+}
+
+/// @brief move the vertices of \a obj to the grid in enc->a, only x and y
+/// are kept
+static const double *
+mvt_transform(mvt_encoder *enc, const LWGEOM *obj)
+{
+	double *pp = mvt_reserve_points(enc, &enc->a, obj->npoints);
+	if (pp == NULL)
+		return NULL;
+	int cdim = LW_POINTBYTESIZE(lwgeom_has_z(obj), lwgeom_has_m(obj));
+	const double *src = obj->pp;
+	for (uint32_t i = 0; i < obj->npoints; i++, src += cdim)
+	{
+		pp[2 * i] = src[0] * enc->scale[0] + enc->offset[0];
+		pp[2 * i + 1] = src[1] * enc->scale[1] + enc->offset[1];
+	}
+	enc->a.npoints = obj->npoints;
+	return pp;
+}
+
+/// @brief round onto the grid into enc->q, dropping vertices that land on
+/// the previous one, a ring also loses the points that repeat its start
+/// @return number of distinct vertices
+static size_t
+mvt_quantize(mvt_encoder *enc, const double *pp, size_t n, int ring)
+{
+	// one more for the closing point of a ring
+	double *q = mvt_reserve_points(enc, &enc->q, n + 1);
+	if (q == NULL)
+		return 0;
+	size_t m = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		double x = floor(pp[2 * i] + 0.5);
+		double y = floor(pp[2 * i + 1] + 0.5);
+		if (!(fabs(x) < 2147483647.0 && fabs(y) < 2147483647.0))
+		{
+			enc->error = LW_TRUE;
+			return 0;
+		}
+		if (m > 0 && x == q[2 * m - 2] && y == q[2 * m - 1])
+			continue;
+		q[2 * m] = x;
+		q[2 * m + 1] = y;
+		m++;
+	}
+	if (ring)
+	{
+		while (m > 1 && q[2 * m - 2] == q[0] && q[2 * m - 1] == q[1])
+			m--;
+	}
+	enc->q.npoints = m;
+	return m;
+}
+
+static inline uint32_t *
+mvt_put_vertex(mvt_encoder *enc, uint32_t *c, const double *p)
+{
+	int32_t x = (int32_t)p[0];
+	int32_t y = (int32_t)p[1];
+	int32_t dx = x - enc->cursor[0];
+	int32_t dy = y - enc->cursor[1];
+	*c++ = ((uint32_t)dx << 1) ^ (uint32_t)(dx >> 31);
+	*c++ = ((uint32_t)dy << 1) ^ (uint32_t)(dy >> 31);
+	enc->cursor[0] = x;
+	enc->cursor[1] = y;
+	return c;
+}
+
+/// @brief MoveTo the first vertex of enc->q and LineTo the rest
+static void
+mvt_emit_line(mvt_encoder *enc, size_t n)
+{
+	if (n >= MVT_COUNT_MAX)
+	{
+		enc->error = LW_TRUE;
+		return;
+	}
+	uint32_t *c = mvt_reserve_cmds(enc, 2 * n + 2);
+	if (c == NULL)
+		return;
+	const double *q = enc->q.pp;
+	*c++ = MVT_COMMAND(MVT_MOVETO, 1);
+	c = mvt_put_vertex(enc, c, q);
+	*c++ = MVT_COMMAND(MVT_LINETO, n - 1);
+	for (size_t i = 1; i < n; i++)
+		c = mvt_put_vertex(enc, c, q + 2 * i);
+	enc->len = (size_t)(c - enc->cmds);
+}
+
+/// @brief write the ring in enc->q, backwards when \a reverse is set, the
+/// first vertex stays first either way
+static void
+mvt_emit_ring(mvt_encoder *enc, size_t n, int reverse)
+{
+	if (n >= MVT_COUNT_MAX)
+	{
+		enc->error = LW_TRUE;
+		return;
+	}
+	uint32_t *c = mvt_reserve_cmds(enc, 2 * n + 3);
+	if (c == NULL)
+		return;
+	const double *q = enc->q.pp;
+	*c++ = MVT_COMMAND(MVT_MOVETO, 1);
+	c = mvt_put_vertex(enc, c, q);
+	*c++ = MVT_COMMAND(MVT_LINETO, n - 1);
+	for (size_t i = 1; i < n; i++)
+		c = mvt_put_vertex(enc, c, q + 2 * (reverse ? n - i : i));
+	*c++ = MVT_COMMAND(MVT_CLOSEPATH, 1);
+	enc->len = (size_t)(c - enc->cmds);
+}
+
+/// @brief Liang-Barsky clipping of the segment \a p, \a q to the buffered
+/// tile, both ends are moved onto the boundary when they lie outside
+/// @return 0 when nothing is left, otherwise 1, or 3 when \a q was moved
+static int
+mvt_clip_segment(const double *clip, double *p, double *q)
+{
+	double dx = q[0] - p[0];
+	double dy = q[1] - p[1];
+	double pk[4] = {-dx, -dy, dx, dy};
+	double qk[4] = {p[0] - clip[0], p[1] - clip[1], clip[2] - p[0], clip[3] - p[1]};
+	double t0 = 0.0;
+	double t1 = 1.0;
+	for (int k = 0; k < 4; k++)
+	{
+		if (pk[k] == 0.0)
+		{
+			if (qk[k] < 0.0)
+				return 0;
+			continue;
+		}
+		double t = qk[k] / pk[k];
+		if (pk[k] < 0.0)
+		{
+			if (t > t1)
+				return 0;
+			if (t > t0)
+				t0 = t;
+		}
+		else
+		{
+			if (t < t0)
+				return 0;
+			if (t < t1)
+				t1 = t;
+		}
+	}
+	double x = p[0];
+	double y = p[1];
+	if (t1 < 1.0)
+	{
+		q[0] = x + t1 * dx;
+		q[1] = y + t1 * dy;
+	}
+	if (t0 > 0.0)
+	{
+		p[0] = x + t0 * dx;
+		p[1] = y + t0 * dy;
+	}
+	return t1 < 1.0 ? 3 : 1;
+}
+
+/// @brief quantize and write the clipped piece collected in enc->b
+static void
+mvt_flush_part(mvt_encoder *enc)
+{
+	if (enc->b.npoints >= 2)
+	{
+		size_t n = mvt_quantize(enc, enc->b.pp, enc->b.npoints, LW_FALSE);
+		if (n >= 2)
+			mvt_emit_line(enc, n);
+	}
+	enc->b.npoints = 0;
+}
+
+static void
+mvt_encode_line(mvt_encoder *enc, const LWGEOM *obj)
+{
+	double box[4];
+	if (obj->npoints < 2)
+		return;
+	mvt_envelope(enc, &obj->env, box);
+	if (mvt_box_outside(enc, box))
+		return;
+	const double *pp = mvt_transform(enc, obj);
+	if (pp == NULL)
+		return;
+
+	if (mvt_box_inside(enc, box))
+	{
+		size_t n = mvt_quantize(enc, pp, obj->npoints, LW_FALSE);
+		if (n >= 2)
+			mvt_emit_line(enc, n);
+		return;
+	}
+
+	// a line that leaves the tile and comes back becomes several lines
+	enc->b.npoints = 0;
+	for (uint32_t i = 0; i + 1 < obj->npoints; i++)
+	{
+		double p[2] = {pp[2 * i], pp[2 * i + 1]};
+		double q[2] = {pp[2 * i + 2], pp[2 * i + 3]};
+		int r = mvt_clip_segment(enc->clip, p, q);
+		if (r == 0)
+		{
+			mvt_flush_part(enc);
+			continue;
+		}
+		double *part = mvt_reserve_points(enc, &enc->b, enc->b.npoints + 2);
+		if (part == NULL)
+			return;
+		if (enc->b.npoints == 0)
+		{
+			part[0] = p[0];
+			part[1] = p[1];
+			enc->b.npoints = 1;
+		}
+		part[2 * enc->b.npoints] = q[0];
+		part[2 * enc->b.npoints + 1] = q[1];
+		enc->b.npoints++;
+		if (r & 2)
+			mvt_flush_part(enc);
+	}
+	mvt_flush_part(enc);
+}
+
+/// @brief Sutherland-Hodgman clipping of an open ring of \a n vertices in
+/// enc->a against the four sides of the buffered tile, the pieces outside
+/// collapse onto the tile border
+/// @return the clipped ring and its vertex count in \a n
+static const double *
+mvt_clip_ring(mvt_encoder *enc, size_t *n)
+{
+	mvt_points *src = &enc->a;
+	mvt_points *dst = &enc->b;
+	size_t count = *n;
+	for (int side = 0; side < 4 && count > 0; side++)
+	{
+		// every input edge adds at most two vertices
+		double *out = mvt_reserve_points(enc, dst, 2 * count);
+		if (out == NULL)
+			return NULL;
+		int axis = side & 1;
+		int lower = side < 2;
+		double bound = enc->clip[side];
+		const double *in = src->pp;
+		const double *prev = in + 2 * (count - 1);
+		int prev_in = lower ? prev[axis] >= bound : prev[axis] <= bound;
+		size_t m = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			const double *cur = in + 2 * i;
+			int cur_in = lower ? cur[axis] >= bound : cur[axis] <= bound;
+			if (cur_in != prev_in)
+			{
+				double t = (bound - prev[axis]) / (cur[axis] - prev[axis]);
+				out[2 * m + axis] = bound;
+				out[2 * m + 1 - axis] = prev[1 - axis] + t * (cur[1 - axis] - prev[1 - axis]);
+				m++;
+			}
+			if (cur_in)
+			{
+				out[2 * m] = cur[0];
+				out[2 * m + 1] = cur[1];
+				m++;
+			}
+			prev = cur;
+			prev_in = cur_in;
+		}
+		count = m;
+		mvt_points *t = src;
+		src = dst;
+		dst = t;
+	}
+	*n = count;
+	return src->pp;
+}
+
+static void
+mvt_encode_polygon(mvt_encoder *enc, const LWGEOM *obj)
+{
+	double box[4];
+	if (obj->ngeoms == 0)
+		return;
+	mvt_envelope(enc, &obj->env, box);
+	if (mvt_box_outside(enc, box))
+		return;
+	int clip = !mvt_box_inside(enc, box);
+
+	for (uint32_t i = 0; i < obj->ngeoms; i++)
+	{
+		// the shell comes first, without it the holes don't matter
+		int shell = i == 0;
+		const LWGEOM *ring = obj->geoms[i];
+		if (ring->npoints < 4)
+		{
+			if (shell)
+				return;
+			continue;
+		}
+		const double *pp = mvt_transform(enc, ring);
+		if (pp == NULL)
+			return;
+		size_t n = ring->npoints - 1;
+		if (clip)
+		{
+			pp = mvt_clip_ring(enc, &n);
+			if (pp == NULL)
+				return;
+		}
+		n = mvt_quantize(enc, pp, n, LW_TRUE);
+		if (n < 3)
+		{
+			if (shell)
+				return;
+			continue;
+		}
+
+		// exterior rings have a positive area in grid units, which is
+		// clockwise on screen since y grows down, holes the other way
+		double *q = enc->q.pp;
+		q[2 * n] = q[0];
+		q[2 * n + 1] = q[1];
+		int ccw = nv_ccw(q, (int)(n + 1), 2);
+		mvt_emit_ring(enc, n, ccw != shell);
+	}
+}
+
+static void
+mvt_add_point(mvt_encoder *enc, const double *p)
+{
+	double x = p[0] * enc->scale[0] + enc->offset[0];
+	double y = p[1] * enc->scale[1] + enc->offset[1];
+	if (!(x >= enc->clip[0] && x <= enc->clip[2] && y >= enc->clip[1] && y <= enc->clip[3]))
+		return;
+	size_t m = enc->q.npoints;
+	double *q = mvt_reserve_points(enc, &enc->q, m + 1);
+	if (q == NULL)
+		return;
+	x = floor(x + 0.5);
+	y = floor(y + 0.5);
+	if (m > 0 && x == q[2 * m - 2] && y == q[2 * m - 1])
+		return;
+	q[2 * m] = x;
+	q[2 * m + 1] = y;
+	enc->q.npoints = m + 1;
+}
+
+/// @brief the feature type, a collection keeps only its members of the
+/// highest dimension
+static uint8_t
+mvt_type(const LWGEOM *obj)
+{
+	switch (obj->type)
+	{
+	case POINTTYPE:
+		return obj->npoints ? MVT_POINT : 0;
+	case LINETYPE:
+		return obj->npoints ? MVT_LINESTRING : 0;
+	case POLYTYPE:
+		return obj->ngeoms ? MVT_POLYGON : 0;
+	default: {
+		uint8_t type = 0;
+		for (uint32_t i = 0; i < obj->ngeoms && type < MVT_POLYGON; i++)
+			type = LWMAX(type, mvt_type(obj->geoms[i]));
+		return type;
+	}
+	}
+}
+
+static void
+mvt_encode(mvt_encoder *enc, const LWGEOM *obj, uint8_t type)
+{
+	switch (obj->type)
+	{
+	case POINTTYPE:
+		if (type == MVT_POINT && obj->npoints > 0)
+			mvt_add_point(enc, obj->pp);
+		break;
+	case LINETYPE:
+		if (type == MVT_LINESTRING)
+			mvt_encode_line(enc, obj);
+		break;
+	case POLYTYPE:
+		if (type == MVT_POLYGON)
+			mvt_encode_polygon(enc, obj);
+		break;
+	default:
+		for (uint32_t i = 0; i < obj->ngeoms && !enc->error; i++)
+			mvt_encode(enc, obj->geoms[i], type);
+		break;
+	}
+}
+
+/// @brief encode \a obj into enc->cmds, nothing is written when it falls
+/// outside the buffered tile
+/// @return the feature type, 0 when the geometry was clipped away, -1 on error
+static int
+mvt_encode_geometry(mvt_encoder *enc, const LWGEOM *obj)
+{
+	enc->len = 0;
+	enc->cursor[0] = enc->cursor[1] = 0;
+	enc->q.npoints = 0;
+
+	uint8_t type = mvt_type(obj);
+	if (type == 0)
+		return 0;
+	mvt_encode(enc, obj, type);
+	if (type == MVT_POINT && enc->q.npoints > 0)
+	{
+		// all the points of a multipoint share one MoveTo
+		size_t n = enc->q.npoints;
+		uint32_t *c = n < MVT_COUNT_MAX ? mvt_reserve_cmds(enc, 2 * n + 1) : NULL;
+		if (c != NULL)
+		{
+			*c++ = MVT_COMMAND(MVT_MOVETO, n);
+			for (size_t i = 0; i < n; i++)
+				c = mvt_put_vertex(enc, c, enc->q.pp + 2 * i);
+			enc->len = (size_t)(c - enc->cmds);
+		}
+		else
+			enc->error = LW_TRUE;
+	}
+	if (enc->error)
+		return -1;
+	return enc->len ? type : 0;
+}
+
+static uint8_t *
+mvt_reserve(mvt_buffer *buf, size_t n)
+{
+	if (buf->error)
+		return NULL;
+	if (buf->len + n > buf->capacity)
+	{
+		size_t capacity = buf->capacity ? buf->capacity : 4096;
+		while (buf->len + n > capacity)
+			capacity *= 2;
+		uint8_t *data = (uint8_t *)lwrealloc(buf->data, capacity);
+		if (data == NULL)
+		{
+			buf->error = LW_TRUE;
+			return NULL;
+		}
+		buf->data = data;
+		buf->capacity = capacity;
+	}
+	return buf->data + buf->len;
+}
+
+static inline uint8_t *
+mvt_put_uvarint(uint8_t *p, uint64_t v)
+{
+	while (v >= 0x80)
+	{
+		*p++ = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+static inline size_t
+mvt_uvarint_size(uint64_t v)
+{
+	size_t n = 1;
+	while (v >= 0x80)
+	{
+		v >>= 7;
+		n++;
+	}
+	return n;
+}
+
+/// @brief append one Feature message with the geometry in enc->cmds
+static void
+mvt_write_feature(mvt_buffer *buf, const mvt_encoder *enc, int type, const uint64_t *id)
+{
+	size_t geomsize = 0;
+	for (size_t i = 0; i < enc->len; i++)
+		geomsize += mvt_uvarint_size(enc->cmds[i]);
+	size_t size = 2 + 1 + mvt_uvarint_size(geomsize) + geomsize;
+	if (id)
+		size += 1 + mvt_uvarint_size(*id);
+
+	uint8_t *p = mvt_reserve(buf, 1 + mvt_uvarint_size(size) + size);
+	if (p == NULL)
+		return;
+	*p++ = MVT_KEY(MVT_LAYER_FEATURES, MVT_WIRE_LENGTH);
+	p = mvt_put_uvarint(p, size);
+	if (id)
+	{
+		*p++ = MVT_KEY(MVT_FEATURE_ID, MVT_WIRE_VARINT);
+		p = mvt_put_uvarint(p, *id);
+	}
+	*p++ = MVT_KEY(MVT_FEATURE_TYPE, MVT_WIRE_VARINT);
+	*p++ = (uint8_t)type;
+	*p++ = MVT_KEY(MVT_FEATURE_GEOMETRY, MVT_WIRE_LENGTH);
+	p = mvt_put_uvarint(p, geomsize);
+	for (size_t i = 0; i < enc->len; i++)
+		p = mvt_put_uvarint(p, enc->cmds[i]);
+	buf->len = (size_t)(p - buf->data);
+}
+
+/* ------------------------------- output mvt ------------------------------- */
+
+/// @brief encode one geometry as Mapbox Vector Tile command integers,
+/// coordinates are rounded to the tile grid, clipped to the tile plus its
+/// buffer and polygon rings are wound as the specification requires
+/// @param geometry receives the commands allocated with lwmalloc, or NULL
+/// when nothing of the geometry is left inside the tile
+/// @param type receives the feature type, 1 point, 2 line, 3 polygon or 0
+int
+lwgeom_write_mvt(const LWGEOM *obj, const LWMVT_TILE *tile, uint32_t **geometry, size_t *len, uint8_t *type)
+{
+	mvt_encoder enc;
+	if (obj == NULL || geometry == NULL || !mvt_init(&enc, tile))
+		return LW_FAILURE;
+
+	int t = mvt_encode_geometry(&enc, obj);
+	if (t < 0)
+	{
+		mvt_free(&enc);
+		return LW_FAILURE;
+	}
+	*geometry = NULL;
+	if (t > 0)
+	{
+		*geometry = enc.cmds;
+		enc.cmds = NULL;
+	}
+	if (len)
+		*len = enc.len;
+	if (type)
+		*type = (uint8_t)t;
+	mvt_free(&enc);
+	return LW_SUCCESS;
+}
+
+/// @brief encode a whole layer into one protobuf Tile message, features
+/// that fall outside the tile and NULL geometries are left out, tiles of
+/// several layers are the concatenation of their layer outputs
+/// @param ids feature ids, may be NULL
+/// @param name layer name
+/// @param data receives the tile allocated with lwmalloc
+int
+lwgeom_write_mvt_layer(LWGEOM *const *geoms,
+		       const uint64_t *ids,
+		       size_t count,
+		       const char *name,
+		       const LWMVT_TILE *tile,
+		       char **data,
+		       size_t *len)
+{
+	mvt_encoder enc;
+	if (geoms == NULL || name == NULL || data == NULL || !mvt_init(&enc, tile))
+		return LW_FAILURE;
+
+	mvt_buffer buf = {0};
+	size_t namelen = strlen(name);
+	uint8_t *p = mvt_reserve(&buf, 1 + MVT_VARINT_MAX + 1 + MVT_VARINT_MAX + namelen);
+	if (p != NULL)
+	{
+		*p++ = MVT_KEY(MVT_TILE_LAYERS, MVT_WIRE_LENGTH);
+		p += MVT_VARINT_MAX;
+		*p++ = MVT_KEY(MVT_LAYER_NAME, MVT_WIRE_LENGTH);
+		p = mvt_put_uvarint(p, namelen);
+		memcpy(p, name, namelen);
+		buf.len = (size_t)(p + namelen - buf.data);
+	}
+
+	for (size_t i = 0; i < count && !buf.error; i++)
+	{
+		if (geoms[i] == NULL)
+			continue;
+		int type = mvt_encode_geometry(&enc, geoms[i]);
+		if (type < 0)
+			buf.error = LW_TRUE;
+		else if (type > 0)
+			mvt_write_feature(&buf, &enc, type, ids ? ids + i : NULL);
+	}
+	mvt_free(&enc);
+
+	p = mvt_reserve(&buf, 2 + MVT_VARINT_MAX + 1);
+	if (p == NULL)
+	{
+		lwfree(buf.data);
+		return LW_FAILURE;
+	}
+	*p++ = MVT_KEY(MVT_LAYER_EXTENT, MVT_WIRE_VARINT);
+	p = mvt_put_uvarint(p, tile->extent);
+	*p++ = MVT_KEY(MVT_LAYER_VERSION, MVT_WIRE_VARINT);
+	*p++ = 2;
+	buf.len = (size_t)(p - buf.data);
+
+	// the layer length was reserved up front, the body moves up to it
+	size_t body = buf.len - 1 - MVT_VARINT_MAX;
+	size_t size = mvt_uvarint_size(body);
+	mvt_put_uvarint(buf.data + 1, body);
+	memmove(buf.data + 1 + size, buf.data + 1 + MVT_VARINT_MAX, body);
+	buf.len = 1 + size + body;
+
+	*data = (char *)buf.data;
+	if (len)
+		*len = buf.len;
+	return LW_SUCCESS;
+}
@@ -23,8 +23,285 @@
 #include "liblwgeom.h"
 #include "liblwgeom_internel.h"
 
+#include "lwpool.h"
+#include <string.h>
+
+/* ------------------------------- inner ora -------------------------------- */
+
+/// rows converted per task by the batch writer
+#define ORA_BATCH_BLOCK 256
+
+typedef struct {
+	int *elem_info;
+	double *ordinates;
+	size_t nelem; ///< integers written to elem_info
+	size_t nord;  ///< doubles written to ordinates
+} ora_writer;
+
+/// @brief SDO_GTYPE of \a obj, DLTT with the LRS measure last
+static int
+ora_gtype(const LWGEOM *obj)
+{
+	static const int tt[] = {0, 1, 2, 3, 5, 6, 7, 4};
+	int hasz = lwgeom_has_z(obj);
+	int hasm = lwgeom_has_m(obj);
+	int d = 2 + hasz + hasm;
+	int l = hasm ? d : 0;
+	return d * 1000 + l * 100 + (obj->type <= COLLECTIONTYPE ? tt[obj->type] : 0);
+}
+
+/// @brief count the elem_info integers and ordinates needed for \a obj
+static void
+ora_size(const LWGEOM *obj, size_t *nelem, size_t *nord)
+{
+	int cdim = lwgeom_dim_coordinate(obj);
+	switch (obj->type)
+	{
+	case POINTTYPE:
+	case LINETYPE:
+		if (obj->npoints == 0)
+			return;
+		*nelem += 3;
+		*nord += (size_t)obj->npoints * cdim;
+		return;
+	case MPOINTTYPE:
+	{
+		// all points go into a single point cluster
+		size_t n = 0;
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			n += obj->geoms[i]->npoints;
+		if (n == 0)
+			return;
+		*nelem += 3;
+		*nord += n * cdim;
+		return;
+	}
+	default:
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			ora_size(obj->geoms[i], nelem, nord);
+		return;
+	}
+}
+
+static void
+ora_element(ora_writer *w, int etype, int interp)
+{
+	w->elem_info[w->nelem++] = (int)w->nord + 1;
+	w->elem_info[w->nelem++] = etype;
+	w->elem_info[w->nelem++] = interp;
+}
+
+/// @brief twice the signed area of a ring, positive when counterclockwise
+static double
+ora_ring_area(const LWGEOM *ring)
+{
+	int cdim = lwgeom_dim_coordinate(ring);
+	const double *pp = ring->pp;
+	double area = 0;
+	for (uint32_t k = 0; k + 1 < ring->npoints; k++, pp += cdim)
+		area += pp[0] * pp[cdim + 1] - pp[cdim] * pp[1];
+	return area;
+}
+
+/// @brief write the vertices of \a obj, backwards when \a reverse is set
+static void
+ora_ordinates(ora_writer *w, const LWGEOM *obj, int reverse)
+{
+	if (obj->npoints == 0)
+		return;
+	size_t cdim = (size_t)lwgeom_dim_coordinate(obj);
+	size_t n = (size_t)obj->npoints * cdim;
+	if (!reverse)
+		memcpy(w->ordinates + w->nord, obj->pp, n * sizeof(double));
+	else
+		for (size_t v = 0; v < obj->npoints; v++)
+			memcpy(w->ordinates + w->nord + v * cdim, obj->pp + (obj->npoints - 1 - v) * cdim, cdim * sizeof(double));
+	w->nord += n;
+}
+
+/// @brief write the polygon rings, Oracle wants the exterior ring
+/// counterclockwise and the interior rings clockwise
+static void
+ora_polygon(ora_writer *w, const LWGEOM *poly)
+{
+	for (uint32_t i = 0; i < poly->ngeoms; i++)
+	{
+		const LWGEOM *ring = poly->geoms[i];
+		if (ring->npoints == 0)
+			continue;
+		int shell = i == 0;
+		ora_element(w, shell ? 1003 : 2003, 1);
+		ora_ordinates(w, ring, (ora_ring_area(ring) > 0) != shell);
+	}
+}
+
+static void
+ora_write(ora_writer *w, const LWGEOM *obj)
+{
+	switch (obj->type)
+	{
+	case POINTTYPE:
+	case LINETYPE:
+		if (obj->npoints == 0)
+			return;
+		ora_element(w, obj->type == POINTTYPE ? 1 : 2, 1);
+		ora_ordinates(w, obj, LW_FALSE);
+		return;
+	case POLYTYPE:
+		ora_polygon(w, obj);
+		return;
+	case MPOINTTYPE:
+	{
+		size_t first = w->nelem;
+		ora_element(w, 1, 0);
+		int n = 0;
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			ora_ordinates(w, obj->geoms[i], LW_FALSE);
+			n += (int)obj->geoms[i]->npoints;
+		}
+		if (n == 0)
+			w->nelem = first;
+		else
+			w->elem_info[first + 2] = n;
+		return;
+	}
+	default:
+		// members of nested collections are flattened, SDO has no nesting
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			ora_write(w, obj->geoms[i]);
+		return;
+	}
+}
+
+/// @brief fill \a sdo for \a obj with its arrays at the given addresses
+static void
+ora_fill(const LWGEOM *obj, LWGEOM_SDO *sdo, int *elem_info, double *ordinates)
+{
+	ora_writer w = {elem_info, ordinates, 0, 0};
+	ora_write(&w, obj);
+	sdo->sdo_gtype = ora_gtype(obj);
+	sdo->sdo_srid = 0;
+	sdo->sdo_elem_count = w.nelem;
+	sdo->sdo_elem_info = elem_info;
+	sdo->sdo_ord_count = w.nord;
+	sdo->sdo_ordinates = ordinates;
+}
+
+/* ------------------------------- output ora ------------------------------- */
+
+/// @brief convert \a obj to an Oracle SDO_GEOMETRY, the arrays are allocated
+/// with lwmalloc and owned by the caller. SDO_SRID is left 0.
 int
 lwgeom_write_ora(const LWGEOM *obj, LWGEOM_SDO *sdo)
 {
-	return 0;
-}
\ No newline at end of file
+	if (obj == NULL || sdo == NULL)
+		return LW_FAILURE;
+
+	size_t nelem = 0, nord = 0;
+	ora_size(obj, &nelem, &nord);
+	int *elem_info = nelem ? (int *)lwmalloc(nelem * sizeof(int)) : NULL;
+	double *ordinates = nord ? (double *)lwmalloc(nord * sizeof(double)) : NULL;
+	if ((nelem && elem_info == NULL) || (nord && ordinates == NULL))
+	{
+		lwfree(elem_info);
+		lwfree(ordinates);
+		return LW_FAILURE;
+	}
+	ora_fill(obj, sdo, elem_info, ordinates);
+	return LW_SUCCESS;
+}
+
+typedef struct {
+	LWGEOM *const *geoms;
+	size_t count;
+	LWGEOM_SDO *sdos;
+	size_t *starts; ///< first elem_info integer and ordinate of every row
+	int *elem_info;
+	double *ordinates;
+} ora_batch;
+
+static void
+ora__size_block(size_t index, void *udata)
+{
+	ora_batch *b = (ora_batch *)udata;
+	size_t last = LWMIN((index + 1) * ORA_BATCH_BLOCK, b->count);
+	for (size_t i = index * ORA_BATCH_BLOCK; i < last; i++)
+	{
+		LWGEOM_SDO *sdo = &b->sdos[i];
+		memset(sdo, 0, sizeof(*sdo));
+		if (b->geoms[i])
+			ora_size(b->geoms[i], &sdo->sdo_elem_count, &sdo->sdo_ord_count);
+	}
+}
+
+static void
+ora__fill_block(size_t index, void *udata)
+{
+	ora_batch *b = (ora_batch *)udata;
+	size_t last = LWMIN((index + 1) * ORA_BATCH_BLOCK, b->count);
+	for (size_t i = index * ORA_BATCH_BLOCK; i < last; i++)
+	{
+		LWGEOM_SDO *sdo = &b->sdos[i];
+		int *elem_info = b->elem_info + b->starts[2 * i];
+		double *ordinates = b->ordinates + b->starts[2 * i + 1];
+		if (b->geoms[i])
+			ora_fill(b->geoms[i], sdo, elem_info, ordinates);
+		else
+		{
+			sdo->sdo_elem_info = elem_info;
+			sdo->sdo_ordinates = ordinates;
+		}
+	}
+}
+
+/// @brief convert an array of geometries for an array bind. All rows share
+/// one elem_info and one ordinate array, every LWGEOM_SDO points at its own
+/// range in them, so the arrays bound for the whole batch take two
+/// allocations.
+/// @param sdos receives \a count rows, a NULL geometry gives SDO_GTYPE 0
+/// @param elem_info receives the shared elem_info array, free with lwfree
+/// @param ordinates receives the shared ordinate array, free with lwfree
+int
+lwgeom_write_ora_batch(LWGEOM *const *geoms,
+		       size_t count,
+		       int nthreads,
+		       LWGEOM_SDO *sdos,
+		       int **elem_info,
+		       double **ordinates)
+{
+	if (geoms == NULL || sdos == NULL || elem_info == NULL || ordinates == NULL)
+		return LW_FAILURE;
+
+	ora_batch b = {geoms, count, sdos, NULL, NULL, NULL};
+	b.starts = (size_t *)lwmalloc(LWMAX(count, 1) * 2 * sizeof(size_t));
+	if (b.starts == NULL)
+		return LW_FAILURE;
+	size_t nblocks = (count + ORA_BATCH_BLOCK - 1) / ORA_BATCH_BLOCK;
+	lwpool_run(nblocks, nthreads, ora__size_block, &b);
+
+	size_t nelem = 0, nord = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		b.starts[2 * i] = nelem;
+		b.starts[2 * i + 1] = nord;
+		nelem += sdos[i].sdo_elem_count;
+		nord += sdos[i].sdo_ord_count;
+	}
+	b.elem_info = (int *)lwmalloc(LWMAX(nelem, 1) * sizeof(int));
+	b.ordinates = (double *)lwmalloc(LWMAX(nord, 1) * sizeof(double));
+	if (b.elem_info == NULL || b.ordinates == NULL)
+	{
+		lwfree(b.starts);
+		lwfree(b.elem_info);
+		lwfree(b.ordinates);
+		memset(sdos, 0, count * sizeof(LWGEOM_SDO));
+		return LW_FAILURE;
+	}
+	lwpool_run(nblocks, nthreads, ora__fill_block, &b);
+	lwfree(b.starts);
+
+	*elem_info = b.elem_info;
+	*ordinates = b.ordinates;
+	return LW_SUCCESS;
+}
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+
+#include "lwgeom_sink.h"
+#include <math.h>
+
+/* ----------------------------- inner polyline ----------------------------- */
+
+/// longest encoding of one value, 5 bits a character
+#define POLYLINE_VALUE_MAX 13
+/// largest grid value, deltas then stay well inside 64 bits
+#define POLYLINE_GRID_MAX 9007199254740992.0
+
+static inline char *
+polyline_put(char *p, int64_t delta)
+{
+	uint64_t v = (uint64_t)delta << 1;
+	if (delta < 0)
+		v = ~v;
+	while (v >= 0x20)
+	{
+		*p++ = (char)((0x20 | (v & 0x1f)) + 63);
+		v >>= 5;
+	}
+	*p++ = (char)(v + 63);
+	return p;
+}
+
+/* ----------------------------- output polyline ---------------------------- */
+
+/// @brief write the vertices of a linestring or point as an Encoded Polyline,
+/// latitude (y) first. Z and M are dropped
+/// @param precision decimal places kept, 5 for the classic format and 6 for
+/// routing engines that use 1e6
+int
+lwgeom_write_polyline_to(const LWGEOM *obj, int precision, LWSINK *sink)
+{
+	if (obj == NULL || sink == NULL || (obj->type != LINETYPE && obj->type != POINTTYPE) || precision < 0 ||
+	    precision > 10)
+		return LW_FAILURE;
+
+	size_t mark = lwsink__begin(sink);
+	double factor = pow(10, precision);
+	int cdim = lwgeom_dim_coordinate(obj);
+	const double *pp = obj->pp;
+	int64_t last_x = 0, last_y = 0;
+	for (uint32_t i = 0; i < obj->npoints; i++, pp += cdim)
+	{
+		double x = round(pp[0] * factor), y = round(pp[1] * factor);
+		if (!(fabs(x) < POLYLINE_GRID_MAX && fabs(y) < POLYLINE_GRID_MAX))
+		{
+			lwsink__fail(sink);
+			break;
+		}
+		char *p = lwsink__reserve(sink, 2 * POLYLINE_VALUE_MAX);
+		if (p == NULL)
+			break;
+		char *start = p;
+		p = polyline_put(p, (int64_t)y - last_y);
+		p = polyline_put(p, (int64_t)x - last_x);
+		lwsink__commit(sink, (size_t)(p - start));
+		last_x = (int64_t)x;
+		last_y = (int64_t)y;
+	}
+	return lwsink__end(sink, mark);
+}
+
+int
+lwgeom_write_polyline(const LWGEOM *obj, int precision, char **polyline, size_t *len)
+{
+	if (obj == NULL || polyline == NULL)
+		return LW_FAILURE;
+
+	LWSINK sink;
+	lwsink__init(&sink, LWSINK_BUFFER, NULL, 0, 0);
+	if (!lwgeom_write_polyline_to(obj, precision, &sink) || lwsink_data(&sink, NULL) == NULL)
+	{
+		lwfree(sink.data);
+		return LW_FAILURE;
+	}
+	*polyline = sink.data;
+	if (len)
+		*len = sink.len;
+	return LW_SUCCESS;
+}
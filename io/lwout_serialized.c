@@ -0,0 +1,202 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+
+#include "lwgeom_serialized.h"
+#include <math.h>
+
+/* --------------------------- inner serialized ----------------------------- */
+
+typedef struct {
+	uint8_t *cur;
+	int cdim;
+	lwflags_t dims;
+} ser_writer;
+
+/// @brief bytes of the body of \a obj, 0 when a member has other dimensions
+/// than the geometry
+static size_t
+ser_body_size(const LWGEOM *obj, lwflags_t dims)
+{
+	if ((obj->flags & (LW_FLAG_Z | LW_FLAG_M)) != dims)
+		return 0;
+	size_t cdim = (size_t)lwgeom_dim_coordinate(obj);
+	size_t size = 8;
+	switch (obj->type)
+	{
+	case POINTTYPE:
+	case LINETYPE:
+		return size + (size_t)obj->npoints * cdim * sizeof(double);
+	case POLYTYPE:
+		size += ((size_t)obj->ngeoms * 4 + 7) & ~(size_t)7;
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			if ((obj->geoms[i]->flags & (LW_FLAG_Z | LW_FLAG_M)) != dims)
+				return 0;
+			size += (size_t)obj->geoms[i]->npoints * cdim * sizeof(double);
+		}
+		return size;
+	case MPOINTTYPE:
+	case MLINETYPE:
+	case MPOLYTYPE:
+	case COLLECTIONTYPE:
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			size_t member = ser_body_size(obj->geoms[i], dims);
+			if (member == 0)
+				return 0;
+			size += member;
+		}
+		return size;
+	default:
+		return 0;
+	}
+}
+
+static void
+ser_write_points(ser_writer *w, const LWGEOM *obj)
+{
+	size_t n = (size_t)obj->npoints * w->cdim * sizeof(double);
+	if (n > 0)
+		memcpy(w->cur, obj->pp, n);
+	w->cur += n;
+}
+
+static void
+ser_write_body(ser_writer *w, const LWGEOM *obj)
+{
+	ser_store_u32(w->cur, obj->type);
+	switch (obj->type)
+	{
+	case POINTTYPE:
+	case LINETYPE:
+		ser_store_u32(w->cur + 4, obj->npoints);
+		w->cur += 8;
+		ser_write_points(w, obj);
+		break;
+	case POLYTYPE: {
+		ser_store_u32(w->cur + 4, obj->ngeoms);
+		w->cur += 8;
+		size_t counts = ((size_t)obj->ngeoms * 4 + 7) & ~(size_t)7;
+		memset(w->cur, 0, counts);
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			ser_store_u32(w->cur + 4 * (size_t)i, obj->geoms[i]->npoints);
+		w->cur += counts;
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			ser_write_points(w, obj->geoms[i]);
+		break;
+	}
+	default:
+		ser_store_u32(w->cur + 4, obj->ngeoms);
+		w->cur += 8;
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			ser_write_body(w, obj->geoms[i]);
+		break;
+	}
+}
+
+/// @brief float bounds that hold \a lo and \a hi
+static void
+ser_round_out(double lo, double hi, float *flo, float *fhi)
+{
+	*flo = (float)lo;
+	if ((double)*flo > lo)
+		*flo = nextafterf(*flo, -INFINITY);
+	*fhi = (float)hi;
+	if ((double)*fhi < hi)
+		*fhi = nextafterf(*fhi, INFINITY);
+}
+
+static int
+ser_has_box(const LWGEOM *obj)
+{
+	return obj->type != POINTTYPE && !lwgeom__is_empty(obj);
+}
+
+/* --------------------------- output serialized ---------------------------- */
+
+/// @brief bytes of the serialized form of \a obj, 0 when it cannot be
+/// serialized
+size_t
+lwgeom_serialized_size(const LWGEOM *obj)
+{
+	if (obj == NULL)
+		return 0;
+	size_t body = ser_body_size(obj, obj->flags & (LW_FLAG_Z | LW_FLAG_M));
+	if (body == 0)
+		return 0;
+	size_t size = SER_HEADER_SIZE + (ser_has_box(obj) ? SER_BOX_SIZE : 0) + body;
+	return size > UINT32_MAX ? 0 : size;
+}
+
+/// @brief serialize \a obj into \a buf, nothing is allocated
+/// @return bytes written, 0 when \a size is too small or \a obj cannot be
+/// serialized
+size_t
+lwgeom_write_serialized_buffer(const LWGEOM *obj, char *buf, size_t size)
+{
+	size_t need = lwgeom_serialized_size(obj);
+	if (need == 0 || need > size || buf == NULL)
+		return 0;
+
+	uint8_t *p = (uint8_t *)buf;
+	uint8_t flags = (uint8_t)((lwgeom_has_z(obj) ? SER_FLAG_Z : 0) | (lwgeom_has_m(obj) ? SER_FLAG_M : 0));
+	if (ser_has_box(obj))
+		flags |= SER_FLAG_BOX;
+	ser_store_u32(p, (uint32_t)need);
+	p[4] = obj->type;
+	p[5] = flags;
+	p[6] = p[7] = 0;
+	p += SER_HEADER_SIZE;
+	if (flags & SER_FLAG_BOX)
+	{
+		float box[4];
+		ser_round_out(obj->env.xmin, obj->env.xmax, &box[0], &box[2]);
+		ser_round_out(obj->env.ymin, obj->env.ymax, &box[1], &box[3]);
+		memcpy(p, box, sizeof(box));
+		p += SER_BOX_SIZE;
+	}
+	ser_writer w = {p, lwgeom_dim_coordinate(obj), obj->flags & (LW_FLAG_Z | LW_FLAG_M)};
+	ser_write_body(&w, obj);
+	return need;
+}
+
+/// @brief serialize \a obj into a buffer allocated with lwmalloc, the buffer
+/// is 8 byte aligned so lwgeom_read_serialized_view can reference it
+int
+lwgeom_write_serialized(const LWGEOM *obj, char **data, size_t *len)
+{
+	if (data == NULL)
+		return LW_FAILURE;
+	size_t size = lwgeom_serialized_size(obj);
+	if (size == 0)
+		return LW_FAILURE;
+	char *buf = (char *)lwmalloc(size);
+	if (buf == NULL)
+		return LW_FAILURE;
+	lwgeom_write_serialized_buffer(obj, buf, size);
+	*data = buf;
+	if (len)
+		*len = size;
+	return LW_SUCCESS;
+}
@@ -0,0 +1,448 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "liblwgeom_internel.h"
+
+#include <math.h>
+#include <string.h>
+
+/* ------------------------------ inner twkb -------------------------------- */
+
+/// metadata header bits
+#define TWKB_BBOX     0x01
+#define TWKB_SIZE     0x02
+#define TWKB_IDLIST   0x04
+#define TWKB_EXTENDED 0x08
+#define TWKB_EMPTY    0x10
+
+/// room reserved for a varint before its value is known
+#define TWKB_VARINT_MAX 10
+
+typedef struct {
+	uint8_t *data;
+	size_t len;
+	size_t capacity;
+	int error;
+} twkb_buffer;
+
+/// Encoder state, the coordinate deltas run across all the parts of one
+/// geometry and restart at zero for every member of a collection.
+typedef struct {
+	uint8_t variant;
+	int precision[3]; ///< xy, z and m decimal digits
+	double factor[4]; ///< scale of every ordinate of a vertex
+	int cdim;
+	int64_t last[4];
+} twkb_state;
+
+static uint8_t *
+twkb_reserve(twkb_buffer *buf, size_t n)
+{
+	if (buf->error)
+		return NULL;
+	if (buf->len + n > buf->capacity)
+	{
+		size_t capacity = buf->capacity ? buf->capacity : 256;
+		while (buf->len + n > capacity)
+			capacity *= 2;
+		uint8_t *data = (uint8_t *)lwrealloc(buf->data, capacity);
+		if (data == NULL)
+		{
+			buf->error = LW_TRUE;
+			return NULL;
+		}
+		buf->data = data;
+		buf->capacity = capacity;
+	}
+	return buf->data + buf->len;
+}
+
+static inline uint8_t *
+twkb_put_uvarint(uint8_t *p, uint64_t v)
+{
+	while (v >= 0x80)
+	{
+		*p++ = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+static inline uint8_t *
+twkb_put_varint(uint8_t *p, int64_t v)
+{
+	// zigzag, small magnitudes of either sign get short codes
+	return twkb_put_uvarint(p, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static inline size_t
+twkb_uvarint_size(uint64_t v)
+{
+	size_t n = 1;
+	while (v >= 0x80)
+	{
+		v >>= 7;
+		n++;
+	}
+	return n;
+}
+
+static void
+twkb_write_uvarint(twkb_buffer *buf, uint64_t v)
+{
+	uint8_t *p = twkb_reserve(buf, TWKB_VARINT_MAX);
+	if (p)
+		buf->len = (size_t)(twkb_put_uvarint(p, v) - buf->data);
+}
+
+/// @brief round to the nearest integer at the encoding precision, values
+/// that don't fit 62 bits can't be encoded
+static inline int
+twkb_quantize(double v, double factor, int64_t *q)
+{
+	double s = v * factor;
+	if (!(fabs(s) < 4.0e18))
+		return LW_FALSE;
+	*q = (int64_t)(s + copysign(0.5, s));
+	return LW_TRUE;
+}
+
+/// vertices encoded per buffer reservation
+#define TWKB_BLOCK 256
+
+/// @brief write the vertices of \a obj as deltas, dropping vertices that
+/// round onto the previous one while more than \a minpoints remain
+/// @param count write the vertex count in front of the vertices
+static inline __attribute__((always_inline)) void
+twkb_encode(twkb_buffer *buf, twkb_state *st, const LWGEOM *obj, uint32_t minpoints, int count, int cdim)
+{
+	size_t countsize = count ? twkb_uvarint_size(obj->npoints) : 0;
+	if (twkb_reserve(buf, countsize) == NULL)
+		return;
+	size_t start = buf->len;
+	buf->len += countsize;
+
+	int64_t last[4];
+	double factor[4];
+	memcpy(last, st->last, sizeof(last));
+	memcpy(factor, st->factor, sizeof(factor));
+	const double *pp = obj->pp;
+	uint32_t written = 0;
+	for (uint32_t i = 0; i < obj->npoints;)
+	{
+		// reserve for a block of vertices at a time, the buffer only grows
+		// by what the encoding actually takes
+		uint32_t n = LWMIN(obj->npoints - i, (uint32_t)TWKB_BLOCK);
+		uint8_t *p = twkb_reserve(buf, (size_t)n * cdim * TWKB_VARINT_MAX);
+		if (p == NULL)
+			return;
+		for (uint32_t stop = i + n; i < stop; i++, pp += cdim)
+		{
+			int64_t q[4], delta[4];
+			int64_t moved = 0;
+			for (int k = 0; k < cdim; k++)
+			{
+				if (!twkb_quantize(pp[k], factor[k], &q[k]))
+				{
+					buf->error = LW_TRUE;
+					return;
+				}
+				delta[k] = q[k] - last[k];
+				moved |= delta[k];
+			}
+			if (moved == 0 && written > 0 && written + (obj->npoints - i - 1) >= minpoints)
+				continue;
+			for (int k = 0; k < cdim; k++)
+			{
+				p = twkb_put_varint(p, delta[k]);
+				last[k] = q[k];
+			}
+			written++;
+		}
+		buf->len = (size_t)(p - buf->data);
+	}
+	memcpy(st->last, last, sizeof(last));
+
+	if (count)
+	{
+		// fewer vertices may need a shorter count, then the deltas move up
+		size_t size = twkb_uvarint_size(written);
+		uint8_t *p = buf->data + start;
+		if (size < countsize)
+		{
+			memmove(p + size, p + countsize, buf->len - start - countsize);
+			buf->len -= countsize - size;
+		}
+		twkb_put_uvarint(p, written);
+	}
+}
+
+static void
+twkb_write_points(twkb_buffer *buf, twkb_state *st, const LWGEOM *obj, uint32_t minpoints, int count)
+{
+	switch (st->cdim)
+	{
+	case 2:
+		twkb_encode(buf, st, obj, minpoints, count, 2);
+		break;
+	case 3:
+		twkb_encode(buf, st, obj, minpoints, count, 3);
+		break;
+	default:
+		twkb_encode(buf, st, obj, minpoints, count, 4);
+		break;
+	}
+}
+
+/// @brief quantized extent of the Z and M ordinates of \a obj
+static int
+twkb_bounds(const twkb_state *st, const LWGEOM *obj, int64_t *min, int64_t *max, int *first)
+{
+	const double *pp = obj->pp;
+	for (uint32_t i = 0; i < obj->npoints; i++, pp += st->cdim)
+	{
+		for (int k = 2; k < st->cdim; k++)
+		{
+			int64_t q;
+			if (!twkb_quantize(pp[k], st->factor[k], &q))
+				return LW_FALSE;
+			if (*first || q < min[k])
+				min[k] = q;
+			if (*first || q > max[k])
+				max[k] = q;
+		}
+		*first = LW_FALSE;
+	}
+	for (uint32_t i = 0; i < obj->ngeoms; i++)
+	{
+		if (!twkb_bounds(st, obj->geoms[i], min, max, first))
+			return LW_FALSE;
+	}
+	return LW_TRUE;
+}
+
+static void twkb_write_geometry(twkb_buffer *buf, twkb_state *st, const LWGEOM *obj);
+
+static void
+twkb_write_body(twkb_buffer *buf, twkb_state *st, const LWGEOM *obj)
+{
+	switch (obj->type)
+	{
+	case POINTTYPE:
+		twkb_write_points(buf, st, obj, 1, LW_FALSE);
+		break;
+	case LINETYPE:
+		twkb_write_points(buf, st, obj, 2, LW_TRUE);
+		break;
+	case POLYTYPE:
+		twkb_write_uvarint(buf, obj->ngeoms);
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			twkb_write_points(buf, st, obj->geoms[i], 4, LW_TRUE);
+		break;
+	case MPOINTTYPE:
+	case MLINETYPE:
+	case MPOLYTYPE:
+	{
+		// empty parts have no encoding of their own and are left out
+		uint32_t n = 0;
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			n += !lwgeom__is_empty(obj->geoms[i]);
+		twkb_write_uvarint(buf, n);
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			if (!lwgeom__is_empty(obj->geoms[i]))
+				twkb_write_body(buf, st, obj->geoms[i]);
+		}
+		break;
+	}
+	case COLLECTIONTYPE:
+		twkb_write_uvarint(buf, obj->ngeoms);
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			twkb_write_geometry(buf, st, obj->geoms[i]);
+		break;
+	default:
+		buf->error = LW_TRUE;
+		break;
+	}
+}
+
+static void
+twkb_write_geometry(twkb_buffer *buf, twkb_state *st, const LWGEOM *obj)
+{
+	if (obj->type < POINTTYPE || obj->type > COLLECTIONTYPE)
+	{
+		buf->error = LW_TRUE;
+		return;
+	}
+	int empty = lwgeom__is_empty(obj);
+	uint8_t meta = empty ? TWKB_EMPTY : st->variant & (LW_TWKB_BBOX | LW_TWKB_SIZE);
+	int hasz = lwgeom_has_z(obj);
+	int hasm = lwgeom_has_m(obj);
+	if (hasz || hasm)
+		meta |= TWKB_EXTENDED;
+
+	uint8_t *p = twkb_reserve(buf, 3);
+	if (p == NULL)
+		return;
+	int prec = st->precision[0];
+	*p++ = (uint8_t)(obj->type | ((((unsigned)prec << 1) ^ (unsigned)(prec >> 31)) & 0x0f) << 4);
+	*p++ = meta;
+	if (meta & TWKB_EXTENDED)
+		*p++ = (uint8_t)(hasz | hasm << 1 | (hasz ? st->precision[1] : 0) << 2 | (hasm ? st->precision[2] : 0) << 5);
+	buf->len = (size_t)(p - buf->data);
+	if (empty)
+		return;
+
+	st->cdim = LW_POINTBYTESIZE(hasz, hasm);
+	st->factor[2] = hasz ? pow(10, st->precision[1]) : pow(10, st->precision[2]);
+	st->factor[3] = pow(10, st->precision[2]);
+
+	size_t sizepos = buf->len;
+	if (meta & TWKB_SIZE)
+	{
+		if (twkb_reserve(buf, TWKB_VARINT_MAX) == NULL)
+			return;
+		buf->len += TWKB_VARINT_MAX;
+	}
+	if (meta & TWKB_BBOX)
+	{
+		// rounding keeps order, X and Y come straight from the envelope
+		int64_t min[4], max[4];
+		int first = LW_TRUE;
+		if (!twkb_quantize(obj->env.xmin, st->factor[0], &min[0]) ||
+		    !twkb_quantize(obj->env.ymin, st->factor[1], &min[1]) ||
+		    !twkb_quantize(obj->env.xmax, st->factor[0], &max[0]) ||
+		    !twkb_quantize(obj->env.ymax, st->factor[1], &max[1]) ||
+		    (st->cdim > 2 && !twkb_bounds(st, obj, min, max, &first)) ||
+		    (p = twkb_reserve(buf, 8 * TWKB_VARINT_MAX)) == NULL)
+		{
+			buf->error = LW_TRUE;
+			return;
+		}
+		for (int k = 0; k < st->cdim; k++)
+		{
+			p = twkb_put_varint(p, min[k]);
+			p = twkb_put_varint(p, max[k] - min[k]);
+		}
+		buf->len = (size_t)(p - buf->data);
+	}
+
+	memset(st->last, 0, sizeof(st->last));
+	twkb_write_body(buf, st, obj);
+	if (buf->error || !(meta & TWKB_SIZE))
+		return;
+
+	// the size counts the bytes after it, the body moves up to meet it
+	size_t body = buf->len - sizepos - TWKB_VARINT_MAX;
+	size_t size = twkb_uvarint_size(body);
+	memmove(buf->data + sizepos + size, buf->data + sizepos + TWKB_VARINT_MAX, body);
+	twkb_put_uvarint(buf->data + sizepos, body);
+	buf->len = sizepos + size + body;
+}
+
+static int
+twkb_state_init(twkb_state *st, int precision_xy, int precision_z, int precision_m, uint8_t variant)
+{
+	if (precision_xy < -7 || precision_xy > 7 || precision_z < 0 || precision_z > 7 || precision_m < 0 ||
+	    precision_m > 7)
+		return LW_FAILURE;
+	memset(st, 0, sizeof(*st));
+	st->variant = variant;
+	st->precision[0] = precision_xy;
+	st->precision[1] = precision_z;
+	st->precision[2] = precision_m;
+	st->factor[0] = st->factor[1] = pow(10, precision_xy);
+	return LW_SUCCESS;
+}
+
+static int
+twkb_write_records(const LWGEOM *const *geoms, size_t count, twkb_state *st, char **data, size_t *len, size_t *offsets)
+{
+	twkb_buffer buf = {NULL, 0, 0, LW_FALSE};
+	for (size_t i = 0; i < count && !buf.error; i++)
+	{
+		if (offsets)
+			offsets[i] = buf.len;
+		if (geoms[i] == NULL)
+			buf.error = LW_TRUE;
+		else
+			twkb_write_geometry(&buf, st, geoms[i]);
+	}
+	if (buf.error || twkb_reserve(&buf, 1) == NULL)
+	{
+		lwfree(buf.data);
+		return LW_FAILURE;
+	}
+	if (offsets)
+		offsets[count] = buf.len;
+	*data = (char *)buf.data;
+	if (len)
+		*len = buf.len;
+	return LW_SUCCESS;
+}
+
+/* ------------------------------- output twkb ------------------------------ */
+
+/// @brief write Tiny WKB, coordinates are rounded to the given number of
+/// decimal digits and stored as zigzag varint deltas
+/// @param precision_xy digits for X and Y, -7 to 7, negative values round
+/// to tens, hundreds and so on
+/// @param precision_z digits for Z, 0 to 7
+/// @param precision_m digits for M, 0 to 7
+/// @param variant LW_TWKB_BBOX and LW_TWKB_SIZE add the optional headers
+/// @param data receives the encoding allocated with lwmalloc
+int
+lwgeom_write_twkb(const LWGEOM *obj,
+		  int precision_xy,
+		  int precision_z,
+		  int precision_m,
+		  uint8_t variant,
+		  char **data,
+		  size_t *len)
+{
+	twkb_state st;
+	if (obj == NULL || data == NULL || !twkb_state_init(&st, precision_xy, precision_z, precision_m, variant))
+		return LW_FAILURE;
+	return twkb_write_records(&obj, 1, &st, data, len, NULL);
+}
+
+/// @brief write many geometries one after the other into one buffer that
+/// grows as needed, the records are concatenated TWKB
+/// @param offsets receives \a count + 1 record boundaries when not NULL,
+/// record i is [offsets[i], offsets[i + 1])
+int
+lwgeom_write_twkb_batch(LWGEOM *const *geoms,
+			size_t count,
+			int precision_xy,
+			int precision_z,
+			int precision_m,
+			uint8_t variant,
+			char **data,
+			size_t *len,
+			size_t *offsets)
+{
+	twkb_state st;
+	if (geoms == NULL || data == NULL || !twkb_state_init(&st, precision_xy, precision_z, precision_m, variant))
+		return LW_FAILURE;
+	return twkb_write_records((const LWGEOM *const *)geoms, count, &st, data, len, offsets);
+}
@@ -20,10 +20,323 @@
  * IN THE SOFTWARE.
  */
 
-#include "liblwgeom_internel.h"
+#include "lwgeom_sink.h"
 
+#include <math.h>
+#include <string.h>
+
+/* ------------------------------- inner wkb -------------------------------- */
+
+#define WKB_XDR 0
+#define WKB_NDR 1
+
+#define WKB_ZFLAG 0x80000000u
+#define WKB_MFLAG 0x40000000u
+
+/// bytes staged on the stack before they are handed to a sink
+#define WKB_CHUNK_SIZE 4096
+
+/// Output position. Either a memory range that is known to be large enough,
+/// or a chunk that is flushed to a sink whenever it fills up.
+typedef struct {
+	uint8_t *out;
+	uint8_t *end;
+	LWSINK *sink;
+	uint8_t *chunk;
+	int swap;
+	int hex;
+	int error;
+} wkb_writer;
+
+static const char wkb_hex_digits[] = "0123456789ABCDEF";
+
+static inline int
+wkb_machine_endian(void)
+{
+	const uint16_t one = 1;
+	return *(const uint8_t *)&one ? WKB_NDR : WKB_XDR;
+}
+
+static void
+wkb_flush(wkb_writer *w)
+{
+	if (w->sink == NULL || w->error || w->out == w->chunk)
+		return;
+	lwsink__append(w->sink, (const char *)w->chunk, (size_t)(w->out - w->chunk));
+	// a full fixed sink goes on counting
+	if (w->sink->status == LW_SINK_ERROR)
+		w->error = LW_TRUE;
+	w->out = w->chunk;
+}
+
+/// @brief write raw bytes, hex encoding them in hex mode
+static void
+wkb_emit(wkb_writer *w, const uint8_t *bytes, size_t n)
+{
+	while (n > 0 && !w->error)
+	{
+		size_t room = (size_t)(w->end - w->out);
+		if (room == 0)
+		{
+			if (w->sink == NULL)
+			{
+				w->error = LW_TRUE;
+				return;
+			}
+			wkb_flush(w);
+			continue;
+		}
+		if (w->hex)
+		{
+			size_t take = LWMIN(n, room / 2);
+			if (take == 0)
+			{
+				if (w->sink == NULL)
+				{
+					w->error = LW_TRUE;
+					return;
+				}
+				wkb_flush(w);
+				continue;
+			}
+			uint8_t *o = w->out;
+			for (size_t i = 0; i < take; i++)
+			{
+				o[2 * i] = (uint8_t)wkb_hex_digits[bytes[i] >> 4];
+				o[2 * i + 1] = (uint8_t)wkb_hex_digits[bytes[i] & 0x0f];
+			}
+			w->out += 2 * take;
+			bytes += take;
+			n -= take;
+		}
+		else
+		{
+			size_t take = LWMIN(n, room);
+			memcpy(w->out, bytes, take);
+			w->out += take;
+			bytes += take;
+			n -= take;
+		}
+	}
+}
+
+static void
+wkb_emit_uint32(wkb_writer *w, uint32_t v)
+{
+	if (w->swap)
+		v = __builtin_bswap32(v);
+	wkb_emit(w, (const uint8_t *)&v, 4);
+}
+
+/// @brief write \a n doubles, swapping in blocks when the byte order differs
+static void
+wkb_emit_doubles(wkb_writer *w, const double *pp, size_t n)
+{
+	if (!w->swap)
+	{
+		wkb_emit(w, (const uint8_t *)pp, n * sizeof(double));
+		return;
+	}
+	uint64_t block[256];
+	while (n > 0)
+	{
+		size_t take = LWMIN(n, sizeof(block) / sizeof(block[0]));
+		memcpy(block, pp, take * sizeof(double));
+		for (size_t i = 0; i < take; i++)
+			block[i] = __builtin_bswap64(block[i]);
+		wkb_emit(w, (const uint8_t *)block, take * sizeof(double));
+		pp += take;
+		n -= take;
+	}
+}
+
+static uint32_t
+wkb_type(const LWGEOM *obj, uint8_t variant)
+{
+	uint32_t type = obj->type;
+	if (variant & LW_WKB_EXTENDED)
+	{
+		if (lwgeom_has_z(obj))
+			type |= WKB_ZFLAG;
+		if (lwgeom_has_m(obj))
+			type |= WKB_MFLAG;
+	}
+	else
+	{
+		if (lwgeom_has_z(obj))
+			type += 1000;
+		if (lwgeom_has_m(obj))
+			type += 2000;
+	}
+	return type;
+}
+
+static void
+wkb_write_geometry(wkb_writer *w, const LWGEOM *obj, uint8_t variant)
+{
+	uint8_t order = (variant & LW_WKB_XDR) ? WKB_XDR : WKB_NDR;
+	wkb_emit(w, &order, 1);
+	wkb_emit_uint32(w, wkb_type(obj, variant));
+
+	int cdim = lwgeom_dim_coordinate(obj);
+	switch (obj->type)
+	{
+	case POINTTYPE:
+		if (obj->npoints == 0)
+		{
+			// POINT EMPTY is written with NaN ordinates
+			double nan[4] = {NAN, NAN, NAN, NAN};
+			wkb_emit_doubles(w, nan, (size_t)cdim);
+		}
+		else
+		{
+			wkb_emit_doubles(w, obj->pp, (size_t)cdim);
+		}
+		break;
+	case LINETYPE:
+		wkb_emit_uint32(w, obj->npoints);
+		wkb_emit_doubles(w, obj->pp, (size_t)obj->npoints * cdim);
+		break;
+	case POLYTYPE:
+		wkb_emit_uint32(w, obj->ngeoms);
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			const LWGEOM *ring = obj->geoms[i];
+			wkb_emit_uint32(w, ring->npoints);
+			wkb_emit_doubles(w, ring->pp, (size_t)ring->npoints * cdim);
+		}
+		break;
+	default:
+		wkb_emit_uint32(w, obj->ngeoms);
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			wkb_write_geometry(w, obj->geoms[i], variant);
+		break;
+	}
+}
+
+static size_t
+wkb_binary_size(const LWGEOM *obj)
+{
+	size_t cbytes = (size_t)lwgeom_dim_coordinate(obj) * sizeof(double);
+	size_t size = 1 + 4;
+	switch (obj->type)
+	{
+	case POINTTYPE:
+		return size + cbytes;
+	case LINETYPE:
+		return size + 4 + obj->npoints * cbytes;
+	case POLYTYPE:
+		size += 4;
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			size += 4 + obj->geoms[i]->npoints * cbytes;
+		return size;
+	default:
+		size += 4;
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+			size += wkb_binary_size(obj->geoms[i]);
+		return size;
+	}
+}
+
+static uint8_t
+wkb_variant(uint8_t variant)
+{
+	if (!(variant & (LW_WKB_NDR | LW_WKB_XDR)))
+		variant |= LW_WKB_NDR;
+	return variant;
+}
+
+/* -------------------------------- output wkb ------------------------------ */
+
+/// @brief exact number of bytes written for \a obj, hex output counts two
+/// characters per byte and no terminating NUL
+size_t
+lwgeom_wkb_size(const LWGEOM *obj, uint8_t variant)
+{
+	size_t size = wkb_binary_size(obj);
+	return (variant & LW_WKB_HEX) ? size * 2 : size;
+}
+
+/// @brief write \a obj into a caller supplied buffer
+/// @return bytes written, 0 if \a size is less than lwgeom_wkb_size
+size_t
+lwgeom_write_wkb_buffer(const LWGEOM *obj, uint8_t variant, uint8_t *buf, size_t size)
+{
+	variant = wkb_variant(variant);
+	size_t need = lwgeom_wkb_size(obj, variant);
+	if (need > size)
+		return 0;
+
+	wkb_writer w = {buf, buf + need, NULL, NULL, 0, 0, LW_FALSE};
+	w.swap = ((variant & LW_WKB_XDR) ? WKB_XDR : WKB_NDR) != wkb_machine_endian();
+	w.hex = (variant & LW_WKB_HEX) != 0;
+	wkb_write_geometry(&w, obj, variant);
+	return w.error ? 0 : need;
+}
+
+/// @brief write \a obj to \a sink, a buffer sink is sized once and written
+/// in place, the other sinks take it in chunks of at most 4096 bytes staged
+/// on the stack
+int
+lwgeom_write_wkb_to(const LWGEOM *obj, uint8_t variant, LWSINK *sink)
+{
+	if (obj == NULL || sink == NULL)
+		return LW_FAILURE;
+	variant = wkb_variant(variant);
+
+	size_t mark = lwsink__begin(sink);
+	if (sink->kind == LWSINK_BUFFER)
+	{
+		size_t size = lwgeom_wkb_size(obj, variant);
+		char *p = lwsink__reserve(sink, size);
+		if (p && lwgeom_write_wkb_buffer(obj, variant, (uint8_t *)p, size) == size)
+			lwsink__commit(sink, size);
+		else
+			lwsink__fail(sink);
+	}
+	else
+	{
+		uint8_t chunk[WKB_CHUNK_SIZE];
+		wkb_writer w = {chunk, chunk + sizeof(chunk), sink, chunk, 0, 0, LW_FALSE};
+		w.swap = ((variant & LW_WKB_XDR) ? WKB_XDR : WKB_NDR) != wkb_machine_endian();
+		w.hex = (variant & LW_WKB_HEX) != 0;
+		wkb_write_geometry(&w, obj, variant);
+		wkb_flush(&w);
+		if (w.error)
+			lwsink__fail(sink);
+	}
+	return lwsink__end(sink, mark);
+}
+
+/// @brief write \a obj into a buffer allocated exactly once with lwmalloc,
+/// hex output is NUL terminated
+int
+lwgeom__write_wkb(const LWGEOM *obj, uint8_t variant, char **data, size_t *len)
+{
+	if (obj == NULL || data == NULL)
+		return LW_FAILURE;
+	variant = wkb_variant(variant);
+	size_t size = lwgeom_wkb_size(obj, variant);
+	int hex = (variant & LW_WKB_HEX) != 0;
+	uint8_t *buf = (uint8_t *)lwmalloc(size + (hex ? 1 : 0));
+	if (buf == NULL)
+		return LW_FAILURE;
+	if (lwgeom_write_wkb_buffer(obj, variant, buf, size) != size)
+	{
+		lwfree(buf);
+		return LW_FAILURE;
+	}
+	if (hex)
+		buf[size] = '\0';
+	*data = (char *)buf;
+	if (len)
+		*len = size;
+	return LW_SUCCESS;
+}
+
+/// @brief write little endian ISO WKB, hex encoded when \a hex is set
 int
 lwgeom_write_wkb(const LWGEOM *g, int hex, char **data, size_t *len)
 {
-	return 0;
+	return lwgeom__write_wkb(g, LW_WKB_ISO | LW_WKB_NDR | (hex ? LW_WKB_HEX : 0), data, len);
 }
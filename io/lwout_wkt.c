@@ -20,18 +20,133 @@
  * IN THE SOFTWARE.
  */
 
-#include "liblwgeom_internel.h"
+#include "lwgeom_sink.h"
 
-#include <string.h>
-#include <locale.h>
+/* -------------------------------- inner wkt ------------------------------- */
 
-#include <assert.h>
-#include <ctype.h>
+typedef struct {
+	LWSINK *sink;
+	int precision;
+	int extended;
+} wkt_writer;
 
-/* -------------------------------- inner wkt ------------------------------- */
+static const char *
+wkt_type_name(uint8_t type)
+{
+	switch (type)
+	{
+	case POINTTYPE:
+		return "POINT";
+	case LINETYPE:
+		return "LINESTRING";
+	case POLYTYPE:
+		return "POLYGON";
+	case MPOINTTYPE:
+		return "MULTIPOINT";
+	case MLINETYPE:
+		return "MULTILINESTRING";
+	case MPOLYTYPE:
+		return "MULTIPOLYGON";
+	case COLLECTIONTYPE:
+		return "GEOMETRYCOLLECTION";
+	default:
+		return NULL;
+	}
+}
+
+static void wkt_write_body(wkt_writer *w, const LWGEOM *obj);
+
+static void
+wkt_write_tagged(wkt_writer *w, const LWGEOM *obj)
+{
+	const char *name = wkt_type_name(obj->type);
+	if (name == NULL)
+	{
+		lwsink__fail(w->sink);
+		return;
+	}
+	lwsink__append_str(w->sink, name);
+	if (w->extended)
+	{
+		// EWKT tells the dimension by the ordinate count, only M stands out
+		if (lwgeom_has_m(obj) && !lwgeom_has_z(obj))
+			lwsink__append(w->sink, "M", 1);
+		if (lwgeom__is_empty(obj))
+			lwsink__append(w->sink, " ", 1);
+	}
+	else if (lwgeom_has_z(obj) && lwgeom_has_m(obj))
+		lwsink__append(w->sink, " ZM ", 4);
+	else if (lwgeom_has_z(obj))
+		lwsink__append(w->sink, " Z ", 3);
+	else if (lwgeom_has_m(obj))
+		lwsink__append(w->sink, " M ", 3);
+	else if (lwgeom__is_empty(obj))
+		lwsink__append(w->sink, " ", 1);
+	wkt_write_body(w, obj);
+}
+
+/// @brief write the body of \a obj, "EMPTY" or the parenthesized content
+static void
+wkt_write_body(wkt_writer *w, const LWGEOM *obj)
+{
+	if (lwgeom__is_empty(obj))
+	{
+		lwsink__append(w->sink, "EMPTY", 5);
+		return;
+	}
+	lwsink__append(w->sink, "(", 1);
+	switch (obj->type)
+	{
+	case POINTTYPE:
+	case LINETYPE:
+		lwsink__write_points(w->sink, obj, lwgeom_dim_coordinate(obj), w->precision, ' ', ',');
+		break;
+	default:
+		for (uint32_t i = 0; i < obj->ngeoms; i++)
+		{
+			if (i > 0)
+				lwsink__append(w->sink, ",", 1);
+			if (obj->type == COLLECTIONTYPE)
+				wkt_write_tagged(w, obj->geoms[i]);
+			else
+				wkt_write_body(w, obj->geoms[i]);
+		}
+		break;
+	}
+	lwsink__append(w->sink, ")", 1);
+}
+
+/// @brief shared by the WKT and EWKT writers
+/// @param extended write the EWKT spelling of the dimension
+int
+lwgeom__write_wkt(const LWGEOM *obj, int precision, int extended, LWSINK *sink)
+{
+	if (obj == NULL || sink == NULL)
+		return LW_FAILURE;
+
+	size_t mark = lwsink__begin(sink);
+	wkt_writer w = {sink, precision, extended};
+	wkt_write_tagged(&w, obj);
+	return lwsink__end(sink, mark);
+}
+
+/* -------------------------------- output wkt ------------------------------ */
+
+/// @brief write OGC WKT to \a sink
+/// @param precision decimal places, negative for the fewest digits that read
+/// back to the same value
+int
+lwgeom_write_wkt_to(const LWGEOM *obj, int precision, LWSINK *sink)
+{
+	return lwgeom__write_wkt(obj, precision, LW_FALSE, sink);
+}
 
+/// @brief write OGC WKT, numbers are written with the fewest digits that read
+/// back to the same value
+/// @param data receives a NUL terminated string allocated with lwmalloc
+/// @param len receives the string length, may be NULL
 int
 lwgeom_write_wkt(const LWGEOM *obj, char **data, size_t *len)
 {
-	return 0;
-}
\ No newline at end of file
+	return lwgeom__write_text(lwgeom_write_wkt_to, obj, data, len);
+}
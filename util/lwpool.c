@@ -0,0 +1,176 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "lwpool.h"
+#include "lwutil.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+struct lwpool__job {
+	size_t count;
+	atomic_size_t next;
+	lwpool_func func;
+	void *udata;
+	int helpers;              ///< workers that may still join, under the pool lock
+	int active;               ///< workers inside the job, under the pool lock
+	struct lwpool__job *link; ///< next job that takes workers
+};
+
+/// Worker threads are started on demand and then kept for the life of the
+/// process, waiting for jobs. Jobs that still take workers are queued newest
+/// first, so a job started from inside a task is served before its parent.
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t work; ///< a job was queued
+	pthread_cond_t done; ///< a worker left a job
+	struct lwpool__job *jobs;
+	int nworkers;
+} lwpool__pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0};
+
+static void
+lwpool__drain(struct lwpool__job *job)
+{
+	for (;;)
+	{
+		size_t i = atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed);
+		if (i >= job->count)
+			break;
+		job->func(i, job->udata);
+	}
+}
+
+static void *
+lwpool__worker(void *arg)
+{
+	(void)arg;
+	pthread_mutex_lock(&lwpool__pool.lock);
+	for (;;)
+	{
+		struct lwpool__job *job = lwpool__pool.jobs;
+		if (job == NULL)
+		{
+			pthread_cond_wait(&lwpool__pool.work, &lwpool__pool.lock);
+			continue;
+		}
+		if (--job->helpers == 0)
+			lwpool__pool.jobs = job->link;
+		job->active++;
+		pthread_mutex_unlock(&lwpool__pool.lock);
+
+		lwpool__drain(job);
+
+		pthread_mutex_lock(&lwpool__pool.lock);
+		if (--job->active == 0)
+			pthread_cond_broadcast(&lwpool__pool.done);
+	}
+	return NULL;
+}
+
+/// @brief start workers until there are \a nworkers, called with the pool
+/// lock held
+static void
+lwpool__grow(int nworkers)
+{
+	pthread_attr_t attr;
+	if (pthread_attr_init(&attr) != 0)
+		return;
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	while (lwpool__pool.nworkers < nworkers)
+	{
+		pthread_t thread;
+		if (pthread_create(&thread, &attr, lwpool__worker, NULL) != 0)
+			break;
+		lwpool__pool.nworkers++;
+	}
+	pthread_attr_destroy(&attr);
+}
+
+/// @brief Resolve the number of threads to use.
+/// @param nthreads requested number of threads, 0 or less means one per
+/// online processor
+/// @return the number of threads, at least 1
+int
+lwpool_nthreads(int nthreads)
+{
+	if (nthreads > 0)
+		return nthreads;
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+
+/// @brief Run \a func for every index in [0, count) on up to \a nthreads
+/// threads and wait for all of them.
+///
+/// The threads come from a pool kept across calls, so a call costs a wake up
+/// and not a thread start. Indices are handed out one at a time from a shared
+/// counter, so uneven tasks balance themselves. The calling thread takes part
+/// in the work and finishes the job alone when no worker is free or can be
+/// started, so tasks may call lwpool_run themselves.
+/// @param count number of tasks
+/// @param nthreads number of threads, see lwpool_nthreads
+/// @param func task callback
+/// @param udata user data passed to \a func
+/// @return LW_SUCCESS
+int
+lwpool_run(size_t count, int nthreads, lwpool_func func, void *udata)
+{
+	struct lwpool__job job = {.count = count, .func = func, .udata = udata};
+	atomic_init(&job.next, 0);
+
+	nthreads = lwpool_nthreads(nthreads);
+	if ((size_t)nthreads > count)
+		nthreads = count > 0 ? (int)count : 1;
+	if (nthreads == 1)
+	{
+		lwpool__drain(&job);
+		return LW_SUCCESS;
+	}
+
+	pthread_mutex_lock(&lwpool__pool.lock);
+	lwpool__grow(nthreads - 1);
+	job.helpers = lwpool__pool.nworkers < nthreads - 1 ? lwpool__pool.nworkers : nthreads - 1;
+	if (job.helpers > 0)
+	{
+		job.link = lwpool__pool.jobs;
+		lwpool__pool.jobs = &job;
+		pthread_cond_broadcast(&lwpool__pool.work);
+	}
+	pthread_mutex_unlock(&lwpool__pool.lock);
+
+	lwpool__drain(&job);
+
+	pthread_mutex_lock(&lwpool__pool.lock);
+	/* take the job off the queue if some workers never came */
+	if (job.helpers > 0)
+	{
+		struct lwpool__job **at = &lwpool__pool.jobs;
+		while (*at != &job)
+			at = &(*at)->link;
+		*at = job.link;
+	}
+	while (job.active > 0)
+		pthread_cond_wait(&lwpool__pool.done, &lwpool__pool.lock);
+	pthread_mutex_unlock(&lwpool__pool.lock);
+	return LW_SUCCESS;
+}
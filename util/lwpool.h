@@ -20,30 +20,16 @@
  * IN THE SOFTWARE.
  */
 
-#ifndef STOK_H
-#define STOK_H
 
-#include <stddef.h>
+#ifndef LWPOOL_H
+#define LWPOOL_H
 
-enum
-{
-	STOK_EOF,  // end of string stream
-	STOK_EOL,  // end of line
-	STOK_NUM,  // token a number value
-	STOK_WORD, // token a string value
-};
+#include <stddef.h>
 
-typedef struct {
-	double ntok;
-	char stok[255];
-	size_t len;
-	char *head; // string stream head pointer
-	char *pos;  // string stream current pointer
-	char *end;  // string stream end pointer
-} stok_t;
+/// Task callback, called once for every index in [0, count).
+typedef void (*lwpool_func)(size_t index, void *udata);
 
-void stok_init(stok_t *tok, char *t);
-int stok_next_token(stok_t *tok);
-int stok_peek_next_token(stok_t *tok);
+extern int lwpool_nthreads(int nthreads);
+extern int lwpool_run(size_t count, int nthreads, lwpool_func func, void *udata);
 
-#endif /* STOK_H */
\ No newline at end of file
+#endif /* LWPOOL_H */
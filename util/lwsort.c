@@ -0,0 +1,180 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "lwsort.h"
+#include "lwpool.h"
+#include "lwutil.h"
+#include <string.h>
+
+#define LWSORT_RADIX_BITS 11
+#define LWSORT_RADIX      (1 << LWSORT_RADIX_BITS)
+#define LWSORT_PASSES     ((64 + LWSORT_RADIX_BITS - 1) / LWSORT_RADIX_BITS)
+
+/// below this many keys a single thread is faster than starting more
+#define LWSORT_PARALLEL_MIN (1 << 16)
+
+struct lwsort__pass {
+	const uint64_t *keys;
+	const uint64_t *vals;
+	uint64_t *keys_out;
+	uint64_t *vals_out;
+	size_t count;
+	size_t nblocks;
+	int shift;
+	size_t (*offsets)[LWSORT_RADIX]; ///< per block histogram, then start offsets
+};
+
+static void
+lwsort__block_range(const struct lwsort__pass *p, size_t block, size_t *first, size_t *last)
+{
+	size_t size = p->count / p->nblocks;
+	*first = block * size;
+	*last = block == p->nblocks - 1 ? p->count : *first + size;
+}
+
+static void
+lwsort__histogram(size_t block, void *udata)
+{
+	struct lwsort__pass *p = (struct lwsort__pass *)udata;
+	size_t first, last;
+	lwsort__block_range(p, block, &first, &last);
+
+	size_t *hist = p->offsets[block];
+	memset(hist, 0, sizeof(size_t) * LWSORT_RADIX);
+	for (size_t i = first; i < last; i++)
+		hist[(p->keys[i] >> p->shift) & (LWSORT_RADIX - 1)]++;
+}
+
+static void
+lwsort__scatter(size_t block, void *udata)
+{
+	struct lwsort__pass *p = (struct lwsort__pass *)udata;
+	size_t first, last;
+	lwsort__block_range(p, block, &first, &last);
+
+	size_t *offsets = p->offsets[block];
+	for (size_t i = first; i < last; i++)
+	{
+		size_t dst = offsets[(p->keys[i] >> p->shift) & (LWSORT_RADIX - 1)]++;
+		p->keys_out[dst] = p->keys[i];
+		if (p->vals)
+			p->vals_out[dst] = p->vals[i];
+	}
+}
+
+/// @brief Sort 64-bit keys in ascending order, carrying a 64-bit value along
+/// with each key.
+///
+/// This is a stable LSD radix sort on 11-bit digits. Every pass splits the
+/// array into one block per thread: blocks are counted in parallel, turned
+/// into per-block output offsets, then scattered in parallel. Passes whose
+/// digit is the same for all keys (typically the high bits of short
+/// geohashes) are skipped. The result is written back to \a keys and
+/// \a vals, using one temporary buffer of the same size.
+/// @param keys keys to sort
+/// @param vals values moved with the keys, may be NULL
+/// @param count number of keys
+/// @param nthreads number of threads, see lwpool_nthreads
+/// @return LW_SUCCESS, or LW_FAILURE if the system is out of memory
+int
+lwsort_radix64(uint64_t *keys, uint64_t *vals, size_t count, int nthreads)
+{
+	if (count < 2)
+		return LW_SUCCESS;
+
+	/* one sequential pass finds the digits that actually vary */
+	uint64_t all_or = 0;
+	uint64_t all_and = ~(uint64_t)0;
+	for (size_t i = 0; i < count; i++)
+	{
+		all_or |= keys[i];
+		all_and &= keys[i];
+	}
+	uint64_t varying = all_or ^ all_and;
+	if (varying == 0)
+		return LW_SUCCESS;
+
+	size_t nblocks = count < LWSORT_PARALLEL_MIN ? 1 : (size_t)lwpool_nthreads(nthreads);
+	uint64_t *tmp_keys = (uint64_t *)lwmalloc(sizeof(uint64_t) * count);
+	uint64_t *tmp_vals = vals ? (uint64_t *)lwmalloc(sizeof(uint64_t) * count) : NULL;
+	size_t(*offsets)[LWSORT_RADIX] = (size_t(*)[LWSORT_RADIX])lwmalloc(sizeof(size_t) * LWSORT_RADIX * nblocks);
+	if (!tmp_keys || (vals && !tmp_vals) || !offsets)
+	{
+		lwfree(tmp_keys);
+		lwfree(tmp_vals);
+		lwfree(offsets);
+		return LW_FAILURE;
+	}
+
+	struct lwsort__pass p = {.keys = keys,
+				 .vals = vals,
+				 .keys_out = tmp_keys,
+				 .vals_out = tmp_vals,
+				 .count = count,
+				 .nblocks = nblocks,
+				 .offsets = offsets};
+
+	for (int pass = 0; pass < LWSORT_PASSES; pass++)
+	{
+		p.shift = pass * LWSORT_RADIX_BITS;
+		if (((varying >> p.shift) & (LWSORT_RADIX - 1)) == 0)
+			continue;
+
+		lwpool_run(nblocks, (int)nblocks, lwsort__histogram, &p);
+
+		/* digit-major, block-minor prefix sum keeps the sort stable */
+		size_t sum = 0;
+		for (size_t d = 0; d < LWSORT_RADIX; d++)
+		{
+			for (size_t b = 0; b < nblocks; b++)
+			{
+				size_t c = offsets[b][d];
+				offsets[b][d] = sum;
+				sum += c;
+			}
+		}
+
+		lwpool_run(nblocks, (int)nblocks, lwsort__scatter, &p);
+
+		/* swap the buffers */
+		uint64_t *k = (uint64_t *)p.keys;
+		uint64_t *v = (uint64_t *)p.vals;
+		p.keys = p.keys_out;
+		p.vals = p.vals_out;
+		p.keys_out = k;
+		p.vals_out = v;
+	}
+
+	/* after an odd number of passes the result is in the temporary buffer */
+	if (p.keys != keys)
+	{
+		memcpy(keys, p.keys, sizeof(uint64_t) * count);
+		if (vals)
+			memcpy(vals, p.vals, sizeof(uint64_t) * count);
+	}
+
+	lwfree(tmp_keys);
+	lwfree(tmp_vals);
+	lwfree(offsets);
+	return LW_SUCCESS;
+}